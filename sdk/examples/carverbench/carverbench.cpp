@@ -0,0 +1,498 @@
+/**********************************************************************
+*
+* Copyright (C)2015-2022 Maxwell Analytica. All rights reserved.
+*
+* @file carverbench.cpp
+* @brief Microbenchmarks of the carver matching kernels
+* @details carverbench [--config filecarver.json] [--baseline out.json] [--compare base.json] [--quick]
+*          [--simd scalar|sse4.2|avx2|avx512]
+*          Reports ns/byte and cycles per 4 KB block, the baseline json is what
+*          --compare judges a later build against. Dispatched kernels are measured
+*          at every supported level, the rest at the selected one
+* @author Maxwell
+* @version 1.0.0
+* @date 2026-10-19 22:31:08.154
+*
+**********************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include <fstream>
+#include <iomanip>
+#include <functional>
+#include "../carverscanner/filecarver.h"
+#include "../carverscanner/carvertable.h"
+#include "../../third_party/safequeue.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define BENCH_TSC
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+const int32_t ConstBufferSize	= 4 * 1024 * 1024;
+const int32_t ConstSparseGap	= 0x10000;
+const int32_t ConstDenseGap		= 0x200;
+
+// common signatures when no filecarver.json is given
+static const char* ConstDefaultCarvers = R"([
+	{"extension":"jpg","header":{"logic":"and","characters":[{"hex":true,"size":3,"offset":0,"context":"FFD8FF"}]},"footer":{"logic":"and","characters":[{"hex":true,"size":2,"padding":0,"context":"FFD9"}]}},
+	{"extension":"png","header":{"logic":"and","characters":[{"hex":true,"size":8,"offset":0,"context":"89504E470D0A1A0A"}]},"footer":{"logic":"and","characters":[{"hex":true,"size":8,"padding":0,"context":"49454E44AE426082"}]}},
+	{"extension":"gif","header":{"logic":"or","characters":[{"hex":false,"size":6,"offset":0,"context":"GIF87a"},{"hex":false,"size":6,"offset":0,"context":"GIF89a"}]},"footer":{"logic":"and","characters":[{"hex":true,"size":2,"padding":0,"context":"003B"}]}},
+	{"extension":"pdf","header":{"logic":"and","characters":[{"hex":false,"size":5,"offset":0,"context":"%PDF-"}]},"footer":{"logic":"and","characters":[{"hex":false,"size":5,"padding":0,"context":"%%EOF"}]}},
+	{"extension":"zip","header":{"logic":"and","characters":[{"hex":true,"size":4,"offset":0,"context":"504B0304"}]},"footer":{"logic":"and","characters":[{"hex":true,"size":4,"padding":18,"context":"504B0506"}]}},
+	{"extension":"rar","header":{"logic":"and","characters":[{"hex":true,"size":7,"offset":0,"context":"526172211A0700"}]},"footer":{"logic":"and","characters":[{"hex":true,"size":7,"padding":0,"context":"C43D7B00400700"}]}},
+	{"extension":"doc","header":{"logic":"and","characters":[{"hex":true,"size":8,"offset":0,"context":"D0CF11E0A1B11AE1"}]},"footer":{"logic":"and","characters":[{"hex":true,"size":4,"padding":0,"context":"00000000"}]}},
+	{"extension":"mp4","header":{"logic":"and","characters":[{"hex":false,"size":4,"offset":4,"context":"ftyp"}]},"footer":{"logic":"and","characters":[{"hex":false,"size":4,"padding":0,"context":"moov"}]}}
+])";
+
+typedef struct _BenchResult
+{
+	std::string	name;
+	std::string	params;
+	double		ns_per_byte;
+	double		cycles_per_block;
+	int64_t		hits;
+}BenchResult, *PBenchResult;
+
+static std::vector<BenchResult> results;
+static double min_seconds = 0.3;
+
+static inline uint64_t ticks()
+{
+#ifdef BENCH_TSC
+	return __rdtsc();
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// repeat `pass` over `bytes` until the minimum time is reached, `pass` returns hits of one pass
+static void measure(const std::string& name, const std::string& params, int64_t bytes, std::function<int64_t()> pass)
+{
+	int64_t hits = pass();
+	int64_t passes = 0;
+	uint64_t cycles = 0;
+	auto started = std::chrono::steady_clock::now();
+	double elapsed = 0.0;
+	do
+	{
+		uint64_t begin = ticks();
+		pass();
+		cycles += ticks() - begin;
+		++passes;
+		elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+	} while (elapsed < min_seconds);
+
+	BenchResult result;
+	result.name = name;
+	result.params = params;
+	result.ns_per_byte = elapsed * 1e9 / ((double)bytes * passes);
+	result.cycles_per_block = (double)cycles / ((double)bytes * passes) * WD_BLOCK_SIZE;
+	result.hits = hits;
+	results.push_back(result);
+	printf("%-12s %-36s %10.3f ns/B %12.1f cyc/blk %9.1f MB/s %10lld hits\n", name.c_str(), params.c_str(),
+		result.ns_per_byte, result.cycles_per_block, 1e3 / result.ns_per_byte, (long long)hits);
+}
+
+static void fillRandom(std::vector<char>& buffer, uint64_t seed)
+{
+	uint64_t state = seed | 1;
+	for (size_t pos = 0; pos < buffer.size(); ++pos)
+	{
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		buffer[pos] = (char)(state >> 24);
+	}
+}
+
+// `pattern` every `gap` bytes at sector aligned positions, 0 plants nothing
+static void plant(std::vector<char>& buffer, const std::string& pattern, int32_t offset, int32_t gap)
+{
+	if (gap <= 0)
+		return;
+	for (size_t pos = 0; pos + gap <= buffer.size(); pos += gap)
+		memcpy(&buffer[pos + offset], pattern.data(), pattern.size());
+}
+
+static std::string pattern(int32_t size, uint64_t seed)
+{
+	std::vector<char> bytes(size);
+	fillRandom(bytes, seed);
+	return std::string(bytes.begin(), bytes.end());
+}
+
+static std::string hex(const std::string& bytes)
+{
+	static const char digits[] = "0123456789ABCDEF";
+	std::string text;
+	for (unsigned char value : bytes)
+	{
+		text.push_back(digits[value >> 4]);
+		text.push_back(digits[value & 0x0F]);
+	}
+	return text;
+}
+
+static const char* densityName(int32_t gap)
+{
+	return gap == 0 ? "none" : (gap == ConstSparseGap ? "sparse" : "dense");
+}
+
+static void benchBoyerMoore()
+{
+	std::vector<char> buffer(ConstBufferSize);
+	for (int32_t size : { 2, 4, 8, 16, 32, 64 })
+	{
+		std::string target = pattern(size, size);
+		for (int32_t gap : { 0, ConstSparseGap, ConstDenseGap })
+		{
+			fillRandom(buffer, 7);
+			plant(buffer, target, 0, gap);
+			measure("boyermoore", "len=" + std::to_string(size) + " random " + densityName(gap), buffer.size(), [&] {
+				int64_t hits = 0;
+				int32_t pos = 0;
+				while (pos < (int32_t)buffer.size())
+				{
+					int32_t found = MaUtil::BoyerMoore(&buffer[pos], (int32_t)buffer.size() - pos, &target[0], size);
+					if (found < 0)
+						break;
+					++hits;
+					pos += found + 1;
+				}
+				return hits;
+			});
+		}
+		// near misses everywhere, the text repeats the pattern without its last byte
+		std::string adversarial(size, 'a');
+		adversarial[size - 1] = 'b';
+		std::fill(buffer.begin(), buffer.end(), 'a');
+		measure("boyermoore", "len=" + std::to_string(size) + " adversarial", buffer.size(), [&] {
+			return (int64_t)MaUtil::BoyerMoore(&buffer[0], (int32_t)buffer.size(), &adversarial[0], size) >= 0 ? 1 : 0;
+		});
+	}
+}
+
+static std::shared_ptr<FileCarver> makeCarver(const std::string& json)
+{
+	auto carver = std::make_shared<FileCarver>();
+	if (carver->setCharacteristics(frjson::parse(json).get<frjson::object_t>()) != 0)
+		return nullptr;
+	carver->setGeometry(512, 512);
+	return carver;
+}
+
+static std::string headerJson(const std::string& logic, const std::vector<std::string>& signatures)
+{
+	frjson carver;
+	carver["extension"] = "bench";
+	carver["validator"] = "none";
+	carver["header"]["logic"] = logic;
+	carver["header"]["characters"] = frjson::array();
+	int32_t offset = 0;
+	for (auto& signature : signatures)
+	{
+		carver["header"]["characters"].push_back({ { "hex", true }, { "size", signature.size() }, { "offset", offset }, { "context", hex(signature) } });
+		offset += (int32_t)signature.size();
+	}
+	carver["footer"]["logic"] = "and";
+	carver["footer"]["characters"] = frjson::array({ { { "hex", true }, { "size", 2 }, { "padding", 0 }, { "context", "FFD9" } } });
+	return carver.dump();
+}
+
+static int64_t headerPass(FileCarver& carver, std::vector<char>& buffer)
+{
+	int64_t hits = 0;
+	auto package = std::make_shared<ClusterPackage>();
+	for (size_t pos = 0; pos < buffer.size(); pos += WD_BLOCK_SIZE)
+	{
+		memcpy(package->Buffer, &buffer[pos], WD_BLOCK_SIZE);
+		package->BlockNumber = pos / 512;
+		hits += carver.analyzeHeader(package) > 0 ? 1 : 0;
+		carver.initialize();
+	}
+	return hits;
+}
+
+static void benchHeader()
+{
+	std::vector<char> buffer(ConstBufferSize);
+	for (const char* logic : { "and", "or", "not" })
+	{
+		for (int32_t size : { 2, 4, 8, 16, 32, 64 })
+		{
+			// two characteristics back to back, both of `size` bytes
+			std::string first = pattern(size, 11 + size), second = pattern(size, 13 + size);
+			auto carver = makeCarver(headerJson(logic, { first, second }));
+			if (carver == nullptr)
+				continue;
+			for (int32_t gap : { 0, ConstSparseGap, ConstDenseGap })
+			{
+				fillRandom(buffer, 17);
+				plant(buffer, first + second, 0, gap);
+				measure(std::string("header.") + logic, "len=" + std::to_string(size) + " random " + densityName(gap), buffer.size(), [&] {
+					return headerPass(*carver, buffer);
+				});
+			}
+			// every sector starts with the signature but its last byte
+			std::string near = first + second;
+			near.back() ^= 0x01;
+			fillRandom(buffer, 19);
+			plant(buffer, near, 0, 512);
+			measure(std::string("header.") + logic, "len=" + std::to_string(size) + " adversarial", buffer.size(), [&] {
+				return headerPass(*carver, buffer);
+			});
+		}
+	}
+}
+
+static void benchHexDecode()
+{
+	for (int32_t size : { 2, 4, 8, 16, 32, 64 })
+	{
+		// eight characteristics, per byte cost of loading one carver
+		std::vector<std::string> signatures;
+		for (int32_t index = 0; index < 8; ++index)
+			signatures.push_back(pattern(size, 23 + index));
+		auto object = frjson::parse(headerJson("or", signatures)).get<frjson::object_t>();
+		measure("hexdecode", "len=" + std::to_string(size) + " x8", size * 8, [&] {
+			FileCarver carver;
+			return (int64_t)(carver.setCharacteristics(object) == 0 ? 1 : 0);
+		});
+	}
+}
+
+static void benchSafequeue()
+{
+	const int32_t count = 0x4000;
+	ClusterPackage package;
+	ma::Safequeue<ClusterPackage> queue;
+	measure("safequeue", "push+pop 1 thread", (int64_t)count * WD_BLOCK_SIZE, [&] {
+		for (int32_t index = 0; index < count; ++index)
+			queue.push(package);
+		int64_t popped = 0;
+		while (queue.tryPop() != nullptr)
+			++popped;
+		return popped;
+	});
+	measure("safequeue", "push+pop 2 threads", (int64_t)count * WD_BLOCK_SIZE, [&] {
+		std::thread producer([&] {
+			for (int32_t index = 0; index < count; ++index)
+				queue.push(package);
+		});
+		int64_t popped = 0;
+		while (popped < count)
+		{
+			if (queue.waitPop() != nullptr)
+				++popped;
+		}
+		producer.join();
+		return popped;
+	});
+}
+
+static void benchKernels()
+{
+	std::vector<char> buffer(ConstBufferSize);
+	const uint8_t* data = (const uint8_t*)buffer.data();
+	for (int32_t level = SL_Scalar; level <= CpuDispatch::supported(); ++level)
+	{
+		const ScanKernels& kernels = CpuDispatch::kernels((SimdLevel)level);
+		const std::string name = CpuDispatch::name((SimdLevel)level);
+		for (int32_t gap : { 0, ConstSparseGap, ConstDenseGap })
+		{
+			fillRandom(buffer, 29);
+			plant(buffer, "\xFF\xD9", 0, gap);
+			measure("findpair", name + " random " + densityName(gap), buffer.size(), [&] {
+				int64_t hits = 0;
+				for (size_t pos = 0; pos < buffer.size(); ++pos, ++hits)
+				{
+					pos += kernels.findPair(data + pos, buffer.size() - pos, 0xFF, 0xD9);
+					if (pos >= buffer.size())
+						break;
+				}
+				return hits;
+			});
+		}
+		// zeroed space is scanned whole, random data leaves at the first vector
+		for (bool zeroed : { true, false })
+		{
+			if (zeroed)
+				std::fill(buffer.begin(), buffer.end(), 0);
+			else
+				fillRandom(buffer, 31);
+			measure("uniform", name + (zeroed ? " zeroed" : " random"), buffer.size(), [&] {
+				int64_t hits = 0;
+				for (size_t pos = 0; pos < buffer.size(); pos += WD_BLOCK_SIZE)
+					hits += kernels.uniform(data + pos, WD_BLOCK_SIZE) ? 1 : 0;
+				return hits;
+			});
+		}
+		fillRandom(buffer, 37);
+		measure("crc32c", name, buffer.size(), [&] {
+			return (int64_t)(kernels.crc32c(0xFFFFFFFF, data, buffer.size()) & 1);
+		});
+	}
+}
+
+static void benchCarverSet(const frjson& carvers_object)
+{
+	std::vector<std::shared_ptr<FileCarver>> carvers;
+	std::vector<std::string> signatures;
+	for (auto& object : carvers_object)
+	{
+		auto carver = std::make_shared<FileCarver>();
+		if (carver->setCharacteristics(object.get<frjson::object_t>()) != 0)
+			continue;
+		carver->setGeometry(512, 512);
+		carvers.push_back(carver);
+		auto& probes = carver->getHeaderProbes();
+		if (!probes.empty() && probes.front().offset == 0)
+			signatures.emplace_back((const char*)probes.front().character, probes.front().size);
+	}
+	if (carvers.empty())
+		return;
+
+	CarverTable table;
+	table.build(carvers);
+	std::vector<char> buffer(ConstBufferSize);
+	std::vector<uint32_t> selected;
+	std::vector<CarveEvent> events;
+	for (int32_t gap : { 0, ConstSparseGap, ConstDenseGap })
+	{
+		fillRandom(buffer, 29);
+		if (gap > 0)
+		{
+			// signatures of the set in turn
+			size_t turn = 0;
+			for (size_t pos = 0; pos + gap <= buffer.size() && !signatures.empty(); pos += gap)
+			{
+				auto& signature = signatures[turn++ % signatures.size()];
+				memcpy(&buffer[pos], signature.data(), signature.size());
+			}
+		}
+		measure("carverset", std::to_string(carvers.size()) + " carvers " + densityName(gap), buffer.size(), [&] {
+			int64_t hits = 0;
+			for (size_t pos = 0; pos < buffer.size(); pos += WD_BLOCK_SIZE)
+			{
+				BlockSpan span = { &buffer[pos], 1, pos / 512, false, false };
+				table.select(&buffer[pos], false, selected);
+				for (uint32_t index : selected)
+				{
+					events.clear();
+					hits += carvers[index]->analyzeBlocks(span, events);
+					carvers[index]->takeCompleted();
+					table.update(index, *carvers[index]);
+				}
+			}
+			for (uint32_t index = 0; index < carvers.size(); ++index)
+			{
+				carvers[index]->initialize();
+				table.update(index, *carvers[index]);
+			}
+			return hits;
+		});
+	}
+}
+
+static void writeBaseline(const std::string& path)
+{
+	frjson baseline;
+	baseline["benchmarks"] = frjson::array();
+	for (auto& result : results)
+	{
+		baseline["benchmarks"].push_back({ { "name", result.name }, { "params", result.params },
+			{ "nsPerByte", result.ns_per_byte }, { "cyclesPerBlock", result.cycles_per_block }, { "hits", result.hits } });
+	}
+	std::ofstream o(path);
+	o << std::setw(4) << baseline << std::endl;
+}
+
+static void compareBaseline(const std::string& path)
+{
+	frjson baseline;
+	std::ifstream is(path);
+	if (!is.is_open())
+	{
+		printf("can not open baseline %s\n", path.c_str());
+		return;
+	}
+	is >> baseline;
+	printf("\n%-12s %-36s %10s %10s %8s\n", "compare", "", "base", "now", "ratio");
+	for (auto& entry : baseline.at("benchmarks"))
+	{
+		for (auto& result : results)
+		{
+			if (result.name != entry.at("name").get<std::string>() || result.params != entry.at("params").get<std::string>())
+				continue;
+			double base = entry.at("nsPerByte").get<double>();
+			// a kernel change must keep the hits, otherwise it is not comparable
+			bool same = entry.value("hits", result.hits) == result.hits;
+			printf("%-12s %-36s %10.3f %10.3f %7.2fx%s\n", result.name.c_str(), result.params.c_str(), base,
+				result.ns_per_byte, base / result.ns_per_byte, same ? "" : " hits differ");
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::string config_path, baseline_path, compare_path;
+	for (int32_t index = 1; index < argc; ++index)
+	{
+		std::string arg = argv[index];
+		if (arg == "--config" && index + 1 < argc)
+			config_path = argv[++index];
+		else if (arg == "--baseline" && index + 1 < argc)
+			baseline_path = argv[++index];
+		else if (arg == "--compare" && index + 1 < argc)
+			compare_path = argv[++index];
+		else if (arg == "--quick")
+			min_seconds = 0.05;
+		else if (arg == "--simd" && index + 1 < argc)
+		{
+			SimdLevel level = CpuDispatch::parse(argv[++index]);
+			if (level == SL_Count)
+			{
+				printf("unknown simd level %s\n", argv[index]);
+				return -1;
+			}
+			CpuDispatch::select(level);
+		}
+	}
+	printf("simd level %s, %s supported\n", CpuDispatch::name(CpuDispatch::level()), CpuDispatch::name(CpuDispatch::supported()));
+
+	frjson carvers = frjson::parse(ConstDefaultCarvers);
+	if (config_path.length() > 0)
+	{
+		try
+		{
+			frjson config;
+			std::ifstream is(config_path);
+			is >> config;
+			carvers = config.at("carvers");
+		}
+		catch (std::exception& e)
+		{
+			printf("parse %s exception: %s\n", config_path.c_str(), e.what());
+			return -1;
+		}
+	}
+
+	benchBoyerMoore();
+	benchKernels();
+	benchHeader();
+	benchHexDecode();
+	benchSafequeue();
+	benchCarverSet(carvers);
+
+	if (baseline_path.length() > 0)
+		writeBaseline(baseline_path);
+	if (compare_path.length() > 0)
+		compareBaseline(compare_path);
+	return 0;
+}
@@ -0,0 +1,654 @@
+/**********************************************************************
+*
+* Copyright (C)2015-2022 Maxwell Analytica. All rights reserved.
+*
+* @file carvercoordinator.cpp
+* @brief
+* @details
+* @author Maxwell
+* @version 1.0.0
+* @date 2026-10-19 23:59:24.806
+*
+**********************************************************************/
+#include "carvercoordinator.h"
+#include <algorithm>
+#include <ctime>
+#include <fstream>
+#include <thread>
+#include <string.h>
+#include "../carverscanner/streamdigest.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
+
+const uint64_t ConstFileCarveID		= 0x2000000000000000;
+const uint64_t ConstRawMask			= 0x4000000000000000;
+
+// pipes are created and inherited one process at a time, or a child keeps the write end of another
+static std::mutex spawn_mutex;
+
+WorkerProcess::WorkerProcess()
+{
+	ended_ = true;
+#ifdef _WIN32
+	process_ = nullptr;
+	output_ = nullptr;
+#else
+	pid_ = -1;
+	output_ = -1;
+#endif
+}
+
+WorkerProcess::~WorkerProcess()
+{
+	kill();
+	wait();
+}
+
+#ifdef _WIN32
+bool WorkerProcess::start(const std::string& command)
+{
+	std::lock_guard<std::mutex> lock(spawn_mutex);
+	SECURITY_ATTRIBUTES attributes = { sizeof(SECURITY_ATTRIBUTES), nullptr, TRUE };
+	HANDLE read_end = nullptr, write_end = nullptr;
+	if (!CreatePipe(&read_end, &write_end, &attributes, 0))
+		return false;
+	SetHandleInformation(read_end, HANDLE_FLAG_INHERIT, 0);
+
+	STARTUPINFOA startup = { sizeof(STARTUPINFOA) };
+	startup.dwFlags = STARTF_USESTDHANDLES;
+	startup.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
+	startup.hStdOutput = write_end;
+	startup.hStdError = GetStdHandle(STD_ERROR_HANDLE);
+	PROCESS_INFORMATION information = {};
+	std::vector<char> line(command.begin(), command.end());
+	line.push_back('\0');
+	BOOL created = CreateProcessA(nullptr, line.data(), nullptr, nullptr, TRUE, 0, nullptr, nullptr, &startup, &information);
+	CloseHandle(write_end);
+	if (!created)
+	{
+		CloseHandle(read_end);
+		return false;
+	}
+	CloseHandle(information.hThread);
+	process_ = information.hProcess;
+	output_ = read_end;
+	pending_.clear();
+	ended_ = false;
+	return true;
+}
+
+bool WorkerProcess::readLine(std::string& line)
+{
+	char buffer[4096];
+	while (true)
+	{
+		size_t end = pending_.find('\n');
+		if (end != std::string::npos)
+		{
+			line.assign(pending_, 0, end);
+			pending_.erase(0, end + 1);
+			if (!line.empty() && line.back() == '\r')
+				line.pop_back();
+			return true;
+		}
+		DWORD read = 0;
+		if (ended_ || !ReadFile((HANDLE)output_, buffer, sizeof(buffer), &read, nullptr) || read == 0)
+		{
+			ended_ = true;
+			return false;
+		}
+		pending_.append(buffer, read);
+	}
+}
+
+int32_t WorkerProcess::wait()
+{
+	if (process_ == nullptr)
+		return -1;
+	DWORD code = (DWORD)-1;
+	WaitForSingleObject((HANDLE)process_, INFINITE);
+	GetExitCodeProcess((HANDLE)process_, &code);
+	CloseHandle((HANDLE)process_);
+	CloseHandle((HANDLE)output_);
+	process_ = nullptr;
+	output_ = nullptr;
+	ended_ = true;
+	return (int32_t)code;
+}
+
+void WorkerProcess::kill()
+{
+	if (process_ != nullptr)
+		TerminateProcess((HANDLE)process_, (UINT)-1);
+}
+#else
+bool WorkerProcess::start(const std::string& command)
+{
+	std::lock_guard<std::mutex> lock(spawn_mutex);
+	int fds[2];
+	if (pipe(fds) != 0)
+		return false;
+	fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+	fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+	pid_t pid = fork();
+	if (pid < 0)
+	{
+		close(fds[0]);
+		close(fds[1]);
+		return false;
+	}
+	if (pid == 0)
+	{
+		dup2(fds[1], STDOUT_FILENO);
+		execl("/bin/sh", "sh", "-c", command.c_str(), (char*)nullptr);
+		_exit(127);
+	}
+	close(fds[1]);
+	pid_ = (int32_t)pid;
+	output_ = fds[0];
+	pending_.clear();
+	ended_ = false;
+	return true;
+}
+
+bool WorkerProcess::readLine(std::string& line)
+{
+	char buffer[4096];
+	while (true)
+	{
+		size_t end = pending_.find('\n');
+		if (end != std::string::npos)
+		{
+			line.assign(pending_, 0, end);
+			pending_.erase(0, end + 1);
+			return true;
+		}
+		ssize_t result = ended_ ? 0 : read(output_, buffer, sizeof(buffer));
+		if (result < 0 && errno == EINTR)
+			continue;
+		if (result <= 0)
+		{
+			ended_ = true;
+			return false;
+		}
+		pending_.append(buffer, result);
+	}
+}
+
+int32_t WorkerProcess::wait()
+{
+	if (pid_ < 0)
+		return -1;
+	int status = 0;
+	while (waitpid(pid_, &status, 0) < 0 && errno == EINTR);
+	close(output_);
+	pid_ = -1;
+	output_ = -1;
+	ended_ = true;
+	return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+void WorkerProcess::kill()
+{
+	if (pid_ > 0)
+		::kill(pid_, SIGKILL);
+}
+#endif
+
+CarverCoordinator::CarverCoordinator()
+{
+	delegate_ = nullptr;
+	device_size_ = 0;
+	sector_size_ = 512;
+	deduplicate_ = false;
+	stop_ = false;
+	remaining_ = 0;
+	active_ = 0;
+	reassigned_ = 0;
+	merged_ = 0;
+	sequence_ = 0;
+	suppressed_ = 0;
+}
+
+CarverCoordinator::~CarverCoordinator()
+{
+
+}
+
+int32_t CarverCoordinator::advance(ITransferDelegate* delegate, const CoordinatorSetting& setting)
+{
+	if (delegate == nullptr)
+		return -1;
+	delegate_ = delegate;
+	setting_ = setting;
+	try
+	{
+		char context[4096] = { 0 };
+		int32_t size = sizeof(context);
+		delegate_->Context(context, &size);
+		frjson device = frjson::parse(std::string(context, size));
+		device_size_ = device.at("Size").get<int64_t>();
+		sector_size_ = device.value("BytesPerSector", 512);
+		image_path_ = device.at("ImagePath").get<std::string>();
+		if (setting_.config_path.length() > 0)
+		{
+			std::ifstream is(setting_.config_path);
+			frjson config;
+			is >> config;
+			deduplicate_ = config.value("deduplicate", false);
+		}
+	}
+	catch (std::exception& e)
+	{
+		delegate_->Logger("[%s] parse context exception: %s", __FUNCTION__, e.what());
+		return -1;
+	}
+	if (device_size_ <= 0 || sector_size_ <= 0)
+		return -1;
+
+	if (setting_.launchers.empty())
+		setting_.launchers.push_back("");
+	if (setting_.max_attempts <= 0)
+		setting_.max_attempts = DefaultAttempts;
+	// whole sectors, so every range starts on one
+	int64_t range_size = setting_.range_size > 0 ? setting_.range_size : DefaultRangeSize;
+	range_size = std::max<int64_t>(sector_size_, range_size - range_size % sector_size_);
+	setting_.range_size = range_size;
+	// a carve starting in a range closes within its truncate limit, past the range by at most that
+	if (setting_.overlap <= 0)
+	{
+		int64_t longest = longestCarve(setting_.config_path);
+		setting_.overlap = longest > 0 ? longest : DefaultOverlap;
+	}
+	setting_.overlap = (setting_.overlap + sector_size_ - 1) / sector_size_ * sector_size_;
+	// read on both sides, an overlap past the range size would have every worker carve its neighbours too
+	if (setting_.overlap > range_size)
+	{
+		delegate_->Logger("[%s] overlap %lld clamped to the range size %lld", __FUNCTION__, setting_.overlap, range_size);
+		setting_.overlap = range_size;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		ranges_.clear();
+		pending_.clear();
+		for (int64_t offset = 0; offset < device_size_; offset += range_size)
+		{
+			CarveRange range;
+			range.offset = offset;
+			range.size = std::min(range_size, device_size_ - offset);
+			range.attempts = 0;
+			range.completed = false;
+			range.failed = false;
+			pending_.push_back(ranges_.size());
+			ranges_.push_back(range);
+		}
+		remaining_ = ranges_.size();
+		active_ = (int32_t)setting_.launchers.size();
+		processes_.clear();
+		for (int32_t slot = 0; slot < active_; ++slot)
+			processes_.push_back(std::make_shared<WorkerProcess>());
+	}
+	delegate_->Logger("[%s] %zu ranges of %lld bytes, overlap %lld, %d workers", __FUNCTION__,
+		ranges_.size(), range_size, setting_.overlap, active_);
+
+	std::vector<std::thread> workers;
+	for (int32_t slot = 0; slot < (int32_t)setting_.launchers.size(); ++slot)
+		workers.emplace_back(&CarverCoordinator::work, this, slot);
+	for (auto& worker : workers)
+		worker.join();
+	merge();
+
+	if (reassigned_ > 0)
+		delegate_->Logger("[%s] reassigned %lld ranges", __FUNCTION__, reassigned_);
+	if (suppressed_ > 0)
+		delegate_->Logger("[%s] suppressed %lld duplicate files", __FUNCTION__, suppressed_);
+	delegate_->Logger("[%s] merged %llu files", __FUNCTION__, (unsigned long long)sequence_);
+	if (!stop_)
+	{
+		int64_t size = 0;
+		delegate_->Transfer(NotifyOption::NO_Completed, nullptr, &size);
+	}
+	return 0;
+}
+
+void CarverCoordinator::stop()
+{
+	stop_ = true;
+	std::lock_guard<std::mutex> lock(mutex_);
+	for (auto& process : processes_)
+		process->kill();
+	condition_.notify_all();
+}
+
+int64_t CarverCoordinator::reassigned() const
+{
+	return reassigned_;
+}
+
+int64_t CarverCoordinator::suppressed() const
+{
+	return suppressed_;
+}
+
+void CarverCoordinator::work(int32_t slot)
+{
+	int32_t failures = 0;
+	while (!stop_)
+	{
+		size_t index = 0;
+		CarveRange range;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			// a range carved elsewhere may still come back
+			condition_.wait(lock, [this] { return stop_ || !pending_.empty() || remaining_ == 0; });
+			if (stop_ || pending_.empty())
+				break;
+			index = pending_.front();
+			pending_.pop_front();
+			range = ranges_[index];
+		}
+
+		std::vector<CarvedRecord> files;
+		bool carved = carve(slot, range, files);
+		if (stop_)
+			break;
+		bool settled = true;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			CarveRange& target = ranges_[index];
+			if (carved)
+			{
+				target.files.swap(files);
+				target.completed = true;
+				--remaining_;
+				failures = 0;
+			}
+			else if (++target.attempts >= setting_.max_attempts)
+			{
+				target.failed = true;
+				--remaining_;
+				++failures;
+			}
+			else
+			{
+				// ahead of the others, the merge waits for it
+				pending_.push_front(index);
+				++reassigned_;
+				++failures;
+				settled = false;
+			}
+			condition_.notify_all();
+		}
+		if (!carved)
+			delegate_->Logger("[%s] worker %d failed on range %lld + %lld", __FUNCTION__, slot, range.offset, range.size);
+		if (settled)
+			merge();
+		if (failures >= setting_.max_attempts)
+		{
+			retire(slot);
+			return;
+		}
+	}
+}
+
+bool CarverCoordinator::carve(int32_t slot, const CarveRange& range, std::vector<CarvedRecord>& files)
+{
+	int64_t start = std::max<int64_t>(0, range.offset - setting_.overlap);
+	int64_t end = std::min(device_size_, range.offset + range.size + setting_.overlap);
+	std::string command;
+	if (setting_.launchers[slot].length() > 0)
+		command = setting_.launchers[slot] + " ";
+	command += quote(setting_.worker_path) + " --image " + quote(image_path_)
+		+ " --offset " + std::to_string(start) + " --size " + std::to_string(end - start)
+		+ " --sector " + std::to_string(sector_size_);
+	if (setting_.config_path.length() > 0)
+		command += " --config " + quote(setting_.config_path);
+
+	std::shared_ptr<WorkerProcess> process;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		process = processes_[slot];
+	}
+	if (stop_ || !process->start(command))
+		return false;
+
+	bool done = false;
+	bool malformed = false;
+	int64_t reported = 0;
+	std::string text;
+	while (!done && !malformed && process->readLine(text))
+	{
+		frjson line = frjson::parse(text, nullptr, false);
+		if (line.is_discarded() || !line.is_object())
+			continue;
+		try
+		{
+			std::string type = line.value("type", "");
+			if (type == "done")
+			{
+				done = line.value("files", -1ll) == reported;
+				break;
+			}
+			if (type != "file")
+				continue;
+			if (!validRecord(line))
+			{
+				delegate_->Logger("[%s] worker %d malformed file line", __FUNCTION__, slot);
+				malformed = true;
+				break;
+			}
+			++reported;
+			// owned by the range its first sector lies in, the other copies are carved there
+			CarvedRecord record;
+			record.start_blockno = line["runs"][0][1].get<uint64_t>();
+			int64_t offset = (int64_t)record.start_blockno * sector_size_;
+			if (offset < range.offset || offset >= range.offset + range.size)
+				continue;
+			record.parent_start = line.value("parentStart", -1ll);
+			record.line = std::move(line);
+			files.push_back(std::move(record));
+		}
+		catch (std::exception& e)
+		{
+			delegate_->Logger("[%s] worker %d bad line: %s", __FUNCTION__, slot, e.what());
+			malformed = true;
+		}
+	}
+	// the rest of its output is not trusted either
+	if (malformed)
+		process->kill();
+	return process->wait() == 0 && done && !malformed;
+}
+
+bool CarverCoordinator::validRecord(const frjson& line)
+{
+	auto runs = line.find("runs");
+	if (runs == line.end() || !runs->is_array() || runs->empty())
+		return false;
+	for (auto& run : *runs)
+	{
+		if (!run.is_array() || run.size() != 3)
+			return false;
+		for (auto& value : run)
+		{
+			if (!value.is_number_unsigned())
+				return false;
+		}
+	}
+	for (auto key : { "did", "size", "digestFlag", "crc32", "confidence" })
+	{
+		auto field = line.find(key);
+		if (field != line.end() && !field->is_number_unsigned())
+			return false;
+	}
+	auto parent = line.find("parentStart");
+	if (parent != line.end() && !parent->is_number_integer())
+		return false;
+	auto name = line.find("name");
+	if (name != line.end() && !name->is_string())
+		return false;
+	auto sha256 = line.find("sha256");
+	if (sha256 != line.end() && (!sha256->is_string() || sha256->get<std::string>().find_first_not_of("0123456789abcdefABCDEF") != std::string::npos))
+		return false;
+	return true;
+}
+
+void CarverCoordinator::merge()
+{
+	std::lock_guard<std::mutex> merge_lock(merge_mutex_);
+	while (!stop_)
+	{
+		CarveRange range;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (merged_ >= ranges_.size() || !(ranges_[merged_].completed || ranges_[merged_].failed))
+				break;
+			range.offset = ranges_[merged_].offset;
+			range.size = ranges_[merged_].size;
+			range.failed = ranges_[merged_].failed;
+			range.files.swap(ranges_[merged_].files);
+			++merged_;
+		}
+		if (range.failed)
+		{
+			delegate_->Logger("[%s] range %lld + %lld not carved", __FUNCTION__, range.offset, range.size);
+			Runlist run;
+			run.Start = range.offset / sector_size_;
+			run.Number = (range.size + sector_size_ - 1) / sector_size_;
+			int64_t len = sizeof(Runlist);
+			delegate_->Transfer(NotifyOption::NO_BadCluster, &run, &len);
+			continue;
+		}
+		// a worker emits in validation order, the stream goes by device offset
+		std::stable_sort(range.files.begin(), range.files.end(), [](const CarvedRecord& left, const CarvedRecord& right) {
+			return left.start_blockno < right.start_blockno;
+		});
+		for (auto& record : range.files)
+			emit(record);
+	}
+}
+
+void CarverCoordinator::emit(const CarvedRecord& record)
+{
+	const frjson& line = record.line;
+	auto info = new RawFileInfo();
+	info->Size = line.value("size", 0ull);
+	info->DigestFlag = line.value("digestFlag", 0u);
+	info->Crc32 = line.value("crc32", 0u);
+	std::string sha256 = line.value("sha256", "");
+	for (size_t pos = 0; pos + 1 < sha256.size() && pos / 2 < sizeof(info->Sha256); pos += 2)
+		info->Sha256[pos / 2] = (uint8_t)std::stoul(sha256.substr(pos, 2), nullptr, 16);
+	if (deduplicate_ && info->DigestFlag != DF_None)
+	{
+		// same key as the scanner, copies found by different workers meet here
+		std::string key((char*)&info->Size, sizeof(info->Size));
+		if (info->DigestFlag & DF_Sha256)
+			key.append((const char*)info->Sha256, 32);
+		else
+			key.append((const char*)&info->Crc32, sizeof(info->Crc32));
+		if (!emitted_digests_.insert(key).second)
+		{
+			++suppressed_;
+			delete info;
+			return;
+		}
+	}
+
+	info->Id = ConstRawMask + (++sequence_);
+	auto parent = record.parent_start >= 0 ? emitted_starts_.find((uint64_t)record.parent_start) : emitted_starts_.end();
+	info->Pid = parent != emitted_starts_.end() ? parent->second : ConstFileCarveID;
+	emitted_starts_[record.start_blockno] = info->Id;
+	info->Did = line.value("did", 0ull);
+	info->Attribute = 32765;
+	info->ScanType = ST_Raw;
+	info->FileSystem = FSC_Raw;
+	info->Category = 1;
+	info->CreateTime = (int64_t)std::time(nullptr);
+	info->AccessTime = info->CreateTime;
+	info->ModifyTime = info->CreateTime;
+	info->Confidence = line.value("confidence", 0u);
+	std::string name = line.value("name", "");
+	memcpy(info->Name, name.c_str(), std::min<size_t>(name.size(), sizeof(info->Name)));
+	Runlist** tail = &info->Runlist;
+	for (auto& run : line["runs"])
+	{
+		auto node = new Runlist();
+		node->Offset = run[0].get<uint64_t>();
+		node->Start = run[1].get<uint64_t>();
+		node->Number = run[2].get<uint64_t>();
+		*tail = node;
+		tail = &node->Next;
+	}
+	info->RunlistCategory = RLC_General;
+	int64_t len = sizeof(RawFileInfo);
+	delegate_->Transfer(NotifyOption::NO_FileInfo, info, &len);
+}
+
+void CarverCoordinator::retire(int32_t slot)
+{
+	delegate_->Logger("[%s] worker %d retired after %d failures in a row", __FUNCTION__, slot, setting_.max_attempts);
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (--active_ > 0)
+			return;
+		// nobody left to carve them
+		for (auto index : pending_)
+		{
+			ranges_[index].failed = true;
+			--remaining_;
+		}
+		pending_.clear();
+		condition_.notify_all();
+	}
+	merge();
+}
+
+int64_t CarverCoordinator::longestCarve(const std::string& config_path)
+{
+	if (config_path.empty())
+		return 0;
+	int64_t longest = 0;
+	try
+	{
+		std::ifstream is(config_path);
+		frjson config;
+		is >> config;
+		for (auto& carver : config.at("carvers"))
+		{
+			int64_t truncate_size = carver.value("truncate", 0ll);
+			if (truncate_size <= 0)
+				return 0;
+			longest = std::max(longest, truncate_size);
+		}
+	}
+	catch (std::exception&)
+	{
+		return 0;
+	}
+	return longest;
+}
+
+std::string CarverCoordinator::quote(const std::string& text)
+{
+#ifdef _WIN32
+	return "\"" + text + "\"";
+#else
+	std::string result = "'";
+	for (char ch : text)
+	{
+		if (ch == '\'')
+			result += "'\\''";
+		else
+			result.push_back(ch);
+	}
+	return result + "'";
+#endif
+}
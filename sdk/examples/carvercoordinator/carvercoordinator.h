@@ -0,0 +1,165 @@
+/**********************************************************************
+*
+* Copyright (C)2015-2022 Maxwell Analytica. All rights reserved.
+*
+* @file carvercoordinator.h
+* @brief Coordinator carving one image with several worker processes
+* @details The image is cut into ranges handed to carverworker processes, locally
+*          or through a launcher on nodes sharing the image. A worker reads an
+*          overlap before and after its range, at most the range size, so carves
+*          crossing a boundary within the overlap are found whole, and a file is
+*          kept from the range holding its start. A file longer than the overlap,
+*          from a carver without truncate or past a clamped overlap, is cut where
+*          its worker stops reading.
+*          Ranges are merged in device order into one de-duplicated stream, the
+*          range of a worker ending without its done line is carved again
+* @author Maxwell
+* @version 1.0.0
+* @date 2026-10-19 23:59:24.806
+*
+**********************************************************************/
+#ifndef CARVER_COORDINATOR_H
+#define CARVER_COORDINATOR_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "../../include/datatype.h"
+#include "../../include/iscanner.h"
+#include "../../third_party/json.hpp"
+
+using frjson = nlohmann::json;
+
+typedef struct _CoordinatorSetting
+{
+	std::string					worker_path;	/* carverworker executable */
+	std::string					config_path;	/* filecarver.json given to every worker, empty for their own */
+	std::vector<std::string>	launchers;		/* one per worker, "" runs it here, "ssh node2" on a node sharing the image */
+	int64_t						range_size;		/* bytes owned by one range */
+	int64_t						overlap;		/* bytes read past both ends of a range, 0 for the longest truncate of the config, clamped to range_size */
+	int32_t						max_attempts;	/* of one range, and failures in a row before a worker is retired */
+}CoordinatorSetting, *PCoordinatorSetting;
+
+// line of a worker, kept until its range is merged
+typedef struct _CarvedRecord
+{
+	uint64_t	start_blockno;
+	int64_t		parent_start;	/* start of the enclosing file, -1 for none */
+	frjson		line;
+}CarvedRecord, *PCarvedRecord;
+
+typedef struct _CarveRange
+{
+	int64_t						offset;		/* bytes, files starting in [offset, offset + size) belong here */
+	int64_t						size;
+	int32_t						attempts;
+	bool						completed;
+	bool						failed;
+	std::vector<CarvedRecord>	files;
+}CarveRange, *PCarveRange;
+
+// child process with its stdout on a pipe
+class WorkerProcess
+{
+public:
+	WorkerProcess();
+	~WorkerProcess();
+
+	bool start(const std::string& command);
+
+	// next line of the output, false at its end
+	bool readLine(std::string& line);
+
+	// exit code, -1 when killed or not started
+	int32_t wait();
+
+	void kill();
+
+private:
+	std::string pending_;
+	bool ended_;
+#ifdef _WIN32
+	void* process_;
+	void* output_;
+#else
+	int32_t pid_;
+	int32_t output_;
+#endif
+};
+
+class CarverCoordinator
+{
+public:
+	CarverCoordinator();
+	~CarverCoordinator();
+
+	// carves the device of `delegate`, its context names the image in "ImagePath", files and
+	// failed ranges go to its Transfer, returns when every range is merged or failed
+	int32_t advance(ITransferDelegate* delegate, const CoordinatorSetting& setting);
+
+	// kill the workers, ranges not merged yet are dropped
+	void stop();
+
+	int64_t reassigned() const;
+
+	int64_t suppressed() const;
+
+public:
+	static const int64_t DefaultRangeSize = 0x40000000;
+	static const int64_t DefaultOverlap = 0x4000000;
+	static const int32_t DefaultAttempts = 3;
+
+private:
+	void work(int32_t slot);
+
+	// one attempt of a worker on `range`, false when it did not end with its done line or wrote a malformed one
+	bool carve(int32_t slot, const CarveRange& range, std::vector<CarvedRecord>& files);
+
+	// every field emit() reads has the type it is read as
+	static bool validRecord(const frjson& line);
+
+	// emit ranges done in device order
+	void merge();
+
+	void emit(const CarvedRecord& record);
+
+	void retire(int32_t slot);
+
+	// longest "truncate" of the carvers, 0 when one of them has none
+	static int64_t longestCarve(const std::string& config_path);
+
+	static std::string quote(const std::string& text);
+
+private:
+	ITransferDelegate* delegate_;
+	CoordinatorSetting setting_;
+	std::string image_path_;
+	int64_t device_size_;
+	int32_t sector_size_;
+	bool deduplicate_;
+	std::atomic<bool> stop_;
+	// ranges and the queue, guarded by `mutex_`
+	std::mutex mutex_;
+	std::condition_variable condition_;
+	std::vector<CarveRange> ranges_;
+	std::deque<size_t> pending_;
+	size_t remaining_;
+	int32_t active_;
+	int64_t reassigned_;
+	std::vector<std::shared_ptr<WorkerProcess>> processes_;
+	// merged stream, guarded by `merge_mutex_`
+	std::mutex merge_mutex_;
+	size_t merged_;
+	uint64_t sequence_;
+	std::map<uint64_t, uint64_t> emitted_starts_;
+	std::unordered_set<std::string> emitted_digests_;
+	int64_t suppressed_;
+};
+
+#endif // CARVER_COORDINATOR_H
@@ -0,0 +1,175 @@
+/**********************************************************************
+*
+* Copyright (C)2015-2022 Maxwell Analytica. All rights reserved.
+*
+* @file main.cpp
+* @brief Carves an image with worker processes and prints the merged files
+* @details carvercoordinator --image <path> --worker <carverworker> [--config filecarver.json]
+*          [--workers 4] [--launcher "ssh node2"]... [--range-size bytes] [--overlap bytes]
+*          [--attempts 3] [--sector 512]
+*          Every --launcher adds a worker run through it, --workers adds local ones
+* @author Maxwell
+* @version 1.0.0
+* @date 2026-10-19 23:59:37.152
+*
+**********************************************************************/
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <mutex>
+#include "carvercoordinator.h"
+
+#ifdef _MSC_VER
+#define fseek64 _fseeki64
+#define ftell64 _ftelli64
+#else
+#define fseek64 fseeko
+#define ftell64 ftello
+#endif
+
+class MergeDelegate : public ITransferDelegate
+{
+public:
+	MergeDelegate(const std::string& path, int32_t sector_size)
+	{
+		path_ = path;
+		sector_size_ = sector_size;
+		size_ = 0;
+		FILE* image = fopen(path.c_str(), "rb");
+		if (image != nullptr)
+		{
+			if (fseek64(image, 0, SEEK_END) == 0)
+				size_ = ftell64(image);
+			fclose(image);
+		}
+	}
+
+	virtual ~MergeDelegate()
+	{
+
+	}
+
+	int64_t size() const
+	{
+		return size_;
+	}
+
+	// files are read by the workers
+	virtual int32_t Read(void* buffer, int64_t offset, int32_t count)
+	{
+		return -1;
+	}
+
+	virtual bool Availabled(const uint64_t& offset, int32_t option)
+	{
+		return true;
+	}
+
+	virtual int32_t Transfer(int32_t type, void* ptr, int64_t* size)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (type == NO_FileInfo && ptr != nullptr)
+		{
+			auto info = (RawFileInfo*)ptr;
+			fprintf(stdout, "id=%llx pid=%llx did=%llu size=%llu confidence=%u name=%s runs=",
+				(unsigned long long)info->Id, (unsigned long long)info->Pid, (unsigned long long)info->Did,
+				(unsigned long long)info->Size, info->Confidence, (const char*)info->Name);
+			Runlist* run = info->Runlist;
+			while (run != nullptr)
+			{
+				fprintf(stdout, "%llu+%llu%s", (unsigned long long)run->Start, (unsigned long long)run->Number, run->Next != nullptr ? "," : "\n");
+				Runlist* next = run->Next;
+				delete run;
+				run = next;
+			}
+			delete info;
+		}
+		else if (type == NO_BadCluster && ptr != nullptr)
+		{
+			auto run = (Runlist*)ptr;
+			fprintf(stdout, "missing start=%llu number=%llu\n", (unsigned long long)run->Start, (unsigned long long)run->Number);
+		}
+		else if (type == NO_Completed)
+		{
+			fprintf(stdout, "completed\n");
+		}
+		fflush(stdout);
+		return 0;
+	}
+
+	virtual int32_t Context(void* params, int32_t* size)
+	{
+		frjson context;
+		context["DiskIndex"] = 0;
+		context["BytesPerSector"] = sector_size_;
+		context["StartingOffset"] = 0;
+		context["Size"] = size_;
+		context["ImagePath"] = path_;
+		std::string text = context.dump();
+		memcpy(params, text.c_str(), text.size());
+		*size = (int32_t)text.size();
+		return 0;
+	}
+
+	virtual int32_t Logger(const char* format, ...)
+	{
+		std::lock_guard<std::mutex> lock(log_mutex_);
+		va_list args;
+		va_start(args, format);
+		vfprintf(stderr, format, args);
+		va_end(args);
+		fputc('\n', stderr);
+		return 0;
+	}
+
+private:
+	std::string path_;
+	int32_t sector_size_;
+	int64_t size_;
+	std::mutex mutex_;
+	std::mutex log_mutex_;
+};
+
+int main(int argc, char** argv)
+{
+	std::string image_path;
+	int32_t sector_size = 512;
+	int32_t local_workers = 0;
+	CoordinatorSetting setting;
+	setting.range_size = 0;
+	setting.overlap = 0;
+	setting.max_attempts = 0;
+	for (int32_t index = 1; index < argc; ++index)
+	{
+		std::string arg = argv[index];
+		if (arg == "--image" && index + 1 < argc)
+			image_path = argv[++index];
+		else if (arg == "--worker" && index + 1 < argc)
+			setting.worker_path = argv[++index];
+		else if (arg == "--config" && index + 1 < argc)
+			setting.config_path = argv[++index];
+		else if (arg == "--workers" && index + 1 < argc)
+			local_workers = std::stoi(argv[++index]);
+		else if (arg == "--launcher" && index + 1 < argc)
+			setting.launchers.push_back(argv[++index]);
+		else if (arg == "--range-size" && index + 1 < argc)
+			setting.range_size = std::stoll(argv[++index]);
+		else if (arg == "--overlap" && index + 1 < argc)
+			setting.overlap = std::stoll(argv[++index]);
+		else if (arg == "--attempts" && index + 1 < argc)
+			setting.max_attempts = std::stoi(argv[++index]);
+		else if (arg == "--sector" && index + 1 < argc)
+			sector_size = std::stoi(argv[++index]);
+	}
+	for (int32_t index = 0; index < local_workers; ++index)
+		setting.launchers.push_back("");
+
+	MergeDelegate delegate(image_path, sector_size);
+	if (delegate.size() <= 0 || setting.worker_path.empty())
+	{
+		delegate.Logger("usage: carvercoordinator --image <path> --worker <carverworker> [--config filecarver.json] [--workers n]");
+		return 1;
+	}
+	CarverCoordinator coordinator;
+	return coordinator.advance(&delegate, setting) == 0 ? 0 : 1;
+}
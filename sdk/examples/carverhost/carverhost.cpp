@@ -0,0 +1,455 @@
+/**********************************************************************
+*
+* Copyright (C)2015-2022 Maxwell Analytica. All rights reserved.
+*
+* @file carverhost.cpp
+* @brief Process hosting a CarverScanner for a RemoteScanner
+* @details carverhost --channel <name> --parent <pid>
+*          Blocks of the ring go to write_buffer in place, calls of the engine
+*          are served one at a time and the delegate of the scanner forwards
+*          to the engine. Reads of the scanner come back on the same ring, every
+*          block carries its Availabled result so the scanner does not ask for
+*          it across the processes. The host leaves on destroy, or once its
+*          parent is gone
+* @author Maxwell
+* @version 1.0.0
+* @date 2026-10-19 23:59:48.239
+*
+**********************************************************************/
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../carverscanner/carverscanner.h"
+#include "../remotescanner/shmchannel.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+const int32_t ConstPollMilliseconds		= 100;
+const int32_t ConstLoggerSize			= 4096;
+// block records whose Availabled bits are kept for the scanner, it asks once it carves them
+const size_t ConstMarkedRecords			= 0x4000;
+
+static std::atomic<bool> parent_gone(false);
+
+#ifdef _WIN32
+static HANDLE parent_process = nullptr;
+#else
+static pid_t parent_pid = 0;
+#endif
+
+static bool parent_alive()
+{
+#ifdef _WIN32
+	if (parent_process != nullptr && WaitForSingleObject(parent_process, 0) == WAIT_OBJECT_0)
+		parent_gone = true;
+#else
+	// orphans are adopted by another process
+	if (getppid() != parent_pid)
+		parent_gone = true;
+#endif
+	return !parent_gone;
+}
+
+class ChannelDelegate : public ITransferDelegate
+{
+public:
+	ChannelDelegate(ShmChannel* channel)
+	{
+		channel_ = channel;
+		read_buffer_ = nullptr;
+		read_offset_ = 0;
+		read_count_ = 0;
+	}
+
+	virtual ~ChannelDelegate()
+	{
+
+	}
+
+	// the data comes in block records, feed() copies them here as they arrive
+	virtual int32_t Read(void* buffer, int64_t offset, int32_t count)
+	{
+		std::lock_guard<std::mutex> read_lock(read_mutex_);
+		{
+			std::lock_guard<std::mutex> lock(mark_mutex_);
+			read_buffer_ = (uint8_t*)buffer;
+			read_offset_ = offset;
+			read_count_ = count;
+		}
+		int32_t result = -1;
+		uint64_t produced = 0;
+		{
+			// not held while the records are taken, the scan thread may need it to make room for them
+			std::lock_guard<std::mutex> lock(call_mutex_);
+			CallSlot* slot = &channel_->header()->up;
+			slot->method = SM_Read;
+			slot->args[0] = offset;
+			slot->args[1] = count;
+			if (call(slot))
+			{
+				result = slot->result;
+				produced = slot->events;
+			}
+		}
+		while (result > 0 && !channel_->blocks().drained(produced, ConstPollMilliseconds))
+		{
+			if (!parent_alive())
+				result = -1;
+		}
+		std::lock_guard<std::mutex> lock(mark_mutex_);
+		read_buffer_ = nullptr;
+		return result;
+	}
+
+	virtual bool Availabled(const uint64_t& offset, int32_t option)
+	{
+		if (option == 0)
+		{
+			std::lock_guard<std::mutex> lock(mark_mutex_);
+			auto iter = marks_.upper_bound(offset);
+			if (iter != marks_.begin())
+			{
+				// the sector the scanner asks for starts one of the 4096 byte blocks of the record
+				const MarkedRecord& mark = (--iter)->second;
+				uint64_t position = offset * mark.sector_size - mark.offset;
+				uint64_t index = position / WD_BLOCK_SIZE;
+				if (position % WD_BLOCK_SIZE == 0 && index < mark.count)
+					return (mark.bits[index / 8] >> (index % 8) & 1) != 0;
+			}
+		}
+		std::lock_guard<std::mutex> lock(call_mutex_);
+		CallSlot* slot = &channel_->header()->up;
+		slot->method = SM_DelegateAvailabled;
+		slot->option = option;
+		slot->args[0] = (int64_t)offset;
+		// nothing is carved once the engine is gone
+		return call(slot) && slot->result != 0;
+	}
+
+	// a block record taken off the ring, its bits are kept and the data of a Read placed
+	void take(RingRecord* record)
+	{
+		const uint8_t* payload = ShmRing::payload(record);
+		uint8_t* target = nullptr;
+		std::unique_lock<std::mutex> lock(mark_mutex_);
+		if (record->reserved > 0 && record->value > 0)
+		{
+			MarkedRecord mark;
+			mark.offset = (uint64_t)record->offset;
+			mark.sector_size = (uint64_t)record->reserved;
+			mark.count = (uint64_t)(record->value + WD_BLOCK_SIZE - 1) / WD_BLOCK_SIZE;
+			mark.bits.assign(payload + record->value, payload + record->value + (mark.count + 7) / 8);
+			uint64_t first = mark.offset / mark.sector_size;
+			marks_[first] = std::move(mark);
+			order_.push_back(first);
+			if (order_.size() > ConstMarkedRecords)
+			{
+				marks_.erase(order_.front());
+				order_.pop_front();
+			}
+		}
+		if (record->type == RT_Read && read_buffer_ != nullptr && record->offset >= read_offset_
+			&& record->offset + record->value <= read_offset_ + read_count_)
+			target = read_buffer_ + (record->offset - read_offset_);
+		lock.unlock();
+		// the buffer stays until the ring is consumed past this record
+		if (target != nullptr)
+			memcpy(target, payload, (size_t)record->value);
+	}
+
+	// the engine delivers on its own thread, a failure there is returned by the next transfer
+	virtual int32_t Transfer(int32_t type, void* ptr, int64_t* size)
+	{
+		std::lock_guard<std::mutex> lock(event_mutex_);
+		if (type == NO_FileInfo && ptr != nullptr)
+		{
+			// the engine side builds its own copy, this one is released like a delegate would
+			auto info = (RawFileInfo*)ptr;
+			std::vector<uint64_t> runs;
+			for (Runlist* run = info->Runlist; run != nullptr; run = run->Next)
+			{
+				runs.push_back(run->Offset);
+				runs.push_back(run->Start);
+				runs.push_back(run->Number);
+			}
+			uint32_t bytes = (uint32_t)(sizeof(RawFileInfo) + runs.size() * sizeof(uint64_t));
+			RingRecord* record = reserve(bytes);
+			if (record != nullptr)
+			{
+				record->type = RT_FileInfo;
+				record->value = (int64_t)runs.size() / 3;
+				memcpy(ShmRing::payload(record), (const void*)info, sizeof(RawFileInfo));
+				if (!runs.empty())
+					memcpy(ShmRing::payload(record) + sizeof(RawFileInfo), runs.data(), runs.size() * sizeof(uint64_t));
+				channel_->events().commit(record);
+			}
+			Runlist* run = info->Runlist;
+			while (run != nullptr)
+			{
+				Runlist* next = run->Next;
+				delete run;
+				run = next;
+			}
+			delete info;
+			return record != nullptr ? channel_->header()->failure.exchange(0) : -1;
+		}
+
+		int64_t length = size != nullptr ? *size : 0;
+		uint32_t bytes = ptr != nullptr && length > 0 && length <= channel_->events().limit() ? (uint32_t)length : 0;
+		RingRecord* record = reserve(bytes);
+		if (record == nullptr)
+			return -1;
+		record->type = RT_Transfer;
+		record->value = type;
+		record->offset = length;
+		if (bytes > 0)
+			memcpy(ShmRing::payload(record), ptr, bytes);
+		channel_->events().commit(record);
+		return channel_->header()->failure.exchange(0);
+	}
+
+	virtual int32_t Context(void* params, int32_t* size)
+	{
+		std::lock_guard<std::mutex> lock(call_mutex_);
+		CallSlot* slot = &channel_->header()->up;
+		slot->method = SM_Context;
+		slot->size = 0;
+		if (!call(slot))
+			return -1;
+		// the scanner passes a buffer of 4096 bytes
+		*size = (int32_t)std::min<uint32_t>(slot->size, 4096);
+		memcpy(params, channel_->payload(slot), *size);
+		return slot->result;
+	}
+
+	virtual int32_t Logger(const char* format, ...)
+	{
+		char text[ConstLoggerSize];
+		va_list args;
+		va_start(args, format);
+		int32_t length = vsnprintf(text, sizeof(text), format, args);
+		va_end(args);
+		if (length < 0)
+			return -1;
+		length = std::min<int32_t>(length, sizeof(text) - 1);
+
+		std::lock_guard<std::mutex> lock(event_mutex_);
+		RingRecord* record = reserve(length + 1);
+		if (record == nullptr)
+			return -1;
+		record->type = RT_Logger;
+		memcpy(ShmRing::payload(record), text, length + 1);
+		channel_->events().commit(record);
+		return 0;
+	}
+
+private:
+	bool call(CallSlot* slot)
+	{
+		uint32_t sequence = channel_->request(slot);
+		while (!channel_->response(slot, sequence, ConstPollMilliseconds))
+		{
+			if (!parent_alive())
+				return false;
+		}
+		return true;
+	}
+
+	RingRecord* reserve(uint32_t size)
+	{
+		RingRecord* record = nullptr;
+		while ((record = channel_->events().reserve(size, ConstPollMilliseconds)) == nullptr)
+		{
+			if (!parent_alive())
+				return nullptr;
+		}
+		return record;
+	}
+
+private:
+	typedef struct _MarkedRecord
+	{
+		uint64_t				offset;
+		uint64_t				sector_size;
+		uint64_t				count;		/* blocks of 4096 bytes */
+		std::vector<uint8_t>	bits;
+	}MarkedRecord;
+
+private:
+	ShmChannel* channel_;
+	std::mutex call_mutex_;
+	std::mutex event_mutex_;
+	std::mutex read_mutex_;
+	// marks by the sector of their record, guarded by `mark_mutex_` with the Read in progress
+	std::mutex mark_mutex_;
+	std::map<uint64_t, MarkedRecord> marks_;
+	std::deque<uint64_t> order_;
+	uint8_t* read_buffer_;
+	int64_t read_offset_;
+	int64_t read_count_;
+};
+
+// blocks are carved straight from the ring, the ones of a Read go to the delegate
+static void feed(ShmChannel* channel, IScanner* scanner, ChannelDelegate* delegate, std::atomic<bool>* closing)
+{
+	ShmRing& blocks = channel->blocks();
+	while (!*closing)
+	{
+		RingRecord* record = blocks.peek(ConstPollMilliseconds);
+		if (record == nullptr)
+		{
+			if (!parent_alive())
+				break;
+			continue;
+		}
+		delegate->take(record);
+		if (record->type == RT_Block)
+			scanner->write_buffer((const char*)ShmRing::payload(record), record->offset, (int32_t)record->value);
+		blocks.release(record);
+	}
+}
+
+static void serve(ShmChannel* channel, IScanner* scanner, ITransferDelegate* delegate, std::atomic<bool>* closing)
+{
+	CallSlot* slot = &channel->header()->down;
+	uint8_t* payload = channel->payload(slot);
+	std::vector<char> buffer;
+	// every request taken is answered, one posted before this thread started is not missed
+	uint32_t sequence = slot->reply.sequence.load(std::memory_order_acquire);
+	while (!*closing)
+	{
+		if (!channel->accept(slot, sequence, ConstPollMilliseconds))
+		{
+			if (!parent_alive())
+				break;
+			continue;
+		}
+		slot->result = WFC_Success;
+		switch (slot->method)
+		{
+		case SM_SetDelegate:
+			scanner->set_delegate(delegate);
+			break;
+		case SM_Explore:
+			slot->result = scanner->explore();
+			break;
+		case SM_Advance:
+			slot->result = scanner->advance();
+			break;
+		case SM_Stop:
+			scanner->stop();
+			break;
+		case SM_Pause:
+			scanner->pause();
+			break;
+		case SM_Resume:
+			scanner->resume();
+			break;
+		case SM_Filesystem:
+			slot->result = scanner->filesystem();
+			break;
+		case SM_Availabled:
+		{
+			uint64_t offset = (uint64_t)slot->args[0];
+			slot->result = scanner->availabled(offset, slot->option) ? 1 : 0;
+			break;
+		}
+		case SM_InjectControl:
+		{
+			// the buffer of the engine may be larger than the payload, what the scanner writes is sent back
+			int32_t size = (int32_t)slot->args[0];
+			buffer.assign(std::max<size_t>((size_t)size, slot->size), 0);
+			memcpy(buffer.data(), payload, slot->size);
+			slot->result = scanner->inject_control(buffer.data(), size, slot->option);
+			bool written = size != (int32_t)slot->args[0] || memcmp(buffer.data(), payload, slot->size) != 0;
+			slot->args[0] = size;
+			slot->args[1] = written && size >= 0 && (uint32_t)size <= slot->capacity ? 1 : 0;
+			slot->size = slot->args[1] != 0 ? (uint32_t)size : 0;
+			if (slot->size > 0)
+				memcpy(payload, buffer.data(), slot->size);
+			break;
+		}
+		case SM_ReadBuffer:
+			slot->result = scanner->read_buffer((char*)payload, slot->args[0], (int32_t)slot->args[1]);
+			break;
+		case SM_SaveFile:
+		{
+			int64_t length = slot->args[2];
+			int64_t id = slot->args[0];
+			// ids of a batch follow the path
+			if (slot->option == SFO_Batch && slot->size > length)
+				id = (int64_t)(intptr_t)(payload + length);
+			slot->result = scanner->save_file((char*)payload, slot->index, id, slot->args[1], slot->option);
+			break;
+		}
+		case SM_SpecialRead:
+			slot->result = scanner->special_read_buffer(payload, slot->index, slot->args[0], slot->args[1], slot->args[2], slot->option);
+			break;
+		case SM_Destroy:
+			*closing = true;
+			break;
+		default:
+			slot->result = WFC_Error;
+			break;
+		}
+		if (slot->method == SM_Destroy)
+			break;
+		slot->events = channel->events().produced();
+		channel->answer(slot);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::string name;
+	int64_t parent = 0;
+	for (int32_t index = 1; index < argc; ++index)
+	{
+		std::string arg = argv[index];
+		if (arg == "--channel" && index + 1 < argc)
+			name = argv[++index];
+		else if (arg == "--parent" && index + 1 < argc)
+			parent = std::stoll(argv[++index]);
+	}
+#ifdef _WIN32
+	parent_process = OpenProcess(SYNCHRONIZE, FALSE, (DWORD)parent);
+#else
+	parent_pid = (pid_t)parent;
+#endif
+
+	ShmChannel channel;
+	if (name.empty() || !channel.open(name))
+	{
+		fprintf(stderr, "can not open channel %s\n", name.c_str());
+		return 1;
+	}
+	ChannelDelegate delegate(&channel);
+	CarverScanner* scanner = new CarverScanner();
+	std::atomic<bool> closing(false);
+	std::thread feeder(feed, &channel, scanner, &delegate, &closing);
+	serve(&channel, scanner, &delegate, &closing);
+
+	// the feeder is out of write_buffer before the scanner goes
+	closing = true;
+	feeder.join();
+	scanner->destroy();
+	if (parent_alive())
+	{
+		CallSlot* slot = &channel.header()->down;
+		slot->events = channel.events().produced();
+		channel.answer(slot);
+	}
+	channel.close();
+	return 0;
+}
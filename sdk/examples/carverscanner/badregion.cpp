@@ -0,0 +1,143 @@
+/**********************************************************************
+*
+* Copyright (C)2015-2022 Maxwell Analytica. All rights reserved.
+*
+* @file badregion.cpp
+* @brief
+* @details
+* @author Maxwell
+* @version 1.0.0
+* @date 2026-10-19 23:52:07.318
+*
+**********************************************************************/
+#include "badregion.h"
+#include <algorithm>
+
+BadRegionMap::BadRegionMap()
+{
+	skip_ = DefaultSkip;
+	max_skip_ = DefaultMaxSkip;
+	slow_latency_ = 0;
+	stride_ = skip_;
+	recovered_ = 0;
+}
+
+BadRegionMap::~BadRegionMap()
+{
+
+}
+
+void BadRegionMap::setPolicy(int64_t skip, int64_t max_skip, int64_t slow_latency, int32_t alignment)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	alignment = alignment > 0 ? alignment : 1;
+	skip_ = skip > alignment ? skip - skip % alignment : alignment;
+	max_skip_ = std::max(skip_, max_skip - max_skip % alignment);
+	slow_latency_ = slow_latency > 0 ? slow_latency : 0;
+	stride_ = skip_;
+}
+
+bool BadRegionMap::slow(int64_t latency) const
+{
+	return slow_latency_ > 0 && latency > slow_latency_;
+}
+
+int64_t BadRegionMap::skip(int64_t offset, int64_t limit)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	int64_t end = std::min(limit, offset + stride_);
+	if (end <= offset)
+		return offset;
+	stride_ = std::min(stride_ * 2, max_skip_);
+
+	// joined with the regions it touches
+	auto next = regions_.upper_bound(offset);
+	if (next != regions_.begin())
+	{
+		auto previous = std::prev(next);
+		if (previous->second.offset + previous->second.size >= offset)
+		{
+			offset = previous->second.offset;
+			end = std::max(end, offset + previous->second.size);
+			next = regions_.erase(previous);
+		}
+	}
+	while (next != regions_.end() && next->second.offset <= end)
+	{
+		end = std::max(end, next->second.offset + next->second.size);
+		next = regions_.erase(next);
+	}
+	regions_[offset] = { offset, end - offset, false };
+	return end;
+}
+
+void BadRegionMap::passed()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	stride_ = skip_;
+}
+
+int64_t BadRegionMap::skipTo(int64_t offset) const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	auto next = regions_.upper_bound(offset);
+	if (next == regions_.begin())
+		return offset;
+	auto& region = std::prev(next)->second;
+	return offset < region.offset + region.size ? region.offset + region.size : offset;
+}
+
+int64_t BadRegionMap::readableTo(int64_t offset, int64_t limit) const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	auto next = regions_.upper_bound(offset);
+	return next == regions_.end() ? limit : std::min(limit, next->second.offset);
+}
+
+void BadRegionMap::refine(int64_t offset, int64_t start, int64_t end)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	auto found = regions_.find(offset);
+	if (found == regions_.end())
+		return;
+	int64_t size = found->second.size;
+	regions_.erase(found);
+	if (end > start)
+	{
+		regions_[start] = { start, end - start, true };
+		size -= end - start;
+	}
+	recovered_ += size;
+}
+
+std::vector<BadRegion> BadRegionMap::regions() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	std::vector<BadRegion> result;
+	for (auto& region : regions_)
+		result.push_back(region.second);
+	return result;
+}
+
+int64_t BadRegionMap::skipped() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	int64_t size = 0;
+	for (auto& region : regions_)
+		size += region.second.size;
+	return size;
+}
+
+int64_t BadRegionMap::recovered() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return recovered_;
+}
+
+void BadRegionMap::clear()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	regions_.clear();
+	stride_ = skip_;
+	recovered_ = 0;
+}
@@ -0,0 +1,80 @@
+/**********************************************************************
+*
+* Copyright (C)2015-2022 Maxwell Analytica. All rights reserved.
+*
+* @file badregion.h
+* @brief Unreadable or slow device areas skipped while pulling
+* @details Every bad read skips ahead by a stride doubled on each further bad
+*          read and reset by a good one, so a failing area costs a few reads
+*          whatever its size. Skipped areas are refined at the end of the scan.
+* @author Maxwell
+* @version 1.0.0
+* @date 2026-10-19 23:52:07.318
+*
+**********************************************************************/
+#ifndef BAD_REGION_H
+#define BAD_REGION_H
+
+#include <map>
+#include <mutex>
+#include <vector>
+#include <stdint.h>
+
+typedef struct _BadRegion
+{
+	int64_t		offset;		/* bytes */
+	int64_t		size;
+	bool		refined;	/* edges already read back, what is left is unreadable */
+}BadRegion, *PBadRegion;
+
+class BadRegionMap
+{
+public:
+	BadRegionMap();
+	~BadRegionMap();
+
+	// `skip` bytes after the first bad read up to `max_skip`, both multiples of `alignment`,
+	// reads slower than `slow_latency` microseconds count as bad, 0 for never
+	void setPolicy(int64_t skip, int64_t max_skip, int64_t slow_latency, int32_t alignment);
+
+	bool slow(int64_t latency) const;
+
+	// read at `offset` was bad, records the skipped area up to `limit` and returns its end
+	int64_t skip(int64_t offset, int64_t limit);
+
+	// a good read, the stride starts over
+	void passed();
+
+	// end of the region containing `offset`, `offset` when it is not recorded
+	int64_t skipTo(int64_t offset) const;
+
+	// start of the first region past `offset`, at most `limit`
+	int64_t readableTo(int64_t offset, int64_t limit) const;
+
+	// region at `offset` shrinks to [start, end) still unreadable, dropped when empty
+	void refine(int64_t offset, int64_t start, int64_t end);
+
+	std::vector<BadRegion> regions() const;
+
+	// bytes recorded, and bytes read back by refining
+	int64_t skipped() const;
+
+	int64_t recovered() const;
+
+	void clear();
+
+public:
+	static constexpr int64_t DefaultSkip = 0x100000;
+	static constexpr int64_t DefaultMaxSkip = 0x10000000;
+
+private:
+	mutable std::mutex mutex_;
+	int64_t skip_;
+	int64_t max_skip_;
+	int64_t slow_latency_;
+	int64_t stride_;
+	int64_t recovered_;
+	std::map<int64_t, BadRegion> regions_;
+};
+
+#endif // BAD_REGION_H
@@ -0,0 +1,286 @@
+/**********************************************************************
+*
+* Copyright (C)2015-2022 Maxwell Analytica. All rights reserved.
+*
+* @file batchextractor.cpp
+* @brief
+* @details
+* @author Maxwell
+* @version 1.0.0
+* @date 2026-10-19 17:32:09.164
+*
+**********************************************************************/
+#include "batchextractor.h"
+#include <stdio.h>
+#include <algorithm>
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
+#endif
+
+#ifdef _MSC_VER
+#define fseek64 _fseeki64
+#else
+#define fseek64 fseeko
+#endif
+
+// extents closer than the gap are read together, the gap is read and dropped
+const uint64_t ConstCoalesceGap		= 0x10000;
+const uint64_t ConstMaxRequest		= 0x400000;
+const int64_t ConstWriterLimit		= 0x2000000;
+
+AsyncWriter::AsyncWriter()
+{
+	limit_ = ConstWriterLimit;
+	pending_ = 0;
+	failed_ = false;
+}
+
+AsyncWriter::~AsyncWriter()
+{
+	finish();
+}
+
+void AsyncWriter::start(int64_t limit)
+{
+	limit_ = limit > 0 ? limit : ConstWriterLimit;
+	pending_ = 0;
+	failed_ = false;
+	job_queue_.reopen();
+	worker_ = std::thread(&AsyncWriter::work, this);
+}
+
+void AsyncWriter::write(FILE* file, std::shared_ptr<std::vector<char>> buffer, size_t begin, size_t length)
+{
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		cond_.wait(lock, [&] { return pending_ == 0 || pending_ + (int64_t)length <= limit_; });
+		pending_ += length;
+	}
+	job_queue_.push({ file, buffer, begin, length, false });
+}
+
+void AsyncWriter::close(FILE* file)
+{
+	job_queue_.push({ file, nullptr, 0, 0, true });
+}
+
+bool AsyncWriter::finish()
+{
+	if (!worker_.joinable())
+		return !failed_;
+
+	// the worker writes what is queued, then sees the queue closed
+	job_queue_.close();
+	worker_.join();
+	return !failed_;
+}
+
+void AsyncWriter::work()
+{
+	WriteJob job;
+	while (job_queue_.pop(job))
+	{
+		if (job.close)
+		{
+			if (fclose(job.file) != 0)
+				failed_ = true;
+			continue;
+		}
+		if (fwrite(job.buffer->data() + job.begin, 1, job.length, job.file) != job.length)
+			failed_ = true;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			pending_ -= job.length;
+		}
+		cond_.notify_one();
+	}
+}
+
+BatchExtractor::BatchExtractor(DeviceReader reader, uint32_t sector_size)
+{
+	reader_ = reader;
+	sector_size_ = sector_size > 0 ? sector_size : 512;
+	image_base_ = 0;
+	requests_ = 0;
+}
+
+BatchExtractor::~BatchExtractor()
+{
+
+}
+
+void BatchExtractor::setImagePath(const std::string& path, uint64_t base)
+{
+	image_path_ = path;
+	image_base_ = base;
+}
+
+void BatchExtractor::add(const ExtractItem& item)
+{
+	if (item.size > 0 && !item.path.empty())
+		items_.push_back(item);
+}
+
+int64_t BatchExtractor::requests() const
+{
+	return requests_;
+}
+
+int32_t BatchExtractor::run()
+{
+	requests_ = 0;
+	if (items_.empty())
+		return 0;
+
+	std::stable_sort(items_.begin(), items_.end(), [](const ExtractItem& a, const ExtractItem& b) {
+		return a.offset < b.offset;
+	});
+
+	int32_t result = -1;
+	if (!image_path_.empty())
+		result = copyRange();
+	if (result < 0)
+		result = readRange();
+	items_.clear();
+	return result;
+}
+
+int32_t BatchExtractor::copyRange()
+{
+#ifdef __linux__
+	int source = open(image_path_.c_str(), O_RDONLY);
+	if (source < 0)
+		return -1;
+	posix_fadvise(source, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+	int32_t written = 0;
+	bool fallback = false;
+	for (auto& item : items_)
+	{
+		int target = open(item.path.c_str(), O_WRONLY | O_CREAT | (item.position == 0 ? O_TRUNC : 0), 0644);
+		if (target < 0)
+			continue;
+		if (item.position > 0)
+			lseek(target, (off_t)item.position, SEEK_SET);
+		off_t offset = (off_t)(image_base_ + item.offset);
+		uint64_t remain = item.size;
+		bool kernel_copy = true;
+		while (remain > 0)
+		{
+			size_t count = (size_t)std::min<uint64_t>(remain, ConstMaxRequest);
+			ssize_t done = kernel_copy ? copy_file_range(source, &offset, target, nullptr, count, 0) : -1;
+			if (done < 0)
+			{
+				// cross filesystem or unsupported, sendfile moves the same pages
+				kernel_copy = false;
+				done = sendfile(target, source, &offset, count);
+			}
+			if (done <= 0)
+				break;
+			remain -= done;
+			++requests_;
+		}
+		::close(target);
+		if (remain > 0)
+		{
+			fallback = true;
+			break;
+		}
+		if (item.position == 0)
+			++written;
+	}
+	::close(source);
+	// start over through the device reader
+	return fallback ? -1 : written;
+#else
+	return -1;
+#endif
+}
+
+int32_t BatchExtractor::readRange()
+{
+	AsyncWriter writer;
+	writer.start(ConstWriterLimit);
+
+	struct ActiveItem
+	{
+		size_t index;
+		FILE* file;
+		uint64_t queued;
+	};
+	std::vector<ActiveItem> active;
+	size_t next = 0;
+	int32_t written = 0;
+
+	while (next < items_.size() || !active.empty())
+	{
+		// coalesce the following extents while the gap stays small
+		uint64_t start = next < items_.size() ? items_[next].offset : 0;
+		if (!active.empty())
+		{
+			start = UINT64_MAX;
+			for (auto& item : active)
+				start = std::min(start, items_[item.index].offset + item.queued);
+		}
+		start -= start % sector_size_;
+		uint64_t end = start;
+		for (auto& item : active)
+			end = std::max(end, items_[item.index].offset + items_[item.index].size);
+		for (size_t index = next; index < items_.size() && items_[index].offset <= end + ConstCoalesceGap; ++index)
+		{
+			if (items_[index].offset >= start + ConstMaxRequest)
+				break;
+			end = std::max(end, items_[index].offset + items_[index].size);
+		}
+		end = std::min(end, start + ConstMaxRequest);
+		end = (end + sector_size_ - 1) / sector_size_ * sector_size_;
+
+		auto buffer = std::make_shared<std::vector<char>>((size_t)(end - start));
+		int32_t count = reader_(buffer->data(), (int64_t)start, (int32_t)(end - start));
+		++requests_;
+		if (count <= 0)
+			break;
+		end = start + count;
+
+		for (; next < items_.size() && items_[next].offset < end; ++next)
+		{
+			// fragments come in device order, after the first one of their file
+			uint64_t position = items_[next].position;
+			FILE* file = fopen(items_[next].path.c_str(), position == 0 ? "wb" : "r+b");
+			if (file != nullptr && position > 0 && fseek64(file, (int64_t)position, SEEK_SET) != 0)
+			{
+				fclose(file);
+				file = nullptr;
+			}
+			if (file != nullptr)
+				active.push_back({ next, file, 0 });
+		}
+		// every open file takes its slice of the request
+		for (auto iter = active.begin(); iter != active.end();)
+		{
+			auto& item = items_[iter->index];
+			uint64_t position = item.offset + iter->queued;
+			uint64_t slice_end = std::min(end, item.offset + item.size);
+			if (position >= start && position < slice_end)
+			{
+				writer.write(iter->file, buffer, (size_t)(position - start), (size_t)(slice_end - position));
+				iter->queued += slice_end - position;
+			}
+			if (slice_end == item.offset + item.size)
+			{
+				writer.close(iter->file);
+				if (item.position == 0)
+					++written;
+				iter = active.erase(iter);
+				continue;
+			}
+			++iter;
+		}
+	}
+	for (auto& item : active)
+		writer.close(item.file);
+	writer.finish();
+	return written;
+}
@@ -0,0 +1,108 @@
+/**********************************************************************
+*
+* Copyright (C)2015-2022 Maxwell Analytica. All rights reserved.
+*
+* @file batchextractor.h
+* @brief Offset ordered extraction of many carved files
+* @details Extents are sorted by device offset and coalesced into large
+*          sequential reads, output files are written by a bounded
+*          asynchronous writer. A file backed image is copied in kernel
+*          with copy_file_range or sendfile where available
+* @author Maxwell
+* @version 1.0.0
+* @date 2026-10-19 17:32:09.164
+*
+**********************************************************************/
+#ifndef BATCH_EXTRACTOR_H
+#define BATCH_EXTRACTOR_H
+
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <memory>
+#include <condition_variable>
+#include "validator.h"
+#include "workqueue.h"
+
+typedef struct _ExtractItem
+{
+	int64_t		id;
+	uint64_t	offset;		/* device offset in bytes */
+	uint64_t	size;
+	uint64_t	position;	/* offset in the file, fragments of one file share the path */
+	std::string	path;
+}ExtractItem, *PExtractItem;
+
+class AsyncWriter
+{
+public:
+	AsyncWriter();
+	~AsyncWriter();
+
+	void start(int64_t limit);
+
+	// queue `length` bytes of `buffer` for `file`, waits while more than the limit is pending
+	void write(FILE* file, std::shared_ptr<std::vector<char>> buffer, size_t begin, size_t length);
+
+	// close once everything queued before is written
+	void close(FILE* file);
+
+	// drain the queue and join, returns false if any write failed
+	bool finish();
+
+private:
+	struct WriteJob
+	{
+		FILE* file;
+		std::shared_ptr<std::vector<char>> buffer;
+		size_t begin;
+		size_t length;
+		bool close;
+	};
+
+	void work();
+
+private:
+	int64_t limit_;
+	int64_t pending_;
+	std::atomic<bool> failed_;
+	std::mutex mutex_;
+	std::condition_variable cond_;
+	std::thread worker_;
+	WorkQueue<WriteJob> job_queue_;
+};
+
+class BatchExtractor
+{
+public:
+	BatchExtractor(DeviceReader reader, uint32_t sector_size);
+	~BatchExtractor();
+
+	// source device starts at `base` of this image file, enables the in kernel copy
+	void setImagePath(const std::string& path, uint64_t base = 0);
+
+	void add(const ExtractItem& item);
+
+	// returns the number of files written, fragments after the first are not counted
+	int32_t run();
+
+	// device read requests issued by the last run
+	int64_t requests() const;
+
+private:
+	int32_t copyRange();
+
+	int32_t readRange();
+
+private:
+	DeviceReader reader_;
+	uint32_t sector_size_;
+	std::string image_path_;
+	uint64_t image_base_;
+	std::vector<ExtractItem> items_;
+	int64_t requests_;
+};
+
+#endif // BATCH_EXTRACTOR_H
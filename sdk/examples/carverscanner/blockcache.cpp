@@ -0,0 +1,138 @@
+/**********************************************************************
+*
+* Copyright (C)2015-2022 Maxwell Analytica. All rights reserved.
+*
+* @file blockcache.cpp
+* @brief
+* @details
+* @author Maxwell
+* @version 1.0.0
+* @date 2026-10-19 16:48:30.517
+*
+**********************************************************************/
+#include "blockcache.h"
+#include <string.h>
+
+BlockCache::BlockCache()
+{
+	capacity_ = 0;
+	hits_ = 0;
+	misses_ = 0;
+	for (auto& shard : shards_)
+		shard.hand = 0;
+}
+
+BlockCache::~BlockCache()
+{
+
+}
+
+void BlockCache::setCapacity(int64_t capacity)
+{
+	capacity_ = capacity > 0 ? capacity : 0;
+	uint32_t count = (uint32_t)(capacity_ / WD_CACHE_BLOCK_SIZE / WD_CACHE_SHARDS);
+	for (auto& shard : shards_)
+	{
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		shard.slots.assign(count, { 0, false, false });
+		shard.data.reset(count > 0 ? new char[(size_t)count * WD_CACHE_BLOCK_SIZE] : nullptr);
+		shard.index.clear();
+		shard.index.reserve(count);
+		shard.hand = 0;
+	}
+	hits_ = 0;
+	misses_ = 0;
+}
+
+int64_t BlockCache::capacity() const
+{
+	return capacity_;
+}
+
+BlockCache::Shard& BlockCache::shard(uint64_t blockno)
+{
+	// neighbouring blocks land on different shards, sequential readers do not contend
+	return shards_[blockno % WD_CACHE_SHARDS];
+}
+
+bool BlockCache::lookup(uint64_t blockno, void* buffer)
+{
+	Shard& shard = this->shard(blockno);
+	std::lock_guard<std::mutex> lock(shard.mutex);
+	auto iter = shard.index.find(blockno);
+	if (iter == shard.index.end())
+	{
+		++misses_;
+		return false;
+	}
+	Slot& slot = shard.slots[iter->second];
+	slot.referenced = true;
+	memcpy(buffer, shard.data.get() + (size_t)iter->second * WD_CACHE_BLOCK_SIZE, WD_CACHE_BLOCK_SIZE);
+	++hits_;
+	return true;
+}
+
+void BlockCache::insert(uint64_t blockno, const void* buffer)
+{
+	Shard& shard = this->shard(blockno);
+	std::lock_guard<std::mutex> lock(shard.mutex);
+	if (shard.slots.empty())
+		return;
+
+	uint32_t position = 0;
+	auto iter = shard.index.find(blockno);
+	if (iter != shard.index.end())
+	{
+		position = iter->second;
+	}
+	else
+	{
+		// second chance, the hand clears reference bits until it finds an unreferenced slot
+		while (true)
+		{
+			Slot& slot = shard.slots[shard.hand];
+			if (!slot.valid || !slot.referenced)
+				break;
+			slot.referenced = false;
+			shard.hand = (shard.hand + 1) % shard.slots.size();
+		}
+		position = shard.hand;
+		shard.hand = (shard.hand + 1) % shard.slots.size();
+
+		Slot& slot = shard.slots[position];
+		if (slot.valid)
+			shard.index.erase(slot.blockno);
+		slot.blockno = blockno;
+		slot.valid = true;
+		shard.index[blockno] = position;
+	}
+	// new blocks start unreferenced, a block read once by the scan is evicted before one read again
+	memcpy(shard.data.get() + (size_t)position * WD_CACHE_BLOCK_SIZE, buffer, WD_CACHE_BLOCK_SIZE);
+}
+
+void BlockCache::clear()
+{
+	for (auto& shard : shards_)
+	{
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		for (auto& slot : shard.slots)
+		{
+			slot.valid = false;
+			slot.referenced = false;
+		}
+		shard.index.clear();
+		shard.hand = 0;
+	}
+	hits_ = 0;
+	misses_ = 0;
+}
+
+int64_t BlockCache::hits() const
+{
+	return hits_;
+}
+
+int64_t BlockCache::misses() const
+{
+	return misses_;
+}
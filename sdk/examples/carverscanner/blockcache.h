@@ -0,0 +1,78 @@
+/**********************************************************************
+*
+* Copyright (C)2015-2022 Maxwell Analytica. All rights reserved.
+*
+* @file blockcache.h
+* @brief Size-bounded cache of recently seen device blocks
+* @details Blocks are spread over shards by number, each shard evicts with
+*          the CLOCK algorithm under its own lock
+* @author Maxwell
+* @version 1.0.0
+* @date 2026-10-19 16:48:30.517
+*
+**********************************************************************/
+#ifndef BLOCK_CACHE_H
+#define BLOCK_CACHE_H
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+
+#define WD_CACHE_BLOCK_SIZE		4096
+#define WD_CACHE_SHARDS			16
+
+class BlockCache
+{
+public:
+	BlockCache();
+	~BlockCache();
+
+	// capacity in bytes, 0 disables the cache
+	void setCapacity(int64_t capacity);
+
+	int64_t capacity() const;
+
+	// copy block `blockno` (in units of WD_CACHE_BLOCK_SIZE) into `buffer`
+	bool lookup(uint64_t blockno, void* buffer);
+
+	void insert(uint64_t blockno, const void* buffer);
+
+	void clear();
+
+	int64_t hits() const;
+
+	int64_t misses() const;
+
+public:
+	static constexpr int64_t DefaultCapacity = 16ll * 1024 * 1024;
+
+private:
+	struct Slot
+	{
+		uint64_t blockno;
+		bool valid;
+		bool referenced;
+	};
+
+	struct Shard
+	{
+		std::mutex mutex;
+		std::vector<Slot> slots;
+		std::unique_ptr<char[]> data;
+		std::unordered_map<uint64_t, uint32_t> index;
+		uint32_t hand;
+	};
+
+	Shard& shard(uint64_t blockno);
+
+private:
+	int64_t capacity_;
+	Shard shards_[WD_CACHE_SHARDS];
+	std::atomic<int64_t> hits_;
+	std::atomic<int64_t> misses_;
+};
+
+#endif // BLOCK_CACHE_H
@@ -12,9 +12,11 @@
 **********************************************************************/
 #include "carverscanner.h"
 #include <stdio.h>
+#include <string.h>
 #include <ctime>
 #include <fstream>
 #include <filesystem>
+#include <thread>
 
 using namespace std::filesystem;
 
@@ -22,18 +24,93 @@ const int32_t ConstBytesOfSector	= 512;
 const uint64_t ConstRootID			= 0x1000000000000000;
 const uint64_t ConstFileCarveID		= 0x2000000000000000;
 const uint64_t ConstRawMask			= 0x4000000000000000; 
+// approximate bytes charged to the memory budget
+const int64_t ConstPackageCharge		= sizeof(ClusterPackage) + 64;
+const int64_t ConstCandidateCharge		= sizeof(CarvedFileInfo) + 64;
+const int64_t ConstResultCharge			= sizeof(RawFileInfo) + sizeof(Runlist) + 0x10000;
+const int64_t ConstThrottleMicroseconds	= 2000;
+// triage reads and the package marking a jump in device order
+const int32_t ConstPullSize				= 0x100000;
+const int32_t ConstBreakOption			= -2;
+// package read again past a refined bad region, only carves already open take it
+const int32_t ConstFollowOption			= -3;
+// package queued behind the last pulled or written one, the scan completes once it is carved
+const int32_t ConstEndOption			= -4;
+// package handing the files reused from a manifest to the carving thread
+const int32_t ConstReuseOption			= -5;
+const int64_t ConstTriageLogSeconds		= 10;
+// bytes carved past a refined bad region
+const int64_t ConstRefineFollow			= 0x400000;
+// longest single sleep of a throttled caller, an interrupt is noticed in between
+const int64_t ConstThrottleSliceMicroseconds	= 10000;
+// packages between progress lines, 256 MB
+const int64_t ConstProgressPackages		= 0x10000;
+// carve window when a carver has no truncate limit
+const int64_t ConstUnboundedWindow		= 0x4000000;
 
 IScanner* CreateScanner()
 {
 	return (new CarverScanner());
 }
 
+// compiled carvers by configuration, alive while a scanner uses them
+static std::mutex prototype_mutex;
+static std::map<std::string, std::weak_ptr<const CarverPrototypes>> prototype_cache;
+
+std::shared_ptr<const CarverPrototypes> CarverScanner::compileCarvers(const frjson& carvers)
+{
+	std::string key = carvers.dump();
+	std::lock_guard<std::mutex> lock(prototype_mutex);
+	auto iter = prototype_cache.find(key);
+	if (iter != prototype_cache.end())
+	{
+		auto prototypes = iter->second.lock();
+		if (prototypes != nullptr)
+			return prototypes;
+	}
+	
+	auto prototypes = std::make_shared<CarverPrototypes>();
+	for (auto& carver_object : carvers.get<frjson::array_t>())
+	{
+		auto carver = std::make_shared<FileCarver>();
+		if (carver->setCharacteristics(carver_object) < 0)
+			continue;
+		prototypes->emplace_back(carver);
+	}
+	for (auto cached = prototype_cache.begin(); cached != prototype_cache.end();)
+		cached = cached->second.expired() ? prototype_cache.erase(cached) : std::next(cached);
+	prototype_cache[key] = prototypes;
+	return prototypes;
+}
+
 CarverScanner::CarverScanner()
 {
 	stop_ = true;
+	cancelled_ = false;
+	interrupt_ = false;
+	rejections_ = false;
 	pause_ = false;
 	file_count_ = 0;
+	deduplicate_ = false;
+	duplicate_count_ = 0;
+	validation_workers_ = 0;
+	validation_threshold_ = 50;
+	fragment_policy_ = { 1, WD_BLOCK_SIZE, 0, 0 };
+	carve_sequence_ = 0;
+	sector_size_ = ConstBytesOfSector;
+	probe_alignment_ = 0;
 	delegate_ = nullptr;
+	pulling_ = false;
+	triage_.enabled = false;
+	triage_sampled_ = 0;
+	triage_completed_ = false;
+	bad_region_.enabled = false;
+	bad_region_.refine = false;
+	range_offset_ = 0;
+	range_size_ = 0;
+	manifest_setting_.enabled = false;
+	manifest_setting_.extent = ScanManifest::DefaultExtent;
+	carvers_key_ = 0;
 }
 
 CarverScanner::~CarverScanner()
@@ -64,25 +141,85 @@ int32_t CarverScanner::advance()
 		sector_size_ = sector_size_ > 0 ? sector_size_ : ConstBytesOfSector;
 		offset_ = deviceJson.at("StartingOffset").get<int64_t>();
 		device_size_ = deviceJson.at("Size").get<int64_t>();
-		//
-		FileCarver::WD_SECTOR_SIZE = sector_size_;
+		// optional, the device is backed by this image file
+		image_path_ = deviceJson.value("ImagePath", "");
 	}
 	catch (...) 
 	{
 		delegate_->Logger("exception parse device info");
 	}
 	
+	{
+		std::lock_guard<std::mutex> lock(mutex_lock_);
+		for (auto& carver : carver_container_)
+			carver->setGeometry(sector_size_, probe_alignment_ > 0 ? probe_alignment_ : sector_size_);
+		carver_table_.build(carver_container_);
+	}
 	stop_ = false;
-	queue_wait_ = false;
+	cancelled_ = false;
+	interrupt_ = false;
+	rate_limiter_.reset();
+	claimed_extents_.clear();
+	emitted_digests_.clear();
+	block_cache_.clear();
+	header_cache_.clear();
+	bad_regions_.clear();
+	manifest_.reset(device_size_, sector_size_, manifest_setting_.extent, carvers_key_);
+	{
+		std::lock_guard<std::mutex> lock(extent_mutex_);
+		carved_extents_.clear();
+		reused_files_.clear();
+		rejected_ids_.clear();
+	}
+	rejections_ = false;
+	dropped_ids_.clear();
+	duplicate_count_ = 0;
+	
+	if (validation_workers_ > 0)
+	{
+		auto reader = [this](void* buffer, int64_t offset, int32_t count) {
+			return (int32_t)cachedRead(buffer, offset, count);
+		};
+		auto emitter = [this](RawFileInfo* info) {
+			emit(info);
+		};
+		// children held for a rejected candidate go to the root, the carving thread releases its claims
+		auto rejecter = [this](const RawFileInfo* info) {
+			{
+				std::lock_guard<std::mutex> lock(transfer_mutex_);
+				orphan(info->Id);
+			}
+			std::lock_guard<std::mutex> lock(extent_mutex_);
+			rejected_ids_.push_back(info->Id);
+			rejections_ = true;
+		};
+		validation_pool_.setFragments(fragment_policy_);
+		validation_pool_.setRejecter(rejecter);
+		validation_pool_.start(validation_workers_, validation_threshold_, reader, emitter, &memory_budget_);
+	}
 	
 	result_future_ = std::async([this] {
 		return this->run();
 	});
 	
+	if (triage_.enabled || bad_region_.enabled || range_size_ > 0 || manifest_setting_.enabled)
+	{
+		{
+			std::lock_guard<std::mutex> lock(triage_mutex_);
+			triage_hits_.assign(carver_container_.size(), 0);
+			triage_sampled_ = 0;
+			triage_completed_ = false;
+		}
+		pulling_ = true;
+		pull_future_ = std::async([this] {
+			return this->pull();
+		});
+	}
+	
 	return 0;
 }
 
-int32_t CarverScanner::registerCarvers()
+int32_t CarverScanner::registerCarvers(bool persist)
 {
 	std::string strExecutablePath(_pgmptr);
 	path executablePath(strExecutablePath);
@@ -108,20 +245,98 @@ int32_t CarverScanner::registerCarvers()
 			carver_container_.clear();
 			//
 			std::string protocol = config_object_.at("protocol").get<std::string>();
-			frjson::array_t info_array = config_object_.at("carvers").get<frjson::array_t>();
-			for (auto &carver_object : info_array)
+			// optional, header probe granularity in bytes, sector size by default
+			probe_alignment_ = config_object_.value("alignment", 0);
+			// optional, bytes of recently seen blocks kept for read_buffer and special_read_buffer
+			block_cache_.setCapacity(config_object_.value("blockCache", BlockCache::DefaultCapacity));
+			// optional, hashes of blocks without any header kept to skip probing their copies, 0 disables
+			header_cache_.setCapacity(config_object_.value("headerCache", HeaderCache::DefaultCapacity));
+			// optional, suppress carved files whose content digest was already emitted
+			deduplicate_ = config_object_.value("deduplicate", false);
+			// optional, {"workers": 2, "threshold": 50} validates candidates before transfer,
+			// {"fragments": 4, "cluster": 4096, "gapWindow": 262144, "cutWindow": 16384} reassembles the ones failing
+			validation_workers_ = 0;
+			fragment_policy_.max_fragments = 1;
+			auto validation = config_object_.find("validation");
+			if (validation != config_object_.end() && validation->is_object())
 			{
-				auto carver = std::make_shared<FileCarver>();
-				if (carver->setCharacteristics(carver_object) < 0)
-					continue;
+				validation_workers_ = validation->value("workers", 2);
+				validation_threshold_ = validation->value("threshold", 50);
+				fragment_policy_.max_fragments = validation->value("fragments", 1);
+				fragment_policy_.cluster = validation->value("cluster", WD_BLOCK_SIZE);
+				fragment_policy_.gap_window = validation->value("gapWindow", 0x40000ull);
+				fragment_policy_.cut_window = validation->value("cutWindow", 0x4000ull);
+			}
+			// optional, trace events from the start of the scan, switches on the process-wide rings as IC_ProcessTraceIn does
+			if (config_object_.value("trace", false))
+				TraceRing::enable(true);
+			// optional, {"bytesPerSecond": 0, "iops": 0, "latencyTarget": 0} limits device traffic, 0 for unlimited
+			auto rate = config_object_.find("rateLimit");
+			if (rate != config_object_.end() && rate->is_object())
+			{
+				rate_limiter_.setLimit(rate->value("bytesPerSecond", 0ll), rate->value("iops", 0ll));
+				rate_limiter_.setLatencyTarget(rate->value("latencyTarget", 0ll));
+			}
+			// optional, {"stride": 67108864, "sample": 1048576, "continue": false, "ranges": [[offset, size]]}
+			triage_.enabled = false;
+			triage_.ranges.clear();
+			auto triage = config_object_.find("triage");
+			if (triage != config_object_.end() && triage->is_object())
+			{
+				triage_.enabled = true;
+				triage_.stride = triage->value("stride", 0x4000000ll);
+				triage_.sample = triage->value("sample", 0x100000ll);
+				triage_.proceed = triage->value("continue", false);
+				auto ranges = triage->find("ranges");
+				if (ranges != triage->end() && ranges->is_array())
+				{
+					for (auto& range : *ranges)
+						triage_.ranges.emplace_back(range.at(0).get<int64_t>(), range.at(1).get<int64_t>());
+				}
+			}
+			// optional, {"skip": 1048576, "maxSkip": 268435456, "slowRead": 0, "refine": true}
+			bad_region_.enabled = false;
+			auto bad_region = config_object_.find("badRegion");
+			if (bad_region != config_object_.end() && bad_region->is_object())
+			{
+				bad_region_.enabled = true;
+				bad_region_.skip = bad_region->value("skip", BadRegionMap::DefaultSkip);
+				bad_region_.max_skip = bad_region->value("maxSkip", BadRegionMap::DefaultMaxSkip);
+				bad_region_.slow_read = bad_region->value("slowRead", 0ll);
+				bad_region_.refine = bad_region->value("refine", true);
+			}
+			// optional, {"path": "scan.manifest", "previous": "", "extent": 1048576} records a completed pull,
+			// "previous" names the manifest of an earlier pull to carve only what changed since
+			manifest_setting_.enabled = false;
+			auto manifest = config_object_.find("manifest");
+			if (manifest != config_object_.end() && manifest->is_object())
+			{
+				manifest_setting_.enabled = true;
+				manifest_setting_.path = manifest->value("path", "");
+				manifest_setting_.previous = manifest->value("previous", "");
+				manifest_setting_.extent = manifest->value("extent", ScanManifest::DefaultExtent);
+			}
+			std::string identity = config_object_.at("carvers").dump() + std::to_string(probe_alignment_);
+			if (validation != config_object_.end())
+				identity += validation->dump();
+			carvers_key_ = CpuDispatch::kernels().hash64((const uint8_t*)identity.data(), identity.size());
+			// every scanner works on its own copies, signatures and matchers are shared
+			carver_prototypes_ = compileCarvers(config_object_.at("carvers"));
+			for (auto& prototype : *carver_prototypes_)
+			{
+				auto carver = std::make_shared<FileCarver>(*prototype);
+				carver->setGeometry(sector_size_, probe_alignment_ > 0 ? probe_alignment_ : sector_size_);
 				carver_container_.emplace_back(carver);
 			}
 		}
 
 		if (config_setting_.size() > 0)
 		{
-			std::ofstream o(config_path);
-			o << std::setw(4) << config_object_ << std::endl;
+			if (persist)
+			{
+				std::ofstream o(config_path);
+				o << std::setw(4) << config_object_ << std::endl;
+			}
  
 			config_setting_.clear();
 		}
@@ -134,12 +349,38 @@ int32_t CarverScanner::registerCarvers()
 	return carver_container_.size();
 }
 
+int32_t CarverScanner::loadCarvers(const char* config, int32_t size, bool persist)
+{
+	// run() scans with the carvers and settings of its advance, a new set waits for the scan to end
+	if (result_future_.valid() && result_future_.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+	{
+		delegate_->Logger("[%s] carver config rejected while scanning", __FUNCTION__);
+		return -1;
+	}
+	config_setting_.assign(config, size);
+	//
+	return registerCarvers(persist);
+}
+
+int32_t CarverScanner::use_carvers(const char* config, int32_t size)
+{
+	if (delegate_ == nullptr || config == nullptr || size <= 0)
+		return -1;
+	
+	return loadCarvers(config, size, false) > 0 ? 0 : -1;
+}
+
 void CarverScanner::stop()
 {
 	if (stop_)
 		return;
 	
+	cancelled_ = pulling_ || package_safe_queue_.size() > 0;
+	interrupt_ = true;
 	stop_ = true;
+	memory_budget_.wake();
+	if (pull_future_.valid())
+		pull_future_.wait();
 	if (package_safe_queue_.size() == 0)
 	{
 		ClusterPackage package;
@@ -185,11 +426,133 @@ int32_t CarverScanner::inject_control(void* data, int32_t& size, int32_t option)
 		size = config.size();
 		memcpy(data, config.c_str(), size);
 	}
+	else if (option == IC_TriageOut)
+	{
+		std::string report = triageReport();
+		if (size < report.size())
+			return -1;
+		size = report.size();
+		memcpy(data, report.c_str(), size);
+	}
+	else if (option == IC_BadRegionOut)
+	{
+		std::string report = badRegionReport();
+		if (size < report.size())
+			return -1;
+		size = report.size();
+		memcpy(data, report.c_str(), size);
+	}
+	else if (option == IC_TraceOut)
+	{
+		// the dump may be large, the size needed is returned with the error and the dump kept for the retry
+		if (trace_dump_.empty())
+			trace_dump_ = TraceRing::dump();
+		if (size < trace_dump_.size())
+		{
+			size = trace_dump_.size();
+			return -1;
+		}
+		size = trace_dump_.size();
+		memcpy(data, trace_dump_.c_str(), size);
+		trace_dump_.clear();
+	}
+	else if (option == IC_ProcessTraceIn)
+	{
+		// {"enabled": true, "clear": false}, the rings are per thread of the process, every scanner records into them
+		try
+		{
+			frjson trace = frjson::parse(std::string((char*)data, size));
+			if (trace.value("clear", false))
+				TraceRing::clear();
+			TraceRing::enable(trace.value("enabled", TraceRing::enabled()));
+		}
+		catch (std::exception& e)
+		{
+			delegate_->Logger("parse trace exception: %s", e.what());
+			return -1;
+		}
+	}
+	else if (option == IC_RateLimitOut)
+	{
+		std::string report = rateReport();
+		if (size < report.size())
+			return -1;
+		size = report.size();
+		memcpy(data, report.c_str(), size);
+	}
+	else if (option == IC_RateLimitIn)
+	{
+		// runtime change, keys left out keep their value
+		try
+		{
+			frjson rate = frjson::parse(std::string((char*)data, size));
+			rate_limiter_.setLimit(rate.value("bytesPerSecond", rate_limiter_.bytesLimit()), rate.value("iops", rate_limiter_.iopsLimit()));
+			rate_limiter_.setLatencyTarget(rate.value("latencyTarget", rate_limiter_.latencyTarget()));
+		}
+		catch (std::exception& e)
+		{
+			delegate_->Logger("parse rate limit exception: %s", e.what());
+			return -1;
+		}
+	}
+	else if (option == IC_DispatchOut)
+	{
+		std::string report = dispatchReport();
+		if (size < report.size())
+			return -1;
+		size = report.size();
+		memcpy(data, report.c_str(), size);
+	}
+	else if (option == IC_ProcessDispatchIn)
+	{
+		// {"level": "avx2"}, levels above the supported one fall back to it, "auto" restores it,
+		// the kernels are shared by every scanner of the process
+		try
+		{
+			frjson dispatch = frjson::parse(std::string((char*)data, size));
+			SimdLevel level = CpuDispatch::parse(dispatch.value("level", "auto"));
+			if (level == SL_Count)
+			{
+				delegate_->Logger("[%s] unknown simd level %s", __FUNCTION__, dispatch.value("level", "").c_str());
+				return -1;
+			}
+			level = CpuDispatch::select(level);
+			delegate_->Logger("[%s] simd level %s, %s supported", __FUNCTION__, CpuDispatch::name(level), CpuDispatch::name(CpuDispatch::supported()));
+		}
+		catch (std::exception& e)
+		{
+			delegate_->Logger("parse dispatch exception: %s", e.what());
+			return -1;
+		}
+	}
+	else if (option == IC_InputEndIn)
+	{
+		// after the last write_buffer, the blocks written are carved and the scan completes
+		if (stop_ || pulling_)
+			return -1;
+		ClusterPackage package;
+		package.Option = ConstEndOption;
+		package_safe_queue_.push(package);
+	}
+	else if (option == IC_RangeIn)
+	{
+		// {"offset": 0, "size": 0}, set before advance, the scanner pulls only that part of the device, size 0 for all of it
+		try
+		{
+			frjson range = frjson::parse(std::string((char*)data, size));
+			range_offset_ = std::max<int64_t>(0, range.value("offset", 0ll));
+			range_size_ = std::max<int64_t>(0, range.value("size", 0ll));
+		}
+		catch (std::exception& e)
+		{
+			delegate_->Logger("parse range exception: %s", e.what());
+			return -1;
+		}
+	}
 	else if (option == IC_FileCarverIn)
 	{
-		config_setting_.assign((char*)data, size);
-		//
-		registerCarvers();
+		if (loadCarvers((const char*)data, size, true) < 0)
+			return -1;
 	}
 	//
 	return 0;
@@ -199,23 +562,107 @@ void CarverScanner::set_delegate(ITransferDelegate* delegate)
 {
 	delegate_ = delegate;
 	//
+	initialize();
 	registerCarvers();
 	delegate_->Logger("[%s] init completed", __FUNCTION__);
 }
 
 int32_t CarverScanner::read_buffer(char* buffer, int64_t offset, int32_t count)
 {
-	return 0;
+	if (delegate_ == nullptr || buffer == nullptr || offset < 0 || count <= 0)
+		return 0;
+	
+	interrupt_ = false;
+	return (int32_t)cachedRead(buffer, offset, count);
 }
 
 int32_t CarverScanner::save_file(char* filePath, int32_t index, int64_t id, int64_t count, int32_t option)
 {
-	return 0;
+	if (delegate_ == nullptr || filePath == nullptr)
+		return WFC_Error;
+	
+	std::vector<int64_t> ids;
+	if (option == SFO_Batch)
+	{
+		if (id == 0 || count <= 0)
+			return WFC_Error;
+		const int64_t* id_array = (const int64_t*)(intptr_t)id;
+		ids.assign(id_array, id_array + count);
+	}
+	else
+	{
+		ids.push_back(id);
+	}
+	
+	interrupt_ = false;
+	// bulk reads bypass the block cache, they would only evict what previews need
+	BatchExtractor extractor([this](void* buffer, int64_t offset, int32_t count) {
+		return deviceRead(buffer, offset, count);
+	}, sector_size_);
+	// the in kernel copy reads the image past the rate limiter, it is only taken without limits
+	if (image_path_.length() > 0 && !rate_limiter_.limited())
+		extractor.setImagePath(image_path_, offset_);
+	{
+		std::lock_guard<std::mutex> lock(extent_mutex_);
+		for (auto file_id : ids)
+		{
+			auto iter = carved_extents_.find(file_id);
+			if (iter == carved_extents_.end())
+				continue;
+			ExtractItem item;
+			item.id = file_id;
+			item.offset = iter->second.start_blockno * sector_size_;
+			item.size = iter->second.size;
+			item.position = 0;
+			item.path = option == SFO_Batch ? (path(filePath) / iter->second.name).string() : std::string(filePath);
+			// fragments are written at their place in the same file
+			for (auto& fragment : iter->second.fragments)
+			{
+				item.offset = fragment.start_blockno * sector_size_;
+				item.size = fragment.size;
+				extractor.add(item);
+				item.position += fragment.size;
+			}
+			if (iter->second.fragments.empty())
+				extractor.add(item);
+		}
+	}
+	
+	int32_t saved = extractor.run();
+	delegate_->Logger("[%s] saved %d of %lld files with %lld requests", __FUNCTION__, saved, (int64_t)ids.size(), extractor.requests());
+	if (option == SFO_Batch)
+		return saved;
+	return saved == 1 ? WFC_Success : WFC_Error;
 }
 
 int32_t CarverScanner::special_read_buffer(void* buffer, int32_t index, int64_t id, int64_t offset, int64_t count, int32_t option)
 {
-	return 0;
+	if (delegate_ == nullptr || buffer == nullptr || offset < 0 || count <= 0)
+		return 0;
+	
+	interrupt_ = false;
+	CarvedExtent extent;
+	{
+		std::lock_guard<std::mutex> lock(extent_mutex_);
+		auto iter = carved_extents_.find(id);
+		if (iter == carved_extents_.end())
+			return 0;
+		extent = iter->second;
+	}
+	// `offset` is within the carved file
+	if ((uint64_t)offset >= extent.size)
+		return 0;
+	if ((uint64_t)(offset + count) > extent.size)
+		count = extent.size - offset;
+	if (!extent.fragments.empty())
+	{
+		CarvedSource source([this](void* buffer, int64_t offset, int32_t count) {
+			return (int32_t)cachedRead(buffer, offset, count);
+		}, extent.fragments, sector_size_);
+		return source.read(offset, buffer, (int32_t)count);
+	}
+	
+	return (int32_t)cachedRead(buffer, extent.start_blockno * sector_size_ + offset, count);
 }
 
 void CarverScanner::destroy()
@@ -223,45 +670,655 @@ void CarverScanner::destroy()
 	delete this;
 }
 
-int64_t last_block_id = -1;
-
 void CarverScanner::write_buffer(const char* buffer, int64_t offset, int32_t count)
 {
+	if (stop_ || pulling_)
+		return;
+	
+	throttle(count);
+	admit(buffer, offset, count);
+}
+
+void CarverScanner::admit(const char* buffer, int64_t offset, int32_t count, int32_t option)
+{
+	// graduated backpressure, slow down past the soft limit and wait for the scan thread at the hard limit
+	MemoryPressure pressure = memory_budget_.pressure();
+	if (pressure != MP_Normal)
+	{
+		uint64_t waited = TraceRing::now();
+		if (pressure == MP_Soft)
+		{
+			int64_t delay = (int64_t)(memory_budget_.overload() * ConstThrottleMicroseconds);
+			if (delay > 0)
+				std::this_thread::sleep_for(std::chrono::microseconds(delay));
+		}
+		// the scan thread frees room with every package it takes, an empty queue frees nothing more
+		if (pressure == MP_Hard)
+			memory_budget_.waitRoom([this] { return !stop_ && !package_safe_queue_.empty(); });
+		TraceRing::record(TE_Backpressure, offset / sector_size_, 0, waited);
+	}
+	
+	memory_budget_.charge(ConstPackageCharge * ((count + WD_BLOCK_SIZE - 1) / WD_BLOCK_SIZE));
+	enqueue(buffer, offset, count, option);
+}
+
+int32_t CarverScanner::try_write_buffer(const char* buffer, int64_t offset, int32_t count)
+{
+	// nothing is taken from the engine while triage reads the device
+	if (stop_ || pulling_)
+		return WFC_Abort;
+	
+	int64_t charge = ConstPackageCharge * ((count + WD_BLOCK_SIZE - 1) / WD_BLOCK_SIZE);
+	if (!memory_budget_.tryCharge(charge))
+		return WFC_Busy;
+	if (!rate_limiter_.tryAcquire(count))
+	{
+		memory_budget_.release(charge);
+		return WFC_Busy;
+	}
+	
+	enqueue(buffer, offset, count);
+	return WFC_Success;
+}
+
+void CarverScanner::enqueue(const char* buffer, int64_t offset, int32_t count, int32_t option)
+{
+	for (int32_t pos = 0; pos < count; pos += WD_BLOCK_SIZE)
+	{
+		ClusterPackage package;
+		package.Option = option;
+		package.BlockNumber = (offset + pos) / sector_size_;
+		memcpy(package.Buffer, buffer + pos, (count - pos) < WD_BLOCK_SIZE ? (count - pos) : WD_BLOCK_SIZE);
+		
+		// whole aligned blocks go to the cache, previews of files found right now are served from it
+		if (count - pos >= WD_BLOCK_SIZE && (offset + pos) % WD_CACHE_BLOCK_SIZE == 0)
+			block_cache_.insert((offset + pos) / WD_CACHE_BLOCK_SIZE, package.Buffer);
+		
+		package_safe_queue_.push(package);
+	}
+}
+
+int64_t CarverScanner::cachedRead(void* buffer, int64_t offset, int64_t count)
+{
+	char block[WD_CACHE_BLOCK_SIZE];
+	int64_t done = 0;
+	while (done < count)
+	{
+		int64_t position = offset + done;
+		uint64_t blockno = position / WD_CACHE_BLOCK_SIZE;
+		int32_t inner = (int32_t)(position % WD_CACHE_BLOCK_SIZE);
+		int32_t length = (int32_t)std::min<int64_t>(WD_CACHE_BLOCK_SIZE - inner, count - done);
+		if (!block_cache_.lookup(blockno, block))
+		{
+			int64_t block_offset = blockno * WD_CACHE_BLOCK_SIZE;
+			int32_t size = WD_CACHE_BLOCK_SIZE;
+			if (device_size_ > 0 && block_offset + size > device_size_)
+				size = (int32_t)((device_size_ - block_offset + sector_size_ - 1) / sector_size_ * sector_size_);
+			if (size <= 0)
+				break;
+			int32_t result = deviceRead(block, block_offset, size);
+			if (result <= inner)
+				break;
+			if (result >= WD_CACHE_BLOCK_SIZE)
+				block_cache_.insert(blockno, block);
+			length = std::min(length, result - inner);
+		}
+		memcpy((char*)buffer + done, block + inner, length);
+		done += length;
+	}
+	return done;
+}
+
+int32_t CarverScanner::deviceRead(void* buffer, int64_t offset, int32_t count, int64_t* latency)
+{
+	throttle(count);
+	std::lock_guard<std::mutex> lock(read_mutex_);
+	auto started = std::chrono::steady_clock::now();
+	int32_t result = delegate_->Read(buffer, offset, count);
+	int64_t elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started).count();
+	rate_limiter_.observe(elapsed);
+	if (latency != nullptr)
+		*latency = elapsed;
+	return result;
+}
+
+void CarverScanner::throttle(int64_t bytes)
+{
+	int64_t delay = rate_limiter_.reserve(bytes);
+	while (delay > 0 && !interrupt_)
+	{
+		int64_t slice = std::min(delay, ConstThrottleSliceMicroseconds);
+		std::this_thread::sleep_for(std::chrono::microseconds(slice));
+		delay -= slice;
+	}
+}
+
+std::string CarverScanner::rateReport()
+{
+	frjson report;
+	report["bytesPerSecond"] = rate_limiter_.bytesLimit();
+	report["iops"] = rate_limiter_.iopsLimit();
+	report["latencyTarget"] = rate_limiter_.latencyTarget();
+	report["scale"] = rate_limiter_.scale();
+	report["effectiveBytes"] = rate_limiter_.effectiveBytes();
+	report["effectiveIops"] = rate_limiter_.effectiveIops();
+	return report.dump();
+}
+
+std::string CarverScanner::dispatchReport()
+{
+	frjson report;
+	report["level"] = CpuDispatch::name(CpuDispatch::level());
+	report["supported"] = CpuDispatch::name(CpuDispatch::supported());
+	report["sha"] = CpuDispatch::sha();
+	return report.dump();
+}
+
+int32_t CarverScanner::pull()
+{
+	// without triage the whole device is pulled in device order
+	RegionScheduler scheduler;
+	if (triage_.enabled)
+	{
+		delegate_->Logger("[%s] triage every %lld bytes, %lld sampled", __FUNCTION__, triage_.stride, triage_.sample);
+		scheduler.build(device_size_, sector_size_, triage_.stride, triage_.ranges, [this](uint64_t blockno) {
+			return delegate_->Availabled(blockno);
+		});
+	}
+	else
+		scheduler.build(device_size_, sector_size_, device_size_, {}, nullptr);
+	if (range_size_ > 0)
+	{
+		delegate_->Logger("[%s] range %lld + %lld", __FUNCTION__, range_offset_, range_size_);
+		int64_t start = range_offset_ - range_offset_ % sector_size_;
+		scheduler.clip(start, range_offset_ + range_size_ - start);
+	}
+	if (bad_region_.enabled)
+		bad_regions_.setPolicy(bad_region_.skip, bad_region_.max_skip, bad_region_.slow_read, sector_size_);
+	ScanManifest previous;
+	bool incremental = false;
+	if (manifest_setting_.enabled && manifest_setting_.previous.length() > 0)
+	{
+		std::string error;
+		if (triage_.enabled)
+			delegate_->Logger("[%s] previous manifest ignored with triage", __FUNCTION__);
+		else if (previous.load(manifest_setting_.previous, error) != 0)
+			delegate_->Logger("[%s] previous manifest not used: %s", __FUNCTION__, error.c_str());
+		else if (!previous.compatible(manifest_))
+			delegate_->Logger("[%s] previous manifest is of another device or carver configuration", __FUNCTION__);
+		else
+			incremental = true;
+	}
+	
+	std::unique_ptr<char[]> buffer(new char[ConstPullSize]);
+	PullConsumer sample = [this](const char* data, int64_t offset, int32_t count) {
+		sampleHeaders(data, offset, count);
+	};
+	// the stream breaks at skipped areas and where regions are out of device order
+	int64_t expected = 0;
+	PullConsumer carve = [this, &expected, incremental](const char* data, int64_t offset, int32_t count) {
+		if (offset != expected)
+		{
+			ClusterPackage package;
+			package.Option = ConstBreakOption;
+			package_safe_queue_.push(package);
+		}
+		// an incremental pull fingerprints the whole device first
+		if (manifest_setting_.enabled && !incremental)
+			manifest_.digest(data, offset, count);
+		admit(data, offset, count);
+		expected = offset + count;
+	};
+	PullConsumer follow = [this, &expected](const char* data, int64_t offset, int32_t count) {
+		admit(data, offset, count, ConstFollowOption);
+		expected = offset + count;
+	};
+	
+	if (triage_.enabled)
+	{
+		auto logged = std::chrono::steady_clock::now();
+		for (auto& region : scheduler.samples(triage_.sample))
+		{
+			pullRange(buffer.get(), region.offset, region.size, sample);
+			if (stop_)
+				break;
+			
+			auto now = std::chrono::steady_clock::now();
+			if (std::chrono::duration_cast<std::chrono::seconds>(now - logged).count() >= ConstTriageLogSeconds)
+			{
+				delegate_->Logger("[%s] %s %s", __FUNCTION__, triageReport().c_str(), rateReport().c_str());
+				logged = now;
+			}
+		}
+		{
+			std::lock_guard<std::mutex> lock(triage_mutex_);
+			triage_completed_ = !stop_;
+		}
+		delegate_->Logger("[%s] %s", __FUNCTION__, triageReport().c_str());
+	}
+	
+	// full scan, sampled blocks still in the block cache are not read again
+	bool carving = !triage_.enabled || triage_.proceed;
+	if (carving && incremental)
+		pullChanges(buffer.get(), previous, scheduler.regions(), carve, follow);
+	else if (carving)
+	{
+		// regions out of device order break the stream, a carve crossing into a region pulled before or later
+		// is followed past the end by the open carves only
+		auto regions = scheduler.regions();
+		std::unordered_set<int64_t> starts;
+		for (auto& region : regions)
+			starts.insert(region.offset);
+		int64_t window = carveWindow();
+		for (size_t index = 0; index < regions.size() && !stop_; ++index)
+		{
+			int64_t end = regions[index].offset + regions[index].size;
+			pullRange(buffer.get(), regions[index].offset, regions[index].size, carve);
+			bool next = index + 1 < regions.size() && regions[index + 1].offset == end;
+			if (!next && starts.count(end) != 0 && !stop_)
+				pullRange(buffer.get(), end, std::min(end + window, device_size_) - end, follow);
+		}
+	}
+	if (bad_region_.enabled)
+	{
+		// the hard parts last
+		if (bad_region_.refine && !stop_)
+			refineRegions(buffer.get(), carving ? carve : sample, carving ? follow : nullptr);
+		delegate_->Logger("[%s] %s", __FUNCTION__, badRegionReport().c_str());
+	}
+	
+	pulling_ = false;
+	if (!stop_)
+	{
+		ClusterPackage package;
+		package.Option = ConstEndOption;
+		package_safe_queue_.push(package);
+	}
+	return 0;
+}
+
+int32_t CarverScanner::pullRead(char* buffer, int64_t offset, int32_t count, int64_t* latency)
+{
+	if (latency != nullptr)
+		*latency = 0;
+	// offset is sector aligned, whole cached blocks are taken from the cache up to the first miss
+	int32_t done = 0;
+	while (done < count && (offset + done) % WD_CACHE_BLOCK_SIZE == 0 && count - done >= WD_CACHE_BLOCK_SIZE)
+	{
+		if (!block_cache_.lookup((offset + done) / WD_CACHE_BLOCK_SIZE, buffer + done))
+			break;
+		done += WD_CACHE_BLOCK_SIZE;
+	}
+	if (done == count)
+		return done;
+	
+	int32_t size = count - done;
+	if (device_size_ > 0 && offset + done + size > device_size_)
+		size = (int32_t)((device_size_ - offset - done + sector_size_ - 1) / sector_size_ * sector_size_);
+	if (size <= 0)
+		return done;
+	int32_t result = deviceRead(buffer + done, offset + done, size, latency);
+	if (result <= 0)
+		return done;
+	
+	for (int32_t pos = done; pos + WD_CACHE_BLOCK_SIZE <= done + result; pos += WD_CACHE_BLOCK_SIZE)
+	{
+		if ((offset + pos) % WD_CACHE_BLOCK_SIZE == 0)
+			block_cache_.insert((offset + pos) / WD_CACHE_BLOCK_SIZE, buffer + pos);
+	}
+	return done + result;
+}
+
+void CarverScanner::pullRange(char* buffer, int64_t offset, int64_t size, const PullConsumer& consume)
+{
+	int64_t end = offset + size;
+	int64_t pos = offset;
+	while (!stop_)
+	{
+		// areas found bad before are not read again
+		pos = bad_regions_.skipTo(pos);
+		if (pos >= end)
+			break;
+		int32_t count = (int32_t)std::min<int64_t>(ConstPullSize, bad_regions_.readableTo(pos, end) - pos);
+		int64_t latency = 0;
+		int32_t result = pullRead(buffer, pos, count, &latency);
+		if (result >= count && !bad_regions_.slow(latency))
+		{
+			consume(buffer, pos, count);
+			bad_regions_.passed();
+			pos += count;
+			continue;
+		}
+		if (!bad_region_.enabled)
+		{
+			// read again a sector at a time, readable runs are taken and unreadable ones reported
+			int64_t limit = pos + count;
+			int64_t good = pos;
+			int64_t bad = -1;
+			for (; pos < limit && !stop_; pos += sector_size_)
+			{
+				char* sector = buffer + (bad < 0 ? pos - good : 0);
+				if (pullRead(sector, pos, sector_size_) >= sector_size_)
+				{
+					if (bad >= 0)
+					{
+						reportBadRegion(bad, pos - bad);
+						bad = -1;
+						good = pos;
+					}
+					continue;
+				}
+				if (bad < 0)
+				{
+					if (pos > good)
+						consume(buffer, good, (int32_t)(pos - good));
+					bad = pos;
+				}
+			}
+			if (bad >= 0)
+				reportBadRegion(bad, pos - bad);
+			else if (pos > good)
+				consume(buffer, good, (int32_t)(pos - good));
+			continue;
+		}
+		
+		// whole sectors read are kept, the skip starts at the first sector missing or past a slow read
+		int32_t good = result > 0 ? result - result % sector_size_ : 0;
+		if (good > 0)
+		{
+			consume(buffer, pos, good);
+			bad_regions_.passed();
+		}
+		int64_t from = pos + good;
+		pos = bad_regions_.skip(from, end);
+		if (pos > from)
+		{
+			delegate_->Logger("[%s] read at %lld returned %d of %d in %lld us, skipped %lld bytes", __FUNCTION__,
+				from - good, result, count, latency, pos - from);
+			if (!bad_region_.refine)
+				reportBadRegion(from, pos - from);
+		}
+	}
+}
+
+void CarverScanner::refineRegions(char* buffer, const PullConsumer& consume, const PullConsumer& follow)
+{
+	int32_t step = std::max<int32_t>(sector_size_, WD_CACHE_BLOCK_SIZE);
+	for (auto& region : bad_regions_.regions())
+	{
+		if (stop_)
+			break;
+		if (region.refined)
+			continue;
+		
+		// leading edge forward up to the first failing read
+		int64_t end = region.offset + region.size;
+		int64_t front = region.offset;
+		while (front < end && !stop_)
+		{
+			int32_t count = (int32_t)std::min<int64_t>(step, end - front);
+			if (pullRead(buffer, front, count) < count)
+				break;
+			consume(buffer, front, count);
+			front += count;
+		}
+		// trailing edge backward, blocks read go to the block cache and are carved in device order below
+		int64_t back = end;
+		while (front < end && back > front + step && !stop_)
+		{
+			int64_t start = std::max(front + step, back - step);
+			if (pullRead(buffer, start, (int32_t)(back - start)) < back - start)
+				break;
+			back = start;
+		}
+		if (stop_)
+			break;
+		
+		// files starting in recovered data are followed past the region for a while, read again without new headers
+		int64_t until = end;
+		if (follow && (front > region.offset || back < end))
+			until = bad_regions_.readableTo(end, std::min(end + ConstRefineFollow, device_size_));
+		bad_regions_.refine(region.offset, front, back);
+		for (int64_t pos = back; pos < until && !stop_;)
+		{
+			int32_t count = (int32_t)std::min<int64_t>(ConstPullSize, (pos < end ? end : until) - pos);
+			int32_t result = pullRead(buffer, pos, count);
+			if (result <= 0)
+				break;
+			(pos < end ? consume : follow)(buffer, pos, result);
+			pos += result;
+		}
+		if (back > front)
+			reportBadRegion(front, back - front);
+	}
+}
+
+void CarverScanner::pullChanges(char* buffer, const ScanManifest& previous, const std::vector<ScanRegion>& regions, const PullConsumer& carve, const PullConsumer& follow)
+{
+	// every block is read and fingerprinted before anything is carved
+	PullConsumer digest = [this](const char* data, int64_t offset, int32_t count) {
+		manifest_.digest(data, offset, count);
+	};
+	for (auto& region : regions)
+	{
+		if (stop_)
+			return;
+		pullRange(buffer, region.offset, region.size, digest);
+	}
 	if (stop_)
 		return;
+	
+	int64_t window = carveWindow();
+	IncrementalPlan plan = previous.plan(manifest_, window);
+	reuse(previous, plan.reused);
+	
+	// extents carved again within the pulled regions, each followed past its end by open carves only
+	std::vector<std::pair<int64_t, int64_t>> ranges;
+	for (auto& range : plan.carve)
+	{
+		for (auto& region : regions)
+		{
+			int64_t start = std::max(range.first, region.offset);
+			int64_t end = std::min(range.first + range.second, region.offset + region.size);
+			if (start < end)
+				ranges.emplace_back(start, end - start);
+		}
+	}
+	std::sort(ranges.begin(), ranges.end());
+	int64_t carved = 0;
+	for (size_t index = 0; index < ranges.size() && !stop_; ++index)
+	{
+		int64_t end = ranges[index].first + ranges[index].second;
+		pullRange(buffer, ranges[index].first, ranges[index].second, carve);
+		carved += ranges[index].second;
+		int64_t until = std::min(end + window, device_size_);
+		if (index + 1 < ranges.size())
+			until = std::min(until, ranges[index + 1].first);
+		if (until > end && !stop_)
+			pullRange(buffer, end, until - end, follow);
+	}
+	delegate_->Logger("[%s] %lld of %lld extents changed, %lld bytes carved again, %zu of %zu files reused", __FUNCTION__,
+		plan.changed, manifest_.extents(), carved, plan.reused.size(), previous.files().size());
+}
 
+void CarverScanner::reuse(const ScanManifest& previous, const std::vector<size_t>& files)
+{
+	// ids and claims belong to the carving thread, it takes the files before the packages carved again
+	{
+		std::lock_guard<std::mutex> lock(extent_mutex_);
+		for (size_t index : files)
+			reused_files_.push_back(previous.files()[index]);
+	}
 	ClusterPackage package;
-	package.BlockNumber = offset / FileCarver::WD_SECTOR_SIZE;
-	memcpy(package.Buffer, buffer, count);
-	if (last_block_id == -1)
+	package.Option = ConstReuseOption;
+	package_safe_queue_.push(package);
+}
+
+void CarverScanner::adopt()
+{
+	std::vector<ManifestFile> files;
 	{
-		last_block_id = package.BlockNumber;
+		std::lock_guard<std::mutex> lock(extent_mutex_);
+		files.swap(reused_files_);
 	}
-	if (last_block_id != package.BlockNumber)
+	std::unordered_map<uint64_t, uint64_t> ids;
+	for (auto& file : files)
+		ids[file.info.Id] = ConstRawMask + (++carve_sequence_);
+	for (auto& file : files)
 	{
-		last_block_id = package.BlockNumber;
+		auto info = new RawFileInfo(file.info);
+		info->Id = ids[file.info.Id];
+		auto parent = ids.find(file.info.Pid);
+		info->Pid = parent != ids.end() ? parent->second : ConstFileCarveID;
+		info->CreateTime = (int64_t)std::time(nullptr);
+		info->AccessTime = info->CreateTime;
+		info->ModifyTime = info->CreateTime;
+		Runlist** tail = &info->Runlist;
+		for (auto& run : file.runs)
+		{
+			*tail = new Runlist(run);
+			(*tail)->Next = nullptr;
+			claimed_extents_.claim(run.Start, run.Start + run.Number, info->Id);
+			tail = &(*tail)->Next;
+		}
+		if (info->Runlist == nullptr)
+		{
+			delete info;
+			continue;
+		}
+		emit(info);
+	}
+}
+
+int64_t CarverScanner::carveWindow() const
+{
+	int64_t window = 0;
+	for (auto& carver : carver_container_)
+	{
+		int64_t truncate_size = carver->getTruncateSize();
+		if (truncate_size <= 0)
+			return ConstUnboundedWindow;
+		window = std::max(window, truncate_size);
+	}
+	return (window + sector_size_ - 1) / sector_size_ * sector_size_;
+}
+
+void CarverScanner::reportBadRegion(int64_t offset, int64_t size)
+{
+	Runlist run;
+	run.Start = offset / sector_size_;
+	run.Number = (size + sector_size_ - 1) / sector_size_;
+	int64_t len = sizeof(Runlist);
+	std::lock_guard<std::mutex> lock(transfer_mutex_);
+	delegate_->Transfer(NotifyOption::NO_BadCluster, &run, &len);
+}
+
+std::string CarverScanner::badRegionReport()
+{
+	frjson report;
+	report["skipped"] = bad_regions_.skipped();
+	report["recovered"] = bad_regions_.recovered();
+	report["regions"] = frjson::array();
+	for (auto& region : bad_regions_.regions())
+	{
+		frjson item;
+		item["offset"] = region.offset;
+		item["size"] = region.size;
+		item["refined"] = region.refined;
+		report["regions"].push_back(item);
+	}
+	return report.dump();
+}
+
+void CarverScanner::sampleHeaders(const char* buffer, int64_t offset, int32_t count)
+{
+	std::vector<int64_t> hits(carver_container_.size(), 0);
+	for (int32_t pos = 0; pos + WD_BLOCK_SIZE <= count; pos += WD_BLOCK_SIZE)
+	{
+		if (!delegate_->Availabled((offset + pos) / sector_size_))
+			continue;
+		for (size_t index = 0; index < carver_container_.size(); ++index)
+		{
+			for (uint32_t bits = carver_container_[index]->matchHeader(buffer + pos); bits != 0; bits &= bits - 1)
+				++hits[index];
+		}
 	}
-	last_block_id += 8;
-				
-	package_safe_queue_.push(package);
 	
-	if (package_safe_queue_.size() > 1024)
+	std::lock_guard<std::mutex> lock(triage_mutex_);
+	for (size_t index = 0; index < hits.size() && index < triage_hits_.size(); ++index)
+		triage_hits_[index] += hits[index];
+	triage_sampled_ += count;
+}
+
+std::string CarverScanner::triageReport()
+{
+	std::lock_guard<std::mutex> lock(triage_mutex_);
+	frjson report;
+	report["sampled"] = triage_sampled_;
+	report["size"] = device_size_;
+	report["completed"] = triage_completed_;
+	report["types"] = frjson::array();
+	for (size_t index = 0; index < triage_hits_.size() && index < carver_container_.size(); ++index)
 	{
-		queue_wait_ = true;
-		queue_semap_.wait();
+		if (triage_hits_[index] == 0)
+			continue;
+		frjson type;
+		type["extension"] = carver_container_[index]->getExtension();
+		type["hits"] = triage_hits_[index];
+		// headers per GB sampled, and the count projected to the whole device
+		double density = triage_sampled_ > 0 ? (double)triage_hits_[index] * 0x40000000 / triage_sampled_ : 0.0;
+		type["density"] = density;
+		type["estimate"] = (int64_t)(density * device_size_ / 0x40000000);
+		report["types"].push_back(type);
 	}
+	return report.dump();
 }
 
 void CarverScanner::initialize()
 {
-
+	// kernels are chosen by CPUID on first use, inject_control may force a lower level later
+	delegate_->Logger("[%s] simd level %s, %s supported", __FUNCTION__, CpuDispatch::name(CpuDispatch::level()), CpuDispatch::name(CpuDispatch::supported()));
+	std::string strExecutablePath(_pgmptr);
+	path executablePath(strExecutablePath);
+	std::string executableDir = executablePath.parent_path().string();
+	std::string config_path = executableDir + "\\config\\engine.json";
+	//
+	try
+	{
+		frjson engine_object;
+		std::ifstream is(config_path);
+		if (!is.is_open())
+			return;
+		is >> engine_object;
+		// optional, bytes shared by ingest queue, open carves and pending results
+		for (auto& scanner_object : engine_object.at("scanners"))
+		{
+			if (scanner_object.value("format", "") != "carver")
+				continue;
+			memory_budget_.setLimit(scanner_object.value("memoryBudget", MemoryBudget::DefaultLimit));
+		}
+	}
+	catch (std::exception& e)
+	{
+		delegate_->Logger("parse engine config exception: %s", e.what());
+	}
+	delegate_->Logger("[%s] memory budget %lld bytes", __FUNCTION__, memory_budget_.limit());
 }
 
 int32_t CarverScanner::run()
 {
+	bool completed = false;
+	int64_t discarded_count = 0;
+	int64_t package_count = 0;
 	while (!stop_)
 	{
-		auto package = package_safe_queue_.waitPop();
+		auto package = package_safe_queue_.tryPop();
+		if (package == nullptr)
+		{
+			uint64_t waited = TraceRing::now();
+			package = package_safe_queue_.waitPop();
+			TraceRing::record(TE_QueueWait, 0, 0, waited);
+		}
 		if (package != nullptr)
 		{
 			if (package->Option == -1)
@@ -269,59 +1326,171 @@ int32_t CarverScanner::run()
 				stop_ = true;
 				break;
 			}
+			if (package->Option == ConstEndOption)
+			{
+				completed = true;
+				stop_ = true;
+				break;
+			}
+			if (package->Option == ConstBreakOption)
+			{
+				// the next package does not follow the last one, open carves cannot be continued
+				for (size_t index = 0; index < carver_container_.size(); ++index)
+				{
+					int32_t discarded = carver_container_[index]->discardCandidates();
+					memory_budget_.release(ConstCandidateCharge * discarded);
+					discarded_count += discarded;
+					carver_table_.update((uint32_t)index, *carver_container_[index]);
+				}
+				// the marker is not charged, a writer waiting on a queue holding only it checks again
+				memory_budget_.wake();
+				continue;
+			}
+			if (package->Option == ConstReuseOption)
+			{
+				adopt();
+				continue;
+			}
+			memory_budget_.release(ConstPackageCharge);
+			if (rejections_)
+				releaseRejected(package->BlockNumber);
+			if (++package_count % ConstProgressPackages == 0)
+				delegate_->Logger("[%s] sector %llu, %s", __FUNCTION__, package->BlockNumber, rateReport().c_str());
 			
-			if (!delegate_->Availabled(package->BlockNumber))
+			TraceRing::record(TE_Dequeue, package->BlockNumber);
+			bool available = delegate_->Availabled(package->BlockNumber);
+			TraceRing::record(TE_Available, package->BlockNumber, available ? 1 : 0);
+			if (!available)
 				continue;
 			
-			for (auto& carver : carver_container_)
+			uint64_t owner = claimed_extents_.owner(package->BlockNumber);
+			bool continuation = package->Option == ConstFollowOption;
+			// a copy of a block no carver found a header in only goes on with the open carves
+			uint64_t block_hash = 0;
+			bool headerless = false;
+			if (!continuation && header_cache_.enabled())
+			{
+				block_hash = CpuDispatch::kernels().hash64((const uint8_t*)package->Buffer, WD_BLOCK_SIZE);
+				headerless = header_cache_.lookup(block_hash);
+			}
+			BlockSpan span = { package->Buffer, 1, package->BlockNumber, false, continuation || headerless };
+			if (headerless)
+				carver_table_.selectOpen(selected_carvers_);
+			else
+				carver_table_.select(package->Buffer, owner != 0, selected_carvers_);
+			// the block is known headerless once every selected carver probed it without a match
+			bool probed = !continuation && !headerless && header_cache_.enabled();
+			for (uint32_t index : selected_carvers_)
 			{
 				if (stop_)
 					break;
 				
-				if (carver->getCarverStatus() == CS_Init)
-					carver->analyzeHeader(package);
-				
-				if (carver->getCarverStatus() == CS_Header)
-					carver->analyzeBody(package);
-				
-				if (carver->getCarverStatus() >= CS_Header)
-					carver->analyzeFooter(package);
-				
-				carver->truncate(package);
-				
-				if (carver->getCarverStatus() >= CS_Footer)
+				auto& carver = carver_container_[index];
+				if (span.continuation && carver->getCandidates().empty())
+					continue;
+				span.claimed = owner != 0;
+				probed = probed && !span.claimed && carver->acceptsHeader();
+				int64_t header_matches = carver->getHeaderMatches();
+				carve_events_.clear();
+				int32_t event_count = carver->analyzeBlocks(span, carve_events_);
+				carver_table_.update(index, *carver);
+				probed = probed && carver->getHeaderMatches() == header_matches;
+				if (TraceRing::enabled())
 				{
-					serialize(carver);
-					carver->initialize();
-					break;
+					// CE_Header, CE_Footer and CE_Truncate in the order of their trace types
+					for (auto& event : carve_events_)
+						TraceRing::record((TraceEventType)(TE_Header + event.type), event.blockno, index);
 				}
+				if (event_count == 0 && carver->getCandidates().empty())
+					continue;
+				
+				collect(carver, index, package->Buffer, package->BlockNumber, owner);
+				owner = claimed_extents_.owner(package->BlockNumber);
 			}
-		}
-		
-		if (queue_wait_ && package_safe_queue_.size() < 1024)
-		{
-			queue_wait_ = false;
-			queue_semap_.signal();
+			if (probed && owner == 0 && !stop_)
+				header_cache_.insert(block_hash);
 		}
 		
 		if (pause_)
 			semap_.wait();
 	}
 	
-	package_safe_queue_.clear();
-	if (queue_wait_)
-		queue_semap_.signal();
+	// candidates rejected after the last package release their claims too
+	while (completed && !cancelled_ && (validation_pool_.pending() > 0 || rejections_))
+	{
+		if (rejections_)
+			releaseRejected(UINT64_MAX);
+		else
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	
+	// markers left behind were never charged
+	int64_t queued = 0;
+	for (auto package = package_safe_queue_.tryPop(); package != nullptr; package = package_safe_queue_.tryPop())
+	{
+		if (package->Option >= 0 || package->Option == ConstFollowOption)
+			++queued;
+	}
+	memory_budget_.release(ConstPackageCharge * queued);
+	
+	int64_t dropped_count = 0;
+	for (auto& carver : carver_container_)
+	{
+		dropped_count += carver->getDroppedCount();
+		memory_budget_.release(ConstCandidateCharge * carver->getCandidates().size());
+		carver->initialize();
+	}
+	if (dropped_count > 0)
+		delegate_->Logger("[%s] ignored %lld headers with every candidate slot busy", __FUNCTION__, dropped_count);
+	if (discarded_count > 0)
+		delegate_->Logger("[%s] discarded %lld candidates open across a region jump", __FUNCTION__, discarded_count);
+	
+	validation_pool_.shutdown(!cancelled_);
+	{
+		// parents never transferred, their children go to the root
+		std::lock_guard<std::mutex> lock(transfer_mutex_);
+		while (!held_children_.empty())
+			orphan(held_children_.begin()->first);
+	}
+	if (block_cache_.hits() > 0)
+		delegate_->Logger("[%s] block cache %lld hits, %lld misses", __FUNCTION__, block_cache_.hits(), block_cache_.misses());
+	if (header_cache_.hits() + header_cache_.misses() > 0)
+		delegate_->Logger("[%s] header cache %lld hits, %lld misses, %.1f%% of blocks skipped header probing", __FUNCTION__, header_cache_.hits(), header_cache_.misses(),
+			100.0 * header_cache_.hits() / (header_cache_.hits() + header_cache_.misses()));
+	if (validation_pool_.rejected() > 0)
+		delegate_->Logger("[%s] rejected %lld candidates by validation", __FUNCTION__, validation_pool_.rejected());
+	if (validation_pool_.reassembled() > 0)
+		delegate_->Logger("[%s] reassembled %lld fragmented files", __FUNCTION__, validation_pool_.reassembled());
+	if (duplicate_count_ > 0)
+		delegate_->Logger("[%s] suppressed %lld duplicate files", __FUNCTION__, duplicate_count_);
 	
+	if (completed && manifest_setting_.enabled && manifest_setting_.path.length() > 0)
+	{
+		std::string error;
+		if (manifest_.save(manifest_setting_.path, error) == 0)
+			delegate_->Logger("[%s] manifest of %lld extents and %zu files written to %s", __FUNCTION__, manifest_.extents(), manifest_.files().size(), manifest_setting_.path.c_str());
+		else
+			delegate_->Logger("[%s] manifest not written: %s", __FUNCTION__, error.c_str());
+	}
+	// everything pulled is carved and validated
+	if (completed)
+	{
+		int64_t size = 0;
+		delegate_->Transfer(NotifyOption::NO_Completed, nullptr, &size);
+	}
 	return 0;
 }
 
-int32_t CarverScanner::serialize(std::shared_ptr<FileCarver> carver)
+int32_t CarverScanner::serialize(std::shared_ptr<FileCarver> carver, std::shared_ptr<CarvedFileInfo> fileInfo)
 {
 	if (delegate_ == nullptr)
 		return -1;
 	
 	std::string fileName;
-	auto fileInfo = carver->getCarvedFileInfo();
+	auto& digest = fileInfo->digest;
+	digest.finalize();
+	if (digest.length() != fileInfo->size)
+		digest.invalidate();
 	if (fileInfo->base_name.length() > 0)
 	{
 		fileName = fileInfo->base_name + "." + carver->getExtension();
@@ -332,9 +1501,9 @@ int32_t CarverScanner::serialize(std::shared_ptr<FileCarver> carver)
 		fileName = strUuid.substr(file_count_++%16, 16) + "." + carver->getExtension();
 	}
 	
-	auto info = new BaseInfo();
-	info->Id = ConstRawMask + file_count_;
-	info->Pid = ConstFileCarveID;
+	auto info = new RawFileInfo();
+	info->Id = fileInfo->id;
+	info->Pid = fileInfo->parent_id != 0 ? fileInfo->parent_id : ConstFileCarveID;
 	info->Did = carver->getDeveloperId();
 	info->Size = fileInfo->size;
 	info->Attribute = 32765;
@@ -351,9 +1520,250 @@ int32_t CarverScanner::serialize(std::shared_ptr<FileCarver> carver)
 	info->Runlist = rl;
 	info->RunlistCategory = RLC_General;
 	memcpy(info->Name, fileName.c_str(), fileName.size() > 256 ? 256 : fileName.size());
+	info->DigestFlag = digest.flags();
+	info->Crc32 = digest.crc32();
+	memcpy(info->Sha256, digest.sha256(), 32);
+	
+	auto validator = carver->getValidator();
+	if (validation_pool_.running() && validator != nullptr)
+	{
+		ValidationTask task;
+		task.info = info;
+		task.sector_size = sector_size_;
+		task.validator = validator;
+		task.charge = ConstResultCharge;
+		memory_budget_.charge(task.charge);
+		validation_pool_.push(task);
+		return 0;
+	}
+	
+	return emit(info);
+}
+
+int32_t CarverScanner::emit(RawFileInfo* info)
+{
+	std::lock_guard<std::mutex> lock(transfer_mutex_);
+	return transfer(info);
+}
+
+int32_t CarverScanner::transfer(RawFileInfo* info)
+{
+	// a child waits for its parent to be transferred, it goes to the root once the parent is dropped
+	if ((info->Pid & ConstRawMask) != 0)
+	{
+		bool transferred = false;
+		{
+			std::lock_guard<std::mutex> lock(extent_mutex_);
+			transferred = carved_extents_.count(info->Pid) != 0;
+		}
+		if (!transferred && dropped_ids_.count(info->Pid) == 0)
+		{
+			held_children_[info->Pid].push_back(info);
+			return 0;
+		}
+		if (!transferred)
+			info->Pid = ConstFileCarveID;
+	}
+	// duplicates are recorded too, the copy kept may change in a later scan
+	if (manifest_setting_.enabled)
+		manifest_.record(info);
+	if (deduplicate_ && info->DigestFlag != DF_None)
+	{
+		// strongest digest available, keyed together with the size
+		std::string key((char*)&info->Size, sizeof(info->Size));
+		if (info->DigestFlag & DF_Sha256)
+			key.append((const char*)info->Sha256, 32);
+		else
+			key.append((const char*)&info->Crc32, sizeof(info->Crc32));
+		if (!emitted_digests_.insert(key).second)
+		{
+			++duplicate_count_;
+			uint64_t id = info->Id;
+			FragmentAssembler::release(info->Runlist);
+			delete info;
+			orphan(id);
+			return 1;
+		}
+	}
 	
-	int64_t len = sizeof(BaseInfo);
+	{
+		std::lock_guard<std::mutex> lock(extent_mutex_);
+		CarvedExtent extent = {
+			info->Runlist->Start,
+			info->Size,
+			std::string((const char*)info->Name, strnlen((const char*)info->Name, sizeof(info->Name))),
+			info->Runlist->Next != nullptr ? FragmentAssembler::fragments(info->Runlist, info->Size) : std::vector<CarvedFragment>()
+		};
+		carved_extents_[info->Id] = extent;
+	}
+	uint64_t id = info->Id;
+	int64_t len = sizeof(RawFileInfo);
 	delegate_->Transfer(NotifyOption::NO_FileInfo, info, &len);
 	
+	auto held = held_children_.find(id);
+	if (held != held_children_.end())
+	{
+		auto children = std::move(held->second);
+		held_children_.erase(held);
+		for (auto child : children)
+			transfer(child);
+	}
 	return 0;
 }
+
+void CarverScanner::orphan(uint64_t id)
+{
+	dropped_ids_.insert(id);
+	auto held = held_children_.find(id);
+	if (held == held_children_.end())
+		return;
+	auto children = std::move(held->second);
+	held_children_.erase(held);
+	for (auto child : children)
+	{
+		child->Pid = ConstFileCarveID;
+		transfer(child);
+	}
+}
+
+void CarverScanner::collect(std::shared_ptr<FileCarver>& carver, uint32_t index, const char* buffer, uint64_t blockno, uint64_t owner)
+{
+	// ids follow header order, also for candidates opened and closed within the block
+	auto closed = carver->takeCompleted();
+	uint64_t parent = carver->getClaimPolicy() == CP_Embed ? owner : 0;
+	for (auto& event : carve_events_)
+	{
+		if (event.type != CE_Header)
+			continue;
+		auto match = [&event](const std::shared_ptr<CarvedFileInfo>& fileInfo) {
+			return fileInfo->id == 0 && fileInfo->start_blockno == event.start_blockno;
+		};
+		auto& candidates = carver->getCandidates();
+		auto iter = std::find_if(candidates.begin(), candidates.end(), match);
+		if (iter != candidates.end())
+			claimExtent(carver, *iter, parent);
+		else if ((iter = std::find_if(closed.begin(), closed.end(), match)) != closed.end())
+			claimExtent(carver, *iter, parent);
+	}
+	
+	for (auto& fileInfo : carver->getCandidates())
+		digestPackage(fileInfo, buffer, blockno, false);
+	
+	for (auto& fileInfo : closed)
+	{
+		memory_budget_.release(ConstCandidateCharge);
+		digestPackage(fileInfo, buffer, blockno, true);
+		claimed_extents_.claim(fileInfo->start_blockno, fileInfo->start_blockno + fileInfo->block_count, fileInfo->id);
+		uint64_t serialized = TraceRing::now();
+		serialize(carver, fileInfo);
+		TraceRing::record(TE_Serialize, fileInfo->id, index, serialized);
+	}
+}
+
+void CarverScanner::releaseRejected(uint64_t position)
+{
+	std::vector<uint64_t> ids;
+	{
+		std::lock_guard<std::mutex> lock(extent_mutex_);
+		ids.swap(rejected_ids_);
+		rejections_ = false;
+	}
+	for (uint64_t id : ids)
+	{
+		for (auto& extent : claimed_extents_.release(id))
+		{
+			if (extent.start < position)
+				recarve(extent.start, std::min(extent.end, position));
+		}
+	}
+}
+
+void CarverScanner::recarve(uint64_t start, uint64_t end)
+{
+	// copies of the carvers that skipped the claim, the live ones are further on
+	std::vector<std::pair<uint32_t, std::shared_ptr<FileCarver>>> carvers;
+	for (size_t index = 0; index < carver_container_.size(); ++index)
+	{
+		if (carver_container_[index]->getClaimPolicy() != CP_Skip)
+			continue;
+		auto carver = std::make_shared<FileCarver>(*carver_container_[index]);
+		carver->initialize();
+		carvers.emplace_back((uint32_t)index, carver);
+	}
+	if (carvers.empty())
+		return;
+	
+	// from the block after the rejected header, headers are taken before `end` and carves go on past it
+	int64_t offset = (int64_t)start * sector_size_ / WD_BLOCK_SIZE * WD_BLOCK_SIZE + WD_BLOCK_SIZE;
+	int64_t limit = (int64_t)end * sector_size_;
+	int64_t until = std::min(limit + carveWindow(), device_size_);
+	std::unique_ptr<char[]> buffer(new char[WD_BLOCK_SIZE]);
+	auto open = [&carvers] {
+		return std::any_of(carvers.begin(), carvers.end(), [](const std::pair<uint32_t, std::shared_ptr<FileCarver>>& entry) {
+			return !entry.second->getCandidates().empty();
+		});
+	};
+	for (; offset < until && !cancelled_; offset += WD_BLOCK_SIZE)
+	{
+		bool opening = offset < limit;
+		if (!opening && !open())
+			break;
+		int64_t count = cachedRead(buffer.get(), offset, WD_BLOCK_SIZE);
+		if (count <= 0)
+			break;
+		if (count < WD_BLOCK_SIZE)
+			memset(buffer.get() + count, 0, (size_t)(WD_BLOCK_SIZE - count));
+		uint64_t blockno = offset / sector_size_;
+		uint64_t owner = claimed_extents_.owner(blockno);
+		for (auto& entry : carvers)
+		{
+			BlockSpan span = { buffer.get(), 1, blockno, owner != 0, !opening };
+			carve_events_.clear();
+			if (entry.second->analyzeBlocks(span, carve_events_) == 0 && entry.second->getCandidates().empty())
+				continue;
+			collect(entry.second, entry.first, buffer.get(), blockno, owner);
+			owner = claimed_extents_.owner(blockno);
+		}
+	}
+	for (auto& entry : carvers)
+		memory_budget_.release(ConstCandidateCharge * entry.second->getCandidates().size());
+}
+
+void CarverScanner::claimExtent(std::shared_ptr<FileCarver> carver, std::shared_ptr<CarvedFileInfo> fileInfo, uint64_t parent)
+{
+	fileInfo->id = ConstRawMask + (++carve_sequence_);
+	memory_budget_.charge(ConstCandidateCharge);
+	fileInfo->parent_id = parent;
+	// an open carve only claims as far as its truncate limit, unbounded carves claim once closed
+	int64_t truncate_size = carver->getTruncateSize();
+	if (truncate_size <= 0)
+		return;
+	
+	uint64_t block_count = truncate_size / sector_size_ + 1;
+	claimed_extents_.claim(fileInfo->start_blockno, fileInfo->start_blockno + block_count, fileInfo->id);
+}
+
+void CarverScanner::digestPackage(std::shared_ptr<CarvedFileInfo>& fileInfo, const char* buffer, uint64_t blockno, bool closing)
+{
+	auto& digest = fileInfo->digest;
+	if (digest.flags() == DF_None)
+		return;
+	
+	// content skipped by the engine leaves a hole, the digest would not match the extent
+	if (blockno != fileInfo->next_blockno)
+	{
+		digest.invalidate();
+		return;
+	}
+	fileInfo->next_blockno = blockno + WD_BLOCK_SIZE / sector_size_;
+	
+	int64_t file_begin = (int64_t)fileInfo->start_blockno * sector_size_;
+	int64_t package_begin = (int64_t)blockno * sector_size_;
+	int64_t begin = file_begin > package_begin ? file_begin - package_begin : 0;
+	int64_t end = WD_BLOCK_SIZE;
+	if (closing && file_begin + (int64_t)fileInfo->size - package_begin < end)
+		end = file_begin + (int64_t)fileInfo->size - package_begin;
+	
+	if (end > begin)
+		digest.update(buffer + begin, (size_t)(end - begin));
+}
@@ -14,12 +14,73 @@
 #define CARVER_SCANNER_H
 
 #include <future>
+#include <atomic>
+#include <unordered_set>
+#include <unordered_map>
+#include <map>
 #include "filecarver.h"
+#include "carvertable.h"
+#include "extentmap.h"
+#include "validationpool.h"
+#include "memorybudget.h"
+#include "blockcache.h"
+#include "headercache.h"
+#include "batchextractor.h"
+#include "regionscheduler.h"
+#include "ratelimiter.h"
+#include "tracering.h"
+#include "badregion.h"
+#include "scanmanifest.h"
 #include "../../include/iscanner.h"
 #include "../../third_party/safequeue.h"
 
 class FileCarver;
 
+// read-only compiled carvers, shared by scanners with the same configuration
+using CarverPrototypes = std::vector<std::shared_ptr<const FileCarver>>;
+
+// device extent of a transferred file, by file id
+typedef struct _CarvedExtent
+{
+	uint64_t	start_blockno;
+	uint64_t	size;
+	std::string	name;
+	std::vector<CarvedFragment> fragments;	/* reassembled files, empty when contiguous */
+}CarvedExtent, *PCarvedExtent;
+
+// optional "triage" setting, the scanner reads `sample` bytes of every `stride` itself
+typedef struct _TriageSetting
+{
+	bool		enabled;
+	int64_t		stride;
+	int64_t		sample;
+	bool		proceed;	/* full scan of the regions in priority order after sampling */
+	std::vector<std::pair<int64_t, int64_t>> ranges;
+}TriageSetting, *PTriageSetting;
+
+// optional "badRegion" setting, the scanner pulls the device itself and skips past failing areas
+typedef struct _BadRegionSetting
+{
+	bool		enabled;
+	int64_t		skip;		/* bytes skipped after the first bad read, doubled on every further one */
+	int64_t		max_skip;
+	int64_t		slow_read;	/* microseconds, a slower read counts as bad, 0 for never */
+	bool		refine;		/* read the edges of skipped areas back once the rest is done */
+}BadRegionSetting, *PBadRegionSetting;
+
+// optional "manifest" setting, the scanner pulls the device itself and writes extent fingerprints and
+// files to `path` once done, a manifest of an earlier pull of the same device makes the pull incremental
+typedef struct _ManifestSetting
+{
+	bool		enabled;
+	std::string	path;
+	std::string	previous;
+	int64_t		extent;		/* bytes per fingerprint */
+}ManifestSetting, *PManifestSetting;
+
+// takes data pulled from the device, sampled or carved
+using PullConsumer = std::function<void(const char* buffer, int64_t offset, int32_t count)>;
+
 class CarverScanner : public IScanner
 {
 public:
@@ -54,38 +115,166 @@ public:
 
 	virtual void destroy();
 
+	// not part of IScanner, write_buffer returning WFC_Busy instead of waiting over the memory budget
+	int32_t try_write_buffer(const char* buffer, int64_t offset, int32_t count = 4096);
+
+	// not part of IScanner, IC_FileCarverIn for this scanner only, filecarver.json is left as it is,
+	// returns -1 while scanning or without any carver
+	int32_t use_carvers(const char* config, int32_t size);
 
 protected:
 	virtual int32_t run();
 
 	void initialize();
 
-	int32_t registerCarvers();
+	void admit(const char* buffer, int64_t offset, int32_t count, int32_t option = 0);
+
+	void enqueue(const char* buffer, int64_t offset, int32_t count, int32_t option = 0);
+
+	int32_t pull();
+
+	int32_t pullRead(char* buffer, int64_t offset, int32_t count, int64_t* latency = nullptr);
+
+	void pullRange(char* buffer, int64_t offset, int64_t size, const PullConsumer& consume);
+
+	void refineRegions(char* buffer, const PullConsumer& consume, const PullConsumer& follow);
+
+	// fingerprints `regions`, then carves what changed since `previous` and transfers the files left as they were
+	void pullChanges(char* buffer, const ScanManifest& previous, const std::vector<ScanRegion>& regions, const PullConsumer& carve, const PullConsumer& follow);
+
+	// queues `files` of `previous` for the carving thread
+	void reuse(const ScanManifest& previous, const std::vector<size_t>& files);
+
+	// on the carving thread, the queued files transferred with new ids, their extents claimed
+	void adopt();
+
+	// bytes a carve may run past the block its header is in
+	int64_t carveWindow() const;
+
+	void reportBadRegion(int64_t offset, int64_t size);
+
+	std::string badRegionReport();
+
+	void sampleHeaders(const char* buffer, int64_t offset, int32_t count);
+
+	std::string triageReport();
+
+	int64_t cachedRead(void* buffer, int64_t offset, int64_t count);
+
+	int32_t deviceRead(void* buffer, int64_t offset, int32_t count, int64_t* latency = nullptr);
+
+	void throttle(int64_t bytes);
+
+	std::string rateReport();
+
+	std::string dispatchReport();
+
+	// `persist` writes an injected config over filecarver.json
+	int32_t registerCarvers(bool persist = true);
+
+	// carvers of `config` from the next advance, -1 while scanning
+	int32_t loadCarvers(const char* config, int32_t size, bool persist);
+
+	static std::shared_ptr<const CarverPrototypes> compileCarvers(const frjson& carvers);
+
+	int32_t serialize(std::shared_ptr<FileCarver> carver, std::shared_ptr<CarvedFileInfo> fileInfo);
+
+	int32_t emit(RawFileInfo* info);
+
+	// emit with `transfer_mutex_` held, a child of a parent not transferred yet is held back
+	int32_t transfer(RawFileInfo* info);
+
+	// with `transfer_mutex_` held, `id` is never transferred, the children held for it go to the root
+	void orphan(uint64_t id);
+
+	void claimExtent(std::shared_ptr<FileCarver> carver, std::shared_ptr<CarvedFileInfo> fileInfo, uint64_t parent);
+
+	// claims and serializes what `carver` opened and closed in the block just analyzed
+	void collect(std::shared_ptr<FileCarver>& carver, uint32_t index, const char* buffer, uint64_t blockno, uint64_t owner);
+
+	// claims of rejected candidates released, the blocks before `position` they hid are carved again
+	void releaseRejected(uint64_t position);
+
+	// sectors [start, end) carved again by copies of the skipping carvers, carves opened go on past `end`
+	void recarve(uint64_t start, uint64_t end);
 
-	int32_t serialize(std::shared_ptr<FileCarver> carver);
+	void digestPackage(std::shared_ptr<CarvedFileInfo>& fileInfo, const char* buffer, uint64_t blockno, bool closing);
 
 private:
-	bool stop_;
-	bool pause_;
+	std::atomic<bool> stop_;
+	// stop came with data left to carve, results not validated yet are dropped
+	std::atomic<bool> cancelled_;
+	// set by stop() only, ends the throttle sleep of the operation running, every operation clears it
+	std::atomic<bool> interrupt_;
+	std::atomic<bool> pause_;
 	std::string info_;
+	std::string image_path_;
 	int64_t offset_;
 	int32_t disk_index_;
 	int32_t sector_size_;
+	int32_t probe_alignment_;
 	int64_t device_size_;
 	int64_t file_count_;
+	bool deduplicate_;
+	int64_t duplicate_count_;
+	int32_t validation_workers_;
+	int32_t validation_threshold_;
+	FragmentPolicy fragment_policy_;
+	uint64_t carve_sequence_;
 	ma::Semaphore semap_;
-	bool queue_wait_;
-	ma::Semaphore queue_semap_;
+	MemoryBudget memory_budget_;
+	RateLimiter rate_limiter_;
 	//
 	frjson config_object_;
 	//
 	ITransferDelegate* delegate_;
 	//
 	std::mutex mutex_lock_;
+	std::mutex read_mutex_;
+	std::mutex transfer_mutex_;
+	std::mutex extent_mutex_;
 	std::string config_setting_;
+	std::string trace_dump_;
 	std::vector<std::shared_ptr<FileCarver> > carver_container_;
+	std::shared_ptr<const CarverPrototypes> carver_prototypes_;
+	ExtentMap claimed_extents_;
+	std::vector<CarveEvent> carve_events_;
+	// configuration stays in `carver_container_`, the block loop scans the table
+	CarverTable carver_table_;
+	std::vector<uint32_t> selected_carvers_;
+	std::unordered_set<std::string> emitted_digests_;
+	ValidationPool validation_pool_;
+	BlockCache block_cache_;
+	// hashes of blocks no carver found a header in, repeated copies only go to open carves
+	HeaderCache header_cache_;
+	std::unordered_map<uint64_t, CarvedExtent> carved_extents_;
+	// candidates rejected by validation, under `extent_mutex_` until the carving thread releases their claims
+	std::vector<uint64_t> rejected_ids_;
+	std::atomic<bool> rejections_;
+	// under `transfer_mutex_`, children waiting for their parent and the ids never transferred
+	std::unordered_map<uint64_t, std::vector<RawFileInfo*>> held_children_;
+	std::unordered_set<uint64_t> dropped_ids_;
 	//
 	std::future<int32_t> result_future_;
+	// triage pulls from the device, data written by the engine meanwhile is ignored
+	TriageSetting triage_;
+	std::atomic<bool> pulling_;
+	std::future<int32_t> pull_future_;
+	std::mutex triage_mutex_;
+	std::vector<int64_t> triage_hits_;
+	int64_t triage_sampled_;
+	bool triage_completed_;
+	BadRegionSetting bad_region_;
+	// part of the device pulled, the whole one when `range_size_` is 0
+	int64_t range_offset_;
+	int64_t range_size_;
+	BadRegionMap bad_regions_;
+	ManifestSetting manifest_setting_;
+	ScanManifest manifest_;
+	// files of the previous manifest waiting for the carving thread, under `extent_mutex_`
+	std::vector<ManifestFile> reused_files_;
+	// carvers and settings the results depend on, a manifest of other ones is not reused
+	uint64_t carvers_key_;
 	ma::Safequeue<ClusterPackage> package_safe_queue_;
 };
 
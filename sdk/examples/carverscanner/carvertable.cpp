@@ -0,0 +1,182 @@
+/**********************************************************************
+*
+* Copyright (C)2015-2022 Maxwell Analytica. All rights reserved.
+*
+* @file carvertable.cpp
+* @brief
+* @details
+* @author Maxwell
+* @version 1.0.0
+* @date 2026-10-19 19:14:37.652
+*
+**********************************************************************/
+#include "carvertable.h"
+
+CarverTable::CarverTable()
+{
+	pattern_combined_ = false;
+	pattern_lanes_ = 0;
+	pattern_alignment_ = 0;
+}
+
+CarverTable::~CarverTable()
+{
+
+}
+
+void CarverTable::build(const std::vector<std::shared_ptr<FileCarver>>& carvers)
+{
+	const size_t count = carvers.size();
+	logic_.resize(count);
+	skip_claimed_.resize(count);
+	lanes_.resize(count);
+	alignment_.resize(count);
+	open_count_.resize(count);
+	signature_begin_.resize(count);
+	signature_end_.resize(count);
+	signature_value_.clear();
+	signature_mask_.clear();
+	signature_offset_.clear();
+	signature_size_.clear();
+	pattern_.assign(count, 0);
+	pattern_hits_.assign(count, 0);
+	pattern_combined_ = false;
+
+	std::vector<PatternSource> patterns;
+	bool same_geometry = true;
+	for (size_t index = 0; index < count; ++index)
+	{
+		auto& carver = carvers[index];
+		logic_[index] = (uint8_t)carver->getHeaderLogic();
+		skip_claimed_[index] = carver->getClaimPolicy() == CP_Skip;
+		lanes_[index] = (uint8_t)carver->getProbeLanes();
+		alignment_[index] = carver->getProbeAlignment();
+		signature_begin_[index] = (uint32_t)signature_value_.size();
+		for (auto& probe : carver->getHeaderProbes())
+		{
+			// the 8 byte prefix, a longer signature is confirmed by the carver
+			signature_value_.push_back(probe.value);
+			signature_mask_.push_back(probe.mask);
+			signature_offset_.push_back(probe.offset);
+			signature_size_.push_back(probe.size < sizeof(uint64_t) ? probe.size : sizeof(uint64_t));
+		}
+		signature_end_[index] = (uint32_t)signature_value_.size();
+		update((uint32_t)index, *carver);
+
+		auto& pattern = carver->getHeaderPattern();
+		if (pattern.text.empty())
+			continue;
+		pattern_[index] = 1;
+		patterns.push_back({ pattern.text, pattern.offset, (uint32_t)index });
+		if (patterns.size() == 1)
+		{
+			pattern_lanes_ = lanes_[index];
+			pattern_alignment_ = alignment_[index];
+		}
+		same_geometry = same_geometry && pattern_lanes_ == lanes_[index] && pattern_alignment_ == alignment_[index];
+	}
+
+	// without the combined automaton every pattern carver confirms its own header
+	std::string error;
+	if (!patterns.empty() && same_geometry)
+		pattern_combined_ = pattern_dfa_.compile(patterns, error) == 0;
+}
+
+void CarverTable::update(uint32_t index, FileCarver& carver)
+{
+	open_count_[index] = (uint32_t)carver.getCandidates().size();
+}
+
+size_t CarverTable::size() const
+{
+	return logic_.size();
+}
+
+uint32_t CarverTable::matchSignature(const char* buffer, uint32_t signature, uint32_t lanes, uint32_t alignment) const
+{
+	const uint64_t value = signature_value_[signature];
+	const uint64_t mask = signature_mask_[signature];
+	const uint32_t offset = signature_offset_[signature];
+	const uint32_t size = signature_size_[signature];
+	uint32_t matched = 0;
+	for (uint32_t lane = 0; lane < lanes; ++lane)
+	{
+		uint32_t pos = lane * alignment + offset;
+		uint64_t word = 0;
+		if (pos + sizeof(uint64_t) <= WD_BLOCK_SIZE)
+			memcpy(&word, buffer + pos, sizeof(uint64_t));
+		else if (pos + size <= WD_BLOCK_SIZE)
+			memcpy(&word, buffer + pos, WD_BLOCK_SIZE - pos);
+		else
+			continue;
+		matched |= (uint32_t)(((word ^ value) & mask) == 0) << lane;
+	}
+	return matched;
+}
+
+void CarverTable::select(const char* buffer, bool claimed, std::vector<uint32_t>& selected)
+{
+	selected.clear();
+	if (pattern_combined_)
+	{
+		std::fill(pattern_hits_.begin(), pattern_hits_.end(), 0);
+		for (uint32_t lane = 0; lane < pattern_lanes_; ++lane)
+		{
+			uint32_t pos = lane * pattern_alignment_;
+			pattern_dfa_.matchAt((const uint8_t*)buffer + pos, WD_BLOCK_SIZE - pos, pattern_hits_);
+		}
+	}
+
+	const uint32_t count = (uint32_t)logic_.size();
+	for (uint32_t index = 0; index < count; ++index)
+	{
+		// an open candidate needs every block for its footer and truncate limit
+		if (open_count_[index] > 0)
+		{
+			selected.push_back(index);
+			continue;
+		}
+		if (claimed && skip_claimed_[index])
+			continue;
+		if (pattern_[index])
+		{
+			if (!pattern_combined_ || pattern_hits_[index])
+				selected.push_back(index);
+			continue;
+		}
+
+		const uint32_t lanes = lanes_[index];
+		const uint32_t all_lanes = lanes >= 32 ? 0xFFFFFFFF : ((1u << lanes) - 1);
+		uint32_t matched = 0;
+		switch (logic_[index])
+		{
+		case LT_None:
+			matched = 1;
+			break;
+		case LT_And:
+			matched = all_lanes;
+			for (uint32_t signature = signature_begin_[index]; signature < signature_end_[index] && matched != 0; ++signature)
+				matched &= matchSignature(buffer, signature, lanes, alignment_[index]);
+			break;
+		case LT_Or:
+			for (uint32_t signature = signature_begin_[index]; signature < signature_end_[index] && matched != all_lanes; ++signature)
+				matched |= matchSignature(buffer, signature, lanes, alignment_[index]);
+			break;
+		default:
+			break;
+		}
+		if (matched != 0)
+			selected.push_back(index);
+	}
+}
+
+void CarverTable::selectOpen(std::vector<uint32_t>& selected) const
+{
+	selected.clear();
+	const uint32_t count = (uint32_t)open_count_.size();
+	for (uint32_t index = 0; index < count; ++index)
+	{
+		if (open_count_[index] > 0)
+			selected.push_back(index);
+	}
+}
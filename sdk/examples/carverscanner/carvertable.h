@@ -0,0 +1,67 @@
+/**********************************************************************
+*
+* Copyright (C)2015-2022 Maxwell Analytica. All rights reserved.
+*
+* @file carvertable.h
+* @brief Flat runtime state of all carvers
+* @details Open candidate state and the leading 8 bytes of every header
+*          signature are kept in parallel arrays. One linear pass per block
+*          selects the carvers that have an open candidate or a possible
+*          header, only those are asked to analyze the block
+* @author Maxwell
+* @version 1.0.0
+* @date 2026-10-19 19:14:37.652
+*
+**********************************************************************/
+#ifndef CARVER_TABLE_H
+#define CARVER_TABLE_H
+
+#include "filecarver.h"
+
+class CarverTable
+{
+public:
+	CarverTable();
+	~CarverTable();
+
+	// snapshot configuration and state of `carvers`, indexes follow the container
+	void build(const std::vector<std::shared_ptr<FileCarver>>& carvers);
+
+	// indexes of carvers to run on `buffer` in ascending order, `claimed` for a block of a claimed extent
+	void select(const char* buffer, bool claimed, std::vector<uint32_t>& selected);
+
+	// indexes of carvers with an open candidate, for a block known to hold no header
+	void selectOpen(std::vector<uint32_t>& selected) const;
+
+	// refresh the state of carver `index` after it analyzed a block
+	void update(uint32_t index, FileCarver& carver);
+
+	size_t size() const;
+
+private:
+	uint32_t matchSignature(const char* buffer, uint32_t signature, uint32_t lanes, uint32_t alignment) const;
+
+private:
+	// per carver
+	std::vector<uint8_t>	logic_;
+	std::vector<uint8_t>	skip_claimed_;
+	std::vector<uint8_t>	lanes_;
+	std::vector<uint16_t>	alignment_;
+	std::vector<uint32_t>	open_count_;
+	std::vector<uint32_t>	signature_begin_;
+	std::vector<uint32_t>	signature_end_;
+	// per header signature, packed in carver order
+	std::vector<uint64_t>	signature_value_;
+	std::vector<uint64_t>	signature_mask_;
+	std::vector<uint16_t>	signature_offset_;
+	std::vector<uint16_t>	signature_size_;
+	// header patterns of every carver in one automaton, ids are carver indexes
+	std::vector<uint8_t>	pattern_;
+	std::vector<uint8_t>	pattern_hits_;
+	PatternDfa				pattern_dfa_;
+	bool					pattern_combined_;
+	uint32_t				pattern_lanes_;
+	uint32_t				pattern_alignment_;
+};
+
+#endif // CARVER_TABLE_H
@@ -0,0 +1,639 @@
+/**********************************************************************
+*
+* Copyright (C)2015-2022 Maxwell Analytica. All rights reserved.
+*
+* @file cpudispatch.cpp
+* @brief
+* @details
+* @author Maxwell
+* @version 1.0.0
+* @date 2026-10-19 23:59:12.417
+*
+**********************************************************************/
+#include "cpudispatch.h"
+#include <string.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define DISPATCH_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define DISPATCH_TARGET(x)
+#else
+#include <cpuid.h>
+#define DISPATCH_TARGET(x) __attribute__((target(x)))
+#endif
+#endif
+
+static inline uint32_t lowestBit(uint64_t value)
+{
+#ifdef _MSC_VER
+	unsigned long index = 0;
+#if defined(_M_X64)
+	_BitScanForward64(&index, value);
+#else
+	if (!_BitScanForward(&index, (unsigned long)value))
+	{
+		_BitScanForward(&index, (unsigned long)(value >> 32));
+		index += 32;
+	}
+#endif
+	return index;
+#else
+	return __builtin_ctzll(value);
+#endif
+}
+
+struct CpuFeature
+{
+	SimdLevel level;
+	bool sha;
+	CpuFeature()
+	{
+		level = SL_Scalar;
+		sha = false;
+#ifdef DISPATCH_X86
+		uint32_t regs[4] = { 0 };
+		cpuid(0, regs);
+		const uint32_t highest = regs[0];
+		cpuid(1, regs);
+		const uint32_t features = regs[2];
+		bool sse42 = (features & (1u << 9)) && (features & (1u << 19)) && (features & (1u << 20));	// SSSE3, SSE4.1, SSE4.2
+		// the OS has to save the wide registers on context switches
+		uint64_t xcr0 = (features & (1u << 27)) ? xgetbv() : 0;
+		bool avx = (features & (1u << 28)) && (xcr0 & 0x06) == 0x06;
+		bool zmm = (xcr0 & 0xE6) == 0xE6;
+		uint32_t extended = 0;
+		if (highest >= 7)
+		{
+			cpuid(7, regs);
+			extended = regs[1];
+		}
+		bool avx2 = sse42 && avx && (extended & (1u << 5));
+		bool avx512 = avx2 && zmm && (extended & (1u << 16)) && (extended & (1u << 30));	// F, BW
+		sha = sse42 && (extended & (1u << 29));
+		level = avx512 ? SL_Avx512 : (avx2 ? SL_Avx2 : (sse42 ? SL_Sse42 : SL_Scalar));
+#endif
+	}
+
+#ifdef DISPATCH_X86
+	static void cpuid(uint32_t leaf, uint32_t regs[4])
+	{
+#ifdef _MSC_VER
+		__cpuidex((int*)regs, leaf, 0);
+#else
+		__cpuid_count(leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+	}
+
+	static uint64_t xgetbv()
+	{
+#ifdef _MSC_VER
+		return _xgetbv(0);
+#else
+		uint32_t low = 0, high = 0;
+		__asm__ volatile("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+		return ((uint64_t)high << 32) | low;
+#endif
+	}
+#endif
+};
+
+static const CpuFeature& cpuFeature()
+{
+	static CpuFeature feature;
+	return feature;
+}
+
+struct Crc32cTable
+{
+	uint32_t table[256];
+	Crc32cTable()
+	{
+		for (uint32_t index = 0; index < 256; ++index)
+		{
+			uint32_t crc = index;
+			for (int32_t bit = 0; bit < 8; ++bit)
+				crc = (crc & 1) ? (crc >> 1) ^ 0x82F63B78 : (crc >> 1);
+			table[index] = crc;
+		}
+	}
+};
+
+// scalar
+
+static size_t findPairScalar(const uint8_t* data, size_t size, uint8_t first, uint8_t second)
+{
+	const uint8_t* cursor = data;
+	const uint8_t* end = data + size;
+	while (end - cursor >= 2)
+	{
+		cursor = (const uint8_t*)memchr(cursor, first, end - cursor - 1);
+		if (cursor == nullptr)
+			break;
+		if (cursor[1] == second)
+			return cursor - data;
+		++cursor;
+	}
+	return size;
+}
+
+static inline bool uniformFrom(const uint8_t* data, size_t pos, size_t size)
+{
+	for (; pos < size; ++pos)
+	{
+		if (data[pos] != data[0])
+			return false;
+	}
+	return true;
+}
+
+static bool uniformScalar(const uint8_t* data, size_t size)
+{
+	if (size == 0)
+		return true;
+	const uint64_t fill = 0x0101010101010101ULL * data[0];
+	size_t pos = 0;
+	for (; pos + sizeof(uint64_t) <= size; pos += sizeof(uint64_t))
+	{
+		uint64_t word;
+		memcpy(&word, data + pos, sizeof(uint64_t));
+		if (word != fill)
+			return false;
+	}
+	return uniformFrom(data, pos, size);
+}
+
+static uint32_t compareLanesScalar(const uint64_t* values, uint32_t lanes, uint64_t value, uint64_t mask)
+{
+	uint32_t matched = 0;
+	for (uint32_t lane = 0; lane < lanes; ++lane)
+		matched |= (uint32_t)(((values[lane] ^ value) & mask) == 0) << lane;
+	return matched;
+}
+
+static uint32_t crc32cScalar(uint32_t crc, const uint8_t* data, size_t size)
+{
+	static Crc32cTable crc_table;
+	const uint32_t* table = crc_table.table;
+	for (size_t pos = 0; pos < size; ++pos)
+		crc = table[(crc ^ data[pos]) & 0xFF] ^ (crc >> 8);
+	return crc;
+}
+
+// stripe `s` is keyed with HashKeys + s * HashStep, every 16 stripes the lanes are scrambled
+static const uint32_t HashStripe			= 64;
+static const uint32_t HashScrambleStripes	= 16;
+static const uint64_t HashStep				= 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t HashPrime32			= 0x9E3779B1ULL;
+static const uint64_t HashPrime64			= 0x9E3779B185EBCA87ULL;
+alignas(64) static const uint64_t HashInit[8] = { 0x00000000C2B2AE3DULL, 0x9E3779B185EBCA87ULL, 0xC2B2AE3D27D4EB4FULL, 0x165667B19E3779F9ULL,
+	0x85EBCA77C2B2AE63ULL, 0x0000000085EBCA77ULL, 0x27D4EB2F165667C5ULL, 0x000000009E3779B1ULL };
+alignas(64) static const uint64_t HashKeys[8] = { 0xE220A8397B1DCDAFULL, 0x6E789E6AA1B965F4ULL, 0x06C45D188009454FULL, 0xF88BB8A8724C81ECULL,
+	0x1B39896A51A8749BULL, 0x53CB9F0C747EA2EAULL, 0x2C829ABE1F4532E1ULL, 0xC584133AC916AB3CULL };
+alignas(64) static const uint64_t HashScramble[8] = { 0x3EE5789041C98AC3ULL, 0xF3B8488C368CB0A6ULL, 0x657EECDD3CB13D09ULL, 0xC2D326E0055BDEF6ULL,
+	0x8621A03FE0BBDB7BULL, 0x8E1F7555983AA92FULL, 0xB54E0F1600CC4D19ULL, 0x84BB3F97971D80ABULL };
+
+static inline void hashStripe(uint64_t* acc, const uint8_t* stripe, uint64_t index)
+{
+	for (uint32_t lane = 0; lane < 8; ++lane)
+	{
+		uint64_t value;
+		memcpy(&value, stripe + lane * sizeof(uint64_t), sizeof(uint64_t));
+		uint64_t keyed = value ^ (HashKeys[lane] + index * HashStep);
+		acc[lane ^ 1] += value;
+		acc[lane] += (keyed & 0xFFFFFFFF) * (keyed >> 32);
+	}
+}
+
+static inline void hashScramble(uint64_t* acc)
+{
+	for (uint32_t lane = 0; lane < 8; ++lane)
+		acc[lane] = (acc[lane] ^ (acc[lane] >> 47) ^ HashScramble[lane]) * HashPrime32;
+}
+
+// high and low half of the 128-bit product xor-ed
+static inline uint64_t hashFold(uint64_t left, uint64_t right)
+{
+	uint64_t low_low = (left & 0xFFFFFFFF) * (right & 0xFFFFFFFF);
+	uint64_t high_low = (left >> 32) * (right & 0xFFFFFFFF);
+	uint64_t low_high = (left & 0xFFFFFFFF) * (right >> 32);
+	uint64_t high_high = (left >> 32) * (right >> 32);
+	uint64_t cross = (low_low >> 32) + (high_low & 0xFFFFFFFF) + low_high;
+	uint64_t high = (high_low >> 32) + (cross >> 32) + high_high;
+	uint64_t low = (cross << 32) | (low_low & 0xFFFFFFFF);
+	return low ^ high;
+}
+
+// the stripes from `pos` on, the last one zero padded, and the final mix shared by every level
+static uint64_t hashFinish(uint64_t* acc, const uint8_t* data, size_t pos, size_t size)
+{
+	for (; pos < size; pos += HashStripe)
+	{
+		uint8_t stripe[HashStripe] = { 0 };
+		memcpy(stripe, data + pos, size - pos < HashStripe ? size - pos : HashStripe);
+		uint64_t index = pos / HashStripe;
+		hashStripe(acc, stripe, index);
+		if ((index + 1) % HashScrambleStripes == 0)
+			hashScramble(acc);
+	}
+	uint64_t hash = (uint64_t)size * HashPrime64;
+	for (uint32_t lane = 0; lane < 8; lane += 2)
+		hash += hashFold(acc[lane] ^ HashKeys[lane + 1], acc[lane + 1] ^ HashScramble[lane]);
+	hash ^= hash >> 37;
+	hash *= 0x165667919E3779F9ULL;
+	return hash ^ (hash >> 32);
+}
+
+static uint64_t hash64Scalar(const uint8_t* data, size_t size)
+{
+	uint64_t acc[8];
+	memcpy(acc, HashInit, sizeof(acc));
+	return hashFinish(acc, data, 0, size);
+}
+
+#ifdef DISPATCH_X86
+
+// SSE4.2, 16 bytes or 2 lanes a step
+
+DISPATCH_TARGET("sse4.2")
+static size_t findPairSse42(const uint8_t* data, size_t size, uint8_t first, uint8_t second)
+{
+	// the second byte is compared on the load one byte later, no shuffling
+	const __m128i head = _mm_set1_epi8((char)first);
+	const __m128i tail = _mm_set1_epi8((char)second);
+	size_t pos = 0;
+	for (; pos + 17 <= size; pos += 16)
+	{
+		__m128i low = _mm_loadu_si128((const __m128i*)(data + pos));
+		__m128i high = _mm_loadu_si128((const __m128i*)(data + pos + 1));
+		uint32_t bits = (uint32_t)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(low, head), _mm_cmpeq_epi8(high, tail)));
+		if (bits != 0)
+			return pos + lowestBit(bits);
+	}
+	return pos + findPairScalar(data + pos, size - pos, first, second);
+}
+
+DISPATCH_TARGET("sse4.2")
+static bool uniformSse42(const uint8_t* data, size_t size)
+{
+	if (size == 0)
+		return true;
+	const __m128i fill = _mm_set1_epi8((char)data[0]);
+	size_t pos = 0;
+	for (; pos + 64 <= size; pos += 64)
+	{
+		__m128i equal = _mm_and_si128(
+			_mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(data + pos)), fill), _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(data + pos + 16)), fill)),
+			_mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(data + pos + 32)), fill), _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(data + pos + 48)), fill)));
+		if (_mm_movemask_epi8(equal) != 0xFFFF)
+			return false;
+	}
+	return uniformFrom(data, pos, size);
+}
+
+DISPATCH_TARGET("sse4.2")
+static uint32_t compareLanesSse42(const uint64_t* values, uint32_t lanes, uint64_t value, uint64_t mask)
+{
+	const __m128i wanted = _mm_set1_epi64x((long long)value);
+	const __m128i valid = _mm_set1_epi64x((long long)mask);
+	uint32_t matched = 0;
+	uint32_t lane = 0;
+	for (; lane + 2 <= lanes; lane += 2)
+	{
+		__m128i v = _mm_and_si128(_mm_xor_si128(_mm_loadu_si128((const __m128i*)&values[lane]), wanted), valid);
+		matched |= (uint32_t)_mm_movemask_pd(_mm_castsi128_pd(_mm_cmpeq_epi64(v, _mm_setzero_si128()))) << lane;
+	}
+	if (lane < lanes)
+		matched |= compareLanesScalar(values + lane, lanes - lane, value, mask) << lane;
+	return matched;
+}
+
+DISPATCH_TARGET("sse4.2")
+static uint32_t crc32cSse42(uint32_t crc, const uint8_t* data, size_t size)
+{
+#if defined(_M_X64) || defined(__x86_64__)
+	uint64_t crc64 = crc;
+	for (; size >= sizeof(uint64_t); size -= sizeof(uint64_t), data += sizeof(uint64_t))
+	{
+		uint64_t value;
+		memcpy(&value, data, sizeof(uint64_t));
+		crc64 = _mm_crc32_u64(crc64, value);
+	}
+	crc = (uint32_t)crc64;
+#endif
+	for (; size >= sizeof(uint32_t); size -= sizeof(uint32_t), data += sizeof(uint32_t))
+	{
+		uint32_t value;
+		memcpy(&value, data, sizeof(uint32_t));
+		crc = _mm_crc32_u32(crc, value);
+	}
+	for (; size > 0; --size, ++data)
+		crc = _mm_crc32_u8(crc, *data);
+	return crc;
+}
+
+// 64x32-bit products of the low and high halves, the 64-bit lanes multiplied by HashPrime32
+DISPATCH_TARGET("sse4.2")
+static size_t hashStripesSse42(uint64_t* lanes, const uint8_t* data, size_t size)
+{
+	__m128i acc[4], key[4];
+	const __m128i step = _mm_set1_epi64x((long long)HashStep);
+	const __m128i prime = _mm_set1_epi32((int)HashPrime32);
+	for (uint32_t part = 0; part < 4; ++part)
+	{
+		acc[part] = _mm_loadu_si128((const __m128i*)(lanes + part * 2));
+		key[part] = _mm_load_si128((const __m128i*)(HashKeys + part * 2));
+	}
+	size_t pos = 0;
+	for (uint64_t index = 0; pos + HashStripe <= size; pos += HashStripe, ++index)
+	{
+		for (uint32_t part = 0; part < 4; ++part)
+		{
+			__m128i value = _mm_loadu_si128((const __m128i*)(data + pos + part * 16));
+			__m128i keyed = _mm_xor_si128(value, key[part]);
+			__m128i product = _mm_mul_epu32(keyed, _mm_srli_epi64(keyed, 32));
+			acc[part] = _mm_add_epi64(acc[part], _mm_add_epi64(product, _mm_shuffle_epi32(value, _MM_SHUFFLE(1, 0, 3, 2))));
+			key[part] = _mm_add_epi64(key[part], step);
+		}
+		if ((index + 1) % HashScrambleStripes == 0)
+		{
+			for (uint32_t part = 0; part < 4; ++part)
+			{
+				__m128i value = _mm_xor_si128(_mm_xor_si128(acc[part], _mm_srli_epi64(acc[part], 47)), _mm_load_si128((const __m128i*)(HashScramble + part * 2)));
+				acc[part] = _mm_add_epi64(_mm_mul_epu32(value, prime), _mm_slli_epi64(_mm_mul_epu32(_mm_srli_epi64(value, 32), prime), 32));
+			}
+		}
+	}
+	for (uint32_t part = 0; part < 4; ++part)
+		_mm_storeu_si128((__m128i*)(lanes + part * 2), acc[part]);
+	return pos;
+}
+
+static uint64_t hash64Sse42(const uint8_t* data, size_t size)
+{
+	uint64_t acc[8];
+	memcpy(acc, HashInit, sizeof(acc));
+	size_t pos = hashStripesSse42(acc, data, size);
+	return hashFinish(acc, data, pos, size);
+}
+
+// AVX2, 32 bytes or 4 lanes a step
+
+DISPATCH_TARGET("avx2")
+static size_t findPairAvx2(const uint8_t* data, size_t size, uint8_t first, uint8_t second)
+{
+	const __m256i head = _mm256_set1_epi8((char)first);
+	const __m256i tail = _mm256_set1_epi8((char)second);
+	size_t pos = 0;
+	for (; pos + 33 <= size; pos += 32)
+	{
+		__m256i low = _mm256_loadu_si256((const __m256i*)(data + pos));
+		__m256i high = _mm256_loadu_si256((const __m256i*)(data + pos + 1));
+		uint32_t bits = (uint32_t)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(low, head), _mm256_cmpeq_epi8(high, tail)));
+		if (bits != 0)
+			return pos + lowestBit(bits);
+	}
+	return pos + findPairScalar(data + pos, size - pos, first, second);
+}
+
+DISPATCH_TARGET("avx2")
+static bool uniformAvx2(const uint8_t* data, size_t size)
+{
+	if (size == 0)
+		return true;
+	const __m256i fill = _mm256_set1_epi8((char)data[0]);
+	size_t pos = 0;
+	for (; pos + 64 <= size; pos += 64)
+	{
+		__m256i equal = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(data + pos)), fill),
+			_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(data + pos + 32)), fill));
+		if ((uint32_t)_mm256_movemask_epi8(equal) != 0xFFFFFFFF)
+			return false;
+	}
+	return uniformFrom(data, pos, size);
+}
+
+DISPATCH_TARGET("avx2")
+static uint32_t compareLanesAvx2(const uint64_t* values, uint32_t lanes, uint64_t value, uint64_t mask)
+{
+	const __m256i wanted = _mm256_set1_epi64x((long long)value);
+	const __m256i valid = _mm256_set1_epi64x((long long)mask);
+	uint32_t matched = 0;
+	uint32_t lane = 0;
+	for (; lane + 4 <= lanes; lane += 4)
+	{
+		__m256i v = _mm256_and_si256(_mm256_xor_si256(_mm256_loadu_si256((const __m256i*)&values[lane]), wanted), valid);
+		matched |= (uint32_t)_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(v, _mm256_setzero_si256()))) << lane;
+	}
+	if (lane < lanes)
+		matched |= compareLanesSse42(values + lane, lanes - lane, value, mask) << lane;
+	return matched;
+}
+
+DISPATCH_TARGET("avx2")
+static size_t hashStripesAvx2(uint64_t* lanes, const uint8_t* data, size_t size)
+{
+	__m256i acc[2], key[2];
+	const __m256i step = _mm256_set1_epi64x((long long)HashStep);
+	const __m256i prime = _mm256_set1_epi32((int)HashPrime32);
+	for (uint32_t part = 0; part < 2; ++part)
+	{
+		acc[part] = _mm256_loadu_si256((const __m256i*)(lanes + part * 4));
+		key[part] = _mm256_load_si256((const __m256i*)(HashKeys + part * 4));
+	}
+	size_t pos = 0;
+	for (uint64_t index = 0; pos + HashStripe <= size; pos += HashStripe, ++index)
+	{
+		for (uint32_t part = 0; part < 2; ++part)
+		{
+			__m256i value = _mm256_loadu_si256((const __m256i*)(data + pos + part * 32));
+			__m256i keyed = _mm256_xor_si256(value, key[part]);
+			__m256i product = _mm256_mul_epu32(keyed, _mm256_srli_epi64(keyed, 32));
+			acc[part] = _mm256_add_epi64(acc[part], _mm256_add_epi64(product, _mm256_shuffle_epi32(value, _MM_SHUFFLE(1, 0, 3, 2))));
+			key[part] = _mm256_add_epi64(key[part], step);
+		}
+		if ((index + 1) % HashScrambleStripes == 0)
+		{
+			for (uint32_t part = 0; part < 2; ++part)
+			{
+				__m256i value = _mm256_xor_si256(_mm256_xor_si256(acc[part], _mm256_srli_epi64(acc[part], 47)), _mm256_load_si256((const __m256i*)(HashScramble + part * 4)));
+				acc[part] = _mm256_add_epi64(_mm256_mul_epu32(value, prime), _mm256_slli_epi64(_mm256_mul_epu32(_mm256_srli_epi64(value, 32), prime), 32));
+			}
+		}
+	}
+	for (uint32_t part = 0; part < 2; ++part)
+		_mm256_storeu_si256((__m256i*)(lanes + part * 4), acc[part]);
+	return pos;
+}
+
+static uint64_t hash64Avx2(const uint8_t* data, size_t size)
+{
+	uint64_t acc[8];
+	memcpy(acc, HashInit, sizeof(acc));
+	size_t pos = hashStripesAvx2(acc, data, size);
+	return hashFinish(acc, data, pos, size);
+}
+
+// AVX-512, 64 bytes or 8 lanes a step, partial steps masked
+
+DISPATCH_TARGET("avx512f,avx512bw")
+static size_t findPairAvx512(const uint8_t* data, size_t size, uint8_t first, uint8_t second)
+{
+	const __m512i head = _mm512_set1_epi8((char)first);
+	const __m512i tail = _mm512_set1_epi8((char)second);
+	size_t pos = 0;
+	for (; pos + 65 <= size; pos += 64)
+	{
+		__m512i low = _mm512_loadu_si512((const void*)(data + pos));
+		__m512i high = _mm512_loadu_si512((const void*)(data + pos + 1));
+		uint64_t bits = _mm512_cmpeq_epi8_mask(low, head) & _mm512_cmpeq_epi8_mask(high, tail);
+		if (bits != 0)
+			return pos + lowestBit(bits);
+	}
+	return pos + findPairScalar(data + pos, size - pos, first, second);
+}
+
+DISPATCH_TARGET("avx512f,avx512bw")
+static bool uniformAvx512(const uint8_t* data, size_t size)
+{
+	if (size == 0)
+		return true;
+	const __m512i fill = _mm512_set1_epi8((char)data[0]);
+	size_t pos = 0;
+	for (; pos + 64 <= size; pos += 64)
+	{
+		if (_mm512_cmpneq_epi8_mask(_mm512_loadu_si512((const void*)(data + pos)), fill) != 0)
+			return false;
+	}
+	return uniformFrom(data, pos, size);
+}
+
+DISPATCH_TARGET("avx512f,avx512bw")
+static uint32_t compareLanesAvx512(const uint64_t* values, uint32_t lanes, uint64_t value, uint64_t mask)
+{
+	const __m512i wanted = _mm512_set1_epi64((long long)value);
+	const __m512i valid = _mm512_set1_epi64((long long)mask);
+	uint32_t matched = 0;
+	for (uint32_t lane = 0; lane < lanes; lane += 8)
+	{
+		__mmask8 loaded = lanes - lane >= 8 ? (__mmask8)0xFF : (__mmask8)((1u << (lanes - lane)) - 1);
+		__m512i v = _mm512_xor_si512(_mm512_maskz_loadu_epi64(loaded, &values[lane]), wanted);
+		matched |= (uint32_t)_mm512_mask_testn_epi64_mask(loaded, v, valid) << lane;
+	}
+	return matched;
+}
+
+DISPATCH_TARGET("avx512f,avx512bw")
+static size_t hashStripesAvx512(uint64_t* lanes, const uint8_t* data, size_t size)
+{
+	__m512i acc = _mm512_loadu_si512((const void*)lanes);
+	__m512i key = _mm512_load_si512((const void*)HashKeys);
+	const __m512i step = _mm512_set1_epi64((long long)HashStep);
+	const __m512i prime = _mm512_set1_epi32((int)HashPrime32);
+	const __m512i scramble = _mm512_load_si512((const void*)HashScramble);
+	size_t pos = 0;
+	for (uint64_t index = 0; pos + HashStripe <= size; pos += HashStripe, ++index)
+	{
+		__m512i value = _mm512_loadu_si512((const void*)(data + pos));
+		__m512i keyed = _mm512_xor_si512(value, key);
+		__m512i product = _mm512_mul_epu32(keyed, _mm512_srli_epi64(keyed, 32));
+		acc = _mm512_add_epi64(acc, _mm512_add_epi64(product, _mm512_shuffle_epi32(value, (_MM_PERM_ENUM)_MM_SHUFFLE(1, 0, 3, 2))));
+		key = _mm512_add_epi64(key, step);
+		if ((index + 1) % HashScrambleStripes == 0)
+		{
+			__m512i mixed = _mm512_xor_si512(_mm512_xor_si512(acc, _mm512_srli_epi64(acc, 47)), scramble);
+			acc = _mm512_add_epi64(_mm512_mul_epu32(mixed, prime), _mm512_slli_epi64(_mm512_mul_epu32(_mm512_srli_epi64(mixed, 32), prime), 32));
+		}
+	}
+	_mm512_storeu_si512((void*)lanes, acc);
+	return pos;
+}
+
+static uint64_t hash64Avx512(const uint8_t* data, size_t size)
+{
+	uint64_t acc[8];
+	memcpy(acc, HashInit, sizeof(acc));
+	size_t pos = hashStripesAvx512(acc, data, size);
+	return hashFinish(acc, data, pos, size);
+}
+
+#endif
+
+static const ScanKernels ScalarKernels = { SL_Scalar, findPairScalar, uniformScalar, compareLanesScalar, crc32cScalar, hash64Scalar };
+#ifdef DISPATCH_X86
+// wider registers do not speed up the crc instruction, it is shared from SSE4.2 on
+static const ScanKernels Sse42Kernels = { SL_Sse42, findPairSse42, uniformSse42, compareLanesSse42, crc32cSse42, hash64Sse42 };
+static const ScanKernels Avx2Kernels = { SL_Avx2, findPairAvx2, uniformAvx2, compareLanesAvx2, crc32cSse42, hash64Avx2 };
+static const ScanKernels Avx512Kernels = { SL_Avx512, findPairAvx512, uniformAvx512, compareLanesAvx512, crc32cSse42, hash64Avx512 };
+#endif
+
+SimdLevel CpuDispatch::supported()
+{
+	return cpuFeature().level;
+}
+
+bool CpuDispatch::sha()
+{
+	return cpuFeature().sha && level() >= SL_Sse42;
+}
+
+SimdLevel CpuDispatch::select(SimdLevel level)
+{
+	const ScanKernels& selected = kernels(level);
+	current().store(&selected, std::memory_order_release);
+	return selected.level;
+}
+
+SimdLevel CpuDispatch::level()
+{
+	return kernels().level;
+}
+
+const ScanKernels& CpuDispatch::kernels()
+{
+	return *current().load(std::memory_order_acquire);
+}
+
+const ScanKernels& CpuDispatch::kernels(SimdLevel level)
+{
+	if (level < SL_Scalar || level > supported())
+		level = supported();
+	switch (level)
+	{
+#ifdef DISPATCH_X86
+	case SL_Avx512:
+		return Avx512Kernels;
+	case SL_Avx2:
+		return Avx2Kernels;
+	case SL_Sse42:
+		return Sse42Kernels;
+#endif
+	default:
+		return ScalarKernels;
+	}
+}
+
+const char* CpuDispatch::name(SimdLevel level)
+{
+	static const char* names[] = { "scalar", "sse4.2", "avx2", "avx512" };
+	return level >= SL_Scalar && level < SL_Count ? names[level] : "unknown";
+}
+
+SimdLevel CpuDispatch::parse(const std::string& name)
+{
+	if (name == "auto")
+		return supported();
+	for (int32_t level = SL_Scalar; level < SL_Count; ++level)
+	{
+		if (name == CpuDispatch::name((SimdLevel)level))
+			return (SimdLevel)level;
+	}
+	return SL_Count;
+}
+
+std::atomic<const ScanKernels*>& CpuDispatch::current()
+{
+	static std::atomic<const ScanKernels*> selected(&kernels(supported()));
+	return selected;
+}
@@ -0,0 +1,75 @@
+/**********************************************************************
+*
+* Copyright (C)2015-2022 Maxwell Analytica. All rights reserved.
+*
+* @file cpudispatch.h
+* @brief Scanning kernels selected by instruction set at run time
+* @details Each kernel is built for scalar, SSE4.2, AVX2 and AVX-512 in the same
+*          binary, CPUID picks the highest level the processor and the OS support
+*          and a lower one may be forced. Every level returns what scalar does.
+* @author Maxwell
+* @version 1.0.0
+* @date 2026-10-19 23:59:12.417
+*
+**********************************************************************/
+#ifndef CPU_DISPATCH_H
+#define CPU_DISPATCH_H
+
+#include <atomic>
+#include <string>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum _SimdLevel
+{
+	SL_Scalar		= 0,
+	SL_Sse42,
+	SL_Avx2,
+	SL_Avx512,				/* F and BW */
+	SL_Count
+} SimdLevel;
+
+typedef struct _ScanKernels
+{
+	SimdLevel	level;
+	// first `pos` with data[pos] == first and data[pos + 1] == second, `size` for none
+	size_t		(*findPair)(const uint8_t* data, size_t size, uint8_t first, uint8_t second);
+	// every byte equals the first one
+	bool		(*uniform)(const uint8_t* data, size_t size);
+	// bit per lane with (values[lane] ^ value) & mask == 0, at most 32 lanes
+	uint32_t	(*compareLanes)(const uint64_t* values, uint32_t lanes, uint64_t value, uint64_t mask);
+	// reflected Castagnoli polynomial
+	uint32_t	(*crc32c)(uint32_t crc, const uint8_t* data, size_t size);
+	// 64-bit content hash, the long input loop of XXH3 over 64-byte stripes
+	uint64_t	(*hash64)(const uint8_t* data, size_t size);
+}ScanKernels, *PScanKernels;
+
+class CpuDispatch
+{
+public:
+	// highest level of the processor, fixed for the process
+	static SimdLevel supported();
+
+	// SHA extensions, used from SSE4.2 on
+	static bool sha();
+
+	// kernels of `level` clamped to the supported one, returns the level in use
+	static SimdLevel select(SimdLevel level);
+
+	static SimdLevel level();
+
+	static const ScanKernels& kernels();
+
+	// kernels of one level regardless of the selection, the supported level for higher ones
+	static const ScanKernels& kernels(SimdLevel level);
+
+	static const char* name(SimdLevel level);
+
+	// "scalar", "sse4.2", "avx2", "avx512" or "auto" for the supported level, SL_Count otherwise
+	static SimdLevel parse(const std::string& name);
+
+private:
+	static std::atomic<const ScanKernels*>& current();
+};
+
+#endif // CPU_DISPATCH_H
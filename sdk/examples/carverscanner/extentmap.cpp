@@ -0,0 +1,98 @@
+/**********************************************************************
+*
+* Copyright (C)2015-2022 Maxwell Analytica. All rights reserved.
+*
+* @file extentmap.cpp
+* @brief
+* @details
+* @author Maxwell
+* @version 1.0.0
+* @date 2026-10-19 10:12:06.318
+*
+**********************************************************************/
+#include "extentmap.h"
+
+ExtentMap::ExtentMap()
+{
+	clear();
+}
+
+ExtentMap::~ExtentMap()
+{
+
+}
+
+bool ExtentMap::claim(uint64_t start, uint64_t end, uint64_t owner)
+{
+	if (end <= start || owner == 0)
+		return false;
+
+	auto next = extents_.upper_bound(start);
+	if (next != extents_.end() && next->first < end)
+		end = next->first;
+
+	auto iter = extents_.find(start);
+	if (iter != extents_.end())
+	{
+		if (iter->second.owner != owner)
+			return false;
+		iter->second.end = end;
+		last_hit_.end = 0;
+		return true;
+	}
+
+	if (this->owner(start) != 0)
+		return false;
+
+	extents_[start] = { start, end, owner };
+	starts_.emplace(owner, start);
+	return true;
+}
+
+uint64_t ExtentMap::owner(uint64_t block)
+{
+	if (block >= last_hit_.start && block < last_hit_.end)
+		return last_hit_.owner;
+
+	auto iter = extents_.upper_bound(block);
+	if (iter == extents_.begin())
+		return 0;
+	--iter;
+	if (block >= iter->second.end)
+		return 0;
+
+	last_hit_ = iter->second;
+	return last_hit_.owner;
+}
+
+std::vector<ClaimedExtent> ExtentMap::release(uint64_t owner)
+{
+	std::vector<ClaimedExtent> released;
+	auto range = starts_.equal_range(owner);
+	for (auto iter = range.first; iter != range.second; ++iter)
+	{
+		auto extent = extents_.find(iter->second);
+		if (extent == extents_.end() || extent->second.owner != owner)
+			continue;
+		released.push_back(extent->second);
+		extents_.erase(extent);
+	}
+	starts_.erase(range.first, range.second);
+	if (last_hit_.owner == owner)
+		last_hit_.end = 0;
+	return released;
+}
+
+size_t ExtentMap::size()
+{
+	return extents_.size();
+}
+
+void ExtentMap::clear()
+{
+	extents_.clear();
+	starts_.clear();
+	last_hit_.start = 0;
+	last_hit_.end = 0;
+	last_hit_.owner = 0;
+}
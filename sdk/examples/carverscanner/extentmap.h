@@ -0,0 +1,56 @@
+/**********************************************************************
+*
+* Copyright (C)2015-2022 Maxwell Analytica. All rights reserved.
+*
+* @file extentmap.h
+* @brief Claimed extents of carved files
+* @details Disjoint, top-level block intervals owned by a carved file, extents
+*          that start inside an existing claim are embedded and not recorded
+* @author Maxwell
+* @version 1.0.0
+* @date 2026-10-19 10:12:06.318
+*
+**********************************************************************/
+#ifndef EXTENT_MAP_H
+#define EXTENT_MAP_H
+
+#include <map>
+#include <vector>
+#include <unordered_map>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct _ClaimedExtent
+{
+	uint64_t	start;		/* first block of extent */
+	uint64_t	end;		/* block past the extent */
+	uint64_t	owner;		/* id of the carved file */
+}ClaimedExtent, *PClaimedExtent;
+
+class ExtentMap
+{
+public:
+	ExtentMap();
+	~ExtentMap();
+
+	// claim [start, end) for owner, update the end when owner already claimed at start
+	bool claim(uint64_t start, uint64_t end, uint64_t owner);
+
+	// owner of the top-level extent containing block, 0 for unclaimed
+	uint64_t owner(uint64_t block);
+
+	// drop every extent of owner, returns them
+	std::vector<ClaimedExtent> release(uint64_t owner);
+
+	size_t size();
+
+	void clear();
+
+private:
+	ClaimedExtent last_hit_;
+	std::map<uint64_t, ClaimedExtent> extents_;
+	// start of every extent by owner
+	std::unordered_multimap<uint64_t, uint64_t> starts_;
+};
+
+#endif // EXTENT_MAP_H
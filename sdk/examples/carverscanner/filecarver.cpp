@@ -16,10 +16,18 @@ FileCarver::FileCarver()
 {
 	extension_ = "";
 	algorithm_ = "";
+	digest_flags_ = DF_None;
 	developer_id_ = 0;
 	truncate_size_ = 0;
-	carved_file_info_ = std::make_shared<CarvedFileInfo>();
+	claim_policy_ = CP_Probe;
+	sector_size_ = 512;
+	probe_lanes_ = 1;
+	probe_alignment_ = WD_BLOCK_SIZE;
+	max_candidates_ = 4;
+	header_pattern_ = { "", 0, 0 };
 	logic_tuple_ = std::make_tuple(LT_None, LT_None, LT_None);
+	uniform_headers_.set();
+	uniform_footers_.set();
 	//
 	initialize();
 }
@@ -29,15 +37,35 @@ FileCarver::~FileCarver()
 
 }
 
-uint16_t FileCarver::WD_SECTOR_SIZE = 512;
-
 void FileCarver::initialize()
 {
-	carver_status_ = CS_Init;
-	//
-	carved_file_info_->size = 0;
-	carved_file_info_->block_count = 0;
-	carved_file_info_->start_blockno = 0;
+	candidates_.clear();
+	completed_.clear();
+	dropped_count_ = 0;
+	header_matches_ = 0;
+}
+
+void FileCarver::setGeometry(uint16_t sector_size, uint16_t alignment)
+{
+	sector_size_ = sector_size > 0 && sector_size <= WD_BLOCK_SIZE ? sector_size : 512;
+	// probe every sector by default, a cluster size may be given to probe coarser
+	if (alignment < sector_size_ || alignment > WD_BLOCK_SIZE)
+		alignment = sector_size_;
+	alignment -= alignment % sector_size_;
+	
+	probe_lanes_ = WD_BLOCK_SIZE / alignment;
+	if (probe_lanes_ > WD_PROBE_LANES)
+	{
+		probe_lanes_ = WD_PROBE_LANES;
+		alignment = WD_BLOCK_SIZE / WD_PROBE_LANES;
+	}
+	probe_alignment_ = alignment;
+	compileUniform();
+}
+
+uint16_t FileCarver::getSectorSize() const
+{
+	return sector_size_;
 }
 
 uint64_t FileCarver::getDeveloperId() const
@@ -52,7 +80,82 @@ std::string FileCarver::getExtension() const
 
 CarverStatus FileCarver::getCarverStatus() const
 {
-	return carver_status_;
+	if (!completed_.empty())
+		return CS_Footer;
+	//
+	return candidates_.empty() ? CS_Init : CS_Header;
+}
+
+bool FileCarver::acceptsHeader() const
+{
+	return candidates_.size() < max_candidates_;
+}
+
+std::vector<std::shared_ptr<CarvedFileInfo>>& FileCarver::getCandidates()
+{
+	return candidates_;
+}
+
+std::vector<std::shared_ptr<CarvedFileInfo>> FileCarver::takeCompleted()
+{
+	std::vector<std::shared_ptr<CarvedFileInfo>> completed;
+	completed.swap(completed_);
+	return completed;
+}
+
+int64_t FileCarver::getDroppedCount() const
+{
+	return dropped_count_;
+}
+
+int64_t FileCarver::getHeaderMatches() const
+{
+	return header_matches_;
+}
+
+ClaimPolicy FileCarver::getClaimPolicy() const
+{
+	return claim_policy_;
+}
+
+int64_t FileCarver::getTruncateSize() const
+{
+	return truncate_size_;
+}
+
+uint32_t FileCarver::getDigestFlags() const
+{
+	return digest_flags_;
+}
+
+std::shared_ptr<Validator> FileCarver::getValidator() const
+{
+	return validator_;
+}
+
+LogicType FileCarver::getHeaderLogic() const
+{
+	return std::get<0>(logic_tuple_);
+}
+
+const std::vector<ProbeInfo>& FileCarver::getHeaderProbes() const
+{
+	return header_probe_;
+}
+
+uint32_t FileCarver::getProbeLanes() const
+{
+	return probe_lanes_;
+}
+
+uint16_t FileCarver::getProbeAlignment() const
+{
+	return probe_alignment_;
+}
+
+const PatternSource& FileCarver::getHeaderPattern() const
+{
+	return header_pattern_;
 }
 
 LogicType FileCarver::logicType(std::string& logic)
@@ -68,9 +171,35 @@ LogicType FileCarver::logicType(std::string& logic)
 	return LogicType::LT_None;
 }
 
+ClaimPolicy FileCarver::claimPolicy(std::string& policy)
+{
+	std::string symbol = MaUtil::lower(policy);
+	if (symbol == "skip")
+		return ClaimPolicy::CP_Skip;
+	else if (symbol == "embed" || symbol == "embedded")
+		return ClaimPolicy::CP_Embed;
+	//
+	return ClaimPolicy::CP_Probe;
+}
+
+AlgorithmType FileCarver::algorithmType(std::string& algorithm)
+{
+	std::string symbol = MaUtil::lower(algorithm);
+	MaUtil::trim(symbol);
+	if (symbol == "crc32" || symbol == "crc32c")
+		return AlgorithmType::ALG_CRC32;
+	else if (symbol == "sha256" || symbol == "sha-256")
+		return AlgorithmType::ALG_SHA256;
+	//
+	return AlgorithmType::ALG_Unknown;
+}
+
 std::shared_ptr<CarvedFileInfo> FileCarver::getCarvedFileInfo() const
 {
-	return carved_file_info_;
+	if (!completed_.empty())
+		return completed_.front();
+	//
+	return candidates_.empty() ? nullptr : candidates_.back();
 }
 
 int32_t FileCarver::setCharacteristics(frjson::object_t object)
@@ -85,18 +214,43 @@ int32_t FileCarver::setCharacteristics(frjson::object_t object)
 			return -1;
 		extension_ = iter->second.get<std::string>();
 		
+		iter = object.find("validator");	// optional, validator of the extension by default, "none" to disable
+		if (iter != object.end())
+			validator_ = Validator::create(iter->second.get<std::string>());
+		else
+			validator_ = Validator::create(extension_);
+		
 		iter = object.find("developerId");	// developer ID
 		if (iter != object.end())
 			developer_id_ = iter->second.get<uint64_t>();
 		
-		iter = object.find("algorithm");	// optional
+		iter = object.find("algorithm");	// optional, e.g. "crc32" or "crc32,sha256"
 		if (iter != object.end())
+		{
 			algorithm_ = iter->second.get<std::string>();
+			for (auto& name : MaUtil::split_string(algorithm_, ','))
+			{
+				AlgorithmType type = algorithmType(name);
+				if (type != ALG_Unknown)
+					digest_flags_ |= 1u << type;
+			}
+		}
 		
 		iter = object.find("truncate");		// optional
 		if (iter != object.end())
 			truncate_size_ = iter->second.get<int64_t>();
 		
+		iter = object.find("candidates");	// optional, open candidates tracked at once
+		if (iter != object.end())
+			max_candidates_ = iter->second.get<uint32_t>() > 0 ? iter->second.get<uint32_t>() : 1;
+		
+		iter = object.find("claimed");		// optional, skip | probe | embed
+		if (iter != object.end())
+		{
+			std::string policy = iter->second.get<std::string>();
+			claim_policy_ = claimPolicy(policy);
+		}
+		
 		frjson::object_t name_object;
 		iter = object.find("name");			// optional
 		if (iter != object.end())
@@ -123,7 +277,22 @@ int32_t FileCarver::setCharacteristics(frjson::object_t object)
 			name_info_->size = name_object.at("size").get<int32_t>();
 			name_info_->padding = name_object.at("padding").get<int32_t>();
 		}
-		if (!header_object.empty())
+		auto pattern = header_object.find("pattern");	// optional, replaces logic and characters, see signaturepattern.h
+		if (pattern != header_object.end())
+		{
+			header_pattern_.text = pattern->second.get<std::string>();
+			auto offset = header_object.find("offset");
+			header_pattern_.offset = offset != header_object.end() ? offset->second.get<uint32_t>() : 0;
+			std::string error;
+			auto dfa = std::make_shared<PatternDfa>();
+			if (dfa->compile({ header_pattern_ }, error) != 0)
+			{
+				std::cout << "parse header pattern: " << error << std::endl;
+				return -1;
+			}
+			header_dfa_ = dfa;
+		}
+		else if (!header_object.empty())
 		{
 			std::string logic = header_object.at("logic").get<std::string>();
 			std::get<0>(logic_tuple_) = logicType(logic);
@@ -137,7 +306,7 @@ int32_t FileCarver::setCharacteristics(frjson::object_t object)
 				std::string context = character_object.at("context").get<std::string>();
 				if (character->hex)
 				{
-					const int32_t size = context.length() > 64 ? 64 : context.length();
+					const int32_t size = context.length() > 128 ? 128 : context.length();
 					for (int32_t pos = 0; pos < size; pos += 2)
 					{
 						int32_t count = (size - pos) > 1 ? 2 : 1;
@@ -147,9 +316,18 @@ int32_t FileCarver::setCharacteristics(frjson::object_t object)
 				}
 				else
 				{
-					memcpy(character->character, context.c_str(), context.length() > 64 ? context.length() : 64);
+					memcpy(character->character, context.c_str(), context.length() > 64 ? 64 : context.length());
 				}
 				header_vector_.emplace_back(character);
+				
+				ProbeInfo probe;
+				probe.value = 0;
+				probe.offset = character->amphibious.offset;
+				probe.size = character->size > 64 ? 64 : character->size;
+				probe.mask = probe.size >= sizeof(uint64_t) ? ~0ull : ((1ull << (probe.size * 8)) - 1);
+				probe.character = character->character;
+				memcpy(&probe.value, character->character, probe.size >= sizeof(uint64_t) ? sizeof(uint64_t) : probe.size);
+				header_probe_.emplace_back(probe);
 			}
 		}
 		if (!body_object.empty())
@@ -166,7 +344,7 @@ int32_t FileCarver::setCharacteristics(frjson::object_t object)
 				std::string context = character_object.at("context").get<std::string>();
 				if (character->hex)
 				{
-					const int32_t size = context.length() > 64 ? 64 : context.length();
+					const int32_t size = context.length() > 128 ? 128 : context.length();
 					for (int32_t pos = 0; pos < size; pos += 2)
 					{
 						int32_t count = (size - pos) > 1 ? 2 : 1;
@@ -176,7 +354,7 @@ int32_t FileCarver::setCharacteristics(frjson::object_t object)
 				}
 				else
 				{
-					memcpy(character->character, context.c_str(), context.length() > 64 ? context.length() : 64);
+					memcpy(character->character, context.c_str(), context.length() > 64 ? 64 : context.length());
 				}
 				body_vector_.emplace_back(character);
 			}
@@ -195,7 +373,7 @@ int32_t FileCarver::setCharacteristics(frjson::object_t object)
 				std::string context = character_object.at("context").get<std::string>();
 				if (character->hex)
 				{
-					const int32_t size = context.length() > 64 ? 64 : context.length();
+					const int32_t size = context.length() > 128 ? 128 : context.length();
 					for (int32_t pos = 0; pos < size; pos += 2)
 					{
 						int32_t count = (size - pos) > 1 ? 2 : 1;
@@ -205,7 +383,7 @@ int32_t FileCarver::setCharacteristics(frjson::object_t object)
 				}
 				else
 				{
-					memcpy(character->character, context.c_str(), context.length() > 64 ? context.length() : 64);
+					memcpy(character->character, context.c_str(), context.length() > 64 ? 64 : context.length());
 				}
 				footer_vector_.emplace_back(character);
 			}
@@ -216,68 +394,234 @@ int32_t FileCarver::setCharacteristics(frjson::object_t object)
 		std::cout << "parse characteristic exception: " << e.what() << std::endl;
 	}
 	
+	compileMatchers();
 	return 0;
 }
 
+template<typename Word>
+static std::shared_ptr<HeaderMatcher> makeHeaderMatcher(LogicType logic, const std::vector<std::shared_ptr<CharacterInfo>>& characters)
+{
+	if (logic == LT_And)
+		return std::make_shared<FixedHeaderMatcher<Word, LT_And>>(characters);
+	return std::make_shared<FixedHeaderMatcher<Word, LT_Or>>(characters);
+}
+
+void FileCarver::compileMatchers()
+{
+	// signatures up to 8 bytes compare with one load, longer ones stay on the generic path
+	header_matcher_ = nullptr;
+	footer_matcher_ = nullptr;
+	
+	if (header_dfa_ != nullptr)
+		header_matcher_ = std::make_shared<PatternHeaderMatcher>(header_dfa_);
+	
+	uint16_t longest = 0;
+	for (auto& character : header_vector_)
+		longest = std::max(longest, character->size);
+	LogicType logic = std::get<0>(logic_tuple_);
+	if (!header_vector_.empty() && longest > 0 && longest <= sizeof(uint64_t) && (logic == LT_And || logic == LT_Or))
+	{
+		if (longest <= 2)
+			header_matcher_ = makeHeaderMatcher<SignatureWord<2>::type>(logic, header_vector_);
+		else if (longest <= 4)
+			header_matcher_ = makeHeaderMatcher<SignatureWord<4>::type>(logic, header_vector_);
+		else
+			header_matcher_ = makeHeaderMatcher<SignatureWord<8>::type>(logic, header_vector_);
+	}
+	
+	longest = 0;
+	uint16_t shortest = 0xFFFF;
+	for (auto& character : footer_vector_)
+	{
+		longest = std::max(longest, character->size);
+		shortest = std::min(shortest, character->size);
+	}
+	logic = std::get<2>(logic_tuple_);
+	// several `and` footers report the offset of the last one, only a single one has a fixed form
+	bool single = footer_vector_.size() == 1 || logic == LT_Or;
+	if (!footer_vector_.empty() && shortest > 0 && longest <= sizeof(uint64_t) && single && (logic == LT_And || logic == LT_Or))
+	{
+		if (longest <= 2)
+			footer_matcher_ = std::make_shared<FixedFooterMatcher<SignatureWord<2>::type>>(footer_vector_);
+		else if (longest <= 4)
+			footer_matcher_ = std::make_shared<FixedFooterMatcher<SignatureWord<4>::type>>(footer_vector_);
+		else
+			footer_matcher_ = std::make_shared<FixedFooterMatcher<SignatureWord<8>::type>>(footer_vector_);
+	}
+	// nothing is skipped until the geometry is known
+	uniform_headers_.set();
+	uniform_footers_.set();
+}
+
+void FileCarver::compileUniform()
+{
+	// matching only depends on the bytes, a block of one value decides it for every such block
+	std::vector<char> block(WD_BLOCK_SIZE);
+	for (uint32_t value = 0; value < 256; ++value)
+	{
+		memset(block.data(), (int)value, block.size());
+		uniform_headers_[value] = matchHeader(block.data()) != 0;
+		int32_t offset = 0;
+		// a missing `not` footer may be missing from any part of the block
+		uniform_footers_[value] = std::get<2>(logic_tuple_) == LT_Not || searchFooter(block.data(), WD_BLOCK_SIZE, offset) != nullptr;
+	}
+}
+
+uint32_t FileCarver::probeLanes(const char* buffer, const ProbeInfo& probe) const
+{
+	// gather the leading 8 bytes of the signature at every lane start, then compare all lanes by the dispatched kernel
+	uint64_t values[WD_PROBE_LANES];
+	uint32_t valid = 0;
+	for (uint32_t lane = 0; lane < probe_lanes_; ++lane)
+	{
+		uint32_t pos = lane * probe_alignment_ + probe.offset;
+		values[lane] = 0;
+		// the whole signature lies in the block, the remainder is confirmed in place below
+		if (pos + probe.size > WD_BLOCK_SIZE)
+			continue;
+		memcpy(&values[lane], buffer + pos, std::min<uint32_t>(sizeof(uint64_t), WD_BLOCK_SIZE - pos));
+		valid |= 1u << lane;
+	}
+	
+	uint32_t matched = CpuDispatch::kernels().compareLanes(values, probe_lanes_, probe.value, probe.mask);
+	matched &= valid;
+	
+	// signatures longer than the prefix confirm the remainder on surviving lanes only
+	if (probe.size > sizeof(uint64_t))
+	{
+		for (uint32_t bits = matched; bits != 0; bits &= bits - 1)
+		{
+			uint32_t hit = ctz32(bits);
+			uint32_t pos = hit * probe_alignment_ + probe.offset;
+			if (memcmp(probe.character + sizeof(uint64_t), buffer + pos + sizeof(uint64_t), probe.size - sizeof(uint64_t)) != 0)
+				matched &= ~(1u << hit);
+		}
+	}
+	
+	return matched;
+}
+
+int32_t FileCarver::analyzeBlocks(const BlockSpan& span, std::vector<CarveEvent>& events)
+{
+	const size_t before = events.size();
+	const uint64_t package_blocks = WD_BLOCK_SIZE / sector_size_;
+	for (uint32_t index = 0; index < span.count; ++index)
+	{
+		const char* buffer = span.data + (size_t)index * WD_BLOCK_SIZE;
+		uint64_t blockno = span.start_blockno + index * package_blocks;
+		const bool header = acceptsHeader() && !span.continuation && (!span.claimed || claim_policy_ != CP_Skip);
+		if (!header && candidates_.empty())
+			continue;
+		const bool uniform = CpuDispatch::kernels().uniform((const uint8_t*)buffer, WD_BLOCK_SIZE);
+		const uint8_t fill = (uint8_t)buffer[0];
+		if (header && (!uniform || uniform_headers_[fill]))
+			headerAt(buffer, blockno, &events);
+		if (candidates_.empty())
+			continue;
+		if (!uniform || uniform_footers_[fill])
+			footerAt(buffer, blockno, &events);
+		truncateAt(blockno, &events);
+	}
+	return (int32_t)(events.size() - before);
+}
+
 int32_t FileCarver::analyzeHeader(std::shared_ptr<ClusterPackage> package)
 {
-	bool matched = true;
-	if (std::get<0>(logic_tuple_) == LT_And)
+	return headerAt(package->Buffer, package->BlockNumber, nullptr);
+}
+
+uint32_t FileCarver::matchHeader(const char* buffer) const
+{
+	const uint32_t all_lanes = (probe_lanes_ >= 32) ? 0xFFFFFFFF : ((1u << probe_lanes_) - 1);
+	uint32_t matched = 1;
+	if (header_matcher_ != nullptr)
+	{
+		matched = header_matcher_->matchLanes(buffer, probe_lanes_, probe_alignment_);
+	}
+	else if (std::get<0>(logic_tuple_) == LT_And)
 	{
-		for (auto& info : header_vector_)
+		matched = all_lanes;
+		for (auto& probe : header_probe_)
 		{
-			if (memcmp(info->character, package->Buffer + info->amphibious.offset, info->size) != 0)
-			{
-				matched = false;
+			matched &= probeLanes(buffer, probe);
+			if (matched == 0)
 				break;
-			}
 		}
 	}
 	else if (std::get<0>(logic_tuple_) == LT_Or)
 	{
-		matched = false;
-		for (auto& info : header_vector_)
+		matched = 0;
+		for (auto& probe : header_probe_)
 		{
-			if (memcmp(info->character, package->Buffer + info->amphibious.offset, info->size) == 0)
-			{
-				matched = true;
+			matched |= probeLanes(buffer, probe);
+			if (matched == all_lanes)
 				break;
-			}
 		}
 	}
 	else if (std::get<0>(logic_tuple_) == LT_Not)
 	{
-		matched = false;
-		for (auto& info : header_vector_)
-		{
-			if (memcmp(info->character, package->Buffer + info->amphibious.offset, info->size) == 0)
-				break;
-		}
+		matched = 0;
 	}
+	//
+	return matched;
+}
+
+int32_t FileCarver::headerAt(const char* buffer, uint64_t blockno, std::vector<CarveEvent>* events)
+{
+	uint32_t matched = matchHeader(buffer);
+	if (matched != 0)
+		++header_matches_;
 	
-	if (matched)
+	// every file start within the package opens a candidate while there is room
+	int32_t opened = 0;
+	for (uint32_t bits = matched; bits != 0; bits &= bits - 1)
 	{
-		if (name_info_ != nullptr)
+		uint32_t base = ctz32(bits) * probe_alignment_;
+		uint64_t start_blockno = blockno + base / sector_size_;
+		auto iter = std::find_if(candidates_.begin(), candidates_.end(), [start_blockno](const std::shared_ptr<CarvedFileInfo>& candidate) {
+			return candidate->start_blockno == start_blockno;
+		});
+		if (iter != candidates_.end())
+			continue;
+		if (candidates_.size() >= max_candidates_)
+		{
+			++dropped_count_;
+			continue;
+		}
+		
+		auto candidate = std::make_shared<CarvedFileInfo>();
+		candidate->id = 0;
+		candidate->parent_id = 0;
+		candidate->size = 0;
+		candidate->block_count = 0;
+		candidate->status = CS_Header;
+		if (name_info_ != nullptr && base + name_info_->offset + name_info_->size + name_info_->padding <= WD_BLOCK_SIZE)
 		{
 			uint16_t name_size = 0;
-			memcpy(&name_size, package->Buffer + name_info_->offset, name_info_->size);
-			if (name_size < 0x100)
+			memcpy(&name_size, buffer + base + name_info_->offset, name_info_->size);
+			uint32_t name_offset = base + name_info_->offset + name_info_->size + name_info_->padding;
+			if (name_size < 0x100 && name_offset + name_size <= WD_BLOCK_SIZE)
 			{
 				auto pBuffer = new char[name_size];
-				memcpy(pBuffer, package->Buffer + name_info_->offset + name_info_->size + name_info_->padding, name_size);
-				carved_file_info_->base_name.assign(pBuffer, name_size);
-				size_t pos = carved_file_info_->base_name.find("\\");
+				memcpy(pBuffer, buffer + name_offset, name_size);
+				candidate->base_name.assign(pBuffer, name_size);
+				size_t pos = candidate->base_name.find("\\");
 				if (pos > 0)
-					carved_file_info_->base_name = carved_file_info_->base_name.substr(0, pos);
+					candidate->base_name = candidate->base_name.substr(0, pos);
 				delete[] pBuffer;
 			}
 		}
 		//
-		carved_file_info_->start_blockno = package->BlockNumber;
-		carver_status_ = CS_Header;
+		candidate->start_blockno = start_blockno;
+		candidate->next_blockno = blockno;
+		candidate->digest.reset(digest_flags_);
+		candidates_.emplace_back(candidate);
+		if (events != nullptr)
+			events->push_back({ CE_Header, blockno, (int32_t)base, start_blockno });
+		++opened;
 	}
 	//
-	return -1;
+	return opened;
 }
 
 int32_t FileCarver::analyzeBody(std::shared_ptr<ClusterPackage> package)
@@ -285,75 +629,179 @@ int32_t FileCarver::analyzeBody(std::shared_ptr<ClusterPackage> package)
 	return -1;
 }
 
-int32_t FileCarver::analyzeFooter(std::shared_ptr<ClusterPackage> package)
+std::shared_ptr<CharacterInfo> FileCarver::searchFooter(const char* buffer, int32_t size, int32_t& offset)
 {
-	if (package->BlockNumber < carved_file_info_->start_blockno)
-		return -1;
-	
-	int32_t offset = 0;
 	std::shared_ptr<CharacterInfo> character_info;
+	if (footer_matcher_ != nullptr)
+	{
+		int32_t index = -1;
+		offset = footer_matcher_->search(buffer, size, index);
+		return offset >= 0 ? footer_vector_[index] : nullptr;
+	}
 	if (std::get<2>(logic_tuple_) == LT_And)
 	{
 		for (auto& info : footer_vector_)
 		{
-			offset = MaUtil::BoyerMoore(package->Buffer, WD_BLOCK_SIZE, (char*)info->character, info->size);
+			offset = MaUtil::BoyerMoore(const_cast<char*>(buffer), size, (char*)info->character, info->size);
 			if (offset < 0)
-				return -1;
+				return nullptr;
 			character_info = info;
 		}
 	}
 	else if (std::get<2>(logic_tuple_) == LT_Or)
 	{
-		for (auto& info : header_vector_)
+		// earliest of the alternatives
+		for (auto& info : footer_vector_)
 		{
-			offset = MaUtil::BoyerMoore(package->Buffer, WD_BLOCK_SIZE, (char*)info->character, info->size);
-			if (offset < 0)
-				return -1;
-			character_info = info;
-			break;
+			int32_t found = MaUtil::BoyerMoore(const_cast<char*>(buffer), size, (char*)info->character, info->size);
+			if (found >= 0 && (character_info == nullptr || found < offset))
+			{
+				offset = found;
+				character_info = info;
+			}
 		}
 	}
 	else if (std::get<2>(logic_tuple_) == LT_Not)
 	{
-		for (auto& info : header_vector_)
+		for (auto& info : footer_vector_)
 		{
-			offset = MaUtil::BoyerMoore(package->Buffer, WD_BLOCK_SIZE, (char*)info->character, info->size);
+			offset = MaUtil::BoyerMoore(const_cast<char*>(buffer), size, (char*)info->character, info->size);
 			if (offset >= 0)
-				return -1;
+				return nullptr;
 			character_info = info;
 		}
 	}
-	
-	if (character_info == nullptr)
+	//
+	return character_info;
+}
+
+int32_t FileCarver::matchFooter(uint64_t blockno, int32_t offset)
+{
+	// the nearest open candidate starting before the footer
+	int32_t index = -1;
+	uint64_t footer_blockno = blockno + offset / sector_size_;
+	for (size_t pos = 0; pos < candidates_.size(); ++pos)
+	{
+		uint64_t start_blockno = candidates_[pos]->start_blockno;
+		if (start_blockno > footer_blockno)
+			continue;
+		if (start_blockno == footer_blockno && (int64_t)(start_blockno - blockno) * sector_size_ >= offset)
+			continue;
+		if (index < 0 || start_blockno >= candidates_[index]->start_blockno)
+			index = (int32_t)pos;
+	}
+	return index;
+}
+
+int32_t FileCarver::discardCandidates()
+{
+	int32_t count = (int32_t)candidates_.size();
+	candidates_.clear();
+	return count;
+}
+
+void FileCarver::closeCandidate(size_t index, uint64_t blockno, uint64_t block_count, uint64_t size)
+{
+	auto candidate = candidates_[index];
+	candidate->block_count = blockno + block_count - candidate->start_blockno;
+	candidate->size = size;
+	candidate->status = CS_Footer;
+	completed_.emplace_back(candidate);
+	candidates_.erase(candidates_.begin() + index);
+}
+
+int32_t FileCarver::analyzeFooter(std::shared_ptr<ClusterPackage> package)
+{
+	return footerAt(package->Buffer, package->BlockNumber, nullptr);
+}
+
+int32_t FileCarver::footerAt(const char* buffer, uint64_t blockno, std::vector<CarveEvent>* events)
+{
+	if (candidates_.empty())
 		return -1;
 	
-	uint16_t block_count = (offset + character_info->size + character_info->amphibious.padding) / FileCarver::WD_SECTOR_SIZE + 1;
-	uint16_t remain_count = (offset + character_info->size + character_info->amphibious.padding) % FileCarver::WD_SECTOR_SIZE;
-	
-	carved_file_info_->block_count = package->BlockNumber - carved_file_info_->start_blockno + block_count;
-	carved_file_info_->size = FileCarver::WD_SECTOR_SIZE * (carved_file_info_->block_count - 1) + remain_count;
+	const uint64_t package_blocks = WD_BLOCK_SIZE / sector_size_;
+	uint64_t first_blockno = candidates_.front()->start_blockno;
+	for (auto& candidate : candidates_)
+		first_blockno = candidate->start_blockno < first_blockno ? candidate->start_blockno : first_blockno;
+	if (blockno + package_blocks <= first_blockno)
+		return -1;
 	
-	carver_status_ = CS_Footer;
+	// nothing before the earliest open candidate can end it
+	int32_t begin = 0;
+	if (blockno < first_blockno)
+		begin = (int32_t)(first_blockno - blockno) * sector_size_;
 	
-	return 0;
+	int32_t closed = 0;
+	while (!candidates_.empty() && begin < WD_BLOCK_SIZE)
+	{
+		int32_t offset = 0;
+		auto character_info = searchFooter(buffer + begin, WD_BLOCK_SIZE - begin, offset);
+		if (character_info == nullptr)
+			break;
+		
+		offset += begin;
+		int32_t end = offset + character_info->size + character_info->amphibious.padding;
+		uint16_t block_count = end / sector_size_ + 1;
+		uint16_t remain_count = end % sector_size_;
+		if (std::get<2>(logic_tuple_) == LT_Not)
+		{
+			// the package lacks every footer characteristic, all open candidates end here
+			for (size_t index = candidates_.size(); index > 0; --index)
+			{
+				uint64_t start_blockno = candidates_[index - 1]->start_blockno;
+				uint64_t count = blockno + block_count - start_blockno;
+				closeCandidate(index - 1, blockno, block_count, sector_size_ * (count - 1) + remain_count);
+				if (events != nullptr)
+					events->push_back({ CE_Footer, blockno, offset, start_blockno });
+				++closed;
+			}
+			break;
+		}
+		
+		int32_t index = matchFooter(blockno, offset);
+		if (index >= 0)
+		{
+			uint64_t start_blockno = candidates_[index]->start_blockno;
+			uint64_t count = blockno + block_count - start_blockno;
+			closeCandidate(index, blockno, block_count, sector_size_ * (count - 1) + remain_count);
+			if (events != nullptr)
+				events->push_back({ CE_Footer, blockno, offset, start_blockno });
+			++closed;
+		}
+		begin = offset + (character_info->size > 0 ? character_info->size : 1);
+	}
+	//
+	return closed > 0 ? 0 : -1;
 }
 
 int32_t FileCarver::truncate(std::shared_ptr<ClusterPackage> package)
+{
+	return truncateAt(package->BlockNumber, nullptr);
+}
+
+int32_t FileCarver::truncateAt(uint64_t blockno, std::vector<CarveEvent>* events)
 {
 	if (truncate_size_ <= 0)
 		return -1;
 	
-	if (package->BlockNumber < carved_file_info_->start_blockno)
-		return -1;
-	
-	int64_t block_count = package->BlockNumber - carved_file_info_->start_blockno;
-	if (FileCarver::WD_SECTOR_SIZE * block_count < truncate_size_)
-		return -1;
-	
-	carved_file_info_->block_count = package->BlockNumber - carved_file_info_->start_blockno + 1;
-	carved_file_info_->size = FileCarver::WD_SECTOR_SIZE * carved_file_info_->block_count;
-	
-	carver_status_ = CS_Footer;
-	
-	return 0;
-}
\ No newline at end of file
+	int32_t closed = 0;
+	for (size_t index = candidates_.size(); index > 0; --index)
+	{
+		auto& candidate = candidates_[index - 1];
+		if (blockno < candidate->start_blockno)
+			continue;
+		
+		int64_t block_count = blockno - candidate->start_blockno;
+		if (sector_size_ * block_count < truncate_size_)
+			continue;
+		
+		uint64_t start_blockno = candidate->start_blockno;
+		closeCandidate(index - 1, blockno, 1, sector_size_ * (block_count + 1));
+		if (events != nullptr)
+			events->push_back({ CE_Truncate, blockno, 0, start_blockno });
+		++closed;
+	}
+	//
+	return closed > 0 ? 0 : -1;
+}
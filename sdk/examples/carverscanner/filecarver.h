@@ -14,20 +14,47 @@
 #define FILE_CARVER_H
 
 #include <tuple>
+#include <bitset>
+#include <memory>
+#include <type_traits>
 #include <string>
+#include <vector>
+#include <algorithm>
 #include <iostream>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 #include "../../include/datatype.h"
 #include "../../third_party/json.hpp"
 #include "../../third_party/mautil.h"
+#include "streamdigest.h"
+#include "cpudispatch.h"
+#include "validator.h"
+#include "signaturepattern.h"
 
 using namespace ma;
 using frjson = nlohmann::json;
 
 using namespace std;
 
+#define WD_PROBE_LANES 8
+
+inline uint32_t ctz32(uint32_t value)
+{
+#ifdef _MSC_VER
+	unsigned long index = 0;
+	_BitScanForward(&index, value);
+	return index;
+#else
+	return __builtin_ctz(value);
+#endif
+}
+
 typedef enum _AlgorithmType
 {
 	ALG_CRC32,
+	ALG_SHA256,
+	ALG_Unknown,
 } AlgorithmType;
 
 typedef enum _LogicType
@@ -38,6 +65,13 @@ typedef enum _LogicType
 	LT_Not
 } LogicType;
 
+typedef enum _ClaimPolicy
+{
+	CP_Probe,
+	CP_Skip,
+	CP_Embed
+} ClaimPolicy;
+
 #pragma pack(push, 1)
 
 typedef struct _NameInfo
@@ -67,6 +101,200 @@ typedef struct _CharacterInfo
 
 #pragma pack(pop)
 
+typedef struct _ProbeInfo
+{
+	uint64_t		value;		/* leading 8 bytes of signature */
+	uint64_t		mask;		/* valid bytes of `value` */
+	uint16_t		offset;
+	uint16_t		size;
+	const uint8_t*	character;
+} ProbeInfo, *PProbeInfo;
+
+// header matches as a bit per probe lane
+class HeaderMatcher
+{
+public:
+	virtual ~HeaderMatcher() {}
+
+	virtual uint32_t matchLanes(const char* buffer, uint32_t lanes, uint32_t alignment) const = 0;
+};
+
+// earliest footer in buffer, `index` of the matching characteristic, -1 for none
+class FooterMatcher
+{
+public:
+	virtual ~FooterMatcher() {}
+
+	virtual int32_t search(const char* buffer, int32_t size, int32_t& index) const = 0;
+};
+
+// smallest load covering a signature of `Size` bytes
+template<uint32_t Size>
+struct SignatureWord
+{
+	typedef typename std::conditional<(Size <= 2), uint16_t,
+		typename std::conditional<(Size <= 4), uint32_t, uint64_t>::type>::type type;
+};
+
+template<typename Word>
+struct FixedSignature
+{
+	Word		value;
+	Word		mask;
+	uint16_t	offset;
+	uint16_t	size;
+
+	// one load, bytes past `limit` are never read, false when the signature does not fit
+	inline bool load(const char* buffer, uint32_t pos, uint32_t limit, Word& word) const
+	{
+		if (pos + sizeof(Word) <= limit)
+			memcpy(&word, buffer + pos, sizeof(Word));
+		else if (pos + size <= limit)
+			memcpy(&word, buffer + pos, limit - pos);
+		else
+			return false;
+		return true;
+	}
+
+	// one masked load
+	inline bool match(const char* buffer, uint32_t pos, uint32_t limit) const
+	{
+		Word word = 0;
+		return load(buffer, pos, limit, word) && ((word ^ value) & mask) == 0;
+	}
+};
+
+template<typename Word>
+inline FixedSignature<Word> fixedSignature(const uint8_t* character, uint16_t size, uint16_t offset)
+{
+	FixedSignature<Word> signature;
+	signature.value = 0;
+	signature.mask = size >= sizeof(Word) ? (Word)~(Word)0 : (Word)((1ull << (size * 8)) - 1);
+	signature.offset = offset;
+	signature.size = size;
+	memcpy(&signature.value, character, size < sizeof(Word) ? size : sizeof(Word));
+	return signature;
+}
+
+template<typename Word, LogicType Logic>
+class FixedHeaderMatcher : public HeaderMatcher
+{
+public:
+	explicit FixedHeaderMatcher(const std::vector<std::shared_ptr<CharacterInfo>>& characters)
+	{
+		for (auto& character : characters)
+			signatures_.push_back(fixedSignature<Word>(character->character, character->size, character->amphibious.offset));
+	}
+
+	virtual uint32_t matchLanes(const char* buffer, uint32_t lanes, uint32_t alignment) const
+	{
+		// each signature gathered from every lane and compared by the dispatched kernel at once
+		const ScanKernels& kernels = CpuDispatch::kernels();
+		const uint32_t all_lanes = lanes >= 32 ? 0xFFFFFFFF : (1u << lanes) - 1;
+		uint32_t matched = (Logic == LT_And) ? all_lanes : 0;
+		uint64_t values[WD_PROBE_LANES];
+		lanes = std::min<uint32_t>(lanes, WD_PROBE_LANES);
+		for (auto& signature : signatures_)
+		{
+			uint32_t valid = 0;
+			for (uint32_t lane = 0; lane < lanes; ++lane)
+			{
+				Word word = 0;
+				if (signature.load(buffer, lane * alignment + signature.offset, WD_BLOCK_SIZE, word))
+					valid |= 1u << lane;
+				values[lane] = word;
+			}
+			uint32_t equal = kernels.compareLanes(values, lanes, signature.value, signature.mask) & valid;
+			matched = (Logic == LT_And) ? (matched & equal) : (matched | equal);
+			if (Logic == LT_And ? matched == 0 : matched == all_lanes)
+				break;
+		}
+		return matched;
+	}
+
+private:
+	std::vector<FixedSignature<Word>> signatures_;
+};
+
+// lanes where the compiled header pattern matches, a pattern may run to the end of the block
+class PatternHeaderMatcher : public HeaderMatcher
+{
+public:
+	PatternHeaderMatcher(std::shared_ptr<const PatternDfa> dfa)
+		: dfa_(dfa)
+	{
+
+	}
+
+	virtual uint32_t matchLanes(const char* buffer, uint32_t lanes, uint32_t alignment) const
+	{
+		uint32_t matched = 0;
+		for (uint32_t lane = 0; lane < lanes; ++lane)
+		{
+			uint32_t pos = lane * alignment;
+			matched |= (uint32_t)dfa_->matchAt((const uint8_t*)buffer + pos, WD_BLOCK_SIZE - pos) << lane;
+		}
+		return matched;
+	}
+
+private:
+	std::shared_ptr<const PatternDfa> dfa_;
+};
+
+template<typename Word>
+class FixedFooterMatcher : public FooterMatcher
+{
+public:
+	explicit FixedFooterMatcher(const std::vector<std::shared_ptr<CharacterInfo>>& characters)
+	{
+		for (auto& character : characters)
+			signatures_.push_back(fixedSignature<Word>(character->character, character->size, 0));
+	}
+
+	virtual int32_t search(const char* buffer, int32_t size, int32_t& index) const
+	{
+		// the dispatched kernel skips to candidates of the first two bytes, memchr to the first of one byte signatures,
+		// the whole signature is confirmed by one load
+		const ScanKernels& kernels = CpuDispatch::kernels();
+		int32_t found = -1;
+		for (size_t pos = 0; pos < signatures_.size(); ++pos)
+		{
+			auto& signature = signatures_[pos];
+			const uint8_t first = (uint8_t)(signature.value & 0xFF);
+			const uint8_t second = (uint8_t)((signature.value >> 8) & 0xFF);
+			int32_t limit = found >= 0 ? found : size;
+			const char* cursor = buffer;
+			while (cursor < buffer + limit)
+			{
+				if (signature.size >= 2)
+				{
+					// the second byte of a start before `limit` may lie on it
+					size_t length = std::min(limit + 1, size) - (cursor - buffer);
+					size_t offset = kernels.findPair((const uint8_t*)cursor, length, first, second);
+					cursor = offset < length ? cursor + offset : nullptr;
+				}
+				else
+				{
+					cursor = (const char*)memchr(cursor, (char)first, buffer + limit - cursor);
+				}
+				if (cursor == nullptr)
+					break;
+				if (signature.match(buffer, (uint32_t)(cursor - buffer), (uint32_t)size))
+				{
+					found = (int32_t)(cursor - buffer);
+					index = (int32_t)pos;
+					break;
+				}
+				++cursor;
+			}
+		}
+		return found;
+	}
+
+private:
+	std::vector<FixedSignature<Word>> signatures_;
+};
+
 typedef enum _CarverStatus 
 {
 	CS_Init			= 0,
@@ -76,12 +304,42 @@ typedef enum _CarverStatus
 	CS_Completed
 }CarverStatus;
 
+typedef enum _CarveEventType
+{
+	CE_Header		= 0,		/* candidate opened */
+	CE_Footer,					/* candidate closed by a footer */
+	CE_Truncate					/* candidate closed at the truncate limit */
+}CarveEventType;
+
+typedef struct _CarveEvent
+{
+	CarveEventType	type;
+	uint64_t		blockno;		/* block holding the event */
+	int32_t			offset;			/* byte offset from `blockno` */
+	uint64_t		start_blockno;	/* start of the candidate */
+}CarveEvent, *PCarveEvent;
+
+// read-only run of consecutive WD_BLOCK_SIZE blocks
+typedef struct _BlockSpan
+{
+	const char*		data;
+	uint32_t		count;
+	uint64_t		start_blockno;	/* sector number of the first block */
+	bool			claimed;		/* inside an extent claimed by another carve */
+	bool			continuation;	/* carves already open go on, no header is taken */
+}BlockSpan, *PBlockSpan;
+
 typedef struct _CarvedFileInfo 
 {
+	CarverStatus status;
+	uint64_t	id;
+	uint64_t	parent_id;
 	uint64_t	size;
 	uint64_t	start_blockno;
 	uint64_t	block_count;
+	uint64_t	next_blockno;
 	std::string	base_name;
+	StreamDigest digest;
 }CarvedFileInfo, *PCarvedFileInfo;
 
 class FileCarver
@@ -98,12 +356,56 @@ public:
 	virtual std::string getExtension() const;
 
 	virtual CarverStatus getCarverStatus() const;
+
+	virtual bool acceptsHeader() const;
+
+	virtual std::vector<std::shared_ptr<CarvedFileInfo>>& getCandidates();
+
+	virtual std::vector<std::shared_ptr<CarvedFileInfo>> takeCompleted();
+
+	virtual int64_t getDroppedCount() const;
+
+	// header probes with at least one lane matched, taken or dropped
+	virtual int64_t getHeaderMatches() const;
+
+	virtual ClaimPolicy getClaimPolicy() const;
+
+	virtual int64_t getTruncateSize() const;
+
+	virtual uint32_t getDigestFlags() const;
+
+	virtual std::shared_ptr<Validator> getValidator() const;
+
+	virtual LogicType getHeaderLogic() const;
+
+	virtual const std::vector<ProbeInfo>& getHeaderProbes() const;
+
+	virtual uint32_t getProbeLanes() const;
+
+	virtual uint16_t getProbeAlignment() const;
+
+	// header pattern, empty text for literal characteristics
+	virtual const PatternSource& getHeaderPattern() const;
 	//
 	virtual int32_t setCharacteristics(frjson::object_t object);
 
+	// bytes per sector of the scanned device and header probe granularity
+	virtual void setGeometry(uint16_t sector_size, uint16_t alignment);
+
+	virtual uint16_t getSectorSize() const;
+
 	virtual std::shared_ptr<CarvedFileInfo> getCarvedFileInfo() const;
 
-	// Interfaces impl by subclass
+	// header lanes matched in a block, nothing is opened
+	virtual uint32_t matchHeader(const char* buffer) const;
+
+	// drop open candidates, the following blocks do not continue them
+	virtual int32_t discardCandidates();
+
+	// header, footer and truncate over every block of `span`, returns the number of events appended
+	virtual int32_t analyzeBlocks(const BlockSpan& span, std::vector<CarveEvent>& events);
+
+	// Per package adapters of analyzeBlocks
 	virtual int32_t analyzeHeader(std::shared_ptr<ClusterPackage> package);
 
 	virtual int32_t analyzeBody(std::shared_ptr<ClusterPackage> package);
@@ -112,24 +414,66 @@ public:
 
 	virtual int32_t truncate(std::shared_ptr<ClusterPackage> package);
 
-public:
-	static uint16_t WD_SECTOR_SIZE;
+	// open candidate ended by the footer at `offset` of block `blockno`, -1 for none
+	virtual int32_t matchFooter(uint64_t blockno, int32_t offset);
 
+public:
 	inline LogicType logicType(std::string& logic);
 
+	inline ClaimPolicy claimPolicy(std::string& policy);
+
+	inline AlgorithmType algorithmType(std::string& algorithm);
+
+protected:
+	uint32_t probeLanes(const char* buffer, const ProbeInfo& probe) const;
+
+	std::shared_ptr<CharacterInfo> searchFooter(const char* buffer, int32_t size, int32_t& offset);
+
+	int32_t headerAt(const char* buffer, uint64_t blockno, std::vector<CarveEvent>* events);
+
+	int32_t footerAt(const char* buffer, uint64_t blockno, std::vector<CarveEvent>* events);
+
+	int32_t truncateAt(uint64_t blockno, std::vector<CarveEvent>* events);
+
+	void closeCandidate(size_t index, uint64_t blockno, uint64_t block_count, uint64_t size);
+
+	void compileMatchers();
+
+	// fill bytes of a uniform block the header or footer can match in
+	void compileUniform();
+
 protected:
 	std::string extension_;
-	CarverStatus carver_status_;
-	std::shared_ptr<CarvedFileInfo> carved_file_info_;
+	int64_t dropped_count_;
+	int64_t header_matches_;
+	uint32_t max_candidates_;
+	std::vector<std::shared_ptr<CarvedFileInfo>> candidates_;
+	std::vector<std::shared_ptr<CarvedFileInfo>> completed_;
 	// configure
 	uint64_t developer_id_;
 	int64_t truncate_size_;
+	ClaimPolicy claim_policy_;
 	std::string algorithm_;
+	uint32_t digest_flags_;
+	std::shared_ptr<Validator> validator_;
 	std::shared_ptr<NameInfo> name_info_;
 	std::tuple<LogicType, LogicType, LogicType> logic_tuple_;
 	std::vector<std::shared_ptr<CharacterInfo>> header_vector_;
 	std::vector<std::shared_ptr<CharacterInfo>> body_vector_;
 	std::vector<std::shared_ptr<CharacterInfo>> footer_vector_;
+	// header probe at each sector boundary
+	uint16_t sector_size_;
+	uint32_t probe_lanes_;
+	uint16_t probe_alignment_;
+	std::vector<ProbeInfo> header_probe_;
+	PatternSource header_pattern_;
+	std::shared_ptr<const PatternDfa> header_dfa_;
+	// specialized at load time, nullptr for the generic path
+	std::shared_ptr<HeaderMatcher> header_matcher_;
+	std::shared_ptr<FooterMatcher> footer_matcher_;
+	// blocks of one repeated byte skip what can not match there, mostly zeroed space
+	std::bitset<256> uniform_headers_;
+	std::bitset<256> uniform_footers_;
 };
 
 #endif // FILE_CARVER_H
@@ -0,0 +1,152 @@
+/**********************************************************************
+*
+* Copyright (C)2015-2022 Maxwell Analytica. All rights reserved.
+*
+* @file fragmentassembler.cpp
+* @brief
+* @details
+* @author Maxwell
+* @version 1.0.0
+* @date 2026-10-19 23:58:31.604
+*
+**********************************************************************/
+#include "fragmentassembler.h"
+#include <algorithm>
+
+FragmentAssembler::FragmentAssembler(DeviceReader reader, uint32_t sector_size, const FragmentPolicy& policy, ValidationScratch* scratch)
+{
+	reader_ = reader;
+	scratch_ = scratch;
+	sector_size_ = sector_size > 0 ? sector_size : 512;
+	policy_ = policy;
+	// whole sectors, so every fragment starts on one
+	policy_.cluster = policy_.cluster > sector_size_ ? policy_.cluster - policy_.cluster % sector_size_ : sector_size_;
+	attempts_ = 0;
+}
+
+FragmentAssembler::~FragmentAssembler()
+{
+
+}
+
+int64_t FragmentAssembler::attempts() const
+{
+	return attempts_;
+}
+
+int32_t FragmentAssembler::assemble(Validator& validator, int32_t threshold, uint64_t broken, std::vector<CarvedFragment>& fragments)
+{
+	attempts_ = 0;
+	int32_t confidence = 0;
+	const uint64_t cluster = policy_.cluster;
+	std::vector<CarvedFragment> candidate, chosen;
+	while ((int32_t)fragments.size() < policy_.max_fragments && !fragments.empty())
+	{
+		// only the last fragment is split, the ones before held up to it
+		uint64_t base = 0, size = 0;
+		for (size_t index = 0; index < fragments.size(); ++index)
+		{
+			if (index + 1 < fragments.size())
+				base += fragments[index].size;
+			size += fragments[index].size;
+		}
+		uint64_t highest = broken / cluster * cluster;
+		uint64_t lowest = std::max(base + cluster, broken > policy_.cut_window ? broken - policy_.cut_window : 0);
+
+		// nearest cut first, for each cut the smallest gap first, the first layout holding past the cut is taken
+		uint64_t farthest = 0;
+		chosen.clear();
+		for (uint64_t cut = highest; cut >= lowest && cut < size && chosen.empty(); cut -= cluster)
+		{
+			for (uint64_t gap = cluster; gap <= policy_.gap_window; gap += cluster)
+			{
+				if (!split(fragments, cut, gap, candidate))
+					break;
+				CarvedSource source(reader_, candidate, sector_size_, scratch_);
+				int32_t score = validator.validate(source);
+				++attempts_;
+				if (score >= threshold)
+				{
+					fragments = candidate;
+					return score;
+				}
+				// holding for more than a cluster, and broken again further on to be split there
+				if (source.broken() >= cut + cluster && source.broken() < source.size())
+				{
+					farthest = source.broken();
+					chosen = candidate;
+					confidence = score;
+					break;
+				}
+			}
+		}
+		if (chosen.empty())
+			break;
+		fragments = chosen;
+		broken = farthest;
+	}
+	return confidence;
+}
+
+bool FragmentAssembler::split(const std::vector<CarvedFragment>& fragments, uint64_t cut, uint64_t gap, std::vector<CarvedFragment>& result) const
+{
+	result.clear();
+	uint64_t base = 0;
+	size_t index = 0;
+	for (; index < fragments.size() && cut >= base + fragments[index].size; ++index)
+	{
+		result.push_back(fragments[index]);
+		base += fragments[index].size;
+	}
+	if (index == fragments.size() || cut == base)
+		return false;
+
+	const CarvedFragment& fragment = fragments[index];
+	uint64_t head = cut - base;
+	if (head + gap >= fragment.size)
+		return false;
+	result.push_back({ fragment.start_blockno, head });
+	result.push_back({ fragment.start_blockno + (head + gap) / sector_size_, fragment.size - head - gap });
+	for (++index; index < fragments.size(); ++index)
+		result.push_back(fragments[index]);
+	return true;
+}
+
+Runlist* FragmentAssembler::runlist(const std::vector<CarvedFragment>& fragments, uint32_t sector_size)
+{
+	Runlist* head = nullptr;
+	Runlist** tail = &head;
+	uint64_t offset = 0;
+	for (auto& fragment : fragments)
+	{
+		auto node = new Runlist();
+		node->Offset = offset;
+		node->Start = fragment.start_blockno;
+		node->Number = (fragment.size + sector_size - 1) / sector_size;
+		*tail = node;
+		tail = &node->Next;
+		offset += fragment.size;
+	}
+	return head;
+}
+
+std::vector<CarvedFragment> FragmentAssembler::fragments(const Runlist* runlist, uint64_t size)
+{
+	std::vector<CarvedFragment> result;
+	for (const Runlist* node = runlist; node != nullptr; node = node->Next)
+	{
+		uint64_t end = node->Next != nullptr ? node->Next->Offset : size;
+		result.push_back({ node->Start, end - node->Offset });
+	}
+	return result;
+}
+
+void FragmentAssembler::release(Runlist* runlist)
+{
+	while (runlist != nullptr)
+	{
+		Runlist* next = runlist->Next;
+		delete runlist;
+		runlist = next;
+	}
+}
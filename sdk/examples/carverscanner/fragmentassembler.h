@@ -0,0 +1,64 @@
+/**********************************************************************
+*
+* Copyright (C)2015-2022 Maxwell Analytica. All rights reserved.
+*
+* @file fragmentassembler.h
+* @brief Gap carving of fragmented files between header and footer
+* @details A carve failing validation where its validator marks a break is
+*          split on a cluster boundary before the break, and the rest is
+*          searched a bounded gap later. Layouts holding further than the
+*          last break are split again, up to the fragment limit.
+* @author Maxwell
+* @version 1.0.0
+* @date 2026-10-19 23:58:31.604
+*
+**********************************************************************/
+#ifndef FRAGMENT_ASSEMBLER_H
+#define FRAGMENT_ASSEMBLER_H
+
+#include "validator.h"
+#include "../../include/datatype.h"
+
+typedef struct _FragmentPolicy
+{
+	int32_t		max_fragments;	/* 1 keeps carves contiguous */
+	uint32_t	cluster;		/* bytes, fragments split on cluster boundaries of the file */
+	uint64_t	gap_window;		/* longest foreign run searched between two fragments */
+	uint64_t	cut_window;		/* how far before a break the fragment may end */
+}FragmentPolicy, *PFragmentPolicy;
+
+class FragmentAssembler
+{
+public:
+	// every layout tried is read through `scratch` when given
+	FragmentAssembler(DeviceReader reader, uint32_t sector_size, const FragmentPolicy& policy, ValidationScratch* scratch = nullptr);
+	~FragmentAssembler();
+
+	// `fragments` holds a carve whose validation broke at `broken`, it is split until a layout
+	// reaches `threshold`, returns the confidence of the layout left in `fragments`
+	int32_t assemble(Validator& validator, int32_t threshold, uint64_t broken, std::vector<CarvedFragment>& fragments);
+
+	// layouts validated by the last assemble
+	int64_t attempts() const;
+
+public:
+	// chained runlist of the fragments, `Offset` is the position in the file
+	static Runlist* runlist(const std::vector<CarvedFragment>& fragments, uint32_t sector_size);
+
+	static std::vector<CarvedFragment> fragments(const Runlist* runlist, uint64_t size);
+
+	static void release(Runlist* runlist);
+
+private:
+	// `fragments` ending at file offset `cut`, the rest of that fragment `gap` bytes later
+	bool split(const std::vector<CarvedFragment>& fragments, uint64_t cut, uint64_t gap, std::vector<CarvedFragment>& result) const;
+
+private:
+	DeviceReader reader_;
+	ValidationScratch* scratch_;
+	uint32_t sector_size_;
+	FragmentPolicy policy_;
+	int64_t attempts_;
+};
+
+#endif // FRAGMENT_ASSEMBLER_H
@@ -0,0 +1,103 @@
+/**********************************************************************
+*
+* Copyright (C)2015-2022 Maxwell Analytica. All rights reserved.
+*
+* @file headercache.cpp
+* @brief
+* @details
+* @author Maxwell
+* @version 1.0.0
+* @date 2026-10-19 23:59:51.604
+*
+**********************************************************************/
+#include "headercache.h"
+#include <algorithm>
+
+HeaderCache::HeaderCache()
+{
+	set_mask_ = 0;
+	hits_ = 0;
+	misses_ = 0;
+}
+
+HeaderCache::~HeaderCache()
+{
+
+}
+
+void HeaderCache::setCapacity(int64_t capacity)
+{
+	uint64_t sets = 0;
+	if (capacity >= WD_HEADER_CACHE_WAYS)
+	{
+		sets = 1;
+		while (sets * 2 * WD_HEADER_CACHE_WAYS <= (uint64_t)capacity)
+			sets *= 2;
+	}
+	ways_.assign(sets * WD_HEADER_CACHE_WAYS, 0);
+	set_mask_ = sets > 0 ? sets - 1 : 0;
+	hits_ = 0;
+	misses_ = 0;
+}
+
+int64_t HeaderCache::capacity() const
+{
+	return (int64_t)ways_.size();
+}
+
+bool HeaderCache::enabled() const
+{
+	return !ways_.empty();
+}
+
+uint64_t* HeaderCache::set(uint64_t hash)
+{
+	return ways_.data() + (hash & set_mask_) * WD_HEADER_CACHE_WAYS;
+}
+
+bool HeaderCache::lookup(uint64_t hash)
+{
+	if (ways_.empty())
+		return false;
+	hash = hash != 0 ? hash : 1;
+	uint64_t* ways = set(hash);
+	for (uint32_t way = 0; way < WD_HEADER_CACHE_WAYS; ++way)
+	{
+		if (ways[way] == hash)
+		{
+			// the hit moves to the front of its set
+			std::rotate(ways, ways + way, ways + way + 1);
+			++hits_;
+			return true;
+		}
+	}
+	++misses_;
+	return false;
+}
+
+void HeaderCache::insert(uint64_t hash)
+{
+	if (ways_.empty())
+		return;
+	hash = hash != 0 ? hash : 1;
+	uint64_t* ways = set(hash);
+	std::copy_backward(ways, ways + WD_HEADER_CACHE_WAYS - 1, ways + WD_HEADER_CACHE_WAYS);
+	ways[0] = hash;
+}
+
+void HeaderCache::clear()
+{
+	std::fill(ways_.begin(), ways_.end(), 0);
+	hits_ = 0;
+	misses_ = 0;
+}
+
+int64_t HeaderCache::hits() const
+{
+	return hits_;
+}
+
+int64_t HeaderCache::misses() const
+{
+	return misses_;
+}
@@ -0,0 +1,61 @@
+/**********************************************************************
+*
+* Copyright (C)2015-2022 Maxwell Analytica. All rights reserved.
+*
+* @file headercache.h
+* @brief Bounded set of block hashes no header was found in
+* @details Hashes are spread over sets of four ways by their low bits, a set
+*          keeps its ways in recently used order and drops the last one.
+*          Only the carving thread uses it, there is no lock
+* @author Maxwell
+* @version 1.0.0
+* @date 2026-10-19 23:59:51.604
+*
+**********************************************************************/
+#ifndef HEADER_CACHE_H
+#define HEADER_CACHE_H
+
+#include <vector>
+#include <stdint.h>
+
+#define WD_HEADER_CACHE_WAYS	4
+
+class HeaderCache
+{
+public:
+	HeaderCache();
+	~HeaderCache();
+
+	// hashes kept, rounded down to a power of two sets, 0 disables the cache
+	void setCapacity(int64_t capacity);
+
+	int64_t capacity() const;
+
+	bool enabled() const;
+
+	// `hash` was inserted and is still kept, counts a hit or a miss
+	bool lookup(uint64_t hash);
+
+	void insert(uint64_t hash);
+
+	void clear();
+
+	int64_t hits() const;
+
+	int64_t misses() const;
+
+public:
+	static constexpr int64_t DefaultCapacity = 65536;
+
+private:
+	uint64_t* set(uint64_t hash);
+
+private:
+	// 0 marks a free way, a hash of 0 is kept as 1
+	std::vector<uint64_t> ways_;
+	uint64_t set_mask_;
+	int64_t hits_;
+	int64_t misses_;
+};
+
+#endif // HEADER_CACHE_H
@@ -0,0 +1,109 @@
+/**********************************************************************
+*
+* Copyright (C)2015-2022 Maxwell Analytica. All rights reserved.
+*
+* @file memorybudget.cpp
+* @brief
+* @details
+* @author Maxwell
+* @version 1.0.0
+* @date 2026-10-19 15:21:53.041
+*
+**********************************************************************/
+#include "memorybudget.h"
+
+MemoryBudget::MemoryBudget()
+{
+	used_ = 0;
+	waiters_ = 0;
+	setLimit(DefaultLimit);
+}
+
+MemoryBudget::~MemoryBudget()
+{
+
+}
+
+void MemoryBudget::setLimit(int64_t limit)
+{
+	// keep room for at least a few hundred packages
+	limit_ = limit < 0x100000 ? 0x100000 : limit;
+	soft_limit_ = limit_ / 4 * 3;
+}
+
+int64_t MemoryBudget::limit() const
+{
+	return limit_;
+}
+
+int64_t MemoryBudget::used() const
+{
+	return used_;
+}
+
+void MemoryBudget::charge(int64_t bytes)
+{
+	used_ += bytes;
+}
+
+bool MemoryBudget::tryCharge(int64_t bytes)
+{
+	int64_t used = used_.load();
+	do
+	{
+		if (used + bytes > limit_)
+			return false;
+	} while (!used_.compare_exchange_weak(used, used + bytes));
+	return true;
+}
+
+void MemoryBudget::release(int64_t bytes)
+{
+	used_ -= bytes;
+	// the lock is only taken while someone waits, a waiter counted before it checked is never missed
+	if (waiters_ > 0)
+		wake();
+}
+
+void MemoryBudget::waitRoom(const std::function<bool()>& blocked)
+{
+	++waiters_;
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		cond_.wait(lock, [&] { return used_ < limit_ || !blocked(); });
+	}
+	--waiters_;
+}
+
+void MemoryBudget::wake()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+	}
+	cond_.notify_all();
+}
+
+MemoryPressure MemoryBudget::pressure() const
+{
+	int64_t used = used_;
+	if (used >= limit_)
+		return MP_Hard;
+	//
+	return used >= soft_limit_ ? MP_Soft : MP_Normal;
+}
+
+double MemoryBudget::overload() const
+{
+	int64_t used = used_;
+	if (used <= soft_limit_)
+		return 0.0;
+	if (used >= limit_)
+		return 1.0;
+	//
+	return (double)(used - soft_limit_) / (double)(limit_ - soft_limit_);
+}
+
+void MemoryBudget::reset()
+{
+	used_ = 0;
+}
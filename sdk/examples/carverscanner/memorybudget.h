@@ -0,0 +1,76 @@
+/**********************************************************************
+*
+* Copyright (C)2015-2022 Maxwell Analytica. All rights reserved.
+*
+* @file memorybudget.h
+* @brief Memory budget shared by the buffers of one scanner
+* @details Ingest queue, open carves and pending results charge the budget,
+*          producers back off when it passes the soft limit
+* @author Maxwell
+* @version 1.0.0
+* @date 2026-10-19 15:21:53.041
+*
+**********************************************************************/
+#ifndef MEMORY_BUDGET_H
+#define MEMORY_BUDGET_H
+
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+#include <stdint.h>
+
+typedef enum _MemoryPressure
+{
+	MP_Normal	= 0,		/* below soft limit */
+	MP_Soft,				/* between soft and hard limit, slow down */
+	MP_Hard					/* budget exhausted, refuse */
+} MemoryPressure;
+
+class MemoryBudget
+{
+public:
+	MemoryBudget();
+	~MemoryBudget();
+
+	void setLimit(int64_t limit);
+
+	int64_t limit() const;
+
+	int64_t used() const;
+
+	// charge unconditionally, for memory that can not be refused
+	void charge(int64_t bytes);
+
+	// charge unless the hard limit would be passed
+	bool tryCharge(int64_t bytes);
+
+	// wakes callers waiting for room
+	void release(int64_t bytes);
+
+	// wait while the hard limit is reached and `blocked` holds, checked again on every release and wake
+	void waitRoom(const std::function<bool()>& blocked);
+
+	// waiting callers check `blocked` again, for changes the budget does not see
+	void wake();
+
+	MemoryPressure pressure() const;
+
+	// fraction of the soft to hard range in use, 0 below soft limit
+	double overload() const;
+
+	void reset();
+
+public:
+	static constexpr int64_t DefaultLimit = 64ll * 1024 * 1024;
+
+private:
+	int64_t limit_;
+	int64_t soft_limit_;
+	std::atomic<int64_t> used_;
+	std::atomic<int32_t> waiters_;
+	std::mutex mutex_;
+	std::condition_variable cond_;
+};
+
+#endif // MEMORY_BUDGET_H
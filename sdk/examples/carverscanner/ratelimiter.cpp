@@ -0,0 +1,220 @@
+/**********************************************************************
+*
+* Copyright (C)2015-2022 Maxwell Analytica. All rights reserved.
+*
+* @file ratelimiter.cpp
+* @brief
+* @details
+* @author Maxwell
+* @version 1.0.0
+* @date 2026-10-19 21:07:35.612
+*
+**********************************************************************/
+#include "ratelimiter.h"
+#include <algorithm>
+
+using namespace std::chrono;
+
+// burst allowed by a full bucket, in seconds of the rate
+const double ConstBurstSeconds		= 0.1;
+// adaptive mode, multiplicative back off and additive recovery once per interval
+const double ConstBackoffFactor		= 0.7;
+const double ConstRecoverStep		= 0.05;
+const double ConstMinimumScale		= 0.05;
+const int64_t ConstAdjustMillisecond	= 200;
+
+RateLimiter::RateLimiter()
+{
+	bytes_limit_ = 0;
+	iops_limit_ = 0;
+	latency_target_ = 0;
+	reset();
+}
+
+RateLimiter::~RateLimiter()
+{
+
+}
+
+void RateLimiter::setLimit(int64_t bytes_per_second, int64_t iops)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	bytes_limit_ = std::max<int64_t>(bytes_per_second, 0);
+	iops_limit_ = std::max<int64_t>(iops, 0);
+	byte_tokens_ = std::min<double>(byte_tokens_, bytes_limit_ * ConstBurstSeconds);
+	op_tokens_ = std::min<double>(op_tokens_, std::max(iops_limit_ * ConstBurstSeconds, 1.0));
+}
+
+void RateLimiter::setLatencyTarget(int64_t microseconds)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	latency_target_ = std::max<int64_t>(microseconds, 0);
+	if (latency_target_ == 0)
+	{
+		scale_ = 1.0;
+		adaptive_bytes_ = 0;
+	}
+}
+
+int64_t RateLimiter::bytesLimit() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return bytes_limit_;
+}
+
+int64_t RateLimiter::iopsLimit() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return iops_limit_;
+}
+
+int64_t RateLimiter::latencyTarget() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return latency_target_;
+}
+
+bool RateLimiter::limited() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return bytes_limit_ > 0 || iops_limit_ > 0 || latency_target_ > 0;
+}
+
+void RateLimiter::refill(steady_clock::time_point now)
+{
+	double elapsed = duration<double>(now - refilled_).count();
+	refilled_ = now;
+	int64_t bytes_rate = bytes_limit_ > 0 ? bytes_limit_ : adaptive_bytes_;
+	if (bytes_rate > 0)
+	{
+		double rate = bytes_rate * scale_;
+		byte_tokens_ = std::min(byte_tokens_ + elapsed * rate, rate * ConstBurstSeconds);
+	}
+	if (iops_limit_ > 0)
+	{
+		double rate = iops_limit_ * scale_;
+		op_tokens_ = std::min(op_tokens_ + elapsed * rate, std::max(rate * ConstBurstSeconds, 1.0));
+	}
+}
+
+void RateLimiter::account(steady_clock::time_point now, int64_t bytes)
+{
+	auto elapsed = duration_cast<milliseconds>(now - window_start_).count();
+	if (elapsed >= 1000)
+	{
+		effective_bytes_ = window_bytes_ * 1000 / elapsed;
+		effective_iops_ = window_ops_ * 1000 / elapsed;
+		window_start_ = now;
+		window_bytes_ = 0;
+		window_ops_ = 0;
+	}
+	window_bytes_ += bytes;
+	window_ops_ += 1;
+}
+
+int64_t RateLimiter::reserve(int64_t bytes)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	auto now = steady_clock::now();
+	refill(now);
+	account(now, bytes);
+	
+	// tokens may go negative, a large request waits for its own debt
+	double wait = 0.0;
+	int64_t bytes_rate = bytes_limit_ > 0 ? bytes_limit_ : adaptive_bytes_;
+	if (bytes_rate > 0)
+	{
+		byte_tokens_ -= bytes;
+		if (byte_tokens_ < 0)
+			wait = std::max(wait, -byte_tokens_ / (bytes_rate * scale_));
+	}
+	if (iops_limit_ > 0)
+	{
+		op_tokens_ -= 1.0;
+		if (op_tokens_ < 0)
+			wait = std::max(wait, -op_tokens_ / (iops_limit_ * scale_));
+	}
+	return (int64_t)(wait * 1000000);
+}
+
+bool RateLimiter::tryAcquire(int64_t bytes)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	auto now = steady_clock::now();
+	refill(now);
+	int64_t bytes_rate = bytes_limit_ > 0 ? bytes_limit_ : adaptive_bytes_;
+	if (bytes_rate > 0 && byte_tokens_ < std::min<double>(bytes, bytes_rate * scale_ * ConstBurstSeconds))
+		return false;
+	if (iops_limit_ > 0 && op_tokens_ < 1.0)
+		return false;
+	
+	if (bytes_rate > 0)
+		byte_tokens_ -= bytes;
+	if (iops_limit_ > 0)
+		op_tokens_ -= 1.0;
+	account(now, bytes);
+	return true;
+}
+
+void RateLimiter::observe(int64_t microseconds)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (latency_target_ <= 0)
+		return;
+	auto now = steady_clock::now();
+	if (duration_cast<milliseconds>(now - adjusted_).count() < ConstAdjustMillisecond)
+		return;
+	
+	if (microseconds > latency_target_)
+	{
+		// without a configured rate, back off from what is currently achieved
+		if (bytes_limit_ == 0 && adaptive_bytes_ == 0)
+		{
+			auto elapsed = std::max<int64_t>(duration_cast<milliseconds>(now - window_start_).count(), 1);
+			adaptive_bytes_ = std::max<int64_t>(effective_bytes_, window_bytes_ * 1000 / elapsed);
+		}
+		scale_ = std::max(scale_ * ConstBackoffFactor, ConstMinimumScale);
+		adjusted_ = now;
+	}
+	else if (scale_ < 1.0)
+	{
+		scale_ = std::min(scale_ + ConstRecoverStep, 1.0);
+		if (scale_ >= 1.0)
+			adaptive_bytes_ = 0;
+		adjusted_ = now;
+	}
+}
+
+int64_t RateLimiter::effectiveBytes() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return effective_bytes_;
+}
+
+int64_t RateLimiter::effectiveIops() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return effective_iops_;
+}
+
+double RateLimiter::scale() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return scale_;
+}
+
+void RateLimiter::reset()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	scale_ = 1.0;
+	adaptive_bytes_ = 0;
+	byte_tokens_ = bytes_limit_ * ConstBurstSeconds;
+	op_tokens_ = std::max(iops_limit_ * ConstBurstSeconds, 1.0);
+	refilled_ = steady_clock::now();
+	window_start_ = refilled_;
+	adjusted_ = refilled_;
+	window_bytes_ = 0;
+	window_ops_ = 0;
+	effective_bytes_ = 0;
+	effective_iops_ = 0;
+}
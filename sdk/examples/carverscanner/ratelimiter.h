@@ -0,0 +1,85 @@
+/**********************************************************************
+*
+* Copyright (C)2015-2022 Maxwell Analytica. All rights reserved.
+*
+* @file ratelimiter.h
+* @brief Token buckets on bytes and operations per second
+* @details Limits device traffic of a scanner on a disk serving a live workload,
+*          in adaptive mode the rate backs off while read latency is above target
+* @author Maxwell
+* @version 1.0.0
+* @date 2026-10-19 21:07:35.612
+*
+**********************************************************************/
+#ifndef RATE_LIMITER_H
+#define RATE_LIMITER_H
+
+#include <mutex>
+#include <chrono>
+#include <stdint.h>
+
+class RateLimiter
+{
+public:
+	RateLimiter();
+	~RateLimiter();
+
+	// 0 for unlimited
+	void setLimit(int64_t bytes_per_second, int64_t iops);
+
+	// latency target of one read in microseconds, 0 disables the adaptive mode
+	void setLatencyTarget(int64_t microseconds);
+
+	int64_t bytesLimit() const;
+
+	int64_t iopsLimit() const;
+
+	int64_t latencyTarget() const;
+
+	// a byte or iops limit or a latency target is set
+	bool limited() const;
+
+	// take tokens of one operation, returns microseconds the caller has to wait
+	int64_t reserve(int64_t bytes);
+
+	// take tokens only when available without waiting
+	bool tryAcquire(int64_t bytes);
+
+	// latency of a completed read in microseconds
+	void observe(int64_t microseconds);
+
+	// rates over the last full second
+	int64_t effectiveBytes() const;
+
+	int64_t effectiveIops() const;
+
+	// fraction of the configured rates allowed by the adaptive mode
+	double scale() const;
+
+	void reset();
+
+private:
+	void refill(std::chrono::steady_clock::time_point now);
+
+	void account(std::chrono::steady_clock::time_point now, int64_t bytes);
+
+private:
+	mutable std::mutex mutex_;
+	int64_t bytes_limit_;
+	int64_t iops_limit_;
+	int64_t latency_target_;
+	double scale_;
+	// adaptive rate when no byte limit is configured, 0 until the first back off
+	int64_t adaptive_bytes_;
+	double byte_tokens_;
+	double op_tokens_;
+	std::chrono::steady_clock::time_point refilled_;
+	std::chrono::steady_clock::time_point window_start_;
+	int64_t window_bytes_;
+	int64_t window_ops_;
+	int64_t effective_bytes_;
+	int64_t effective_iops_;
+	std::chrono::steady_clock::time_point adjusted_;
+};
+
+#endif // RATE_LIMITER_H
@@ -0,0 +1,100 @@
+/**********************************************************************
+*
+* Copyright (C)2015-2022 Maxwell Analytica. All rights reserved.
+*
+* @file regionscheduler.cpp
+* @brief
+* @details
+* @author Maxwell
+* @version 1.0.0
+* @date 2026-10-19 20:26:51.908
+*
+**********************************************************************/
+#include "regionscheduler.h"
+#include <algorithm>
+
+// sectors asked per window to tell unallocated space
+const int32_t ConstProbesPerWindow	= 8;
+
+RegionScheduler::RegionScheduler()
+{
+
+}
+
+RegionScheduler::~RegionScheduler()
+{
+
+}
+
+void RegionScheduler::build(int64_t device_size, int32_t sector_size, int64_t stride,
+	const std::vector<std::pair<int64_t, int64_t>>& ranges, AvailableProbe probe)
+{
+	windows_.clear();
+	if (device_size <= 0 || sector_size <= 0)
+		return;
+	stride = stride > sector_size ? stride - stride % sector_size : sector_size;
+
+	for (int64_t offset = 0; offset < device_size; offset += stride)
+	{
+		ScanRegion window = { offset, std::min(stride, device_size - offset), RP_Remainder };
+		for (auto& range : ranges)
+		{
+			if (range.first < window.offset + window.size && range.first + range.second > window.offset)
+			{
+				window.priority = RP_Requested;
+				break;
+			}
+		}
+		if (probe)
+		{
+			int64_t step = window.size / ConstProbesPerWindow;
+			for (int32_t index = 0; index < ConstProbesPerWindow; ++index)
+			{
+				int64_t position = window.offset + step * index;
+				if (probe((uint64_t)(position / sector_size)))
+				{
+					window.priority = RP_Unallocated;
+					break;
+				}
+			}
+		}
+		windows_.push_back(window);
+	}
+	std::stable_sort(windows_.begin(), windows_.end(), [](const ScanRegion& a, const ScanRegion& b) {
+		return a.priority < b.priority;
+	});
+}
+
+std::vector<ScanRegion> RegionScheduler::regions() const
+{
+	std::vector<ScanRegion> result;
+	for (auto& window : windows_)
+	{
+		if (!result.empty() && result.back().offset + result.back().size == window.offset && result.back().priority == window.priority)
+			result.back().size += window.size;
+		else
+			result.push_back(window);
+	}
+	return result;
+}
+
+std::vector<ScanRegion> RegionScheduler::samples(int64_t sample) const
+{
+	std::vector<ScanRegion> result;
+	for (auto& window : windows_)
+		result.push_back({ window.offset, std::min(sample, window.size), window.priority });
+	return result;
+}
+
+void RegionScheduler::clip(int64_t offset, int64_t size)
+{
+	std::vector<ScanRegion> clipped;
+	for (auto& window : windows_)
+	{
+		int64_t start = std::max(window.offset, offset);
+		int64_t end = std::min(window.offset + window.size, offset + size);
+		if (start < end)
+			clipped.push_back({ start, end - start, window.priority });
+	}
+	windows_.swap(clipped);
+}
@@ -0,0 +1,62 @@
+/**********************************************************************
+*
+* Copyright (C)2015-2022 Maxwell Analytica. All rights reserved.
+*
+* @file regionscheduler.h
+* @brief Prioritized order of device regions for scanner driven reads
+* @details The device is cut into stride sized windows, unallocated windows
+*          come first, then windows inside caller ranges, then the rest.
+*          Triage reads the leading sample of every window in that order
+* @author Maxwell
+* @version 1.0.0
+* @date 2026-10-19 20:26:51.908
+*
+**********************************************************************/
+#ifndef REGION_SCHEDULER_H
+#define REGION_SCHEDULER_H
+
+#include <vector>
+#include <functional>
+#include <stdint.h>
+
+typedef enum _RegionPriority
+{
+	RP_Unallocated	= 0,
+	RP_Requested,
+	RP_Remainder
+} RegionPriority;
+
+typedef struct _ScanRegion
+{
+	int64_t			offset;		/* bytes */
+	int64_t			size;
+	RegionPriority	priority;
+}ScanRegion, *PScanRegion;
+
+// whether sector `blockno` is unallocated, see ITransferDelegate::Availabled
+using AvailableProbe = std::function<bool(uint64_t blockno)>;
+
+class RegionScheduler
+{
+public:
+	RegionScheduler();
+	~RegionScheduler();
+
+	// ranges are {offset, size} in bytes
+	void build(int64_t device_size, int32_t sector_size, int64_t stride,
+		const std::vector<std::pair<int64_t, int64_t>>& ranges, AvailableProbe probe);
+
+	// whole windows for a full scan, adjacent windows of the same priority merged
+	std::vector<ScanRegion> regions() const;
+
+	// leading `sample` bytes of every window
+	std::vector<ScanRegion> samples(int64_t sample) const;
+
+	// windows cut to [offset, offset + size), the rest dropped
+	void clip(int64_t offset, int64_t size);
+
+private:
+	std::vector<ScanRegion> windows_;
+};
+
+#endif // REGION_SCHEDULER_H
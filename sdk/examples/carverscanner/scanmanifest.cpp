@@ -0,0 +1,370 @@
+/**********************************************************************
+*
+* Copyright (C)2015-2022 Maxwell Analytica. All rights reserved.
+*
+* @file scanmanifest.cpp
+* @brief
+* @details
+* @author Maxwell
+* @version 1.0.0
+* @date 2026-10-19 23:59:55.081
+*
+**********************************************************************/
+#include "scanmanifest.h"
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include "cpudispatch.h"
+#include "../../third_party/json.hpp"
+
+using frjson = nlohmann::json;
+
+static const int32_t ConstManifestVersion	= 1;
+
+// a block hash keyed by its position, the sum over an extent does not depend on the order of reads
+static inline uint64_t positioned(uint64_t hash, int64_t offset)
+{
+	uint64_t value = hash ^ ((uint64_t)offset * 0x9E3779B97F4A7C15ULL);
+	value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+	return value ^ (value >> 31);
+}
+
+static std::string hex(const uint8_t* bytes, size_t size)
+{
+	static const char digits[] = "0123456789abcdef";
+	std::string text;
+	for (size_t pos = 0; pos < size; ++pos)
+	{
+		text.push_back(digits[bytes[pos] >> 4]);
+		text.push_back(digits[bytes[pos] & 0x0F]);
+	}
+	return text;
+}
+
+ScanManifest::ScanManifest()
+{
+	device_size_ = 0;
+	sector_size_ = 512;
+	extent_ = DefaultExtent;
+	carvers_ = 0;
+}
+
+ScanManifest::~ScanManifest()
+{
+
+}
+
+void ScanManifest::reset(int64_t device_size, int32_t sector_size, int64_t extent, uint64_t carvers)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	device_size_ = device_size > 0 ? device_size : 0;
+	sector_size_ = sector_size > 0 ? sector_size : 512;
+	extent_ = extent > 0 ? (extent + WD_BLOCK_SIZE - 1) / WD_BLOCK_SIZE * WD_BLOCK_SIZE : DefaultExtent;
+	carvers_ = carvers;
+	size_t count = (size_t)((device_size_ + extent_ - 1) / extent_);
+	fingerprints_.assign(count, 0);
+	digested_.assign(count, 0);
+	files_.clear();
+}
+
+void ScanManifest::digest(const char* buffer, int64_t offset, int32_t count)
+{
+	const ScanKernels& kernels = CpuDispatch::kernels();
+	std::lock_guard<std::mutex> lock(mutex_);
+	int64_t end = std::min(offset + count, device_size_);
+	for (int64_t pos = offset; pos < end;)
+	{
+		// whole device blocks are hashed alone, a block split between two reads in pieces
+		int64_t next = std::min(end, (pos / WD_BLOCK_SIZE + 1) * WD_BLOCK_SIZE);
+		size_t index = (size_t)(pos / extent_);
+		fingerprints_[index] += positioned(kernels.hash64((const uint8_t*)buffer + (pos - offset), (size_t)(next - pos)), pos);
+		digested_[index] += next - pos;
+		pos = next;
+	}
+}
+
+void ScanManifest::record(const RawFileInfo* info)
+{
+	ManifestFile file;
+	file.info = *info;
+	file.info.Runlist = nullptr;
+	file.first = INT64_MAX;
+	file.last = 0;
+	for (const Runlist* run = info->Runlist; run != nullptr; run = run->Next)
+	{
+		Runlist copy = *run;
+		copy.Next = nullptr;
+		file.runs.push_back(copy);
+		file.first = std::min<int64_t>(file.first, (int64_t)run->Start * sector_size_);
+		file.last = std::max<int64_t>(file.last, (int64_t)(run->Start + run->Number) * sector_size_);
+	}
+	if (file.runs.empty())
+		file.first = 0;
+	std::lock_guard<std::mutex> lock(mutex_);
+	files_.emplace_back(std::move(file));
+}
+
+int64_t ScanManifest::extentBytes(int64_t index) const
+{
+	return std::min(extent_, device_size_ - index * extent_);
+}
+
+bool ScanManifest::complete(int64_t index) const
+{
+	return index >= 0 && index < (int64_t)digested_.size() && digested_[index] == extentBytes(index);
+}
+
+bool ScanManifest::compatible(const ScanManifest& other) const
+{
+	return device_size_ == other.device_size_ && sector_size_ == other.sector_size_ && extent_ == other.extent_ && carvers_ == other.carvers_;
+}
+
+IncrementalPlan ScanManifest::plan(const ScanManifest& current, int64_t window) const
+{
+	IncrementalPlan plan;
+	plan.changed = 0;
+	const int64_t count = (int64_t)std::min(fingerprints_.size(), current.fingerprints_.size());
+	// extents not known to be equal keep files from being reused, those pulled now are carved again
+	std::vector<uint8_t> unknown(count, 0);
+	std::vector<uint8_t> carve(count, 0);
+	for (int64_t index = 0; index < count; ++index)
+	{
+		if (complete(index) && current.complete(index) && fingerprints_[index] == current.fingerprints_[index])
+			continue;
+		unknown[index] = 1;
+		if (current.digested_[index] == 0)
+			continue;
+		carve[index] = 1;
+		++plan.changed;
+		// a header shortly before may now end in a different file
+		for (int64_t before = std::max<int64_t>(0, (index * extent_ - window) / extent_); before < index; ++before)
+			carve[before] = current.digested_[before] > 0 ? 1 : carve[before];
+	}
+
+	// a file depending on an unknown extent or starting in one carved again is carved again over its span,
+	// which may take in further files
+	std::vector<uint8_t> dropped(files_.size(), 0);
+	bool grown = true;
+	while (grown)
+	{
+		grown = false;
+		for (size_t file = 0; file < files_.size(); ++file)
+		{
+			if (dropped[file])
+				continue;
+			int64_t first = std::min(files_[file].first / extent_, count - 1);
+			int64_t last = std::min(std::max(files_[file].last - 1, files_[file].first) / extent_, count - 1);
+			bool depends = first < 0 || carve[first] != 0;
+			for (int64_t index = first; index <= last && !depends; ++index)
+				depends = unknown[index] != 0;
+			if (!depends)
+				continue;
+			dropped[file] = 1;
+			for (int64_t index = std::max<int64_t>(first, 0); index <= last; ++index)
+			{
+				if (carve[index] == 0 && current.digested_[index] > 0)
+				{
+					carve[index] = 1;
+					grown = true;
+				}
+			}
+		}
+	}
+
+	for (size_t file = 0; file < files_.size(); ++file)
+	{
+		if (!dropped[file])
+			plan.reused.push_back(file);
+	}
+	for (int64_t index = 0; index < count;)
+	{
+		if (carve[index] == 0)
+		{
+			++index;
+			continue;
+		}
+		int64_t end = index;
+		while (end < count && carve[end] != 0)
+			++end;
+		int64_t offset = index * extent_;
+		plan.carve.emplace_back(offset, std::min(end * extent_, device_size_) - offset);
+		index = end;
+	}
+	return plan;
+}
+
+const std::vector<ManifestFile>& ScanManifest::files() const
+{
+	return files_;
+}
+
+int64_t ScanManifest::extentSize() const
+{
+	return extent_;
+}
+
+int64_t ScanManifest::extents() const
+{
+	return (int64_t)fingerprints_.size();
+}
+
+int32_t ScanManifest::save(const std::string& path, std::string& error) const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	frjson manifest;
+	manifest["version"] = ConstManifestVersion;
+	manifest["deviceSize"] = device_size_;
+	manifest["sectorSize"] = sector_size_;
+	manifest["extent"] = extent_;
+	manifest["carvers"] = carvers_;
+	// 0 for an extent not read whole
+	manifest["fingerprints"] = frjson::array();
+	for (size_t index = 0; index < fingerprints_.size(); ++index)
+		manifest["fingerprints"].push_back(complete((int64_t)index) && fingerprints_[index] != 0 ? fingerprints_[index] : 0);
+	manifest["files"] = frjson::array();
+	for (auto& file : files_)
+	{
+		const RawFileInfo& info = file.info;
+		frjson object;
+		object["id"] = info.Id;
+		object["pid"] = info.Pid;
+		object["did"] = info.Did;
+		object["size"] = info.Size;
+		object["name"] = std::string((const char*)info.Name, strnlen((const char*)info.Name, sizeof(info.Name)));
+		object["attribute"] = info.Attribute;
+		object["category"] = info.Category;
+		object["scanType"] = info.ScanType;
+		object["fileSystem"] = info.FileSystem;
+		object["runlistCategory"] = info.RunlistCategory;
+		object["digest"] = info.DigestFlag;
+		object["crc32"] = info.Crc32;
+		object["sha256"] = hex(info.Sha256, sizeof(info.Sha256));
+		object["confidence"] = info.Confidence;
+		object["runs"] = frjson::array();
+		for (auto& run : file.runs)
+			object["runs"].push_back({ run.Offset, run.Start, run.Number });
+		manifest["files"].push_back(object);
+	}
+
+	// written beside the target and renamed over it, an earlier manifest survives a failed write
+	std::string temp = path + ".tmp";
+	{
+		std::ofstream os(temp, std::ios::binary | std::ios::trunc);
+		if (!os.is_open())
+		{
+			error = "can not write " + temp;
+			return -1;
+		}
+		os << manifest.dump(-1, ' ', false, frjson::error_handler_t::replace);
+		os.close();
+		if (os.fail())
+		{
+			error = "can not write " + temp;
+			std::remove(temp.c_str());
+			return -1;
+		}
+	}
+	std::error_code code;
+	std::filesystem::rename(temp, path, code);
+	if (code)
+	{
+		error = "can not replace " + path + ", " + code.message();
+		std::remove(temp.c_str());
+		return -1;
+	}
+	return 0;
+}
+
+int32_t ScanManifest::load(const std::string& path, std::string& error)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	try
+	{
+		std::ifstream is(path, std::ios::binary);
+		if (!is.is_open())
+		{
+			error = "can not read " + path;
+			return -1;
+		}
+		frjson manifest;
+		is >> manifest;
+		if (manifest.at("version").get<int32_t>() != ConstManifestVersion)
+		{
+			error = "unsupported manifest version";
+			return -1;
+		}
+		device_size_ = manifest.at("deviceSize").get<int64_t>();
+		sector_size_ = manifest.at("sectorSize").get<int32_t>();
+		extent_ = manifest.at("extent").get<int64_t>();
+		carvers_ = manifest.at("carvers").get<uint64_t>();
+		if (device_size_ < 0 || sector_size_ <= 0 || extent_ <= 0 || extent_ % WD_BLOCK_SIZE != 0)
+		{
+			error = "bad manifest geometry";
+			return -1;
+		}
+		fingerprints_ = manifest.at("fingerprints").get<std::vector<uint64_t>>();
+		if ((int64_t)fingerprints_.size() != (device_size_ + extent_ - 1) / extent_)
+		{
+			error = "fingerprints do not cover the device";
+			return -1;
+		}
+		digested_.assign(fingerprints_.size(), 0);
+		for (size_t index = 0; index < fingerprints_.size(); ++index)
+			digested_[index] = fingerprints_[index] != 0 ? extentBytes((int64_t)index) : 0;
+
+		files_.clear();
+		for (auto& object : manifest.at("files"))
+		{
+			ManifestFile file;
+			RawFileInfo& info = file.info;
+			info.Id = object.at("id").get<uint64_t>();
+			info.Pid = object.at("pid").get<uint64_t>();
+			info.Did = object.at("did").get<uint64_t>();
+			info.Size = object.at("size").get<uint64_t>();
+			std::string name = object.value("name", "");
+			memcpy(info.Name, name.c_str(), std::min<size_t>(name.size(), sizeof(info.Name)));
+			info.Attribute = object.value("attribute", 0u);
+			info.Category = object.value("category", 0u);
+			info.ScanType = object.value("scanType", 0u);
+			info.FileSystem = object.value("fileSystem", 0u);
+			info.RunlistCategory = object.value("runlistCategory", 0u);
+			info.DigestFlag = object.value("digest", 0u);
+			info.Crc32 = object.value("crc32", 0u);
+			std::string sha256 = object.value("sha256", "");
+			for (size_t pos = 0; pos + 1 < sha256.size() && pos / 2 < sizeof(info.Sha256); pos += 2)
+				info.Sha256[pos / 2] = (uint8_t)std::stoul(sha256.substr(pos, 2), nullptr, 16);
+			info.Confidence = object.value("confidence", 0u);
+			file.first = INT64_MAX;
+			file.last = 0;
+			for (auto& item : object.at("runs"))
+			{
+				Runlist run;
+				run.Offset = item.at(0).get<uint64_t>();
+				run.Start = item.at(1).get<uint64_t>();
+				run.Number = item.at(2).get<uint64_t>();
+				file.runs.push_back(run);
+				file.first = std::min<int64_t>(file.first, (int64_t)run.Start * sector_size_);
+				file.last = std::max<int64_t>(file.last, (int64_t)(run.Start + run.Number) * sector_size_);
+			}
+			if (file.runs.empty())
+				file.first = 0;
+			files_.emplace_back(std::move(file));
+		}
+	}
+	catch (std::exception& e)
+	{
+		error = e.what();
+		return -1;
+	}
+	return 0;
+}
+
+void ScanManifest::clear()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	fingerprints_.clear();
+	digested_.clear();
+	files_.clear();
+}
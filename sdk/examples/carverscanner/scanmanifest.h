@@ -0,0 +1,97 @@
+/**********************************************************************
+*
+* Copyright (C)2015-2022 Maxwell Analytica. All rights reserved.
+*
+* @file scanmanifest.h
+* @brief Extent fingerprints and transferred files of a scan
+* @details The device is cut into extents, every block pulled is hashed and
+*          folded into the fingerprint of its extent with its position. A later
+*          scan of the same device compares fingerprints against an earlier
+*          manifest, carves again only what changed and the files depending
+*          on it, and transfers the other files as they were recorded
+* @author Maxwell
+* @version 1.0.0
+* @date 2026-10-19 23:59:55.081
+*
+**********************************************************************/
+#ifndef SCAN_MANIFEST_H
+#define SCAN_MANIFEST_H
+
+#include <mutex>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "../../include/datatype.h"
+
+// a transferred file, `info.Runlist` is not set, the runs are kept apart
+typedef struct _ManifestFile
+{
+	RawFileInfo				info;
+	std::vector<Runlist>	runs;
+	int64_t					first;		/* bytes spanned by the runs */
+	int64_t					last;
+}ManifestFile, *PManifestFile;
+
+typedef struct _IncrementalPlan
+{
+	std::vector<std::pair<int64_t, int64_t>> carve;	/* offset and size carved again, device order */
+	std::vector<size_t>		reused;		/* files of the earlier manifest transferred as recorded */
+	int64_t					changed;	/* extents whose content changed */
+}IncrementalPlan, *PIncrementalPlan;
+
+class ScanManifest
+{
+public:
+	ScanManifest();
+	~ScanManifest();
+
+	// `extent` bytes per fingerprint, rounded up to whole blocks, `carvers` identifies the configuration
+	void reset(int64_t device_size, int32_t sector_size, int64_t extent, uint64_t carvers);
+
+	// data pulled at `offset`, every byte of the device once
+	void digest(const char* buffer, int64_t offset, int32_t count);
+
+	// a file transferred, before deduplication
+	void record(const RawFileInfo* info);
+
+	// every byte of extent `index` was digested
+	bool complete(int64_t index) const;
+
+	// same device, sector size, extent and carvers
+	bool compatible(const ScanManifest& other) const;
+
+	// plan of a scan of `current` against this earlier one, changed extents are carved again together
+	// with `window` bytes before them and the full span of every file depending on them
+	IncrementalPlan plan(const ScanManifest& current, int64_t window) const;
+
+	const std::vector<ManifestFile>& files() const;
+
+	int64_t extentSize() const;
+
+	int64_t extents() const;
+
+	// returns 0 on success, otherwise -1 with `error` set
+	int32_t save(const std::string& path, std::string& error) const;
+
+	int32_t load(const std::string& path, std::string& error);
+
+	void clear();
+
+public:
+	static constexpr int64_t DefaultExtent = 0x100000;
+
+private:
+	int64_t extentBytes(int64_t index) const;
+
+private:
+	mutable std::mutex mutex_;
+	int64_t device_size_;
+	int32_t sector_size_;
+	int64_t extent_;
+	uint64_t carvers_;
+	std::vector<uint64_t> fingerprints_;
+	std::vector<int64_t> digested_;
+	std::vector<ManifestFile> files_;
+};
+
+#endif // SCAN_MANIFEST_H
@@ -0,0 +1,578 @@
+/**********************************************************************
+*
+* Copyright (C)2015-2022 Maxwell Analytica. All rights reserved.
+*
+* @file signaturepattern.cpp
+* @brief
+* @details
+* @author Maxwell
+* @version 1.0.0
+* @date 2026-10-19 23:14:40.265
+*
+**********************************************************************/
+#include "signaturepattern.h"
+#include <map>
+#include <algorithm>
+#include <ctype.h>
+#include <string.h>
+
+// an upper bound of repeats keeps the expanded automaton small
+const uint32_t ConstMaxRepeat		= 0x1000;
+const uint32_t ConstMaxNfaStates	= 0x40000;
+
+typedef enum _PatternKind
+{
+	PK_Bytes		= 0,
+	PK_Sequence,
+	PK_Alternation,
+	PK_Repeat
+} PatternKind;
+
+typedef struct _PatternNode
+{
+	PatternKind					kind;
+	std::bitset<256>			bytes;
+	std::vector<_PatternNode>	children;
+	uint32_t					min;
+	uint32_t					max;
+}PatternNode, *PPatternNode;
+
+class PatternParser
+{
+public:
+	PatternParser(const std::string& text)
+		: text_(text), pos_(0)
+	{
+
+	}
+
+	bool parse(PatternNode& node, std::string& error)
+	{
+		if (!alternation(node))
+		{
+			error = error_;
+			return false;
+		}
+		skipSpace();
+		if (pos_ < text_.size())
+		{
+			error = failure("unexpected character");
+			return false;
+		}
+		return true;
+	}
+
+private:
+	std::string failure(const std::string& message)
+	{
+		return message + " at " + std::to_string(pos_) + " of \"" + text_ + "\"";
+	}
+
+	bool fail(const std::string& message)
+	{
+		if (error_.empty())
+			error_ = failure(message);
+		return false;
+	}
+
+	void skipSpace()
+	{
+		while (pos_ < text_.size() && isspace((unsigned char)text_[pos_]))
+			++pos_;
+	}
+
+	bool peek(char symbol)
+	{
+		skipSpace();
+		return pos_ < text_.size() && text_[pos_] == symbol;
+	}
+
+	bool alternation(PatternNode& node)
+	{
+		PatternNode branch;
+		if (!sequence(branch))
+			return false;
+		if (!peek('|'))
+		{
+			node = std::move(branch);
+			return true;
+		}
+		node.kind = PK_Alternation;
+		node.children.push_back(std::move(branch));
+		while (peek('|'))
+		{
+			++pos_;
+			PatternNode next;
+			if (!sequence(next))
+				return false;
+			node.children.push_back(std::move(next));
+		}
+		return true;
+	}
+
+	bool sequence(PatternNode& node)
+	{
+		node.kind = PK_Sequence;
+		while (true)
+		{
+			skipSpace();
+			if (pos_ >= text_.size() || text_[pos_] == '|' || text_[pos_] == ')')
+				break;
+			PatternNode item;
+			if (!atom(item) || !repeat(item))
+				return false;
+			node.children.push_back(std::move(item));
+		}
+		if (node.children.empty())
+			return fail("empty pattern");
+		return true;
+	}
+
+	bool repeat(PatternNode& node)
+	{
+		if (!peek('{'))
+			return true;
+		++pos_;
+		uint32_t min = 0, max = 0;
+		if (!number(min))
+			return false;
+		max = min;
+		if (peek(','))
+		{
+			++pos_;
+			if (!number(max))
+				return false;
+		}
+		if (!peek('}'))
+			return fail("missing }");
+		++pos_;
+		if (max < min || max == 0 || max > ConstMaxRepeat)
+			return fail("bad repeat bounds");
+
+		PatternNode wrapped;
+		wrapped.kind = PK_Repeat;
+		wrapped.min = min;
+		wrapped.max = max;
+		wrapped.children.push_back(std::move(node));
+		node = std::move(wrapped);
+		return true;
+	}
+
+	bool number(uint32_t& value)
+	{
+		skipSpace();
+		size_t begin = pos_;
+		value = 0;
+		while (pos_ < text_.size() && isdigit((unsigned char)text_[pos_]) && value <= ConstMaxRepeat)
+			value = value * 10 + (text_[pos_++] - '0');
+		return pos_ > begin ? true : fail("number expected");
+	}
+
+	bool atom(PatternNode& node)
+	{
+		skipSpace();
+		node.kind = PK_Bytes;
+		char symbol = text_[pos_];
+		if (symbol == '(')
+		{
+			++pos_;
+			if (!alternation(node))
+				return false;
+			if (!peek(')'))
+				return fail("missing )");
+			++pos_;
+			return true;
+		}
+		if (symbol == '[')
+		{
+			++pos_;
+			return byteClass(node.bytes);
+		}
+		if (symbol == '\'')
+		{
+			// literal text is a sequence of single bytes
+			++pos_;
+			node.kind = PK_Sequence;
+			while (pos_ < text_.size() && text_[pos_] != '\'')
+			{
+				PatternNode byte;
+				byte.kind = PK_Bytes;
+				byte.bytes.set((uint8_t)text_[pos_++]);
+				node.children.push_back(std::move(byte));
+			}
+			if (pos_ >= text_.size())
+				return fail("missing '");
+			++pos_;
+			return node.children.empty() ? fail("empty text") : true;
+		}
+		return maskedByte(node.bytes);
+	}
+
+	int32_t nibble(char symbol)
+	{
+		if (symbol >= '0' && symbol <= '9')
+			return symbol - '0';
+		symbol = (char)toupper((unsigned char)symbol);
+		if (symbol >= 'A' && symbol <= 'F')
+			return symbol - 'A' + 10;
+		return symbol == '?' ? 16 : -1;
+	}
+
+	// two hex digits, either may be ? for any nibble
+	bool maskedByte(std::bitset<256>& bytes)
+	{
+		if (pos_ + 1 >= text_.size())
+			return fail("hex byte expected");
+		int32_t high = nibble(text_[pos_]), low = nibble(text_[pos_ + 1]);
+		if (high < 0 || low < 0)
+			return fail("hex byte expected");
+		pos_ += 2;
+		for (int32_t value = 0; value < 256; ++value)
+		{
+			if ((high == 16 || (value >> 4) == high) && (low == 16 || (value & 0x0F) == low))
+				bytes.set(value);
+		}
+		return true;
+	}
+
+	bool exactByte(uint8_t& value)
+	{
+		skipSpace();
+		if (pos_ < text_.size() && text_[pos_] == '\'')
+		{
+			if (pos_ + 2 >= text_.size() || text_[pos_ + 2] != '\'')
+				return fail("single character expected");
+			value = (uint8_t)text_[pos_ + 1];
+			pos_ += 3;
+			return true;
+		}
+		if (pos_ + 1 >= text_.size())
+			return fail("hex byte expected");
+		int32_t high = nibble(text_[pos_]), low = nibble(text_[pos_ + 1]);
+		if (high < 0 || high > 15 || low < 0 || low > 15)
+			return fail("hex byte expected");
+		value = (uint8_t)(high << 4 | low);
+		pos_ += 2;
+		return true;
+	}
+
+	// [00-1F 7F 'a'-'z'], [^...] for the complement
+	bool byteClass(std::bitset<256>& bytes)
+	{
+		bool negate = peek('^');
+		if (negate)
+			++pos_;
+		while (!peek(']'))
+		{
+			if (pos_ >= text_.size())
+				return fail("missing ]");
+			uint8_t first = 0, last = 0;
+			if (!exactByte(first))
+				return false;
+			last = first;
+			if (peek('-'))
+			{
+				++pos_;
+				if (!exactByte(last))
+					return false;
+			}
+			if (last < first)
+				return fail("bad byte range");
+			for (uint32_t value = first; value <= last; ++value)
+				bytes.set(value);
+		}
+		++pos_;
+		if (negate)
+			bytes.flip();
+		return bytes.any() ? true : fail("empty byte class");
+	}
+
+private:
+	const std::string& text_;
+	size_t pos_;
+	std::string error_;
+};
+
+// Thompson automaton, a state either consumes a byte of `bytes` to `next` or follows `epsilon`
+typedef struct _NfaState
+{
+	std::bitset<256>		bytes;
+	int32_t					next;
+	std::vector<uint32_t>	epsilon;
+	int32_t					accept;
+}NfaState, *PNfaState;
+
+class NfaBuilder
+{
+public:
+	std::vector<NfaState> states;
+
+	uint32_t add()
+	{
+		NfaState state;
+		state.next = -1;
+		state.accept = -1;
+		states.push_back(state);
+		return (uint32_t)states.size() - 1;
+	}
+
+	// fragment from `start` to `end`, false when the automaton grows too large
+	bool build(const PatternNode& node, uint32_t& start, uint32_t& end)
+	{
+		if (states.size() > ConstMaxNfaStates)
+			return false;
+		switch (node.kind)
+		{
+		case PK_Bytes:
+			start = add();
+			end = add();
+			states[start].bytes = node.bytes;
+			states[start].next = end;
+			return true;
+		case PK_Sequence:
+		case PK_Repeat:
+		{
+			start = end = add();
+			uint32_t count = node.kind == PK_Sequence ? (uint32_t)node.children.size() : node.max;
+			for (uint32_t index = 0; index < count; ++index)
+			{
+				uint32_t first = 0, last = 0;
+				if (!build(node.kind == PK_Sequence ? node.children[index] : node.children[0], first, last))
+					return false;
+				states[end].epsilon.push_back(first);
+				// repeats past the minimum may stop early
+				if (node.kind == PK_Repeat && index >= node.min)
+					states[end].epsilon.push_back(last);
+				end = last;
+			}
+			return true;
+		}
+		case PK_Alternation:
+			start = add();
+			end = add();
+			for (auto& child : node.children)
+			{
+				uint32_t first = 0, last = 0;
+				if (!build(child, first, last))
+					return false;
+				states[start].epsilon.push_back(first);
+				states[last].epsilon.push_back(end);
+			}
+			return true;
+		}
+		return false;
+	}
+
+	void closure(std::vector<uint32_t>& set)
+	{
+		// states seen in this pass carry the current stamp
+		if (stamps_.size() != states.size())
+			stamps_.assign(states.size(), 0);
+		++stamp_;
+		std::vector<uint32_t> stack(set);
+		for (auto state : set)
+			stamps_[state] = stamp_;
+		while (!stack.empty())
+		{
+			uint32_t state = stack.back();
+			stack.pop_back();
+			for (auto next : states[state].epsilon)
+			{
+				if (stamps_[next] == stamp_)
+					continue;
+				stamps_[next] = stamp_;
+				set.push_back(next);
+				stack.push_back(next);
+			}
+		}
+		std::sort(set.begin(), set.end());
+	}
+
+private:
+	std::vector<uint32_t> stamps_;
+	uint32_t stamp_ = 0;
+};
+
+PatternDfa::PatternDfa()
+{
+	classes_ = 0;
+	start_ = 0;
+	memset(class_map_, 0x00, sizeof(class_map_));
+}
+
+PatternDfa::~PatternDfa()
+{
+
+}
+
+int32_t PatternDfa::compile(const std::vector<PatternSource>& patterns, std::string& error)
+{
+	table_.clear();
+	accepting_.clear();
+	accept_begin_.clear();
+	accept_ids_.clear();
+	classes_ = 0;
+	start_ = 0;
+
+	NfaBuilder nfa;
+	uint32_t root = nfa.add();
+	for (auto& pattern : patterns)
+	{
+		PatternNode node;
+		PatternParser parser(pattern.text);
+		if (!parser.parse(node, error))
+			return -1;
+		if (pattern.offset > 0)
+		{
+			// leading bytes before the signature are anything
+			PatternNode gap;
+			gap.kind = PK_Bytes;
+			gap.bytes.set();
+			PatternNode skip;
+			skip.kind = PK_Repeat;
+			skip.min = skip.max = pattern.offset;
+			skip.children.push_back(std::move(gap));
+			PatternNode sequence;
+			sequence.kind = PK_Sequence;
+			sequence.children.push_back(std::move(skip));
+			sequence.children.push_back(std::move(node));
+			node = std::move(sequence);
+		}
+		uint32_t first = 0, last = 0;
+		if (!nfa.build(node, first, last))
+		{
+			error = "pattern too large \"" + pattern.text + "\"";
+			return -1;
+		}
+		nfa.states[root].epsilon.push_back(first);
+		nfa.states[last].accept = (int32_t)pattern.id;
+	}
+
+	// bytes no pattern tells apart share a column of the table
+	std::vector<const std::bitset<256>*> sets;
+	for (auto& state : nfa.states)
+	{
+		if (state.next >= 0)
+			sets.push_back(&state.bytes);
+	}
+	std::map<std::vector<bool>, uint8_t> signatures;
+	for (int32_t value = 0; value < 256; ++value)
+	{
+		std::vector<bool> signature(sets.size());
+		for (size_t index = 0; index < sets.size(); ++index)
+			signature[index] = (*sets[index])[value];
+		auto iter = signatures.find(signature);
+		if (iter == signatures.end())
+			iter = signatures.emplace(signature, (uint8_t)signatures.size()).first;
+		class_map_[value] = iter->second;
+	}
+	classes_ = (uint32_t)signatures.size();
+	std::vector<uint8_t> representative(classes_);
+	for (int32_t value = 255; value >= 0; --value)
+		representative[class_map_[value]] = (uint8_t)value;
+
+	// subset construction, state 0 is the dead state
+	std::map<std::vector<uint32_t>, uint32_t> known;
+	std::vector<std::vector<uint32_t>> pending;
+	table_.assign(classes_, 0);
+	accepting_.push_back(0);
+	accept_begin_.push_back(0);
+	accept_begin_.push_back(0);
+
+	auto intern = [&](std::vector<uint32_t>& set) -> int64_t {
+		if (set.empty())
+			return 0;
+		nfa.closure(set);
+		auto iter = known.find(set);
+		if (iter != known.end())
+			return iter->second;
+		if (known.size() + 1 >= MaxStates)
+			return -1;
+		uint32_t state = (uint32_t)known.size() + 1;
+		known.emplace(set, state);
+		table_.resize(table_.size() + classes_, 0);
+		std::vector<uint32_t> ids;
+		for (auto member : set)
+		{
+			if (nfa.states[member].accept >= 0)
+				ids.push_back(nfa.states[member].accept);
+		}
+		std::sort(ids.begin(), ids.end());
+		ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+		accepting_.push_back(ids.empty() ? 0 : 1);
+		accept_ids_.insert(accept_ids_.end(), ids.begin(), ids.end());
+		accept_begin_.push_back((uint32_t)accept_ids_.size());
+		pending.push_back(set);
+		return state;
+	};
+
+	std::vector<uint32_t> initial = { root };
+	int64_t start = intern(initial);
+	for (size_t index = 0; index < pending.size(); ++index)
+	{
+		std::vector<uint32_t> set = pending[index];
+		uint32_t state = (uint32_t)index + 1;
+		for (uint32_t symbol = 0; symbol < classes_; ++symbol)
+		{
+			std::vector<uint32_t> next;
+			for (auto member : set)
+			{
+				if (nfa.states[member].next >= 0 && nfa.states[member].bytes[representative[symbol]])
+					next.push_back(nfa.states[member].next);
+			}
+			int64_t target = intern(next);
+			if (target < 0)
+			{
+				error = "patterns need more than " + std::to_string(MaxStates) + " states";
+				table_.clear();
+				return -1;
+			}
+			table_[state * classes_ + symbol] = (uint32_t)target;
+		}
+	}
+	start_ = (uint32_t)start;
+	return 0;
+}
+
+bool PatternDfa::empty() const
+{
+	return table_.empty();
+}
+
+size_t PatternDfa::states() const
+{
+	return accepting_.size();
+}
+
+bool PatternDfa::matchAt(const uint8_t* data, uint32_t size) const
+{
+	if (table_.empty())
+		return false;
+	uint32_t state = start_;
+	for (uint32_t pos = 0; pos < size; ++pos)
+	{
+		state = table_[state * classes_ + class_map_[data[pos]]];
+		if (state == 0)
+			return false;
+		if (accepting_[state])
+			return true;
+	}
+	return false;
+}
+
+void PatternDfa::matchAt(const uint8_t* data, uint32_t size, std::vector<uint8_t>& hits) const
+{
+	if (table_.empty())
+		return;
+	uint32_t state = start_;
+	for (uint32_t pos = 0; pos < size; ++pos)
+	{
+		state = table_[state * classes_ + class_map_[data[pos]]];
+		if (state == 0)
+			return;
+		if (!accepting_[state])
+			continue;
+		for (uint32_t index = accept_begin_[state]; index < accept_begin_[state + 1]; ++index)
+			hits[accept_ids_[index]] = 1;
+	}
+}
@@ -0,0 +1,67 @@
+/**********************************************************************
+*
+* Copyright (C)2015-2022 Maxwell Analytica. All rights reserved.
+*
+* @file signaturepattern.h
+* @brief Header signatures with masks, byte classes, gaps and alternation
+* @details Patterns are compiled to one anchored DFA, matching at a position
+*          costs one table step per byte whatever the number of patterns.
+*          FF D8 FF E?          hex bytes, ? masks a nibble, ?? any byte
+*          [00-1F 7F] [^00]     byte classes and negated classes
+*          'PK'                 literal text
+*          ??{4,12} (FF|00){2}  bounded repeat of the previous item
+*          (E0 | E1 | DB) | ... alternation, groups
+* @author Maxwell
+* @version 1.0.0
+* @date 2026-10-19 23:14:40.265
+*
+**********************************************************************/
+#ifndef SIGNATURE_PATTERN_H
+#define SIGNATURE_PATTERN_H
+
+#include <string>
+#include <vector>
+#include <bitset>
+#include <stdint.h>
+
+typedef struct _PatternSource
+{
+	std::string	text;
+	uint32_t	offset;		/* bytes from the probe position to the pattern */
+	uint32_t	id;			/* reported on a match */
+}PatternSource, *PPatternSource;
+
+class PatternDfa
+{
+public:
+	PatternDfa();
+	~PatternDfa();
+
+	// returns 0 on success, otherwise -1 with `error` describing the first problem
+	int32_t compile(const std::vector<PatternSource>& patterns, std::string& error);
+
+	bool empty() const;
+
+	size_t states() const;
+
+	// whether any pattern matches at `data`, `size` bytes are available
+	bool matchAt(const uint8_t* data, uint32_t size) const;
+
+	// set `hits[id]` of every pattern matching at `data`
+	void matchAt(const uint8_t* data, uint32_t size, std::vector<uint8_t>& hits) const;
+
+public:
+	static constexpr uint32_t MaxStates = 0x4000;
+
+private:
+	uint32_t classes_;
+	uint32_t start_;
+	uint8_t class_map_[256];
+	// state * classes_ + class, state 0 is dead
+	std::vector<uint32_t> table_;
+	std::vector<uint8_t> accepting_;
+	std::vector<uint32_t> accept_begin_;
+	std::vector<uint32_t> accept_ids_;
+};
+
+#endif // SIGNATURE_PATTERN_H
@@ -0,0 +1,260 @@
+/**********************************************************************
+*
+* Copyright (C)2015-2022 Maxwell Analytica. All rights reserved.
+*
+* @file streamdigest.cpp
+* @brief
+* @details
+* @author Maxwell
+* @version 1.0.0
+* @date 2026-10-19 11:02:44.705
+*
+**********************************************************************/
+#include "streamdigest.h"
+#include "cpudispatch.h"
+#include <string.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define DIGEST_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define DIGEST_TARGET(x)
+#else
+#define DIGEST_TARGET(x) __attribute__((target(x)))
+#endif
+#endif
+
+static const uint32_t Sha256K[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static const uint32_t Sha256Init[8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+#ifdef DIGEST_X86
+DIGEST_TARGET("sha,sse4.1,ssse3")
+static void sha256Hard(uint32_t state[8], const uint8_t* data, size_t blocks)
+{
+	const __m128i shuffle = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+	__m128i tmp = _mm_loadu_si128((const __m128i*)&state[0]);
+	__m128i state1 = _mm_loadu_si128((const __m128i*)&state[4]);
+	tmp = _mm_shuffle_epi32(tmp, 0xB1);				// CDAB
+	state1 = _mm_shuffle_epi32(state1, 0x1B);		// EFGH
+	__m128i state0 = _mm_alignr_epi8(tmp, state1, 8);	// ABEF
+	state1 = _mm_blend_epi16(state1, tmp, 0xF0);	// CDGH
+
+	for (; blocks > 0; --blocks, data += 64)
+	{
+		const __m128i abef = state0;
+		const __m128i cdgh = state1;
+		__m128i msg[4];
+		for (int32_t group = 0; group < 16; ++group)
+		{
+			__m128i& current = msg[group & 3];
+			if (group < 4)
+				current = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + group * 16)), shuffle);
+
+			__m128i words = _mm_add_epi32(current, _mm_loadu_si128((const __m128i*)&Sha256K[group * 4]));
+			state1 = _mm_sha256rnds2_epu32(state1, state0, words);
+			// schedule the words of the next group before the previous ones are consumed by msg1
+			if (group >= 3 && group < 15)
+			{
+				__m128i& next = msg[(group + 1) & 3];
+				next = _mm_add_epi32(next, _mm_alignr_epi8(current, msg[(group + 3) & 3], 4));
+				next = _mm_sha256msg2_epu32(next, current);
+			}
+			words = _mm_shuffle_epi32(words, 0x0E);
+			state0 = _mm_sha256rnds2_epu32(state0, state1, words);
+			if (group >= 1 && group <= 12)
+			{
+				__m128i& previous = msg[(group + 3) & 3];
+				previous = _mm_sha256msg1_epu32(previous, current);
+			}
+		}
+		state0 = _mm_add_epi32(state0, abef);
+		state1 = _mm_add_epi32(state1, cdgh);
+	}
+
+	tmp = _mm_shuffle_epi32(state0, 0x1B);			// FEBA
+	state1 = _mm_shuffle_epi32(state1, 0xB1);		// DCHG
+	state0 = _mm_blend_epi16(tmp, state1, 0xF0);	// DCBA
+	state1 = _mm_alignr_epi8(state1, tmp, 8);		// ABEF
+	_mm_storeu_si128((__m128i*)&state[0], state0);
+	_mm_storeu_si128((__m128i*)&state[4], state1);
+}
+#endif
+
+static inline uint32_t rotr32(uint32_t value, uint32_t count)
+{
+	return (value >> count) | (value << (32 - count));
+}
+
+static void sha256Soft(uint32_t state[8], const uint8_t* data, size_t blocks)
+{
+	for (; blocks > 0; --blocks, data += 64)
+	{
+		uint32_t w[64];
+		for (int32_t i = 0; i < 16; ++i)
+			w[i] = ((uint32_t)data[i * 4] << 24) | ((uint32_t)data[i * 4 + 1] << 16) | ((uint32_t)data[i * 4 + 2] << 8) | data[i * 4 + 3];
+		for (int32_t i = 16; i < 64; ++i)
+		{
+			uint32_t s0 = rotr32(w[i - 15], 7) ^ rotr32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+			uint32_t s1 = rotr32(w[i - 2], 17) ^ rotr32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+			w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+		}
+
+		uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+		uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+		for (int32_t i = 0; i < 64; ++i)
+		{
+			uint32_t t1 = h + (rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25)) + ((e & f) ^ (~e & g)) + Sha256K[i] + w[i];
+			uint32_t t2 = (rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+			h = g; g = f; f = e; e = d + t1;
+			d = c; c = b; b = a; a = t1 + t2;
+		}
+		state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+		state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+	}
+}
+
+static void sha256Blocks(uint32_t state[8], const uint8_t* data, size_t blocks)
+{
+#ifdef DIGEST_X86
+	if (CpuDispatch::sha())
+	{
+		sha256Hard(state, data, blocks);
+		return;
+	}
+#endif
+	sha256Soft(state, data, blocks);
+}
+
+StreamDigest::StreamDigest()
+{
+	reset(DF_None);
+}
+
+StreamDigest::~StreamDigest()
+{
+
+}
+
+bool StreamDigest::hardwareCrc32()
+{
+	return CpuDispatch::level() >= SL_Sse42;
+}
+
+bool StreamDigest::hardwareSha256()
+{
+	return CpuDispatch::sha();
+}
+
+void StreamDigest::reset(uint32_t flags)
+{
+	flags_ = flags;
+	finalized_ = false;
+	length_ = 0;
+	crc32_ = 0xFFFFFFFF;
+	sha256_used_ = 0;
+	memcpy(sha256_state_, Sha256Init, sizeof(sha256_state_));
+	memset(sha256_, 0x00, sizeof(sha256_));
+}
+
+void StreamDigest::update(const void* data, size_t size)
+{
+	if (flags_ == DF_None || finalized_ || size == 0)
+		return;
+
+	const uint8_t* bytes = (const uint8_t*)data;
+	length_ += size;
+	if (flags_ & DF_Crc32)
+	{
+		crc32_ = CpuDispatch::kernels().crc32c(crc32_, bytes, size);
+	}
+
+	if (flags_ & DF_Sha256)
+	{
+		if (sha256_used_ > 0)
+		{
+			size_t count = 64 - sha256_used_ < size ? 64 - sha256_used_ : size;
+			memcpy(sha256_block_ + sha256_used_, bytes, count);
+			sha256_used_ += (uint32_t)count;
+			bytes += count;
+			size -= count;
+			if (sha256_used_ < 64)
+				return;
+			sha256Blocks(sha256_state_, sha256_block_, 1);
+			sha256_used_ = 0;
+		}
+		size_t blocks = size / 64;
+		if (blocks > 0)
+			sha256Blocks(sha256_state_, bytes, blocks);
+		memcpy(sha256_block_, bytes + blocks * 64, size % 64);
+		sha256_used_ = (uint32_t)(size % 64);
+	}
+}
+
+void StreamDigest::finalize()
+{
+	if (finalized_)
+		return;
+	finalized_ = true;
+	crc32_ = ~crc32_;
+
+	if (flags_ & DF_Sha256)
+	{
+		uint64_t bits = length_ * 8;
+		sha256_block_[sha256_used_++] = 0x80;
+		if (sha256_used_ > 56)
+		{
+			memset(sha256_block_ + sha256_used_, 0x00, 64 - sha256_used_);
+			sha256Blocks(sha256_state_, sha256_block_, 1);
+			sha256_used_ = 0;
+		}
+		memset(sha256_block_ + sha256_used_, 0x00, 56 - sha256_used_);
+		for (int32_t i = 0; i < 8; ++i)
+			sha256_block_[63 - i] = (uint8_t)(bits >> (i * 8));
+		sha256Blocks(sha256_state_, sha256_block_, 1);
+		for (int32_t i = 0; i < 8; ++i)
+		{
+			sha256_[i * 4] = (uint8_t)(sha256_state_[i] >> 24);
+			sha256_[i * 4 + 1] = (uint8_t)(sha256_state_[i] >> 16);
+			sha256_[i * 4 + 2] = (uint8_t)(sha256_state_[i] >> 8);
+			sha256_[i * 4 + 3] = (uint8_t)sha256_state_[i];
+		}
+	}
+}
+
+void StreamDigest::invalidate()
+{
+	flags_ = DF_None;
+}
+
+uint32_t StreamDigest::flags() const
+{
+	return flags_;
+}
+
+uint32_t StreamDigest::crc32() const
+{
+	return crc32_;
+}
+
+const uint8_t* StreamDigest::sha256() const
+{
+	return sha256_;
+}
+
+uint64_t StreamDigest::length() const
+{
+	return length_;
+}
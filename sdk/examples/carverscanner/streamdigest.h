@@ -0,0 +1,67 @@
+/**********************************************************************
+*
+* Copyright (C)2015-2022 Maxwell Analytica. All rights reserved.
+*
+* @file streamdigest.h
+* @brief Incremental content digest of a carved file
+* @details CRC32C uses SSE4.2 and SHA-256 uses SHA-NI when the processor has them,
+*          otherwise the portable implementation is used
+* @author Maxwell
+* @version 1.0.0
+* @date 2026-10-19 11:02:44.705
+*
+**********************************************************************/
+#ifndef STREAM_DIGEST_H
+#define STREAM_DIGEST_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef enum _DigestFlag
+{
+	DF_None		= 0x0000,
+	DF_Crc32	= 0x0001,
+	DF_Sha256	= 0x0002,
+} DigestFlag;
+
+class StreamDigest
+{
+public:
+	StreamDigest();
+	~StreamDigest();
+
+	// start a new digest for the `DigestFlag` combination
+	void reset(uint32_t flags);
+
+	void update(const void* data, size_t size);
+
+	void finalize();
+
+	// content was not seen contiguously, the digest is meaningless
+	void invalidate();
+
+	uint32_t flags() const;
+
+	uint32_t crc32() const;
+
+	const uint8_t* sha256() const;
+
+	uint64_t length() const;
+
+public:
+	static bool hardwareCrc32();
+
+	static bool hardwareSha256();
+
+private:
+	uint32_t flags_;
+	bool finalized_;
+	uint64_t length_;
+	uint32_t crc32_;
+	uint32_t sha256_state_[8];
+	uint8_t sha256_block_[64];
+	uint32_t sha256_used_;
+	uint8_t sha256_[32];
+};
+
+#endif // STREAM_DIGEST_H
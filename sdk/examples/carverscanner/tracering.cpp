@@ -0,0 +1,188 @@
+/**********************************************************************
+*
+* Copyright (C)2015-2022 Maxwell Analytica. All rights reserved.
+*
+* @file tracering.cpp
+* @brief
+* @details
+* @author Maxwell
+* @version 1.0.0
+* @date 2026-10-19 21:52:14.377
+*
+**********************************************************************/
+#include "tracering.h"
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include "../../third_party/json.hpp"
+
+using frjson = nlohmann::json;
+using namespace std::chrono;
+
+static const char* ConstTraceNames[TE_Count] = {
+	"dequeue", "available", "header", "footer", "truncate", "serialize", "queue wait", "backpressure"
+};
+
+std::atomic<bool> TraceRing::enabled_(false);
+std::atomic<uint64_t> TraceRing::clears_(0);
+
+// rings outlive their threads for the dump, a ring of an exited thread is continued by the next new one
+static std::mutex ring_mutex;
+static std::vector<std::shared_ptr<TraceRing>> ring_registry;
+static std::vector<bool> ring_owned;
+static uint16_t ring_next_tid = 1;
+
+// clock pair taken when tracing is switched on, converts ticks to microseconds
+static uint64_t calibrate_tsc = 0;
+static steady_clock::time_point calibrate_clock;
+
+class TraceOwner
+{
+public:
+	TraceOwner()
+	{
+		std::lock_guard<std::mutex> lock(ring_mutex);
+		for (index_ = 0; index_ < ring_registry.size(); ++index_)
+		{
+			if (!ring_owned[index_])
+				break;
+		}
+		if (index_ == ring_registry.size())
+		{
+			ring_registry.emplace_back(std::make_shared<TraceRing>(ring_next_tid++));
+			ring_owned.push_back(true);
+		}
+		else
+		{
+			ring_registry[index_]->tid_ = ring_next_tid++;
+			ring_owned[index_] = true;
+		}
+		ring_ = ring_registry[index_].get();
+	}
+
+	~TraceOwner()
+	{
+		std::lock_guard<std::mutex> lock(ring_mutex);
+		ring_owned[index_] = false;
+	}
+
+	TraceRing* ring_;
+	size_t index_;
+};
+
+TraceRing::TraceRing(uint16_t tid)
+	: slots_(new Slot[Capacity]())
+{
+	head_ = 0;
+	generation_ = clears_.load();
+	tid_ = tid;
+}
+
+TraceRing::~TraceRing()
+{
+
+}
+
+TraceRing* TraceRing::local()
+{
+	thread_local TraceOwner owner;
+	return owner.ring_;
+}
+
+void TraceRing::enable(bool enabled)
+{
+	if (enabled && !enabled_)
+	{
+		std::lock_guard<std::mutex> lock(ring_mutex);
+		calibrate_tsc = now();
+		calibrate_clock = steady_clock::now();
+	}
+	enabled_ = enabled;
+}
+
+void TraceRing::clear()
+{
+	std::lock_guard<std::mutex> lock(ring_mutex);
+	clears_.fetch_add(1, std::memory_order_release);
+}
+
+bool TraceRing::read(uint64_t index, TraceEvent& event) const
+{
+	const Slot& slot = slots_[index & (Capacity - 1)];
+	uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+	if (sequence != index * 2 + 2)
+		return false;
+	uint64_t words[sizeof(TraceEvent) / sizeof(uint64_t)];
+	for (size_t word = 0; word < sizeof(TraceEvent) / sizeof(uint64_t); ++word)
+		words[word] = slot.words[word].load(std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if (slot.sequence.load(std::memory_order_relaxed) != sequence)
+		return false;
+	memcpy(&event, words, sizeof(words));
+	return true;
+}
+
+std::string TraceRing::dump()
+{
+	std::lock_guard<std::mutex> lock(ring_mutex);
+	// ticks per microsecond, measured over at least 10 ms since tracing was switched on
+	if (calibrate_tsc == 0)
+	{
+		calibrate_tsc = now();
+		calibrate_clock = steady_clock::now();
+	}
+	while (steady_clock::now() - calibrate_clock < milliseconds(10))
+		std::this_thread::sleep_for(milliseconds(1));
+	double ticks = (double)(now() - calibrate_tsc) / duration_cast<nanoseconds>(steady_clock::now() - calibrate_clock).count() * 1000.0;
+	ticks = ticks > 0.0 ? ticks : 1.0;
+
+	std::vector<TraceEvent> events;
+	uint64_t clears = clears_.load(std::memory_order_acquire);
+	for (auto& ring : ring_registry)
+	{
+		// the owner has not recorded since the last clear
+		if (ring->generation_.load(std::memory_order_acquire) != clears)
+			continue;
+		uint64_t head = ring->head_.load(std::memory_order_acquire);
+		uint64_t tail = head > Capacity ? head - Capacity : 0;
+		TraceEvent event;
+		for (uint64_t index = tail; index < head; ++index)
+		{
+			if (ring->read(index, event))
+				events.push_back(event);
+		}
+	}
+	if (events.empty())
+		return "{\"traceEvents\":[]}";
+	
+	uint64_t origin = events.front().tsc;
+	for (auto& event : events)
+		origin = std::min(origin, event.tsc);
+	
+	frjson trace;
+	trace["displayTimeUnit"] = "ns";
+	frjson& list = trace["traceEvents"] = frjson::array();
+	for (auto& event : events)
+	{
+		frjson entry;
+		entry["name"] = event.type < TE_Count ? ConstTraceNames[event.type] : "unknown";
+		entry["pid"] = 1;
+		entry["tid"] = event.tid;
+		entry["ts"] = (event.tsc - origin) / ticks;
+		if (event.duration > 0)
+		{
+			entry["ph"] = "X";
+			entry["dur"] = event.duration / ticks;
+		}
+		else
+		{
+			entry["ph"] = "i";
+			entry["s"] = "t";
+		}
+		entry["args"] = { { "arg", event.arg }, { "value", event.value } };
+		list.push_back(entry);
+	}
+	return trace.dump();
+}
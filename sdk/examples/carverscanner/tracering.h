@@ -0,0 +1,144 @@
+/**********************************************************************
+*
+* Copyright (C)2015-2022 Maxwell Analytica. All rights reserved.
+*
+* @file tracering.h
+* @brief Per-thread rings of fixed size binary trace events
+* @details Recording is a relaxed flag test while tracing is off and a store into
+*          the ring of the calling thread while on, the dump is Chrome trace json
+* @author Maxwell
+* @version 1.0.0
+* @date 2026-10-19 21:52:14.377
+*
+**********************************************************************/
+#ifndef TRACE_RING_H
+#define TRACE_RING_H
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define TRACE_TSC
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#else
+#include <chrono>
+#endif
+
+typedef enum _TraceEventType
+{
+	TE_Dequeue		= 0,	/* package taken by run(), arg: sector */
+	TE_Available,			/* Availabled result, arg: sector, value: 1 unallocated */
+	TE_Header,				/* arg: sector, value: carver index */
+	TE_Footer,
+	TE_Truncate,
+	TE_Serialize,			/* arg: file id, value: carver index */
+	TE_QueueWait,			/* run() waiting for packages */
+	TE_Backpressure,		/* producer waiting for the memory budget */
+	TE_Count
+} TraceEventType;
+
+typedef struct _TraceEvent
+{
+	uint64_t	tsc;
+	uint64_t	duration;	/* ticks, 0 for instant events */
+	uint64_t	arg;
+	uint16_t	type;
+	uint16_t	tid;
+	uint32_t	value;
+}TraceEvent, *PTraceEvent;
+
+class TraceRing
+{
+public:
+	TraceRing(uint16_t tid);
+	~TraceRing();
+
+	static void enable(bool enabled);
+
+	static bool enabled()
+	{
+		return enabled_.load(std::memory_order_relaxed);
+	}
+
+	static uint64_t now()
+	{
+#ifdef TRACE_TSC
+		return __rdtsc();
+#else
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+	}
+
+	// `start` from now() makes a complete event lasting until this call
+	static void record(TraceEventType type, uint64_t arg, uint32_t value = 0, uint64_t start = 0)
+	{
+		if (!enabled())
+			return;
+		uint64_t tsc = now();
+		local()->push({ start != 0 ? start : tsc, start != 0 ? tsc - start : 0, arg, (uint16_t)type, 0, value });
+	}
+
+	// Chrome / Perfetto trace json of every ring
+	static std::string dump();
+
+	// every owner drops its events before recording the next one, the dump skips them at once
+	static void clear();
+
+public:
+	static constexpr uint32_t Capacity = 1 << 16;
+
+private:
+	static TraceRing* local();
+
+	// `sequence` is odd while the owner writes the slot and 2 * (index + 1) once event `index` is in it
+	struct Slot
+	{
+		std::atomic<uint64_t> sequence;
+		std::atomic<uint64_t> words[sizeof(TraceEvent) / sizeof(uint64_t)];
+	};
+
+	void push(const TraceEvent& event)
+	{
+		uint64_t clears = clears_.load(std::memory_order_acquire);
+		if (generation_.load(std::memory_order_relaxed) != clears)
+		{
+			head_.store(0, std::memory_order_relaxed);
+			generation_.store(clears, std::memory_order_release);
+		}
+		uint64_t head = head_.load(std::memory_order_relaxed);
+		uint64_t words[sizeof(TraceEvent) / sizeof(uint64_t)];
+		TraceEvent copy = event;
+		copy.tid = tid_;
+		memcpy(words, &copy, sizeof(words));
+		Slot& slot = slots_[head & (Capacity - 1)];
+		slot.sequence.store(head * 2 + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		for (size_t index = 0; index < sizeof(TraceEvent) / sizeof(uint64_t); ++index)
+			slot.words[index].store(words[index], std::memory_order_relaxed);
+		slot.sequence.store(head * 2 + 2, std::memory_order_release);
+		head_.store(head + 1, std::memory_order_release);
+	}
+
+	// false when the owner has not written event `index` yet or overwrote it during the copy
+	bool read(uint64_t index, TraceEvent& event) const;
+
+private:
+	static std::atomic<bool> enabled_;
+	// generation of clear(), rings recorded under an older one hold no events
+	static std::atomic<uint64_t> clears_;
+	std::unique_ptr<Slot[]> slots_;
+	std::atomic<uint64_t> head_;
+	std::atomic<uint64_t> generation_;
+	uint16_t tid_;
+
+	friend class TraceOwner;
+};
+
+#endif // TRACE_RING_H
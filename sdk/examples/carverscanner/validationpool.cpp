@@ -0,0 +1,178 @@
+/**********************************************************************
+*
+* Copyright (C)2015-2022 Maxwell Analytica. All rights reserved.
+*
+* @file validationpool.cpp
+* @brief
+* @details
+* @author Maxwell
+* @version 1.0.0
+* @date 2026-10-19 13:40:18.226
+*
+**********************************************************************/
+#include "validationpool.h"
+#include "streamdigest.h"
+#include <string.h>
+
+ValidationPool::ValidationPool()
+{
+	threshold_ = 0;
+	budget_ = nullptr;
+	pending_ = 0;
+	rejected_ = 0;
+	reassembled_ = 0;
+	fragment_policy_ = { 1, 4096, 0, 0 };
+}
+
+ValidationPool::~ValidationPool()
+{
+	shutdown();
+}
+
+void ValidationPool::start(int32_t workers, int32_t threshold, DeviceReader reader, ValidationEmitter emitter, MemoryBudget* budget)
+{
+	shutdown();
+	budget_ = budget;
+	threshold_ = threshold;
+	reader_ = reader;
+	emitter_ = emitter;
+	rejected_ = 0;
+	reassembled_ = 0;
+	task_queue_.reopen();
+	for (int32_t index = 0; index < workers; ++index)
+		workers_.emplace_back(&ValidationPool::work, this);
+}
+
+void ValidationPool::setFragments(const FragmentPolicy& policy)
+{
+	fragment_policy_ = policy;
+}
+
+void ValidationPool::setRejecter(ValidationRejecter rejecter)
+{
+	rejecter_ = rejecter;
+}
+
+void ValidationPool::push(ValidationTask task)
+{
+	++pending_;
+	if (!task_queue_.push(task))
+		discard(task);
+}
+
+void ValidationPool::shutdown(bool drain)
+{
+	// a stopped scan transfers nothing more, what is not being validated yet is dropped
+	if (!drain)
+	{
+		for (auto& task : task_queue_.take())
+			discard(task);
+	}
+	// workers take what is still queued, then see the queue closed
+	task_queue_.close();
+	for (auto& worker : workers_)
+	{
+		if (worker.joinable())
+			worker.join();
+	}
+	workers_.clear();
+}
+
+bool ValidationPool::running() const
+{
+	return !workers_.empty();
+}
+
+int32_t ValidationPool::pending() const
+{
+	return pending_;
+}
+
+int64_t ValidationPool::rejected() const
+{
+	return rejected_;
+}
+
+int64_t ValidationPool::reassembled() const
+{
+	return reassembled_;
+}
+
+void ValidationPool::discard(ValidationTask& task)
+{
+	FragmentAssembler::release(task.info->Runlist);
+	delete task.info;
+	if (budget_ != nullptr)
+		budget_->release(task.charge);
+	--pending_;
+}
+
+void ValidationPool::work()
+{
+	// the buffers of every source this worker reads
+	ValidationScratch scratch;
+	scratch.holder = nullptr;
+	ValidationTask task;
+	while (task_queue_.pop(task))
+	{
+		auto info = task.info;
+		CarvedSource source(reader_, info->Runlist->Start, info->Size, task.sector_size, &scratch);
+		int32_t confidence = task.validator->validate(source);
+		if (confidence < threshold_ && fragment_policy_.max_fragments > 1 && source.broken() < source.size())
+		{
+			// foreign data between header and footer, the carve is taken apart around it
+			std::vector<CarvedFragment> fragments(1, { info->Runlist->Start, info->Size });
+			FragmentAssembler assembler(reader_, task.sector_size, fragment_policy_, &scratch);
+			confidence = assembler.assemble(*task.validator, threshold_, source.broken(), fragments);
+			if (confidence > 0 && confidence >= threshold_ && fragments.size() > 1)
+			{
+				FragmentAssembler::release(info->Runlist);
+				info->Runlist = FragmentAssembler::runlist(fragments, task.sector_size);
+				CarvedSource assembled(reader_, fragments, task.sector_size, &scratch);
+				info->Size = assembled.size();
+				redigest(assembled, info);
+				++reassembled_;
+			}
+		}
+		if (confidence > 0 && confidence >= threshold_)
+		{
+			info->Confidence = confidence;
+			emitter_(info);
+		}
+		else
+		{
+			++rejected_;
+			if (rejecter_)
+				rejecter_(info);
+			FragmentAssembler::release(info->Runlist);
+			delete info;
+		}
+		if (budget_ != nullptr)
+			budget_->release(task.charge);
+		--pending_;
+	}
+}
+
+void ValidationPool::redigest(CarvedSource& source, RawFileInfo* info)
+{
+	// digests of the contiguous carve covered the foreign data
+	if (info->DigestFlag == DF_None)
+		return;
+	StreamDigest digest;
+	digest.reset(info->DigestFlag);
+	uint8_t* buffer = source.chunk();
+	for (uint64_t offset = 0; offset < source.size();)
+	{
+		int32_t count = source.read(offset, buffer, (int32_t)source.chunkSize());
+		if (count <= 0)
+			break;
+		digest.update(buffer, count);
+		offset += count;
+	}
+	digest.finalize();
+	if (digest.length() != source.size())
+		digest.invalidate();
+	info->DigestFlag = digest.flags();
+	info->Crc32 = digest.crc32();
+	memcpy(info->Sha256, digest.sha256(), 32);
+}
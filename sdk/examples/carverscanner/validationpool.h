@@ -0,0 +1,88 @@
+/**********************************************************************
+*
+* Copyright (C)2015-2022 Maxwell Analytica. All rights reserved.
+*
+* @file validationpool.h
+* @brief Asynchronous validation of carved candidates
+* @details Completed candidates are validated off the scan thread, only those
+*          scoring at least the threshold are handed back for transfer
+* @author Maxwell
+* @version 1.0.0
+* @date 2026-10-19 13:40:18.226
+*
+**********************************************************************/
+#ifndef VALIDATION_POOL_H
+#define VALIDATION_POOL_H
+
+#include <thread>
+#include <atomic>
+#include "validator.h"
+#include "fragmentassembler.h"
+#include "memorybudget.h"
+#include "workqueue.h"
+#include "../../include/datatype.h"
+
+typedef struct _ValidationTask
+{
+	RawFileInfo*				info;
+	uint32_t					sector_size;
+	int64_t						charge;
+	std::shared_ptr<Validator>	validator;
+}ValidationTask, *PValidationTask;
+
+// emit a validated candidate, `info` ownership is passed on
+using ValidationEmitter = std::function<void(RawFileInfo* info)>;
+
+// a candidate failing validation, `info` is released once it returns
+using ValidationRejecter = std::function<void(const RawFileInfo* info)>;
+
+class ValidationPool
+{
+public:
+	ValidationPool();
+	~ValidationPool();
+
+	void start(int32_t workers, int32_t threshold, DeviceReader reader, ValidationEmitter emitter, MemoryBudget* budget = nullptr);
+
+	// before start, candidates failing validation are searched for fragments
+	void setFragments(const FragmentPolicy& policy);
+
+	// before start, told of every candidate rejected by validation
+	void setRejecter(ValidationRejecter rejecter);
+
+	void push(ValidationTask task);
+
+	// validate everything queued, then join workers, with `drain` false queued candidates are dropped
+	void shutdown(bool drain = true);
+
+	bool running() const;
+
+	int32_t pending() const;
+
+	int64_t rejected() const;
+
+	int64_t reassembled() const;
+
+private:
+	void work();
+
+	// release a candidate that is not validated
+	void discard(ValidationTask& task);
+
+	void redigest(CarvedSource& source, RawFileInfo* info);
+
+private:
+	int32_t threshold_;
+	DeviceReader reader_;
+	ValidationEmitter emitter_;
+	ValidationRejecter rejecter_;
+	MemoryBudget* budget_;
+	std::atomic<int32_t> pending_;
+	std::atomic<int64_t> rejected_;
+	std::atomic<int64_t> reassembled_;
+	FragmentPolicy fragment_policy_;
+	std::vector<std::thread> workers_;
+	WorkQueue<ValidationTask> task_queue_;
+};
+
+#endif // VALIDATION_POOL_H
@@ -0,0 +1,409 @@
+/**********************************************************************
+*
+* Copyright (C)2015-2022 Maxwell Analytica. All rights reserved.
+*
+* @file validator.cpp
+* @brief
+* @details
+* @author Maxwell
+* @version 1.0.0
+* @date 2026-10-19 13:40:18.226
+*
+**********************************************************************/
+#include "validator.h"
+#include <ctype.h>
+#include <string.h>
+#include <algorithm>
+
+const uint32_t ConstWindowSize		= 0x10000;
+const uint64_t ConstEntropyLimit	= 0x2000000;
+
+static inline uint16_t be16(const uint8_t* p)
+{
+	return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static inline uint32_t be32(const uint8_t* p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline uint16_t le16(const uint8_t* p)
+{
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t le32(const uint8_t* p)
+{
+	return p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// CRC-32 of PNG chunks (ISO 3309), not the CRC32C of the stream digest
+struct Crc32Table
+{
+	uint32_t value[256];
+	Crc32Table()
+	{
+		for (uint32_t index = 0; index < 256; ++index)
+		{
+			uint32_t crc = index;
+			for (int32_t bit = 0; bit < 8; ++bit)
+				crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320 : (crc >> 1);
+			value[index] = crc;
+		}
+	}
+};
+
+static uint32_t crc32Update(uint32_t crc, const uint8_t* data, size_t size)
+{
+	static const Crc32Table table;
+	for (size_t pos = 0; pos < size; ++pos)
+		crc = table.value[(crc ^ data[pos]) & 0xFF] ^ (crc >> 8);
+	return crc;
+}
+
+CarvedSource::CarvedSource(DeviceReader reader, uint64_t start_blockno, uint64_t size, uint32_t sector_size, ValidationScratch* scratch)
+	: CarvedSource(reader, std::vector<CarvedFragment>(1, { start_blockno, size }), sector_size, scratch)
+{
+
+}
+
+CarvedSource::CarvedSource(DeviceReader reader, const std::vector<CarvedFragment>& fragments, uint32_t sector_size, ValidationScratch* scratch)
+{
+	reader_ = reader;
+	sector_size_ = sector_size;
+	fragments_ = fragments;
+	size_ = 0;
+	for (auto& fragment : fragments_)
+		size_ += fragment.size;
+	broken_ = size_;
+	window_offset_ = 0;
+	window_size_ = 0;
+	own_.holder = nullptr;
+	scratch_ = scratch != nullptr ? scratch : &own_;
+	if (scratch_->window.size() < ConstWindowSize)
+		scratch_->window.resize(ConstWindowSize);
+}
+
+CarvedSource::~CarvedSource()
+{
+
+}
+
+uint64_t CarvedSource::size() const
+{
+	return size_;
+}
+
+void CarvedSource::breakAt(uint64_t offset)
+{
+	broken_ = std::min(broken_, offset);
+}
+
+uint64_t CarvedSource::broken() const
+{
+	return broken_;
+}
+
+uint8_t* CarvedSource::chunk()
+{
+	if (scratch_->chunk.size() < ConstWindowSize)
+		scratch_->chunk.resize(ConstWindowSize);
+	return scratch_->chunk.data();
+}
+
+uint32_t CarvedSource::chunkSize() const
+{
+	return ConstWindowSize;
+}
+
+bool CarvedSource::fill(uint64_t offset)
+{
+	// windows stay within the fragment holding `offset`
+	uint64_t base = 0;
+	size_t index = 0;
+	for (; index < fragments_.size() && offset >= base + fragments_[index].size; ++index)
+		base += fragments_[index].size;
+	if (index == fragments_.size())
+		return false;
+
+	const CarvedFragment& fragment = fragments_[index];
+	uint64_t inner = offset - base;
+	uint64_t aligned = inner - inner % sector_size_;
+	uint64_t remain = fragment.size - aligned;
+	remain = (remain + sector_size_ - 1) / sector_size_ * sector_size_;
+	int32_t count = (int32_t)std::min<uint64_t>(remain, ConstWindowSize);
+
+	scratch_->holder = this;
+	int32_t result = reader_(scratch_->window.data(), (int64_t)(fragment.start_blockno * sector_size_ + aligned), count);
+	if (result <= 0)
+	{
+		window_size_ = 0;
+		return false;
+	}
+	window_offset_ = base + aligned;
+	window_size_ = (uint32_t)std::min<uint64_t>(std::min(result, count), fragment.size - aligned);
+	return offset < window_offset_ + window_size_;
+}
+
+int32_t CarvedSource::read(uint64_t offset, void* buffer, int32_t count)
+{
+	if (offset >= size_ || count <= 0)
+		return 0;
+	if (offset + count > size_)
+		count = (int32_t)(size_ - offset);
+
+	int32_t done = 0;
+	while (done < count)
+	{
+		uint64_t pos = offset + done;
+		// another source sharing the scratch may have read into the window since
+		if (scratch_->holder != this || pos < window_offset_ || pos >= window_offset_ + window_size_)
+		{
+			if (!fill(pos))
+				break;
+		}
+		uint32_t available = (uint32_t)(window_offset_ + window_size_ - pos);
+		uint32_t length = std::min<uint32_t>(available, count - done);
+		memcpy((char*)buffer + done, scratch_->window.data() + (pos - window_offset_), length);
+		done += length;
+	}
+	return done;
+}
+
+std::shared_ptr<Validator> Validator::create(const std::string& name)
+{
+	std::string symbol = name;
+	std::transform(symbol.begin(), symbol.end(), symbol.begin(), ::tolower);
+	if (symbol == "jpeg" || symbol == "jpg" || symbol == "jpe" || symbol == "jfif")
+		return std::make_shared<JpegValidator>();
+	else if (symbol == "png")
+		return std::make_shared<PngValidator>();
+	else if (symbol == "zip" || symbol == "docx" || symbol == "xlsx" || symbol == "pptx" || symbol == "jar"
+		|| symbol == "apk" || symbol == "odt" || symbol == "ods" || symbol == "odp" || symbol == "epub")
+		return std::make_shared<ZipValidator>();
+	//
+	return nullptr;
+}
+
+std::string JpegValidator::name() const
+{
+	return "jpeg";
+}
+
+int32_t JpegValidator::validate(CarvedSource& source)
+{
+	uint8_t bytes[4] = { 0x00 };
+	if (source.read(0, bytes, 2) != 2 || bytes[0] != 0xFF || bytes[1] != 0xD8)
+		return 0;
+
+	// marker segments up to the first start of scan
+	uint64_t pos = 2;
+	bool frame = false, tables = false;
+	while (true)
+	{
+		if (source.read(pos, bytes, 2) != 2)
+			return 10;
+		if (bytes[0] != 0xFF)
+		{
+			source.breakAt(pos);
+			return 0;
+		}
+		if (bytes[1] == 0xFF)
+		{
+			pos += 1;
+			continue;
+		}
+		uint8_t marker = bytes[1];
+		pos += 2;
+		if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7))
+			continue;
+		if (marker == 0x00 || marker == 0xD8 || marker == 0xD9)
+			return 0;
+		if (source.read(pos, bytes, 2) != 2)
+			return 10;
+		uint16_t length = be16(bytes);
+		if (length < 2)
+			return 0;
+		if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC)
+			frame = true;
+		if (marker == 0xC4 || marker == 0xDB)
+			tables = true;
+		pos += length;
+		if (marker == 0xDA)
+			break;
+	}
+	if (!frame)
+		return 0;
+
+	// entropy coded data, 0xFF is only followed by stuffing, restart or segments between progressive scans
+	uint8_t* chunk = source.chunk();
+	const uint64_t limit = std::min<uint64_t>(source.size(), pos + ConstEntropyLimit);
+	while (pos + 1 < limit)
+	{
+		int32_t count = source.read(pos, chunk, (int32_t)std::min<uint64_t>(source.chunkSize(), limit - pos));
+		if (count < 2)
+			return 10;
+		int32_t index = 0;
+		for (; index + 1 < count; ++index)
+		{
+			if (chunk[index] != 0xFF)
+				continue;
+			uint8_t marker = chunk[index + 1];
+			if (marker == 0x00 || marker == 0xFF || (marker >= 0xD0 && marker <= 0xD7))
+				continue;
+			if (marker == 0xD9)
+			{
+				uint64_t end = pos + index + 2;
+				int32_t score = tables ? 100 : 90;
+				return end == source.size() ? score : score - 30;
+			}
+			if (marker == 0xC4 || marker == 0xDA || marker == 0xDB || marker == 0xDD || marker == 0xFE || (marker >= 0xE0 && marker <= 0xEF))
+			{
+				uint8_t length[2];
+				if (source.read(pos + index + 2, length, 2) != 2 || be16(length) < 2)
+					return 10;
+				pos += index + 2 + be16(length);
+				index = -1;
+				break;
+			}
+			source.breakAt(pos + index);
+			return 20;
+		}
+		if (index >= 0)
+			pos += index;
+	}
+	// clean but no end of image within the carved size
+	return limit < source.size() ? 60 : 50;
+}
+
+std::string PngValidator::name() const
+{
+	return "png";
+}
+
+int32_t PngValidator::validate(CarvedSource& source)
+{
+	static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A };
+	uint8_t bytes[8] = { 0x00 };
+	if (source.read(0, bytes, 8) != 8 || memcmp(bytes, signature, 8) != 0)
+		return 0;
+
+	uint8_t* chunk = source.chunk();
+	uint64_t pos = 8;
+	bool first = true;
+	while (pos + 12 <= source.size())
+	{
+		if (source.read(pos, bytes, 8) != 8)
+			return 10;
+		uint32_t length = be32(bytes);
+		bool named = true;
+		for (int32_t i = 4; i < 8; ++i)
+			named = named && isalpha(bytes[i]);
+		if (length > 0x7FFFFFFF || !named)
+		{
+			source.breakAt(pos);
+			return 0;
+		}
+		if (first && (memcmp(bytes + 4, "IHDR", 4) != 0 || length != 13))
+			return 0;
+		first = false;
+
+		uint32_t crc = crc32Update(0xFFFFFFFF, bytes + 4, 4);
+		uint64_t data = pos + 8;
+		uint64_t remain = length;
+		while (remain > 0)
+		{
+			int32_t count = source.read(data, chunk, (int32_t)std::min<uint64_t>(remain, source.chunkSize()));
+			if (count <= 0)
+				return 30;
+			crc = crc32Update(crc, chunk, count);
+			data += count;
+			remain -= count;
+		}
+		uint8_t stored[4];
+		if (source.read(data, stored, 4) != 4)
+			return 30;
+		if ((crc ^ 0xFFFFFFFF) != be32(stored))
+		{
+			// anywhere in the chunk data
+			source.breakAt(data);
+			return 0;
+		}
+
+		pos = data + 4;
+		if (memcmp(bytes + 4, "IEND", 4) == 0)
+			return pos == source.size() ? 100 : 80;
+	}
+	// every chunk consistent, but truncated before IEND
+	return 30;
+}
+
+std::string ZipValidator::name() const
+{
+	return "zip";
+}
+
+int32_t ZipValidator::validate(CarvedSource& source)
+{
+	uint8_t header[30] = { 0x00 };
+	if (source.read(0, header, 30) != 30 || le32(header) != 0x04034b50)
+		return 0;
+
+	// walk local file headers as far as sizes are known up front
+	uint64_t pos = 0;
+	int32_t entries = 0;
+	bool walked = false;
+	while (pos + 30 <= source.size())
+	{
+		if (source.read(pos, header, 30) != 30)
+			break;
+		uint32_t signature = le32(header);
+		if (signature == 0x02014b50)
+		{
+			walked = true;
+			break;
+		}
+		if (signature != 0x04034b50)
+		{
+			// other records such as data descriptors end the walk, anything else is foreign data
+			if ((signature & 0xFFFF) != 0x4b50)
+				source.breakAt(pos);
+			break;
+		}
+		uint16_t flags = le16(header + 6);
+		uint32_t compressed = le32(header + 18);
+		uint16_t name_size = le16(header + 26);
+		uint16_t extra_size = le16(header + 28);
+		if (name_size == 0)
+			return entries > 0 ? 20 : 0;
+		if ((flags & 0x0008) && compressed == 0)
+			break;
+		pos += 30 + name_size + extra_size + compressed;
+		++entries;
+	}
+
+	// end of central directory within the last 64 KB of the carved size
+	const uint64_t tail = std::min<uint64_t>(source.size(), 22 + 0xFFFF);
+	std::vector<uint8_t> buffer((size_t)tail);
+	if (source.read(source.size() - tail, buffer.data(), (int32_t)tail) != (int32_t)tail)
+		return walked ? 40 : 20;
+	for (int64_t index = (int64_t)tail - 22; index >= 0; --index)
+	{
+		if (le32(&buffer[(size_t)index]) != 0x06054b50)
+			continue;
+		uint64_t eocd = source.size() - tail + index;
+		uint32_t directory_size = le32(&buffer[(size_t)index + 12]);
+		uint32_t directory_offset = le32(&buffer[(size_t)index + 16]);
+		uint16_t comment_size = le16(&buffer[(size_t)index + 20]);
+		if (directory_offset == 0xFFFFFFFF || directory_size == 0xFFFFFFFF)
+			return 90;
+		if ((uint64_t)directory_offset + directory_size != eocd || eocd + 22 + comment_size > source.size())
+			return 10;
+		uint8_t signature[4];
+		if (directory_size > 0 && (source.read(directory_offset, signature, 4) != 4 || le32(signature) != 0x02014b50))
+			return 10;
+		return (walked || entries == 0) ? 100 : 80;
+	}
+	return walked ? 40 : 20;
+}
@@ -0,0 +1,119 @@
+/**********************************************************************
+*
+* Copyright (C)2015-2022 Maxwell Analytica. All rights reserved.
+*
+* @file validator.h
+* @brief Structural validators of carved files
+* @details A validator reads the carved extent back and scores how well the
+*          content follows the format, 0 rejects the candidate
+* @author Maxwell
+* @version 1.0.0
+* @date 2026-10-19 13:40:18.226
+*
+**********************************************************************/
+#ifndef VALIDATOR_H
+#define VALIDATOR_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <functional>
+#include <stdint.h>
+
+// read `count` bytes at byte `offset` of the device, offset and count sector aligned
+using DeviceReader = std::function<int32_t(void* buffer, int64_t offset, int32_t count)>;
+
+// piece of a fragmented file, pieces follow in file order
+typedef struct _CarvedFragment
+{
+	uint64_t	start_blockno;
+	uint64_t	size;		/* bytes */
+}CarvedFragment, *PCarvedFragment;
+
+// heap buffers of a validation worker, reused by every source it reads one after the other
+typedef struct _ValidationScratch
+{
+	std::vector<char>		window;
+	std::vector<uint8_t>	chunk;		/* bytes a validator scans at once */
+	const void*				holder;		/* source whose data is in `window` */
+}ValidationScratch, *PValidationScratch;
+
+class CarvedSource
+{
+public:
+	// without `scratch` the source allocates its own buffers
+	CarvedSource(DeviceReader reader, uint64_t start_blockno, uint64_t size, uint32_t sector_size, ValidationScratch* scratch = nullptr);
+	CarvedSource(DeviceReader reader, const std::vector<CarvedFragment>& fragments, uint32_t sector_size, ValidationScratch* scratch = nullptr);
+	~CarvedSource();
+
+	// read from the carved file, returns bytes read
+	int32_t read(uint64_t offset, void* buffer, int32_t count);
+
+	uint64_t size() const;
+
+	// validators mark where the format stops making sense, the earliest mark is kept
+	void breakAt(uint64_t offset);
+
+	// offset of the first break, size() when the content is consistent throughout
+	uint64_t broken() const;
+
+	// buffer of chunkSize() bytes for validators, it does not hold source data
+	uint8_t* chunk();
+
+	uint32_t chunkSize() const;
+
+private:
+	bool fill(uint64_t offset);
+
+private:
+	DeviceReader reader_;
+	std::vector<CarvedFragment> fragments_;
+	uint64_t size_;
+	uint64_t broken_;
+	uint32_t sector_size_;
+	uint64_t window_offset_;
+	uint32_t window_size_;
+	ValidationScratch own_;
+	ValidationScratch* scratch_;
+};
+
+class Validator
+{
+public:
+	virtual ~Validator() {}
+
+	// confidence 0-100, 0 for invalid
+	virtual int32_t validate(CarvedSource& source) = 0;
+
+	virtual std::string name() const = 0;
+
+public:
+	// validator by name or by file extension, nullptr when the format has none
+	static std::shared_ptr<Validator> create(const std::string& name);
+};
+
+class JpegValidator : public Validator
+{
+public:
+	virtual int32_t validate(CarvedSource& source);
+
+	virtual std::string name() const;
+};
+
+class PngValidator : public Validator
+{
+public:
+	virtual int32_t validate(CarvedSource& source);
+
+	virtual std::string name() const;
+};
+
+class ZipValidator : public Validator
+{
+public:
+	virtual int32_t validate(CarvedSource& source);
+
+	virtual std::string name() const;
+};
+
+#endif // VALIDATOR_H
@@ -0,0 +1,100 @@
+/**********************************************************************
+*
+* Copyright (C)2015-2022 Maxwell Analytica. All rights reserved.
+*
+* @file workqueue.h
+* @brief Blocking queue of work items for the scanner's worker threads
+* @details Items are popped by value, a closed queue still hands out what it
+*          holds and then wakes every waiting worker with nothing. Items can be
+*          taken out at once to release them without running them
+* @author Maxwell
+* @version 1.0.0
+* @date 2026-10-19 23:59:57.406
+*
+**********************************************************************/
+#ifndef WORK_QUEUE_H
+#define WORK_QUEUE_H
+
+#include <deque>
+#include <mutex>
+#include <utility>
+#include <condition_variable>
+
+template<typename T>
+class WorkQueue
+{
+public:
+	WorkQueue()
+	{
+		closed_ = false;
+	}
+
+	// dropped once closed, returns false then
+	bool push(T value)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (closed_)
+				return false;
+			items_.push_back(std::move(value));
+		}
+		cond_.notify_one();
+		return true;
+	}
+
+	// waits for an item, false once the queue is closed and empty
+	bool pop(T& value)
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		cond_.wait(lock, [this] { return !items_.empty() || closed_; });
+		if (items_.empty())
+			return false;
+		value = std::move(items_.front());
+		items_.pop_front();
+		return true;
+	}
+
+	void close()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			closed_ = true;
+		}
+		cond_.notify_all();
+	}
+
+	// accept items again after close
+	void reopen()
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		closed_ = false;
+	}
+
+	// every item still queued, the caller releases them
+	std::deque<T> take()
+	{
+		std::deque<T> items;
+		std::lock_guard<std::mutex> lock(mutex_);
+		items.swap(items_);
+		return items;
+	}
+
+	size_t size() const
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		return items_.size();
+	}
+
+	bool empty() const
+	{
+		return size() == 0;
+	}
+
+private:
+	mutable std::mutex mutex_;
+	std::condition_variable cond_;
+	std::deque<T> items_;
+	bool closed_;
+};
+
+#endif // WORK_QUEUE_H
@@ -0,0 +1,182 @@
+/**********************************************************************
+*
+* Copyright (C)2015-2022 Maxwell Analytica. All rights reserved.
+*
+* @file carvertests.cpp
+* @brief Regression checks of the carver scanner components
+* @details carvertests
+*          Every check prints its result, the exit code is the number of
+*          failed checks
+* @author Maxwell
+* @version 1.0.0
+* @date 2026-10-19 23:59:58.312
+*
+**********************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+#include <filesystem>
+#include "../carverscanner/filecarver.h"
+#include "../carverscanner/extentmap.h"
+#include "../carverscanner/tracering.h"
+#include "../carverscanner/scanmanifest.h"
+
+static int32_t failures = 0;
+
+static void check(bool passed, const char* name)
+{
+	printf("%-56s %s\n", name, passed ? "ok" : "FAILED");
+	if (!passed)
+		++failures;
+}
+
+static std::shared_ptr<FileCarver> makeCarver(const std::string& json)
+{
+	auto carver = std::make_shared<FileCarver>();
+	if (carver->setCharacteristics(frjson::parse(json).get<frjson::object_t>()) != 0)
+		return nullptr;
+	carver->setGeometry(512, 512);
+	return carver;
+}
+
+// a signature longer than 8 bytes at lanes near the end of a block, the bytes past the block continue it
+static void testLongSignatureAtBlockEnd()
+{
+	const char signature[] = "LONGSIGNATURE-16";
+	const int32_t size = 16;
+	const int32_t offset = 500;
+	auto carver = makeCarver(R"({"extension":"test","validator":"none",
+		"header":{"logic":"and","characters":[{"hex":false,"size":16,"offset":500,"context":"LONGSIGNATURE-16"}]},
+		"footer":{"logic":"and","characters":[{"hex":false,"size":4,"padding":0,"context":"TEND"}]}})");
+	check(carver != nullptr && carver->getProbeLanes() == 8, "long signature: carver with 8 lanes");
+	if (carver == nullptr)
+		return;
+
+	// the last lane signature starts at 4084 and crosses into the following block
+	std::vector<char> buffer(WD_BLOCK_SIZE * 2, 0x5A);
+	const uint32_t last = carver->getProbeLanes() - 1;
+	memcpy(&buffer[last * 512 + offset], signature, size);
+	check(carver->matchHeader(buffer.data()) == 0, "long signature: no match across the block end");
+
+	// the lane before it lies in the block and still matches
+	memcpy(&buffer[(last - 1) * 512 + offset], signature, size);
+	check(carver->matchHeader(buffer.data()) == 1u << (last - 1), "long signature: lane inside the block matches");
+
+	// `or` logic goes through the same probe
+	auto either = makeCarver(R"({"extension":"test","validator":"none",
+		"header":{"logic":"or","characters":[{"hex":false,"size":16,"offset":500,"context":"LONGSIGNATURE-16"},
+			{"hex":false,"size":12,"offset":0,"context":"OTHER-SIGNAT"}]},
+		"footer":{"logic":"and","characters":[{"hex":false,"size":4,"padding":0,"context":"TEND"}]}})");
+	check(either != nullptr && either->matchHeader(buffer.data()) == 1u << (last - 1), "long signature: `or` ignores the crossing lane");
+}
+
+// a released claim frees its blocks, a claim inside it is no longer embedded
+static void testExtentRelease()
+{
+	ExtentMap extents;
+	extents.claim(100, 200, 1);
+	extents.claim(100, 300, 1);
+	extents.claim(400, 500, 2);
+	check(extents.owner(250) == 1 && !extents.claim(150, 160, 3), "extents: a claim inside another is embedded");
+	auto released = extents.release(1);
+	check(released.size() == 1 && released[0].start == 100 && released[0].end == 300, "extents: release returns the grown extent");
+	check(extents.owner(250) == 0 && extents.owner(450) == 2, "extents: only the released owner is dropped");
+	check(extents.claim(150, 160, 3) && extents.owner(155) == 3, "extents: released blocks can be claimed again");
+	check(extents.release(1).empty(), "extents: a second release finds nothing");
+}
+
+static size_t traceEvents()
+{
+	return frjson::parse(TraceRing::dump()).at("traceEvents").size();
+}
+
+// a clear from another thread empties the rings at once, their owners restart them on the next event
+static void testTraceClear()
+{
+	TraceRing::enable(true);
+	std::thread([] {
+		for (uint32_t index = 0; index < 3; ++index)
+			TraceRing::record(TE_Header, index, index);
+	}).join();
+	check(traceEvents() == 3, "trace: events of an exited thread are dumped");
+
+	TraceRing::clear();
+	check(traceEvents() == 0, "trace: clear drops them before the owner records again");
+
+	// the ring of the exited thread is taken over by this one
+	TraceRing::record(TE_Footer, 1);
+	check(traceEvents() == 1, "trace: a ring restarts after the clear");
+
+	for (uint32_t index = 0; index < TraceRing::Capacity + 5; ++index)
+		TraceRing::record(TE_Footer, index);
+	check(traceEvents() == TraceRing::Capacity, "trace: a wrapped ring dumps its last events");
+	TraceRing::clear();
+	TraceRing::enable(false);
+}
+
+static void recordFile(ScanManifest& manifest, uint64_t id, uint64_t start, uint64_t number)
+{
+	RawFileInfo info;
+	Runlist run;
+	run.Offset = 0;
+	run.Start = start;
+	run.Number = number;
+	run.Next = nullptr;
+	info.Id = id;
+	info.Size = number * 512;
+	info.Runlist = &run;
+	manifest.record(&info);
+}
+
+// a saved manifest loads back as it was, a later scan carves the changed extent and the file over it again
+static void testManifestPlan()
+{
+	const int64_t extent = 0x10000;
+	std::vector<char> device(extent * 4);
+	for (size_t pos = 0; pos < device.size(); ++pos)
+		device[pos] = (char)(pos * 7 + pos / 4096);
+	ScanManifest earlier;
+	earlier.reset((int64_t)device.size(), 512, extent, 1);
+	earlier.digest(device.data(), 0, (int32_t)device.size());
+	recordFile(earlier, 1, 0, 16);
+	recordFile(earlier, 2, extent * 2 / 512, extent * 3 / 2 / 512);
+
+	std::string path = (std::filesystem::temp_directory_path() / "carvertests.manifest").string();
+	std::string error;
+	ScanManifest loaded;
+	check(earlier.save(path, error) == 0 && loaded.load(path, error) == 0, "manifest: saved and loaded back");
+	check(loaded.compatible(earlier) && loaded.files().size() == 2 && loaded.files()[1].runs.size() == 1
+		&& loaded.files()[1].runs[0].Start == (uint64_t)(extent * 2 / 512), "manifest: geometry and files kept");
+	check(!std::filesystem::exists(path + ".tmp"), "manifest: no temporary file left");
+
+	// a block of the third extent changes
+	device[extent * 2 + 100] ^= 0x55;
+	ScanManifest current;
+	current.reset((int64_t)device.size(), 512, extent, 1);
+	current.digest(device.data(), 0, (int32_t)device.size());
+	IncrementalPlan plan = loaded.plan(current, 0);
+	check(plan.changed == 1 && plan.reused.size() == 1 && plan.reused[0] == 0, "manifest: only the untouched file is reused");
+	check(plan.carve.size() == 1 && plan.carve[0].first == extent * 2 && plan.carve[0].second == extent * 2,
+		"manifest: the changed extent is carved with the file over it");
+
+	plan = loaded.plan(earlier, 0);
+	check(plan.changed == 0 && plan.reused.size() == 2 && plan.carve.empty(), "manifest: nothing carved without changes");
+
+	// a failed save reports it and leaves the earlier manifest
+	error.clear();
+	check(earlier.save((std::filesystem::path(path) / "missing" / "manifest").string(), error) == -1 && !error.empty(),
+		"manifest: a failed save sets the error");
+	check(loaded.load(path, error) == 0, "manifest: the earlier one is still readable");
+	std::filesystem::remove(path);
+}
+
+int main(int argc, char** argv)
+{
+	testLongSignatureAtBlockEnd();
+	testExtentRelease();
+	testTraceClear();
+	testManifestPlan();
+	printf("%d failed\n", failures);
+	return failures;
+}
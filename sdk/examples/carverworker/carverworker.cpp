@@ -0,0 +1,267 @@
+/**********************************************************************
+*
+* Copyright (C)2015-2022 Maxwell Analytica. All rights reserved.
+*
+* @file carverworker.cpp
+* @brief Worker process carving one range of an image for the coordinator
+* @details carverworker --image <path> --offset <bytes> --size <bytes> [--config filecarver.json] [--sector 512] [--timeout 3600]
+*          The range is pulled by a CarverScanner, every carved file is written
+*          to stdout as one json line once the range is done, then {"type":"done"}.
+*          Logs go to stderr. Any other end of the output is a failed range, also
+*          a range not carved within the timeout in seconds
+* @author Maxwell
+* @version 1.0.0
+* @date 2026-10-19 23:59:24.806
+*
+**********************************************************************/
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "../carverscanner/carverscanner.h"
+#include "../../third_party/json.hpp"
+
+using frjson = nlohmann::json;
+
+#ifdef _MSC_VER
+#define fseek64 _fseeki64
+#define ftell64 _ftelli64
+#else
+#define fseek64 fseeko
+#define ftell64 ftello
+#endif
+
+class ImageDelegate : public ITransferDelegate
+{
+public:
+	ImageDelegate(const std::string& path, int32_t sector_size)
+	{
+		path_ = path;
+		sector_size_ = sector_size;
+		size_ = 0;
+		completed_ = false;
+		image_ = fopen(path.c_str(), "rb");
+		if (image_ != nullptr && fseek64(image_, 0, SEEK_END) == 0)
+			size_ = ftell64(image_);
+	}
+
+	virtual ~ImageDelegate()
+	{
+		for (auto info : files_)
+			release(info);
+		if (image_ != nullptr)
+			fclose(image_);
+	}
+
+	bool opened() const
+	{
+		return image_ != nullptr && size_ > 0;
+	}
+
+	virtual int32_t Read(void* buffer, int64_t offset, int32_t count)
+	{
+		std::lock_guard<std::mutex> lock(read_mutex_);
+		if (fseek64(image_, offset, SEEK_SET) != 0)
+			return -1;
+		size_t read = fread(buffer, 1, count, image_);
+		return read > 0 ? (int32_t)read : -1;
+	}
+
+	virtual bool Availabled(const uint64_t& offset, int32_t option)
+	{
+		return true;
+	}
+
+	virtual int32_t Transfer(int32_t type, void* ptr, int64_t* size)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (type == NO_FileInfo && ptr != nullptr)
+		{
+			files_.push_back((RawFileInfo*)ptr);
+		}
+		else if (type == NO_Completed)
+		{
+			completed_ = true;
+			condition_.notify_all();
+		}
+		return 0;
+	}
+
+	virtual int32_t Context(void* params, int32_t* size)
+	{
+		frjson context;
+		context["DiskIndex"] = 0;
+		context["BytesPerSector"] = sector_size_;
+		context["StartingOffset"] = 0;
+		context["Size"] = size_;
+		context["ImagePath"] = path_;
+		std::string text = context.dump();
+		memcpy(params, text.c_str(), text.size());
+		*size = (int32_t)text.size();
+		return 0;
+	}
+
+	virtual int32_t Logger(const char* format, ...)
+	{
+		std::lock_guard<std::mutex> lock(log_mutex_);
+		va_list args;
+		va_start(args, format);
+		vfprintf(stderr, format, args);
+		va_end(args);
+		fputc('\n', stderr);
+		return 0;
+	}
+
+	// false when the scan did not complete within `seconds`
+	bool wait(int64_t seconds)
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		return condition_.wait_for(lock, std::chrono::seconds(seconds), [this] { return completed_; });
+	}
+
+	// parents are named by their start, ids only mean something inside this process
+	int64_t write()
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		std::map<uint64_t, uint64_t> starts;
+		for (auto info : files_)
+		{
+			if (info->Runlist != nullptr)
+				starts[info->Id] = info->Runlist->Start;
+		}
+		for (auto info : files_)
+		{
+			frjson line;
+			line["type"] = "file";
+			line["did"] = info->Did;
+			line["size"] = info->Size;
+			line["name"] = std::string((const char*)info->Name, strnlen((const char*)info->Name, sizeof(info->Name)));
+			line["digestFlag"] = info->DigestFlag;
+			line["crc32"] = info->Crc32;
+			line["sha256"] = hex(info->Sha256, sizeof(info->Sha256));
+			line["confidence"] = info->Confidence;
+			auto parent = starts.find(info->Pid);
+			if (parent != starts.end())
+				line["parentStart"] = parent->second;
+			line["runs"] = frjson::array();
+			for (Runlist* run = info->Runlist; run != nullptr; run = run->Next)
+				line["runs"].push_back({ run->Offset, run->Start, run->Number });
+			fprintf(stdout, "%s\n", line.dump(-1, ' ', false, frjson::error_handler_t::replace).c_str());
+		}
+		frjson done;
+		done["type"] = "done";
+		done["files"] = files_.size();
+		fprintf(stdout, "%s\n", done.dump().c_str());
+		fflush(stdout);
+		return (int64_t)files_.size();
+	}
+
+private:
+	static std::string hex(const uint8_t* bytes, size_t size)
+	{
+		static const char digits[] = "0123456789abcdef";
+		std::string text;
+		for (size_t pos = 0; pos < size; ++pos)
+		{
+			text.push_back(digits[bytes[pos] >> 4]);
+			text.push_back(digits[bytes[pos] & 0x0F]);
+		}
+		return text;
+	}
+
+	static void release(RawFileInfo* info)
+	{
+		Runlist* run = info->Runlist;
+		while (run != nullptr)
+		{
+			Runlist* next = run->Next;
+			delete run;
+			run = next;
+		}
+		delete info;
+	}
+
+private:
+	std::string path_;
+	int32_t sector_size_;
+	int64_t size_;
+	FILE* image_;
+	std::mutex read_mutex_;
+	std::mutex log_mutex_;
+	std::mutex mutex_;
+	std::condition_variable condition_;
+	bool completed_;
+	std::vector<RawFileInfo*> files_;
+};
+
+int main(int argc, char** argv)
+{
+	std::string image_path, config_path;
+	int64_t offset = 0, size = 0, timeout = 3600;
+	int32_t sector_size = 512;
+	for (int32_t index = 1; index < argc; ++index)
+	{
+		std::string arg = argv[index];
+		if (arg == "--image" && index + 1 < argc)
+			image_path = argv[++index];
+		else if (arg == "--config" && index + 1 < argc)
+			config_path = argv[++index];
+		else if (arg == "--offset" && index + 1 < argc)
+			offset = std::stoll(argv[++index]);
+		else if (arg == "--size" && index + 1 < argc)
+			size = std::stoll(argv[++index]);
+		else if (arg == "--sector" && index + 1 < argc)
+			sector_size = std::stoi(argv[++index]);
+		else if (arg == "--timeout" && index + 1 < argc)
+			timeout = std::stoll(argv[++index]);
+	}
+
+	ImageDelegate delegate(image_path, sector_size);
+	if (!delegate.opened() || size <= 0)
+	{
+		delegate.Logger("can not open image %s or empty range", image_path.c_str());
+		return 1;
+	}
+
+	CarverScanner* scanner = new CarverScanner();
+	scanner->set_delegate(&delegate);
+	if (config_path.length() > 0)
+	{
+		std::ifstream is(config_path);
+		std::string config((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+		int32_t config_size = (int32_t)config.size();
+		// workers of one coordinator share the executable directory, the config stays out of its filecarver.json
+		if (config_size == 0 || scanner->use_carvers(config.data(), config_size) != 0)
+		{
+			delegate.Logger("can not load config %s", config_path.c_str());
+			scanner->destroy();
+			return 1;
+		}
+	}
+	frjson range;
+	range["offset"] = offset;
+	range["size"] = size;
+	std::string range_text = range.dump();
+	int32_t range_size = (int32_t)range_text.size();
+	scanner->inject_control((void*)range_text.data(), range_size, IC_RangeIn);
+
+	scanner->advance();
+	if (!delegate.wait(timeout))
+	{
+		// no done line, the coordinator carves the range again
+		delegate.Logger("range %lld + %lld not carved within %lld seconds", offset, size, timeout);
+		scanner->stop();
+		scanner->destroy();
+		return 1;
+	}
+	scanner->stop();
+	delegate.write();
+	scanner->destroy();
+	return 0;
+}
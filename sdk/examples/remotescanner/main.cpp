@@ -0,0 +1,224 @@
+/**********************************************************************
+*
+* Copyright (C)2015-2022 Maxwell Analytica. All rights reserved.
+*
+* @file main.cpp
+* @brief Carves an image with the scanner in a carverhost process or in process
+* @details remotescanner --image <path> [--host carverhost] [--config filecarver.json]
+*          [--block 1048576] [--pull] [--local]
+*          Blocks are written to the scanner, or pulled by it with --pull, and the
+*          carved files are printed with the throughput, --local runs the same
+*          scan in process to compare with
+* @author Maxwell
+* @version 1.0.0
+* @date 2026-10-19 23:59:48.239
+*
+**********************************************************************/
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <vector>
+#include "remotescanner.h"
+#include "../carverscanner/carverscanner.h"
+#include "../../third_party/json.hpp"
+
+using frjson = nlohmann::json;
+
+#ifdef _MSC_VER
+#define fseek64 _fseeki64
+#define ftell64 _ftelli64
+#else
+#define fseek64 fseeko
+#define ftell64 ftello
+#endif
+
+class ImageDelegate : public ITransferDelegate
+{
+public:
+	ImageDelegate(const std::string& path)
+	{
+		path_ = path;
+		size_ = 0;
+		files_ = 0;
+		completed_ = false;
+		image_ = fopen(path.c_str(), "rb");
+		if (image_ != nullptr && fseek64(image_, 0, SEEK_END) == 0)
+			size_ = ftell64(image_);
+	}
+
+	virtual ~ImageDelegate()
+	{
+		if (image_ != nullptr)
+			fclose(image_);
+	}
+
+	int64_t size() const
+	{
+		return size_;
+	}
+
+	int64_t files() const
+	{
+		return files_;
+	}
+
+	virtual int32_t Read(void* buffer, int64_t offset, int32_t count)
+	{
+		std::lock_guard<std::mutex> lock(read_mutex_);
+		if (fseek64(image_, offset, SEEK_SET) != 0)
+			return -1;
+		size_t read = fread(buffer, 1, count, image_);
+		return read > 0 ? (int32_t)read : -1;
+	}
+
+	virtual bool Availabled(const uint64_t& offset, int32_t option)
+	{
+		return true;
+	}
+
+	virtual int32_t Transfer(int32_t type, void* ptr, int64_t* size)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (type == NO_FileInfo && ptr != nullptr)
+		{
+			auto info = (RawFileInfo*)ptr;
+			fprintf(stdout, "id=%llx pid=%llx size=%llu crc=%08x start=%llu\n", (unsigned long long)info->Id, (unsigned long long)info->Pid,
+				(unsigned long long)info->Size, info->Crc32, info->Runlist != nullptr ? (unsigned long long)info->Runlist->Start : 0ull);
+			Runlist* run = info->Runlist;
+			while (run != nullptr)
+			{
+				Runlist* next = run->Next;
+				delete run;
+				run = next;
+			}
+			delete info;
+			++files_;
+		}
+		else if (type == NO_Completed || type == NO_Disconnect)
+		{
+			fprintf(stdout, type == NO_Completed ? "completed\n" : "disconnected\n");
+			completed_ = true;
+			condition_.notify_all();
+		}
+		return 0;
+	}
+
+	virtual int32_t Context(void* params, int32_t* size)
+	{
+		frjson context;
+		context["DiskIndex"] = 0;
+		context["BytesPerSector"] = 512;
+		context["StartingOffset"] = 0;
+		context["Size"] = size_;
+		context["ImagePath"] = path_;
+		std::string text = context.dump();
+		memcpy(params, text.c_str(), text.size());
+		*size = (int32_t)text.size();
+		return 0;
+	}
+
+	virtual int32_t Logger(const char* format, ...)
+	{
+		std::lock_guard<std::mutex> lock(log_mutex_);
+		va_list args;
+		va_start(args, format);
+		vfprintf(stderr, format, args);
+		va_end(args);
+		fputc('\n', stderr);
+		return 0;
+	}
+
+	void wait()
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		condition_.wait(lock, [this] { return completed_; });
+	}
+
+private:
+	std::string path_;
+	int64_t size_;
+	int64_t files_;
+	FILE* image_;
+	std::mutex read_mutex_;
+	std::mutex log_mutex_;
+	std::mutex mutex_;
+	std::condition_variable condition_;
+	bool completed_;
+};
+
+int main(int argc, char** argv)
+{
+	std::string image_path, host_path, config_path;
+	int32_t block_size = 0x100000;
+	bool pull = false, local = false;
+	for (int32_t index = 1; index < argc; ++index)
+	{
+		std::string arg = argv[index];
+		if (arg == "--image" && index + 1 < argc)
+			image_path = argv[++index];
+		else if (arg == "--host" && index + 1 < argc)
+			host_path = argv[++index];
+		else if (arg == "--config" && index + 1 < argc)
+			config_path = argv[++index];
+		else if (arg == "--block" && index + 1 < argc)
+			block_size = std::stoi(argv[++index]);
+		else if (arg == "--pull")
+			pull = true;
+		else if (arg == "--local")
+			local = true;
+	}
+
+	ImageDelegate delegate(image_path);
+	if (delegate.size() <= 0 || (!local && host_path.empty()) || block_size <= 0)
+	{
+		delegate.Logger("usage: remotescanner --image <path> --host <carverhost> [--config filecarver.json] [--pull] [--local]");
+		return 1;
+	}
+
+	IScanner* scanner = local ? (IScanner*)new CarverScanner() : (IScanner*)new RemoteScanner(host_path);
+	auto start = std::chrono::steady_clock::now();
+	scanner->set_delegate(&delegate);
+	if (config_path.length() > 0)
+	{
+		std::ifstream is(config_path);
+		std::string config((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+		int32_t config_size = (int32_t)config.size();
+		scanner->inject_control((void*)config.data(), config_size, IC_FileCarverIn);
+	}
+	if (pull)
+	{
+		// the whole device as one range, the scanner reads it and completes
+		std::string range = "{\"offset\":0,\"size\":" + std::to_string(delegate.size()) + "}";
+		int32_t range_size = (int32_t)range.size();
+		scanner->inject_control((void*)range.data(), range_size, IC_RangeIn);
+		scanner->advance();
+		delegate.wait();
+	}
+	else
+	{
+		scanner->advance();
+		std::vector<char> buffer(block_size);
+		for (int64_t offset = 0; offset < delegate.size(); offset += block_size)
+		{
+			int32_t count = delegate.Read(buffer.data(), offset, block_size);
+			if (count <= 0)
+				break;
+			scanner->write_buffer(buffer.data(), offset, count);
+		}
+		// queued behind the blocks written, stop would drop the ones not carved yet
+		char end = 0;
+		int32_t end_size = 0;
+		if (scanner->inject_control(&end, end_size, IC_InputEndIn) == 0)
+			delegate.wait();
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	scanner->stop();
+	scanner->destroy();
+	delegate.Logger("%s %s: %lld bytes in %.3f s, %.1f MB/s, %lld files", local ? "in process" : "out of process",
+		pull ? "pull" : "push", delegate.size(), seconds, delegate.size() / seconds / 1048576.0, delegate.files());
+	return 0;
+}
@@ -0,0 +1,655 @@
+/**********************************************************************
+*
+* Copyright (C)2015-2022 Maxwell Analytica. All rights reserved.
+*
+* @file remotescanner.cpp
+* @brief
+* @details
+* @author Maxwell
+* @version 1.0.0
+* @date 2026-10-19 23:59:48.239
+*
+**********************************************************************/
+#include "remotescanner.h"
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include "../../third_party/json.hpp"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
+
+using frjson = nlohmann::json;
+
+// waits wake up this often to see whether the host is still there
+const int32_t ConstPollMilliseconds		= 100;
+const int32_t ConstAttachSeconds		= 10;
+const int32_t ConstExitSeconds			= 5;
+// data of one record of a Read, the host copies a part while the next one is read
+const int32_t ConstReadRecord			= 0x100000;
+
+// room of the Availabled bits after `count` bytes of a block record
+static uint32_t mark_bytes(int32_t count)
+{
+	return (uint32_t)(((count + WD_BLOCK_SIZE - 1) / WD_BLOCK_SIZE + 7) / 8);
+}
+
+RemoteScanner::RemoteScanner(const std::string& host_path, uint64_t ring_size)
+{
+	host_path_ = host_path;
+	ring_size_ = ring_size;
+	delegate_ = nullptr;
+	spawned_ = false;
+	disconnected_ = false;
+	closing_ = false;
+	destroying_ = false;
+	deferred_ = false;
+	sector_size_ = 0;
+#ifdef _WIN32
+	process_ = nullptr;
+#else
+	pid_ = -1;
+#endif
+}
+
+RemoteScanner::~RemoteScanner()
+{
+	terminate();
+}
+
+void RemoteScanner::set_delegate(ITransferDelegate* delegate)
+{
+	delegate_ = delegate;
+	if (delegate_ == nullptr)
+		return;
+	if (!spawned_ && !spawn())
+	{
+		disconnected_ = true;
+		delegate_->Logger("[%s] can not start scanner host %s", __FUNCTION__, host_path_.c_str());
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(call_mutex_);
+	CallSlot* slot = &channel_.header()->down;
+	slot->method = SM_SetDelegate;
+	slot->size = 0;
+	call(false);
+}
+
+int32_t RemoteScanner::explore()
+{
+	std::lock_guard<std::mutex> lock(call_mutex_);
+	if (!spawned_ || disconnected_)
+		return WFC_Error;
+	CallSlot* slot = &channel_.header()->down;
+	slot->method = SM_Explore;
+	slot->size = 0;
+	return call(true) ? slot->result : WFC_Error;
+}
+
+int32_t RemoteScanner::advance()
+{
+	std::lock_guard<std::mutex> lock(call_mutex_);
+	if (!spawned_ || disconnected_)
+		return WFC_Error;
+	CallSlot* slot = &channel_.header()->down;
+	slot->method = SM_Advance;
+	slot->size = 0;
+	return call(true) ? slot->result : WFC_Error;
+}
+
+void RemoteScanner::stop()
+{
+	std::lock_guard<std::mutex> lock(call_mutex_);
+	if (!spawned_ || disconnected_)
+		return;
+	CallSlot* slot = &channel_.header()->down;
+	slot->method = SM_Stop;
+	slot->size = 0;
+	call(false);
+}
+
+void RemoteScanner::pause()
+{
+	std::lock_guard<std::mutex> lock(call_mutex_);
+	if (!spawned_ || disconnected_)
+		return;
+	CallSlot* slot = &channel_.header()->down;
+	slot->method = SM_Pause;
+	slot->size = 0;
+	call(false);
+}
+
+void RemoteScanner::resume()
+{
+	std::lock_guard<std::mutex> lock(call_mutex_);
+	if (!spawned_ || disconnected_)
+		return;
+	CallSlot* slot = &channel_.header()->down;
+	slot->method = SM_Resume;
+	slot->size = 0;
+	call(false);
+}
+
+const int32_t RemoteScanner::filesystem()
+{
+	std::lock_guard<std::mutex> lock(call_mutex_);
+	if (!spawned_ || disconnected_)
+		return 0;
+	CallSlot* slot = &channel_.header()->down;
+	slot->method = SM_Filesystem;
+	slot->size = 0;
+	return call(false) ? slot->result : 0;
+}
+
+bool RemoteScanner::availabled(const uint64_t& offset, int32_t option)
+{
+	std::lock_guard<std::mutex> lock(call_mutex_);
+	if (!spawned_ || disconnected_)
+		return false;
+	CallSlot* slot = &channel_.header()->down;
+	slot->method = SM_Availabled;
+	slot->option = option;
+	slot->args[0] = (int64_t)offset;
+	slot->size = 0;
+	return call(false) && slot->result != 0;
+}
+
+int32_t RemoteScanner::inject_control(void* data, int32_t &size, int32_t option)
+{
+	std::lock_guard<std::mutex> lock(call_mutex_);
+	if (!spawned_ || disconnected_ || data == nullptr || size < 0)
+		return WFC_Error;
+	CallSlot* slot = &channel_.header()->down;
+	uint8_t* payload = channel_.payload(slot);
+	slot->method = SM_InjectControl;
+	slot->option = option;
+	slot->args[0] = size;
+	slot->size = std::min<uint32_t>((uint32_t)size, slot->capacity);
+	memcpy(payload, data, slot->size);
+	if (!call(true))
+		return WFC_Error;
+	// only what the scanner wrote is copied back, data of the engine may be read only
+	if (slot->args[1] != 0)
+		memcpy(data, payload, std::min<uint32_t>(slot->size, (uint32_t)size));
+	size = (int32_t)slot->args[0];
+	return slot->result;
+}
+
+void RemoteScanner::write_buffer(const char* buffer, int64_t offset, int32_t count)
+{
+	if (!spawned_ || disconnected_ || buffer == nullptr || count <= 0)
+		return;
+	std::lock_guard<std::mutex> lock(block_mutex_);
+	int32_t limit = blockLimit();
+	for (int32_t pos = 0; pos < count; pos += limit)
+	{
+		if (!push(buffer + pos, offset + pos, std::min(limit, count - pos), ConstPollMilliseconds))
+			return;
+	}
+}
+
+int32_t RemoteScanner::try_write_buffer(const char* buffer, int64_t offset, int32_t count)
+{
+	if (!spawned_ || disconnected_ || buffer == nullptr || count <= 0)
+		return WFC_Error;
+	if (count > blockLimit())
+	{
+		write_buffer(buffer, offset, count);
+		return disconnected_ ? WFC_Error : WFC_Success;
+	}
+	std::lock_guard<std::mutex> lock(block_mutex_);
+	// a full ring is the scanner over its budget
+	if (push(buffer, offset, count, 0))
+		return WFC_Success;
+	return disconnected_ ? WFC_Error : WFC_Busy;
+}
+
+int32_t RemoteScanner::read_buffer(char* buffer, int64_t offset, int32_t count)
+{
+	std::lock_guard<std::mutex> lock(call_mutex_);
+	if (!spawned_ || disconnected_ || buffer == nullptr || count <= 0)
+		return 0;
+	CallSlot* slot = &channel_.header()->down;
+	uint8_t* payload = channel_.payload(slot);
+	int32_t total = 0;
+	while (total < count)
+	{
+		int32_t chunk = std::min<int32_t>(count - total, (int32_t)slot->capacity);
+		slot->method = SM_ReadBuffer;
+		slot->args[0] = offset + total;
+		slot->args[1] = chunk;
+		slot->size = 0;
+		if (!call(total == 0) || slot->result <= 0)
+			break;
+		memcpy(buffer + total, payload, std::min(slot->result, chunk));
+		total += std::min(slot->result, chunk);
+		if (slot->result < chunk)
+			break;
+	}
+	return total;
+}
+
+int32_t RemoteScanner::save_file(char* filePath, int32_t index, int64_t id, int64_t count, int32_t option)
+{
+	std::lock_guard<std::mutex> lock(call_mutex_);
+	if (!spawned_ || disconnected_ || filePath == nullptr)
+		return WFC_Error;
+	CallSlot* slot = &channel_.header()->down;
+	uint8_t* payload = channel_.payload(slot);
+	// the path, then the ids of a batch, which the host can not read from here
+	size_t length = strlen(filePath) + 1;
+	size_t ids = option == SFO_Batch && id != 0 && count > 0 ? (size_t)count * sizeof(int64_t) : 0;
+	if (length + ids > slot->capacity)
+		return WFC_Error;
+	memcpy(payload, filePath, length);
+	if (ids > 0)
+		memcpy(payload + length, (const void*)(intptr_t)id, ids);
+	slot->method = SM_SaveFile;
+	slot->index = index;
+	slot->option = option;
+	slot->args[0] = id;
+	slot->args[1] = count;
+	slot->args[2] = (int64_t)length;
+	slot->size = (uint32_t)(length + ids);
+	return call(true) ? slot->result : WFC_Error;
+}
+
+int32_t RemoteScanner::special_read_buffer(void* buffer, int32_t index, int64_t id, int64_t offset, int64_t count, int32_t option)
+{
+	std::lock_guard<std::mutex> lock(call_mutex_);
+	if (!spawned_ || disconnected_ || buffer == nullptr || count <= 0)
+		return 0;
+	CallSlot* slot = &channel_.header()->down;
+	uint8_t* payload = channel_.payload(slot);
+	int64_t total = 0;
+	while (total < count)
+	{
+		int64_t chunk = std::min<int64_t>(count - total, slot->capacity);
+		slot->method = SM_SpecialRead;
+		slot->index = index;
+		slot->option = option;
+		slot->args[0] = id;
+		slot->args[1] = offset + total;
+		slot->args[2] = chunk;
+		slot->size = 0;
+		if (!call(total == 0) || slot->result <= 0)
+			break;
+		int64_t read = std::min<int64_t>(slot->result, chunk);
+		memcpy((uint8_t*)buffer + total, payload, (size_t)read);
+		total += read;
+		if (read < chunk)
+			break;
+	}
+	return (int32_t)total;
+}
+
+void RemoteScanner::destroy()
+{
+	{
+		std::lock_guard<std::mutex> lock(call_mutex_);
+		if (spawned_ && !disconnected_)
+		{
+			// the host leaves once it answers
+			destroying_ = true;
+			CallSlot* slot = &channel_.header()->down;
+			slot->method = SM_Destroy;
+			slot->size = 0;
+			call(false);
+		}
+	}
+	// a transfer calling this still holds its record of the event ring
+	if (pump_.joinable() && pump_.get_id() == std::this_thread::get_id())
+	{
+		deferred_ = true;
+		return;
+	}
+	terminate();
+	delete this;
+}
+
+bool RemoteScanner::disconnected() const
+{
+	return disconnected_;
+}
+
+int32_t RemoteScanner::run()
+{
+	ShmRing& events = channel_.events();
+	while (true)
+	{
+		RingRecord* record = events.peek(ConstPollMilliseconds);
+		if (record == nullptr)
+		{
+			// whatever the host wrote before it went is delivered first
+			if (closing_ || !alive())
+				break;
+			continue;
+		}
+		uint8_t* payload = ShmRing::payload(record);
+		int32_t result = 0;
+		if (record->type == RT_FileInfo)
+		{
+			// the delegate owns the file info, as with a scanner in process
+			auto info = new RawFileInfo();
+			memcpy((void*)info, payload, sizeof(RawFileInfo));
+			info->Runlist = nullptr;
+			Runlist** tail = &info->Runlist;
+			auto runs = (const uint64_t*)(payload + sizeof(RawFileInfo));
+			for (int64_t index = 0; index < record->value; ++index)
+			{
+				auto run = new Runlist();
+				run->Offset = runs[index * 3];
+				run->Start = runs[index * 3 + 1];
+				run->Number = runs[index * 3 + 2];
+				*tail = run;
+				tail = &run->Next;
+			}
+			int64_t size = sizeof(RawFileInfo);
+			result = delegate_->Transfer(NotifyOption::NO_FileInfo, info, &size);
+		}
+		else if (record->type == RT_Transfer)
+		{
+			int64_t size = record->offset;
+			result = delegate_->Transfer((int32_t)record->value, record->size > 0 ? payload : nullptr, &size);
+		}
+		else if (record->type == RT_Logger)
+		{
+			delegate_->Logger("%s", (const char*)payload);
+		}
+		events.release(record);
+		// the transfer of the host returned long ago, its next one reports the failure
+		if (result != 0)
+		{
+			int32_t none = 0;
+			channel_.header()->failure.compare_exchange_strong(none, result);
+		}
+		if (deferred_)
+			break;
+	}
+	if (deferred_)
+	{
+		// nothing runs on this object any more, the pump is the last one using it
+		pump_.detach();
+		terminate();
+		delete this;
+		return 0;
+	}
+	if (!closing_ && !destroying_)
+	{
+		delegate_->Logger("[%s] scanner host exited", __FUNCTION__);
+		int64_t size = 0;
+		delegate_->Transfer(NotifyOption::NO_Disconnect, nullptr, &size);
+	}
+	return 0;
+}
+
+bool RemoteScanner::spawn()
+{
+	static std::atomic<uint32_t> counter(0);
+#ifdef _WIN32
+	uint32_t pid = (uint32_t)GetCurrentProcessId();
+#else
+	uint32_t pid = (uint32_t)getpid();
+#endif
+	std::string name = "carverhost." + std::to_string(pid) + "." + std::to_string(++counter);
+	if (!channel_.create(name, ring_size_, ShmChannel::DefaultEvents, ShmChannel::DefaultPayload))
+		return false;
+
+#ifdef _WIN32
+	std::string command = "\"" + host_path_ + "\" --channel " + name + " --parent " + std::to_string(pid);
+	std::vector<char> line(command.begin(), command.end());
+	line.push_back('\0');
+	STARTUPINFOA startup = { sizeof(STARTUPINFOA) };
+	PROCESS_INFORMATION information = {};
+	if (!CreateProcessA(nullptr, line.data(), nullptr, nullptr, FALSE, 0, nullptr, nullptr, &startup, &information))
+	{
+		channel_.close();
+		return false;
+	}
+	CloseHandle(information.hThread);
+	process_ = information.hProcess;
+#else
+	std::string parent = std::to_string(pid);
+	pid_t child = fork();
+	if (child < 0)
+	{
+		channel_.close();
+		return false;
+	}
+	if (child == 0)
+	{
+		execl(host_path_.c_str(), host_path_.c_str(), "--channel", name.c_str(), "--parent", parent.c_str(), (char*)nullptr);
+		_exit(127);
+	}
+	pid_ = (int32_t)child;
+#endif
+
+	// the name is dropped once the host has the mapping, nothing is left behind after a crash
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(ConstAttachSeconds);
+	while (channel_.header()->attached.load(std::memory_order_acquire) == 0)
+	{
+		if (!alive() || std::chrono::steady_clock::now() > deadline)
+		{
+			closing_ = true;
+			terminate();
+			return false;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	channel_.unlink();
+
+	spawned_ = true;
+	pump_ = std::thread([this] { this->run(); });
+	server_ = std::thread(&RemoteScanner::serve, this);
+	return true;
+}
+
+void RemoteScanner::serve()
+{
+	CallSlot* slot = &channel_.header()->up;
+	uint8_t* payload = channel_.payload(slot);
+	// every request taken is answered, one posted before this thread started is not missed
+	uint32_t sequence = slot->reply.sequence.load(std::memory_order_acquire);
+	while (!closing_)
+	{
+		if (!channel_.accept(slot, sequence, ConstPollMilliseconds))
+		{
+			if (!alive())
+				break;
+			continue;
+		}
+		if (slot->method == SM_Read)
+		{
+			// the data follows the blocks written before, the host takes it off the block ring
+			slot->result = read(slot->args[0], (int32_t)slot->args[1]);
+			slot->events = channel_.blocks().produced();
+		}
+		else if (slot->method == SM_DelegateAvailabled)
+		{
+			uint64_t offset = (uint64_t)slot->args[0];
+			slot->result = delegate_->Availabled(offset, slot->option) ? 1 : 0;
+		}
+		else if (slot->method == SM_Context)
+		{
+			int32_t size = 0;
+			slot->result = delegate_->Context(payload, &size);
+			slot->size = size > 0 ? (uint32_t)size : 0;
+			// blocks are marked available with the sectors of the device from now on
+			frjson context = frjson::parse(payload, payload + slot->size, nullptr, false);
+			auto sector = context.is_object() ? context.find("BytesPerSector") : context.end();
+			if (sector != context.end() && sector->is_number_integer() && sector->get<int32_t>() > 0)
+				sector_size_ = sector->get<int32_t>();
+		}
+		else
+		{
+			slot->result = WFC_Error;
+		}
+		channel_.answer(slot);
+	}
+}
+
+bool RemoteScanner::call(bool ordered)
+{
+	CallSlot* slot = &channel_.header()->down;
+	slot->result = WFC_Error;
+	if (ordered)
+	{
+		// blocks written before the call are taken by the scanner first
+		uint64_t written = channel_.blocks().produced();
+		while (!channel_.blocks().drained(written, ConstPollMilliseconds))
+		{
+			if (!alive())
+				return false;
+		}
+	}
+	uint32_t sequence = channel_.request(slot);
+	while (!channel_.response(slot, sequence, ConstPollMilliseconds))
+	{
+		if (!alive())
+			return false;
+	}
+	// transfers made before the reply reach the delegate first, unless the call comes from one of them
+	if (std::this_thread::get_id() != pump_.get_id())
+	{
+		while (!channel_.events().drained(slot->events, ConstPollMilliseconds))
+		{
+			if (!alive())
+				return false;
+		}
+	}
+	return true;
+}
+
+bool RemoteScanner::push(const char* buffer, int64_t offset, int32_t count, int32_t timeout)
+{
+	ShmRing& blocks = channel_.blocks();
+	RingRecord* record = nullptr;
+	while ((record = blocks.reserve((uint32_t)count + mark_bytes(count), timeout)) == nullptr)
+	{
+		if (timeout == 0 || !alive())
+			return false;
+	}
+	// the only copy, the host carves from the ring
+	memcpy(ShmRing::payload(record), buffer, count);
+	record->type = RT_Block;
+	mark(record, offset, count);
+	blocks.commit(record);
+	return true;
+}
+
+int32_t RemoteScanner::read(int64_t offset, int32_t count)
+{
+	std::lock_guard<std::mutex> lock(block_mutex_);
+	ShmRing& blocks = channel_.blocks();
+	int32_t limit = std::min(blockLimit(), ConstReadRecord);
+	int32_t total = 0;
+	while (total < count)
+	{
+		int32_t chunk = std::min(count - total, limit);
+		RingRecord* record = nullptr;
+		while ((record = blocks.reserve((uint32_t)chunk + mark_bytes(chunk), ConstPollMilliseconds)) == nullptr)
+		{
+			if (closing_ || !alive())
+				return total > 0 ? total : -1;
+		}
+		// a record not committed is dropped with the next reserve
+		int32_t result = delegate_->Read(ShmRing::payload(record), offset + total, chunk);
+		if (result <= 0)
+			return total > 0 ? total : result;
+		result = std::min(result, chunk);
+		record->type = RT_Read;
+		mark(record, offset + total, result);
+		blocks.commit(record);
+		total += result;
+		if (result < chunk)
+			break;
+	}
+	return total > 0 ? total : -1;
+}
+
+int32_t RemoteScanner::blockLimit()
+{
+	int32_t limit = (int32_t)channel_.blocks().limit();
+	return (int32_t)((limit - mark_bytes(limit)) / WD_BLOCK_SIZE * WD_BLOCK_SIZE);
+}
+
+void RemoteScanner::mark(RingRecord* record, int64_t offset, int32_t count)
+{
+	record->offset = offset;
+	record->value = count;
+	record->reserved = sector_size_;
+	if (record->reserved == 0)
+		return;
+	// the scanner asks once for each 4096 bytes, by the sector they start at
+	uint8_t* bits = ShmRing::payload(record) + count;
+	memset(bits, 0, mark_bytes(count));
+	for (int32_t index = 0; index * WD_BLOCK_SIZE < count; ++index)
+	{
+		uint64_t blockno = (uint64_t)(offset + (int64_t)index * WD_BLOCK_SIZE) / record->reserved;
+		if (delegate_->Availabled(blockno, 0))
+			bits[index / 8] |= 1 << (index % 8);
+	}
+}
+
+bool RemoteScanner::alive()
+{
+	std::lock_guard<std::mutex> lock(process_mutex_);
+#ifdef _WIN32
+	if (process_ != nullptr && WaitForSingleObject((HANDLE)process_, 0) == WAIT_OBJECT_0)
+	{
+		CloseHandle((HANDLE)process_);
+		process_ = nullptr;
+	}
+	if (process_ == nullptr)
+		disconnected_ = true;
+#else
+	int status = 0;
+	if (pid_ > 0 && waitpid(pid_, &status, WNOHANG) == pid_)
+		pid_ = -1;
+	if (pid_ <= 0)
+		disconnected_ = true;
+#endif
+	return !disconnected_;
+}
+
+void RemoteScanner::terminate()
+{
+	closing_ = true;
+	// a pump destroyed from one of its transfers is detached by then
+	if (pump_.joinable())
+		pump_.join();
+	if (server_.joinable())
+		server_.join();
+
+	// the host leaves after destroy, one that does not is killed
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(ConstExitSeconds);
+	while (alive() && std::chrono::steady_clock::now() < deadline)
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	{
+		std::lock_guard<std::mutex> lock(process_mutex_);
+#ifdef _WIN32
+		if (process_ != nullptr)
+		{
+			TerminateProcess((HANDLE)process_, (UINT)-1);
+			WaitForSingleObject((HANDLE)process_, INFINITE);
+			CloseHandle((HANDLE)process_);
+			process_ = nullptr;
+		}
+#else
+		if (pid_ > 0)
+		{
+			kill(pid_, SIGKILL);
+			waitpid(pid_, nullptr, 0);
+			pid_ = -1;
+		}
+#endif
+	}
+	disconnected_ = true;
+	channel_.close();
+}
@@ -0,0 +1,124 @@
+/**********************************************************************
+*
+* Copyright (C)2015-2022 Maxwell Analytica. All rights reserved.
+*
+* @file remotescanner.h
+* @brief Scanner running in a carverhost process behind the IScanner interface
+* @details Blocks are written once into the shared block ring and carved from
+*          there, transfers and logs come back through the event ring and reach
+*          the delegate on one thread, in the order they were made. A call
+*          returns after the blocks written before it are taken and the transfers
+*          made during it are delivered. A crash of the host ends in NO_Disconnect,
+*          calls fail from then on instead of taking the engine down
+* @author Maxwell
+* @version 1.0.0
+* @date 2026-10-19 23:59:48.239
+*
+**********************************************************************/
+#ifndef REMOTE_SCANNER_H
+#define REMOTE_SCANNER_H
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "shmchannel.h"
+#include "../../include/datatype.h"
+#include "../../include/iscanner.h"
+
+class RemoteScanner : public IScanner
+{
+public:
+	// `host_path` is the carverhost executable, started by set_delegate
+	RemoteScanner(const std::string& host_path, uint64_t ring_size = ShmChannel::DefaultBlocks);
+	virtual ~RemoteScanner();
+
+	virtual void set_delegate(ITransferDelegate* delegate);
+
+	virtual int32_t explore();
+
+	virtual int32_t advance();
+
+	virtual void stop();
+
+	virtual void pause();
+
+	virtual void resume();
+
+	virtual const int32_t filesystem();
+
+	virtual bool availabled(const uint64_t& offset, int32_t option = 0);
+
+	virtual int32_t inject_control(void* data, int32_t &size, int32_t option = 0);
+
+	virtual void write_buffer(const char* buffer, int64_t offset, int32_t count = 4096);
+
+	virtual int32_t read_buffer(char* buffer, int64_t offset, int32_t count = 4096);
+
+	virtual int32_t save_file(char* filePath, int32_t index, int64_t id, int64_t count, int32_t option = 0);
+
+	virtual int32_t special_read_buffer(void* buffer, int32_t index, int64_t id, int64_t offset, int64_t count, int32_t option = 0);
+
+	virtual void destroy();
+
+	// not part of IScanner, write_buffer returning WFC_Busy instead of waiting for a full ring
+	int32_t try_write_buffer(const char* buffer, int64_t offset, int32_t count = 4096);
+
+	// the host process is gone
+	bool disconnected() const;
+
+protected:
+	// transfers and logs of the host
+	virtual int32_t run();
+
+private:
+	bool spawn();
+
+	// delegate calls of the host
+	void serve();
+
+	// the call filled in the down slot, false once the host is gone
+	bool call(bool ordered);
+
+	// one block record, waits for room
+	bool push(const char* buffer, int64_t offset, int32_t count, int32_t timeout);
+
+	// Read of the host delegate into block records, returns the bytes read
+	int32_t read(int64_t offset, int32_t count);
+
+	// data bytes of one block record, whole 4096 byte blocks with room for their bits
+	int32_t blockLimit();
+
+	// Availabled bits of the `count` bytes at `offset` after them in `record`
+	void mark(RingRecord* record, int64_t offset, int32_t count);
+
+	bool alive();
+
+	void terminate();
+
+private:
+	std::string host_path_;
+	uint64_t ring_size_;
+	ITransferDelegate* delegate_;
+	ShmChannel channel_;
+	std::atomic<bool> spawned_;
+	std::atomic<bool> disconnected_;
+	std::atomic<bool> closing_;
+	std::atomic<bool> destroying_;
+	// destroyed from a transfer, the pump tears down once it is back from the delegate
+	std::atomic<bool> deferred_;
+	// of the device context, 0 until the host asked for it
+	std::atomic<int32_t> sector_size_;
+	std::mutex call_mutex_;
+	std::mutex block_mutex_;
+	std::mutex process_mutex_;
+	std::thread pump_;
+	std::thread server_;
+#ifdef _WIN32
+	void* process_;
+#else
+	int32_t pid_;
+#endif
+};
+
+#endif // REMOTE_SCANNER_H
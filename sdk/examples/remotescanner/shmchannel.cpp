@@ -0,0 +1,445 @@
+/**********************************************************************
+*
+* Copyright (C)2015-2022 Maxwell Analytica. All rights reserved.
+*
+* @file shmchannel.cpp
+* @brief
+* @details
+* @author Maxwell
+* @version 1.0.0
+* @date 2026-10-19 23:59:48.239
+*
+**********************************************************************/
+#include "shmchannel.h"
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <climits>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#endif
+
+ShmRing::ShmRing()
+{
+	channel_ = nullptr;
+	header_ = nullptr;
+	data_ = nullptr;
+	mask_ = 0;
+	reserved_ = 0;
+}
+
+void ShmRing::attach(ShmChannel* channel, RingHeader* header)
+{
+	channel_ = channel;
+	header_ = header;
+	data_ = (uint8_t*)channel->header() + header->data;
+	mask_ = header->capacity - 1;
+	reserved_ = header->head.load(std::memory_order_relaxed);
+}
+
+uint64_t ShmRing::footprint(uint32_t size)
+{
+	// records start on a cache line
+	return (sizeof(RingRecord) + size + 63) & ~63ull;
+}
+
+uint32_t ShmRing::limit() const
+{
+	// a record and the pad before it always fit together
+	return (uint32_t)(header_->capacity / 2 - sizeof(RingRecord));
+}
+
+RingRecord* ShmRing::reserve(uint32_t size, int32_t timeout)
+{
+	uint64_t need = footprint(size);
+	uint64_t head = header_->head.load(std::memory_order_relaxed);
+	uint64_t contiguous = header_->capacity - (head & mask_);
+	uint64_t total = need <= contiguous ? need : contiguous + need;
+	while (true)
+	{
+		uint32_t sequence = header_->writable.sequence.load(std::memory_order_acquire);
+		uint64_t tail = header_->tail.load(std::memory_order_acquire);
+		if (header_->capacity - (head - tail) >= total)
+			break;
+		if (!channel_->wait(&header_->writable, sequence, timeout))
+			return nullptr;
+	}
+	if (need > contiguous)
+	{
+		auto pad = (RingRecord*)(data_ + (head & mask_));
+		pad->type = RT_Pad;
+		pad->size = (uint32_t)(contiguous - sizeof(RingRecord));
+		head += contiguous;
+	}
+	auto record = (RingRecord*)(data_ + (head & mask_));
+	record->type = RT_Pad;
+	record->size = size;
+	record->offset = 0;
+	record->value = 0;
+	record->reserved = 0;
+	reserved_ = head + need;
+	return record;
+}
+
+void ShmRing::commit(RingRecord* record)
+{
+	header_->head.store(reserved_, std::memory_order_release);
+	channel_->notify(&header_->readable);
+}
+
+RingRecord* ShmRing::peek(int32_t timeout)
+{
+	while (true)
+	{
+		uint32_t sequence = header_->readable.sequence.load(std::memory_order_acquire);
+		uint64_t tail = header_->tail.load(std::memory_order_relaxed);
+		if (header_->head.load(std::memory_order_acquire) == tail)
+		{
+			if (!channel_->wait(&header_->readable, sequence, timeout))
+				return nullptr;
+			continue;
+		}
+		auto record = (RingRecord*)(data_ + (tail & mask_));
+		if (record->type != RT_Pad)
+			return record;
+		release(record);
+	}
+}
+
+void ShmRing::release(RingRecord* record)
+{
+	uint64_t tail = header_->tail.load(std::memory_order_relaxed);
+	header_->tail.store(tail + footprint(record->size), std::memory_order_release);
+	channel_->notify(&header_->writable);
+}
+
+bool ShmRing::empty() const
+{
+	return header_->head.load(std::memory_order_acquire) == header_->tail.load(std::memory_order_acquire);
+}
+
+uint64_t ShmRing::produced() const
+{
+	return header_->head.load(std::memory_order_acquire);
+}
+
+uint64_t ShmRing::consumed() const
+{
+	return header_->tail.load(std::memory_order_acquire);
+}
+
+bool ShmRing::drained(uint64_t position, int32_t timeout)
+{
+	while (true)
+	{
+		uint32_t sequence = header_->writable.sequence.load(std::memory_order_acquire);
+		if (header_->tail.load(std::memory_order_acquire) >= position)
+			return true;
+		if (!channel_->wait(&header_->writable, sequence, timeout))
+			return false;
+	}
+}
+
+uint8_t* ShmRing::payload(RingRecord* record)
+{
+	return (uint8_t*)(record + 1);
+}
+
+ShmChannel::ShmChannel()
+{
+	base_ = nullptr;
+	size_ = 0;
+#ifdef _WIN32
+	mapping_ = nullptr;
+#else
+	descriptor_ = -1;
+	linked_ = false;
+#endif
+}
+
+ShmChannel::~ShmChannel()
+{
+	close();
+}
+
+static uint64_t power_of_two(uint64_t value)
+{
+	uint64_t result = 0x10000;
+	while (result < value)
+		result <<= 1;
+	return result;
+}
+
+bool ShmChannel::create(const std::string& name, uint64_t blocks, uint64_t events, uint32_t payload)
+{
+	blocks = power_of_two(blocks);
+	events = power_of_two(events);
+	payload = (payload + 4095) & ~4095u;
+	uint64_t offset = (sizeof(ShmHeader) + 4095) & ~4095ull;
+	name_ = name;
+	if (!map(true, offset + blocks + events + 2ull * payload))
+		return false;
+
+	// the mapping comes zeroed, only the layout is written
+	auto header = (ShmHeader*)base_;
+	header->magic = Magic;
+	header->version = Version;
+	header->size = size_;
+	header->blocks.capacity = blocks;
+	header->blocks.data = offset;
+	offset += blocks;
+	header->events.capacity = events;
+	header->events.data = offset;
+	offset += events;
+	header->down.capacity = payload;
+	header->down.payload = offset;
+	offset += payload;
+	header->up.capacity = payload;
+	header->up.payload = offset;
+	blocks_.attach(this, &header->blocks);
+	events_.attach(this, &header->events);
+	return true;
+}
+
+bool ShmChannel::open(const std::string& name)
+{
+	name_ = name;
+	if (!map(false, 0))
+		return false;
+	auto header = (ShmHeader*)base_;
+	if (header->magic != Magic || header->version != Version || header->size > size_)
+	{
+		close();
+		return false;
+	}
+	blocks_.attach(this, &header->blocks);
+	events_.attach(this, &header->events);
+	header->attached.store(1, std::memory_order_release);
+	return true;
+}
+
+ShmHeader* ShmChannel::header() const
+{
+	return (ShmHeader*)base_;
+}
+
+ShmRing& ShmChannel::blocks()
+{
+	return blocks_;
+}
+
+ShmRing& ShmChannel::events()
+{
+	return events_;
+}
+
+uint8_t* ShmChannel::payload(CallSlot* slot) const
+{
+	return base_ + slot->payload;
+}
+
+const std::string& ShmChannel::name() const
+{
+	return name_;
+}
+
+uint32_t ShmChannel::request(CallSlot* slot)
+{
+	uint32_t sequence = slot->reply.sequence.load(std::memory_order_acquire);
+	notify(&slot->request);
+	return sequence;
+}
+
+bool ShmChannel::response(CallSlot* slot, uint32_t sequence, int32_t timeout)
+{
+	return wait(&slot->reply, sequence, timeout);
+}
+
+bool ShmChannel::accept(CallSlot* slot, uint32_t& sequence, int32_t timeout)
+{
+	if (!wait(&slot->request, sequence, timeout))
+		return false;
+	sequence = slot->request.sequence.load(std::memory_order_acquire);
+	return true;
+}
+
+void ShmChannel::answer(CallSlot* slot)
+{
+	notify(&slot->reply);
+}
+
+#ifdef _WIN32
+bool ShmChannel::map(bool create, uint64_t size)
+{
+	std::string name = "Local\\" + name_;
+	if (create)
+		mapping_ = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, (DWORD)(size >> 32), (DWORD)size, name.c_str());
+	else
+		mapping_ = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, name.c_str());
+	if (mapping_ == nullptr)
+		return false;
+	if (create && GetLastError() == ERROR_ALREADY_EXISTS)
+	{
+		close();
+		return false;
+	}
+	base_ = (uint8_t*)MapViewOfFile(mapping_, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+	if (base_ == nullptr)
+	{
+		close();
+		return false;
+	}
+	MEMORY_BASIC_INFORMATION information = {};
+	VirtualQuery(base_, &information, sizeof(information));
+	size_ = create ? size : information.RegionSize;
+	return true;
+}
+
+void ShmChannel::close()
+{
+	{
+		std::lock_guard<std::mutex> lock(event_mutex_);
+		for (auto& handle : handles_)
+			CloseHandle((HANDLE)handle.second);
+		handles_.clear();
+	}
+	if (base_ != nullptr)
+		UnmapViewOfFile(base_);
+	if (mapping_ != nullptr)
+		CloseHandle((HANDLE)mapping_);
+	base_ = nullptr;
+	mapping_ = nullptr;
+	size_ = 0;
+}
+
+void ShmChannel::unlink()
+{
+	// the mapping goes with its last handle
+}
+
+void ShmChannel::notify(ShmEvent* event)
+{
+	event->sequence.fetch_add(1, std::memory_order_seq_cst);
+	if (event->waiters.load(std::memory_order_seq_cst) == 0)
+		return;
+	uint64_t offset = (uint8_t*)event - base_;
+	HANDLE handle = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(event_mutex_);
+		auto iter = handles_.find(offset);
+		if (iter == handles_.end())
+		{
+			std::string name = "Local\\" + name_ + "." + std::to_string(offset);
+			iter = handles_.emplace(offset, CreateEventA(nullptr, FALSE, FALSE, name.c_str())).first;
+		}
+		handle = (HANDLE)iter->second;
+	}
+	if (handle != nullptr)
+		SetEvent(handle);
+}
+
+bool ShmChannel::wait(ShmEvent* event, uint32_t sequence, int32_t timeout)
+{
+	if (event->sequence.load(std::memory_order_acquire) != sequence)
+		return true;
+	uint64_t offset = (uint8_t*)event - base_;
+	HANDLE handle = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(event_mutex_);
+		auto iter = handles_.find(offset);
+		if (iter == handles_.end())
+		{
+			std::string name = "Local\\" + name_ + "." + std::to_string(offset);
+			iter = handles_.emplace(offset, CreateEventA(nullptr, FALSE, FALSE, name.c_str())).first;
+		}
+		handle = (HANDLE)iter->second;
+	}
+	event->waiters.fetch_add(1, std::memory_order_seq_cst);
+	// a notify past this check leaves the event set
+	if (event->sequence.load(std::memory_order_seq_cst) == sequence && handle != nullptr)
+		WaitForSingleObject(handle, timeout < 0 ? INFINITE : (DWORD)timeout);
+	event->waiters.fetch_sub(1, std::memory_order_seq_cst);
+	return event->sequence.load(std::memory_order_acquire) != sequence;
+}
+#else
+bool ShmChannel::map(bool create, uint64_t size)
+{
+	std::string name = "/" + name_;
+	descriptor_ = shm_open(name.c_str(), create ? O_RDWR | O_CREAT | O_EXCL : O_RDWR, 0600);
+	if (descriptor_ < 0)
+		return false;
+	linked_ = create;
+	if (create)
+	{
+		if (ftruncate(descriptor_, (off_t)size) != 0)
+		{
+			close();
+			return false;
+		}
+	}
+	else
+	{
+		struct stat information;
+		if (fstat(descriptor_, &information) != 0 || information.st_size < (off_t)sizeof(ShmHeader))
+		{
+			close();
+			return false;
+		}
+		size = (uint64_t)information.st_size;
+	}
+	void* base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor_, 0);
+	if (base == MAP_FAILED)
+	{
+		close();
+		return false;
+	}
+	base_ = (uint8_t*)base;
+	size_ = size;
+	return true;
+}
+
+void ShmChannel::close()
+{
+	if (base_ != nullptr)
+		munmap(base_, size_);
+	if (descriptor_ >= 0)
+		::close(descriptor_);
+	unlink();
+	base_ = nullptr;
+	descriptor_ = -1;
+	size_ = 0;
+}
+
+void ShmChannel::unlink()
+{
+	if (linked_)
+		shm_unlink(("/" + name_).c_str());
+	linked_ = false;
+}
+
+void ShmChannel::notify(ShmEvent* event)
+{
+	event->sequence.fetch_add(1, std::memory_order_seq_cst);
+	if (event->waiters.load(std::memory_order_seq_cst) > 0)
+		syscall(SYS_futex, (uint32_t*)&event->sequence, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+bool ShmChannel::wait(ShmEvent* event, uint32_t sequence, int32_t timeout)
+{
+	if (event->sequence.load(std::memory_order_acquire) != sequence)
+		return true;
+	struct timespec span = { timeout / 1000, (timeout % 1000) * 1000000L };
+	event->waiters.fetch_add(1, std::memory_order_seq_cst);
+	// the kernel compares the word again, a notify past this check is not lost
+	if (event->sequence.load(std::memory_order_seq_cst) == sequence)
+		syscall(SYS_futex, (uint32_t*)&event->sequence, FUTEX_WAIT, sequence, timeout < 0 ? nullptr : &span, nullptr, 0);
+	event->waiters.fetch_sub(1, std::memory_order_seq_cst);
+	return event->sequence.load(std::memory_order_acquire) != sequence;
+}
+#endif
@@ -0,0 +1,231 @@
+/**********************************************************************
+*
+* Copyright (C)2015-2022 Maxwell Analytica. All rights reserved.
+*
+* @file shmchannel.h
+* @brief Shared memory channel between a scanner and the process hosting it
+* @details One named mapping holds a ring of blocks towards the scanner, a ring
+*          of transfers and logs back, and a call slot for each direction. Every
+*          ring has a single producer and a single consumer, a waiting side is
+*          woken through a futex on Linux and a named event on Windows, only
+*          when it actually sleeps
+* @author Maxwell
+* @version 1.0.0
+* @date 2026-10-19 23:59:48.239
+*
+**********************************************************************/
+#ifndef SHM_CHANNEL_H
+#define SHM_CHANNEL_H
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <stdint.h>
+
+typedef struct _ShmEvent
+{
+	std::atomic<uint32_t>	sequence;		/* moved by every notify, the futex word */
+	std::atomic<uint32_t>	waiters;
+}ShmEvent, *PShmEvent;
+
+typedef enum _RingRecordType
+{
+	RT_Pad			= 0,		/* rest of the ring before it wraps */
+	RT_Block,					/* write_buffer at `offset`, `value` bytes then a bit per 4096 of them, see below */
+	RT_FileInfo,				/* RawFileInfo then `value` runs of {offset, start, number} */
+	RT_Transfer,				/* Transfer of `value` type, the payload when it had one */
+	RT_Logger,
+	RT_Read,					/* part of a delegate Read of the scanner, laid out as RT_Block */
+} RingRecordType;
+
+// blocks carry the Availabled result of each 4096 bytes they hold, asked with sectors of
+// `reserved` bytes, a record without it has `reserved` 0 and no bits
+
+typedef struct _RingRecord
+{
+	uint32_t	type;
+	uint32_t	size;			/* payload bytes following the record */
+	int64_t		offset;
+	int64_t		value;
+	int64_t		reserved;
+}RingRecord, *PRingRecord;
+
+typedef struct _RingHeader
+{
+	alignas(64) std::atomic<uint64_t>	head;		/* bytes produced */
+	alignas(64) std::atomic<uint64_t>	tail;		/* bytes consumed */
+	alignas(64) ShmEvent				readable;
+	ShmEvent							writable;
+	uint64_t							capacity;	/* power of two */
+	uint64_t							data;		/* offset of the bytes in the mapping */
+}RingHeader, *PRingHeader;
+
+typedef enum _ShmMethod
+{
+	// scanner calls, made by the engine side
+	SM_SetDelegate	= 1,
+	SM_Explore,
+	SM_Advance,
+	SM_Stop,
+	SM_Pause,
+	SM_Resume,
+	SM_Filesystem,
+	SM_Availabled,
+	SM_InjectControl,
+	SM_ReadBuffer,
+	SM_SaveFile,
+	SM_SpecialRead,
+	SM_Destroy,
+	// delegate calls, made by the scanner side
+	SM_Read			= 0x100,
+	SM_DelegateAvailabled,
+	SM_Context,
+} ShmMethod;
+
+typedef struct _CallSlot
+{
+	alignas(64) ShmEvent	request;
+	ShmEvent				reply;
+	uint32_t				method;
+	int32_t					option;
+	int32_t					index;
+	int32_t					result;
+	int64_t					args[3];
+	uint64_t				events;		/* transfers produced before the reply, blocks of a Read on the up slot */
+	uint32_t				size;		/* payload bytes, both ways */
+	uint32_t				capacity;
+	uint64_t				payload;	/* offset of the payload in the mapping */
+}CallSlot, *PCallSlot;
+
+typedef struct _ShmHeader
+{
+	uint32_t				magic;
+	uint32_t				version;
+	std::atomic<uint32_t>	attached;	/* set by the scanner side once mapped */
+	std::atomic<int32_t>	failure;	/* first failed Transfer of the engine delegate not reported yet */
+	uint64_t				size;
+	RingHeader				blocks;		/* engine to scanner */
+	RingHeader				events;		/* scanner to engine */
+	CallSlot				down;		/* engine calls the scanner */
+	CallSlot				up;			/* scanner calls the delegate */
+}ShmHeader, *PShmHeader;
+
+class ShmChannel;
+
+// ring of one producer and one consumer
+class ShmRing
+{
+public:
+	ShmRing();
+
+	void attach(ShmChannel* channel, RingHeader* header);
+
+	// record with room for `size` payload bytes, nullptr while the ring stays full for `timeout`
+	RingRecord* reserve(uint32_t size, int32_t timeout);
+
+	// publish the reserved record
+	void commit(RingRecord* record);
+
+	// oldest record, nullptr while the ring stays empty for `timeout`
+	RingRecord* peek(int32_t timeout);
+
+	// hand the room of the peeked record back
+	void release(RingRecord* record);
+
+	// largest payload of a record
+	uint32_t limit() const;
+
+	bool empty() const;
+
+	uint64_t produced() const;
+
+	uint64_t consumed() const;
+
+	// wait until `position` bytes are consumed, false on timeout
+	bool drained(uint64_t position, int32_t timeout);
+
+	static uint8_t* payload(RingRecord* record);
+
+private:
+	static uint64_t footprint(uint32_t size);
+
+private:
+	ShmChannel* channel_;
+	RingHeader* header_;
+	uint8_t* data_;
+	uint64_t mask_;
+	uint64_t reserved_;		/* head after the reserved record */
+};
+
+class ShmChannel
+{
+public:
+	ShmChannel();
+	~ShmChannel();
+
+	// engine side, a new mapping named `name`
+	bool create(const std::string& name, uint64_t blocks, uint64_t events, uint32_t payload);
+
+	// scanner side
+	bool open(const std::string& name);
+
+	void close();
+
+	// drop the name once the other side has it mapped, the mapping lives until both close it
+	void unlink();
+
+	ShmHeader* header() const;
+
+	ShmRing& blocks();
+
+	ShmRing& events();
+
+	uint8_t* payload(CallSlot* slot) const;
+
+	const std::string& name() const;
+
+	void notify(ShmEvent* event);
+
+	// until `event` moves past `sequence`, false on timeout
+	bool wait(ShmEvent* event, uint32_t sequence, int32_t timeout);
+
+	// post the call filled in `slot`, returns the reply sequence to wait past
+	uint32_t request(CallSlot* slot);
+
+	// reply of the call posted with `sequence`, false on timeout
+	bool response(CallSlot* slot, uint32_t sequence, int32_t timeout);
+
+	// next request on `slot` after `sequence`, false on timeout
+	bool accept(CallSlot* slot, uint32_t& sequence, int32_t timeout);
+
+	void answer(CallSlot* slot);
+
+public:
+	static const uint32_t Magic = 0x4D484353;
+	static const uint32_t Version = 2;
+	static const uint64_t DefaultBlocks = 0x2000000;
+	static const uint64_t DefaultEvents = 0x800000;
+	static const uint32_t DefaultPayload = 0x400000;
+
+private:
+	bool map(bool create, uint64_t size);
+
+private:
+	std::string name_;
+	uint8_t* base_;
+	uint64_t size_;
+	ShmRing blocks_;
+	ShmRing events_;
+#ifdef _WIN32
+	void* mapping_;
+	// named events by their offset in the mapping
+	std::mutex event_mutex_;
+	std::map<uint64_t, void*> handles_;
+#else
+	int32_t descriptor_;
+	bool linked_;
+#endif
+};
+
+#endif // SHM_CHANNEL_H
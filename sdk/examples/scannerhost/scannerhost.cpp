@@ -0,0 +1,239 @@
+/**********************************************************************
+*
+* Copyright (C)2015-2022 Maxwell Analytica. All rights reserved.
+*
+* @file scannerhost.cpp
+* @brief
+* @details
+* @author Maxwell
+* @version 1.0.0
+* @date 2026-10-19 16:05:12.380
+*
+**********************************************************************/
+#include "scannerhost.h"
+#include <algorithm>
+#include "../../third_party/json.hpp"
+
+using frjson = nlohmann::json;
+
+ScannerHost::ScannerHost()
+{
+	stop_ = false;
+	advancing_ = false;
+	block_size_ = DefaultBlockSize;
+	delegate_ = nullptr;
+}
+
+ScannerHost::~ScannerHost()
+{
+	stop_ = true;
+	for (auto& consumer : consumers_)
+	{
+		if (consumer->worker.joinable())
+			consumer->worker.join();
+	}
+	consumers_.clear();
+}
+
+int32_t ScannerHost::attach(IScanner* scanner, const std::string& name, int32_t queue_limit)
+{
+	if (scanner == nullptr || advancing_)
+		return WFC_Error;
+
+	std::unique_ptr<Consumer> consumer(new Consumer());
+	consumer->scanner = scanner;
+	consumer->name = name;
+	consumer->queue_limit = (size_t)(queue_limit > 0 ? queue_limit : DefaultQueueLimit);
+	consumer->lagging = false;
+	consumer->missed_start = 0;
+	consumer->missed_end = 0;
+	consumer->delivered = 0;
+	consumer->replayed = 0;
+	consumer->lagged = 0;
+	consumer->missed = 0;
+	consumers_.push_back(std::move(consumer));
+	return WFC_Success;
+}
+
+int32_t ScannerHost::advance(ITransferDelegate* delegate, int32_t block_size)
+{
+	if (delegate == nullptr || consumers_.empty() || advancing_)
+		return WFC_Error;
+
+	delegate_ = delegate;
+	int64_t device_size = 0;
+	int32_t sector_size = 512;
+	try
+	{
+		int32_t size = 0;
+		char szBuffer[4096] = { 0x00 };
+		delegate_->Context(szBuffer, &size);
+		frjson deviceJson = frjson::parse(std::string(szBuffer, size));
+		device_size = deviceJson.at("Size").get<int64_t>();
+		sector_size = deviceJson.value("BytesPerSector", 512);
+		sector_size = sector_size > 0 ? sector_size : 512;
+	}
+	catch (...)
+	{
+		delegate_->Logger("exception parse device info");
+		return WFC_Error;
+	}
+	// whole sectors, so replayed reads stay aligned
+	block_size_ = block_size > sector_size ? block_size - block_size % sector_size : sector_size;
+
+	stop_ = false;
+	advancing_ = true;
+	for (auto& consumer : consumers_)
+	{
+		consumer->scanner->advance();
+		consumer->worker = std::thread(&ScannerHost::consume, this, std::ref(*consumer));
+	}
+
+	int32_t result = WFC_Success;
+	for (int64_t offset = 0; offset < device_size && !stop_; offset += block_size_)
+	{
+		int32_t count = (int32_t)std::min<int64_t>(block_size_, device_size - offset);
+		std::unique_ptr<SharedBlock> block(new SharedBlock());
+		block->offset = offset;
+		block->buffer.reset(new char[count]);
+		block->count = read(block->buffer.get(), offset, count);
+		if (block->count <= 0)
+		{
+			result = WFC_Error;
+			break;
+		}
+
+		SharedBlockPtr shared(block.release());
+		for (auto& consumer : consumers_)
+			dispatch(*consumer, shared);
+	}
+
+	// end of pass, queued behind everything the consumer still holds
+	for (auto& consumer : consumers_)
+		consumer->queue.push(nullptr);
+	for (auto& consumer : consumers_)
+	{
+		if (consumer->worker.joinable())
+			consumer->worker.join();
+		delegate_->Logger("[%s] %s delivered %lld blocks, lagged %d times, replayed %lld bytes, missed %lld bytes", __FUNCTION__,
+			consumer->name.c_str(), consumer->delivered, consumer->lagged, consumer->replayed, consumer->missed);
+	}
+	advancing_ = false;
+	return result;
+}
+
+void ScannerHost::stop()
+{
+	stop_ = true;
+	for (auto& consumer : consumers_)
+		consumer->scanner->stop();
+}
+
+std::vector<ConsumerStatistic> ScannerHost::statistics()
+{
+	std::vector<ConsumerStatistic> result;
+	for (auto& consumer : consumers_)
+	{
+		std::lock_guard<std::mutex> lock(consumer->mutex);
+		result.push_back({ consumer->name, consumer->delivered, consumer->replayed, consumer->lagged, consumer->missed });
+	}
+	return result;
+}
+
+void ScannerHost::dispatch(Consumer& consumer, const SharedBlockPtr& block)
+{
+	std::lock_guard<std::mutex> lock(consumer.mutex);
+	int64_t end = block->offset + block->count;
+	if (consumer.lagging)
+	{
+		consumer.missed_end = end;
+		return;
+	}
+	if (consumer.queue.size() >= consumer.queue_limit)
+	{
+		// the consumer is full, it catches up from the device instead of holding the pass
+		consumer.lagging = true;
+		consumer.missed_start = block->offset;
+		consumer.missed_end = end;
+		++consumer.lagged;
+		return;
+	}
+	consumer.queue.push(block);
+}
+
+void ScannerHost::consume(Consumer& consumer)
+{
+	while (true)
+	{
+		SharedBlockPtr block;
+		if (!consumer.queue.pop(block) || !block)
+		{
+			// blocks skipped before the end of pass
+			replay(consumer);
+			break;
+		}
+		if (!stop_)
+			consumer.scanner->write_buffer(block->buffer.get(), block->offset, block->count);
+		{
+			std::lock_guard<std::mutex> lock(consumer.mutex);
+			++consumer.delivered;
+		}
+		// lagging is only set with a full queue, so an empty queue means the skipped range is next
+		if (consumer.queue.empty())
+			replay(consumer);
+	}
+}
+
+void ScannerHost::replay(Consumer& consumer)
+{
+	std::unique_ptr<char[]> buffer;
+	// the consumer never sees what the device did not return, adjacent misses are logged once
+	int64_t gap_start = 0, gap_end = 0;
+	const char* function = __FUNCTION__;
+	auto report = [&] {
+		if (gap_end > gap_start)
+			delegate_->Logger("[%s] %s missed %lld bytes at %lld", function, consumer.name.c_str(), gap_end - gap_start, gap_start);
+		gap_start = gap_end = 0;
+	};
+	while (!stop_)
+	{
+		int64_t start = 0, end = 0;
+		{
+			std::lock_guard<std::mutex> lock(consumer.mutex);
+			if (!consumer.lagging)
+				break;
+			if (consumer.missed_start >= consumer.missed_end)
+			{
+				// caught up, the next shared block follows the replayed range
+				consumer.lagging = false;
+				break;
+			}
+			start = consumer.missed_start;
+			end = std::min<int64_t>(consumer.missed_end, start + block_size_);
+			consumer.missed_start = end;
+		}
+		if (!buffer)
+			buffer.reset(new char[block_size_]);
+		int32_t count = std::max(read(buffer.get(), start, (int32_t)(end - start)), 0);
+		if (count > 0)
+			consumer.scanner->write_buffer(buffer.get(), start, count);
+		if (start + count < end)
+		{
+			if (gap_end != start + count)
+				report();
+			if (gap_end == gap_start)
+				gap_start = start + count;
+			gap_end = end;
+		}
+		std::lock_guard<std::mutex> lock(consumer.mutex);
+		consumer.replayed += count;
+		consumer.missed += end - start - count;
+	}
+	report();
+}
+
+int32_t ScannerHost::read(void* buffer, int64_t offset, int32_t count)
+{
+	std::lock_guard<std::mutex> lock(read_mutex_);
+	return delegate_->Read(buffer, offset, count);
+}
@@ -0,0 +1,107 @@
+/**********************************************************************
+*
+* Copyright (C)2015-2022 Maxwell Analytica. All rights reserved.
+*
+* @file scannerhost.h
+* @brief Multiplexing host running several scanners over one device pass
+* @details Every block is read once into a shared buffer and handed to each
+*          attached scanner through its own bounded queue. A scanner that falls
+*          behind stops receiving shared blocks and replays the missed range by
+*          itself, so it never stalls the device pass of the others
+* @author Maxwell
+* @version 1.0.0
+* @date 2026-10-19 16:05:12.380
+*
+**********************************************************************/
+#ifndef SCANNER_HOST_H
+#define SCANNER_HOST_H
+
+#include <mutex>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../../include/datatype.h"
+#include "../../include/iscanner.h"
+#include "../carverscanner/workqueue.h"
+
+typedef struct _SharedBlock
+{
+	int64_t					offset;
+	int32_t					count;
+	std::unique_ptr<char[]>	buffer;
+}SharedBlock, *PSharedBlock;
+
+// read-only block shared by all consumers, released with the last reference
+using SharedBlockPtr = std::shared_ptr<const SharedBlock>;
+
+typedef struct _ConsumerStatistic
+{
+	std::string				name;
+	int64_t					delivered;		/* blocks delivered from the shared pass */
+	int64_t					replayed;		/* bytes read again by the consumer */
+	int32_t					lagged;			/* times the consumer fell behind */
+	int64_t					missed;			/* bytes of skipped ranges the device did not return */
+}ConsumerStatistic, *PConsumerStatistic;
+
+class ScannerHost
+{
+public:
+	ScannerHost();
+	~ScannerHost();
+
+	// attach before advance, `queue_limit` is the number of shared blocks a consumer may hold
+	int32_t attach(IScanner* scanner, const std::string& name, int32_t queue_limit = DefaultQueueLimit);
+
+	// one pass over the device, returns when every block is written to every scanner,
+	// scanners keep carving what they hold until stop
+	int32_t advance(ITransferDelegate* delegate, int32_t block_size = DefaultBlockSize);
+
+	// abort the pass and stop the attached scanners
+	void stop();
+
+	std::vector<ConsumerStatistic> statistics();
+
+public:
+	static const int32_t DefaultQueueLimit = 64;
+	static const int32_t DefaultBlockSize = 0x100000;
+
+private:
+	struct Consumer
+	{
+		IScanner* scanner;
+		std::string name;
+		size_t queue_limit;
+		WorkQueue<SharedBlockPtr> queue;
+		std::thread worker;
+		// range skipped while lagging, guarded by `mutex`
+		std::mutex mutex;
+		bool lagging;
+		int64_t missed_start;
+		int64_t missed_end;
+		int64_t delivered;
+		int64_t replayed;
+		int32_t lagged;
+		int64_t missed;
+	};
+
+	void dispatch(Consumer& consumer, const SharedBlockPtr& block);
+
+	void consume(Consumer& consumer);
+
+	void replay(Consumer& consumer);
+
+	int32_t read(void* buffer, int64_t offset, int32_t count);
+
+private:
+	std::atomic<bool> stop_;
+	std::atomic<bool> advancing_;
+	int32_t block_size_;
+	ITransferDelegate* delegate_;
+	std::mutex read_mutex_;
+	std::vector<std::unique_ptr<Consumer>> consumers_;
+};
+
+#endif // SCANNER_HOST_H
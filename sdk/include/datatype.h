@@ -78,6 +78,7 @@ enum
 *
 * @brief:	Inject control
 * @details: direction: Out: core -> UI；In: core <- UI
+*           Process: applies to every scanner of the process, not only the one injected
 */
 typedef enum _InjectControlOption
 {
@@ -93,10 +94,30 @@ typedef enum _InjectControlOption
 	IC_DiscardCertificate	= 0x000D,
 	IC_ProtectionStatus		= 0x000E,
 	IC_CreateCertificate	= 0x000F,
+	IC_TriageOut			= 0x0010,
+	IC_RateLimitOut			= 0x0011,
+	IC_RateLimitIn			= 0x0012,
+	IC_TraceOut				= 0x0013,
+	IC_ProcessTraceIn		= 0x0014,
+	IC_BadRegionOut			= 0x0015,
+	IC_DispatchOut			= 0x0016,
+	IC_ProcessDispatchIn	= 0x0017,
+	IC_RangeIn				= 0x0018,
+	IC_InputEndIn			= 0x0019,
 	IC_EncryptedFlag		= 0x4000,
 }InjectControlOption;
 /*
 *
+* @brief:	save_file options
+* @details: batch mode passes the address of `count` int64_t ids in `id`, `filePath` is the target directory
+*/
+typedef enum _SaveFileOption
+{
+	SFO_Single		= 0x0000,	/* `filePath` is the target file of `id` */
+	SFO_Batch		= 0x0001,	/* ids are extracted in device order */
+}SaveFileOption;
+/*
+*
 * @brief:	Notice or Message types
 * @details 
 */
@@ -244,6 +265,23 @@ struct ApfsFileInfo : BaseInfo {
 	uint32_t	SectorOfCluster;
 	uint32_t	SectorSize;
 };
+/*
+*
+* @brief: raw carved file information, inherit `BaseInfo`
+* @details: digest of file content computed while carving
+*/
+struct RawFileInfo : BaseInfo {
+	uint32_t	DigestFlag;			/* valid digests, 1 for CRC32C, 2 for SHA-256 */
+	uint32_t	Crc32;				/* CRC32C of file content */
+	uint8_t		Sha256[32];			/* SHA-256 of file content */
+	uint32_t	Confidence;			/* structural validation score 1-100, 0 for not validated */
+	RawFileInfo() {
+		Confidence = 0;
+		DigestFlag = 0;
+		Crc32 = 0;
+		memset(Sha256, 0x00, 32);
+	}
+};
 
 #pragma pack()
 
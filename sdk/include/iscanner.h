@@ -143,7 +143,7 @@ public:
 	/*
 	*
 	* @brief [optional] Save file according to info offered by engine library in some special case that only scanner can do it
-	* @details 
+	* @details `option` is one of `SaveFileOption`, with SFO_Batch `id` is the address of `count` ids and `filePath` a directory
 	*/
 	virtual int32_t save_file(char* filePath, int32_t index, int64_t id, int64_t count, int32_t option = 0) = 0;
 	/*